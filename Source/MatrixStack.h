@@ -24,8 +24,200 @@
 #pragma once
 
 #include <stdio.h>
+#include <math.h>
+
+#ifdef _WIN32
 #include <windows.h>
 #include <DirectXMath.h>
+#else
+//Subset of DirectXMath used by MatrixStack. row vector, row major as XMMATRIX.
+namespace DirectX
+{
+struct XMVECTOR {
+	float x, y, z;
+	float w = 0.0f; //left out by the { x, y, z } of 3d vectors.
+};
+
+struct XMMATRIX {
+	XMVECTOR r[4];
+
+	XMMATRIX & operator*=(const XMMATRIX & b)
+	{
+		XMMATRIX a = *this;
+		for (int i = 0; i < 4; i++) {
+			const float *ar = &a.r[i].x;
+			float *dr = &r[i].x;
+			for (int j = 0; j < 4; j++) {
+				dr[j] = 0.0f;
+				for (int k = 0; k < 4; k++)
+					dr[j] += ar[k] * (&b.r[k].x)[j];
+			}
+		}
+		return *this;
+	}
+};
+
+struct XMFLOAT4X4 {
+	float m[4][4];
+};
+
+inline XMMATRIX
+XMMatrixSet(
+	float m00, float m01, float m02, float m03,
+	float m10, float m11, float m12, float m13,
+	float m20, float m21, float m22, float m23,
+	float m30, float m31, float m32, float m33)
+{
+	return {{
+			{m00, m01, m02, m03},
+			{m10, m11, m12, m13},
+			{m20, m21, m22, m23},
+			{m30, m31, m32, m33},
+		}
+	};
+}
+
+inline XMMATRIX
+XMMatrixIdentity()
+{
+	return XMMatrixSet(
+			1, 0, 0, 0,
+			0, 1, 0, 0,
+			0, 0, 1, 0,
+			0, 0, 0, 1);
+}
+
+inline XMMATRIX
+XMMatrixTranspose(XMMATRIX m)
+{
+	XMMATRIX ret;
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			(&ret.r[i].x)[j] = (&m.r[j].x)[i];
+	return ret;
+}
+
+inline XMMATRIX
+XMMatrixScaling(float x, float y, float z)
+{
+	return XMMatrixSet(
+			x, 0, 0, 0,
+			0, y, 0, 0,
+			0, 0, z, 0,
+			0, 0, 0, 1);
+}
+
+inline XMMATRIX
+XMMatrixTranslation(float x, float y, float z)
+{
+	return XMMatrixSet(
+			1, 0, 0, 0,
+			0, 1, 0, 0,
+			0, 0, 1, 0,
+			x, y, z, 1);
+}
+
+inline XMMATRIX
+XMMatrixRotationX(float angle)
+{
+	float s = sinf(angle), c = cosf(angle);
+	return XMMatrixSet(
+			1, 0, 0, 0,
+			0, c, s, 0,
+			0, -s, c, 0,
+			0, 0, 0, 1);
+}
+
+inline XMMATRIX
+XMMatrixRotationY(float angle)
+{
+	float s = sinf(angle), c = cosf(angle);
+	return XMMatrixSet(
+			c, 0, -s, 0,
+			0, 1, 0, 0,
+			s, 0, c, 0,
+			0, 0, 0, 1);
+}
+
+inline XMMATRIX
+XMMatrixRotationZ(float angle)
+{
+	float s = sinf(angle), c = cosf(angle);
+	return XMMatrixSet(
+			c, s, 0, 0,
+			-s, c, 0, 0,
+			0, 0, 1, 0,
+			0, 0, 0, 1);
+}
+
+inline XMVECTOR
+XMVector3Normalize(XMVECTOR v)
+{
+	float len = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+	if (len > 0.0f)
+		len = 1.0f / len;
+	return {v.x * len, v.y * len, v.z * len, 0.0f};
+}
+
+inline XMVECTOR
+XMVector3Cross(XMVECTOR a, XMVECTOR b)
+{
+	return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x, 0.0f};
+}
+
+inline float
+XMVector3Dot(XMVECTOR a, XMVECTOR b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline XMMATRIX
+XMMatrixRotationAxis(XMVECTOR axis, float angle)
+{
+	auto n = XMVector3Normalize(axis);
+	float s = sinf(angle), c = cosf(angle), t = 1.0f - c;
+	return XMMatrixSet(
+			c + n.x * n.x * t, n.x * n.y * t + n.z * s, n.x * n.z * t - n.y * s, 0,
+			n.y * n.x * t - n.z * s, c + n.y * n.y * t, n.y * n.z * t + n.x * s, 0,
+			n.z * n.x * t + n.y * s, n.z * n.y * t - n.x * s, c + n.z * n.z * t, 0,
+			0, 0, 0, 1);
+}
+
+inline XMMATRIX
+XMMatrixLookAtLH(XMVECTOR eye, XMVECTOR focus, XMVECTOR up)
+{
+	auto zaxis = XMVector3Normalize({focus.x - eye.x, focus.y - eye.y, focus.z - eye.z, 0.0f});
+	auto xaxis = XMVector3Normalize(XMVector3Cross(up, zaxis));
+	auto yaxis = XMVector3Cross(zaxis, xaxis);
+	return XMMatrixSet(
+			xaxis.x, yaxis.x, zaxis.x, 0,
+			xaxis.y, yaxis.y, zaxis.y, 0,
+			xaxis.z, yaxis.z, zaxis.z, 0,
+			-XMVector3Dot(xaxis, eye), -XMVector3Dot(yaxis, eye), -XMVector3Dot(zaxis, eye), 1);
+}
+
+inline XMMATRIX
+XMMatrixPerspectiveFovLH(float fov, float aspect, float fnear, float ffar)
+{
+	float h = 1.0f / tanf(fov * 0.5f);
+	float w = h / aspect;
+	float r = ffar / (ffar - fnear);
+	return XMMatrixSet(
+			w, 0, 0, 0,
+			0, h, 0, 0,
+			0, 0, r, 1,
+			0, 0, -r * fnear, 0);
+}
+
+inline void
+XMStoreFloat4x4(XMFLOAT4X4 *dst, XMMATRIX m)
+{
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			dst->m[i][j] = (&m.r[i].x)[j];
+}
+} //DirectX
+#endif //_WIN32
 
 //Simple Matrix struct for windows.
 struct MatrixStack {
@@ -159,9 +351,11 @@ struct MatrixStack {
 
 	void Print(DirectX::XMMATRIX m)
 	{
+		DirectX::XMFLOAT4X4 f;
+		XMStoreFloat4x4(&f, m);
 		int i = 0;
-		for (auto & v : m.r) {
-			for (auto & e : v.m128_f32) {
+		for (auto & v : f.m) {
+			for (auto & e : v) {
 				if ((i % 4) == 0) printf("\n");
 				printf("[%02d]%.4f, ", i++, e);
 			}
@@ -31,6 +31,12 @@
 #include <vector>
 #include <algorithm>
 
+#ifdef _WIN32
+#define ODEN_API __declspec(dllexport)
+#else
+#define ODEN_API __attribute__((visibility("default")))
+#endif //_WIN32
+
 namespace oden
 {
 
@@ -49,90 +55,334 @@ enum {
 	CMD_DRAW_INDEX,
 	CMD_DRAW,
 	CMD_DISPATCH,
+	CMD_GENERATE_MIPS,
+	CMD_RELEASE, //destroy a texture of CMD_SET_TEXTURE by name after the frames in flight. The name can be set again.
+	CMD_UPDATE_TEXTURE, //write set_texture.rect of level miplevel of a texture of CMD_SET_TEXTURE, see oden_is_texture_rect_valid.
+	CMD_SET_BUFFER, //bind a storage buffer to read in shaders, see set_buffer.
+	CMD_SET_BUFFER_UAV, //bind a storage buffer to read and write in compute shaders.
+	CMD_UPDATE_BUFFER, //write buf at set_buffer.offset of a buffer of CMD_SET_BUFFER / SET_BUFFER_UAV.
+	CMD_DRAW_INDEX_INDIRECT, //DrawIndex with the arguments in the buffer name, see draw_index_indirect.
+	CMD_DRAW_INDEX_INSTANCED, //DrawIndex of draw_instanced.instance_count instances.
+	CMD_DRAW_INSTANCED, //Draw of draw_instanced.instance_count instances.
 	CMD_MAX,
 };
 
+//set_texture.fmt / set_render_target.fmt. FMT_DEFAULT : R8G8B8A8 textures, R16G16B16A16 render targets.
+//BC formats are for textures only. Their data is 4x4 block rows and stride_size is the bytes of a block row.
+enum {
+	FMT_DEFAULT,
+	FMT_R8G8B8A8_UNORM,
+	FMT_R16G16B16A16_FLOAT,
+	FMT_R11G11B10_FLOAT,
+	FMT_R16G16_FLOAT,
+	FMT_R8_UNORM,
+	FMT_BC1_UNORM,
+	FMT_BC4_UNORM,
+	FMT_BC5_UNORM,
+	FMT_BC7_UNORM,
+	FMT_R32_FLOAT,
+	FMT_MAX,
+};
+
+//Color targets bound by one CMD_SET_RENDER_TARGET.
+enum {
+	RENDER_TARGET_MAX = 8,
+};
+
+//set_shader.depth_func
+enum {
+	DEPTH_FUNC_DEFAULT, //less (less or equal on DX11 / Vulkan), writes depth.
+	DEPTH_FUNC_EQUAL,   //equal to a depth prepass, no depth write.
+};
+
+//Storage buffers are raw 32bit words. hlsl : ByteAddressBuffer t<slot> / RWByteAddressBuffer u<slot>,
+//they share the registers with the textures. glsl : buffer blocks at oden_get_buffer_binding.
+enum {
+	BUFFER_BINDING_BASE = 64,
+};
+
+//Arguments of CMD_DRAW_INDEX_INDIRECT, 5 uint32.
+struct draw_index_indirect_args {
+	uint32_t index_count;
+	uint32_t instance_count;
+	uint32_t start_index;
+	int32_t base_vertex;
+	uint32_t start_instance;
+};
+
 struct cmd {
 	int type;
 	std::string name;
 	std::vector<uint8_t> buf;
+	//CMD_SET_TEXTURE / UPDATE_TEXTURE / VERTEX / INDEX read ext_size bytes at ext_data instead of buf when it is set (an AssetPack mapping).
+	//It is not copied to the command, keep it valid until oden_present_graphics returns (oden_flush_graphics when async).
+	const uint8_t *ext_data = nullptr;
+	size_t ext_size = 0;
 	struct rect_t {
 		int x, y, w, h;
 	};
+
+	//Members of the union. Defined out of it, an anonymous union can not declare types on gcc / clang.
+	struct set_barrier_t {
+		bool to_present;
+		bool to_rendertarget;
+		bool to_depthrendertarget;
+		bool to_texture;
+	};
+
+	struct set_render_target_t {
+		int fmt;
+		rect_t rect; //viewport and scissor in the targets.
+		bool is_backbuffer;
+		//Color targets, 0 : 1. Target i > 0 is oden_get_color_render_target_name(name, i) of format fmts[i].
+		//They share the size and the depth of name.
+		int count;
+		int fmts[RENDER_TARGET_MAX];
+		//Bind only the depth of name, no color target (a depth prepass). Shaders drawn to it run the vertex shader only,
+		//or PSDepth (hlsl) / _PS_DEPTH_ (glsl) for alpha test. Setting name again keeps the depth.
+		bool is_depth_only;
+		//Size the targets are created with, 0 : rect.x + rect.w / rect.y + rect.h. A smaller rect draws
+		//into a part of them (dynamic resolution), they are not made again.
+		int w, h;
+	};
+
+	struct set_depth_render_target_t {
+		int fmt;
+		rect_t rect;
+	};
+
+	struct set_texture_t {
+		int fmt;
+		int slot; //CMD_SET_TEXTURE : -1 creates the texture without binding it.
+		size_t stride_size;
+		rect_t rect; //CMD_UPDATE_TEXTURE : texels of the level, the data is rows stride_size apart (0 : packed).
+		int miplevel; //CMD_SET_TEXTURE : finest level the shaders read, the finer ones are skipped. UAV / UPDATE : the level.
+		int mips; //levels in buf when created. 0 : 1. see oden_get_texture_level_offset.
+	};
+
+	struct set_vertex_t {
+		size_t stride_size;
+	};
+
+	struct set_index_t {
+	};
+
+	struct set_constant_t {
+		int slot;
+	};
+
+	struct set_shader_t {
+		bool is_update;
+		bool is_cull;
+		bool is_enable_depth;
+		int depth_func; //DEPTH_FUNC_*
+	};
+
+
+	struct clear_t {
+		float color[4];
+	};
+
+	struct clear_depth_t {
+		float value;
+	};
+
+	struct draw_index_t {
+		int start;
+		int count;
+	};
+
+	struct draw_t {
+		int vertex_count;
+	};
+
+	struct dispatch_t {
+		int x, y, z;
+	};
+
+	//Box filter levels 1 to miplevel - 1 of a render target from level 0 in one pass. 0 : all levels.
+	//The compute shader and its bindings are not kept, SetShader again before a dispatch.
+	struct generate_mips_t {
+		int miplevel;
+	};
+
+	struct set_buffer_t {
+		int slot;      //CMD_SET_BUFFER : -1 creates the buffer without binding it.
+		size_t size;   //bytes of the buffer when it is created (a multiple of 4). buf is the first size bytes, zero when empty.
+		size_t offset; //CMD_UPDATE_BUFFER : bytes to buf, a multiple of 4.
+	};
+
+	//name is the buffer of the arguments. They are read when the gpu draws, after the dispatches before it.
+	//Each instance draws the indices again, shaders tell them apart by SV_InstanceID / gl_InstanceIndex.
+	struct draw_index_indirect_t {
+		size_t offset; //bytes to draw_index_indirect_args, a multiple of 4.
+	};
+
+	//Instances draw the same indices / vertices. The per instance data is a buffer of CMD_SET_BUFFER
+	//read at SV_InstanceID / gl_InstanceIndex, which count from 0 on every backend.
+	struct draw_instanced_t {
+		int start;          //first index of CMD_DRAW_INDEX_INSTANCED.
+		int count;          //indices / vertices of an instance.
+		int instance_count;
+	};
+
+	//cmd c = {} zeroes only the first member (set_barrier), builders clear the one they fill.
 	union {
-		struct set_barrier_t {
-			bool to_present;
-			bool to_rendertarget;
-			bool to_depthrendertarget;
-			bool to_texture;
-		} set_barrier;
-
-		struct set_render_target_t {
-			int fmt;
-			rect_t rect;
-			bool is_backbuffer;
-		} set_render_target;
-
-		struct set_depth_render_target_t {
-			int fmt;
-			rect_t rect;
-		} set_depth_render_target;
-
-		struct set_texture_t {
-			int fmt;
-			int slot;
-			size_t stride_size;
-			rect_t rect;
-			int miplevel;
-		} set_texture;
-
-		struct set_vertex_t {
-			size_t stride_size;
-		} set_vertex;
-
-		struct set_index_t {
-		} set_index;
-
-		struct set_constant_t {
-			int slot;
-		} set_constant;
-
-		struct set_shader_t {
-			bool is_update;
-			bool is_cull;
-			bool is_enable_depth;
-		} set_shader;
-
-
-		struct clear_t {
-			float color[4];
-		} clear;
-
-		struct clear_depth_t {
-			float value;
-		} clear_depth;
-
-		struct draw_index_t {
-			int start;
-			int count;
-		} draw_index;
-
-		struct draw_t {
-			int vertex_count;
-		} draw;
-
-		struct dispatch_t {
-			int x, y, z;
-		} dispatch;
+		set_barrier_t set_barrier;
+		set_render_target_t set_render_target;
+		set_depth_render_target_t set_depth_render_target;
+		set_texture_t set_texture;
+		set_vertex_t set_vertex;
+		set_index_t set_index;
+		set_constant_t set_constant;
+		set_shader_t set_shader;
+		clear_t clear;
+		clear_depth_t clear_depth;
+		draw_index_t draw_index;
+		draw_t draw;
+		dispatch_t dispatch;
+		generate_mips_t generate_mips;
+		set_buffer_t set_buffer;
+		draw_index_indirect_t draw_index_indirect;
+		draw_instanced_t draw_instanced;
 	};
 };
 
-__declspec(dllexport)
+struct frame_stats {
+	uint64_t frame;
+	uint32_t frames_in_flight;
+	double cpu_wait_ms;  //render thread blocked on a free frame slot.
+	double latency_ms;   //cpu submit to the end of frame gpu timestamp, calibrated to the cpu clock. Without one, to the completion seen.
+};
+
+ODEN_API
 void
 oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 	void *handle, uint32_t w, uint32_t h,
 	uint32_t buffernum, uint32_t heapcount, uint32_t slotmax);
 
+//Same as oden_present_graphics, but a render thread runs it and this returns at once.
+//vcmd is swapped with the emptied buffer of an earlier frame, so its capacity is kept.
+//Blocks while the queue depth of frames are waiting or being presented.
+//handle == nullptr terminates on the render thread and waits for it.
+//Call oden_flush_graphics before calling oden_present_graphics directly.
+ODEN_API
+void
+oden_present_graphics_async(const char * appname, std::vector<cmd> & vcmd,
+	void *handle, uint32_t w, uint32_t h,
+	uint32_t buffernum, uint32_t heapcount, uint32_t slotmax);
+
+//1 (default) : the app records a frame while the render thread presents the previous one. max 8.
+ODEN_API
+void
+oden_set_present_queue_depth(uint32_t depth);
+
+//Wait until the render thread has presented every queued frame.
+ODEN_API
+void
+oden_flush_graphics(void);
+
+struct cmd_stats {
+	uint64_t count;
+	double cpu_ms;
+};
+
+//0 : follow buffernum of oden_present_graphics.
+//1 : lowest latency. larger value trades latency for throughput.
+ODEN_API
+void
+oden_set_frames_in_flight(uint32_t num);
+
+//Move stats of the frames completed on gpu since last call.
+ODEN_API
+void
+oden_get_frame_stats(std::vector<frame_stats> & vstats);
+
+//Per command type (indexed by CMD_*) count and cpu time since last call.
+ODEN_API
+void
+oden_get_cmd_stats(std::vector<cmd_stats> & vstats);
+
+struct pass_stats {
+	uint64_t frame;
+	uint32_t count;  //draw / dispatch commands with the name.
+	double cpu_ms;   //translation of them and of the commands since the previous draw / dispatch.
+	double gpu_ms;   //gpu time of the same span. negative when the backend has no timestamps.
+};
+
+//Last frame completed on gpu, keyed by draw / dispatch name ("bloomX", "present_draw"...).
+//Commands after the last draw / dispatch go to the name of the last command.
+//Returns false until another frame completes.
+ODEN_API
+bool
+oden_get_pass_stats(std::map<std::string, pass_stats> & mstats);
+
+enum {
+	MEMORY_RT_COLOR,
+	MEMORY_RT_DEPTH,
+	MEMORY_TEXTURE,
+	MEMORY_CONSTANT,
+	MEMORY_VERTEX,
+	MEMORY_INDEX,
+	MEMORY_STAGING,
+	MEMORY_BUFFER,
+	MEMORY_MAX,
+};
+
+struct memory_stats {
+	int category;     //MEMORY_*
+	std::string heap; //memory type / heap the backend allocated from.
+	uint64_t bytes;
+};
+
+//Live resources keyed by name, and the peak of their total since the device was created.
+ODEN_API
+void
+oden_get_memory_stats(std::map<std::string, memory_stats> & mstats, uint64_t & high_water);
+
+//Copy of the last presented backbuffer (BGRA8) of a headless device.
+//The first call enables readback, so the pixels arrive a few frames later.
+ODEN_API
+bool
+oden_get_backbuffer_readback(std::vector<uint32_t> & vdata, uint32_t & w, uint32_t & h);
+
+//Record a Chrome trace event JSON (Perfetto / chrome://tracing) until oden_trace_stop.
+//Frames, translation, shader compiles, resources, uploads, fence waits and gpu passes.
+ODEN_API
+bool
+oden_trace_start(const char *filename);
+
+ODEN_API
+void
+oden_trace_stop(void);
+
+//Application span on the calling thread. Times are of oden_trace_get_time_ms.
+ODEN_API
+void
+oden_trace_event(const char *category, const char *name, double start_ms, double end_ms);
+
+ODEN_API
+double
+oden_trace_get_time_ms(void);
+
+//Backend logs below the level are not recorded. 0 : verbose, 1 : info (default), 2 : errors, 3 : none.
+//Levels below ODEN_LOG_LEVEL of the backend build are compiled out, verbose is by default.
+ODEN_API
+void
+oden_log_set_level(int level);
+
+//Logs are written by a background thread. Write the pending ones now.
+ODEN_API
+void
+oden_log_flush(void);
+
+//Pass as handle of oden_present_graphics to run without window and swapchain.
+inline void *
+oden_get_headless_handle(void)
+{
+	return (void *)(intptr_t)-1;
+}
+
 inline std::string
 oden_get_backbuffer_basename(void)
 {
@@ -169,6 +419,165 @@ oden_get_depth_render_target_name(std::string name)
 	return name + "_depth";
 }
 
+//Color target index of a CMD_SET_RENDER_TARGET. index 0 is name itself.
+inline std::string
+oden_get_color_render_target_name(std::string name, int index)
+{
+	return index == 0 ? name : name + "_color" + std::to_string(index);
+}
+
+//glsl binding of a CMD_SET_BUFFER / SET_BUFFER_UAV slot. The textures of the slot are slot * 3 + 0 / 1 / 2.
+inline int
+oden_get_buffer_binding(int slot, bool is_uav)
+{
+	return BUFFER_BINDING_BASE + slot * 2 + (is_uav ? 1 : 0);
+}
+
+inline int
+oden_get_texture_format(int fmt)
+{
+	return fmt == FMT_DEFAULT ? FMT_R8G8B8A8_UNORM : fmt;
+}
+
+inline int
+oden_get_render_target_format(int fmt)
+{
+	return fmt == FMT_DEFAULT ? FMT_R16G16B16A16_FLOAT : fmt;
+}
+
+//Color targets of a CMD_SET_RENDER_TARGET, clamped to 1 - RENDER_TARGET_MAX.
+inline int
+oden_get_render_target_count(const cmd & c)
+{
+	return (std::min)((std::max)(c.set_render_target.count, 1), (int)RENDER_TARGET_MAX);
+}
+
+//Size the targets of a CMD_SET_RENDER_TARGET are created with.
+inline void
+oden_get_render_target_size(const cmd & c, int & w, int & h)
+{
+	auto & rect = c.set_render_target.rect;
+	w = c.set_render_target.w ? c.set_render_target.w : rect.x + rect.w;
+	h = c.set_render_target.h ? c.set_render_target.h : rect.y + rect.h;
+}
+
+//Format of the color target index of a CMD_SET_RENDER_TARGET, FMT_DEFAULT resolved.
+inline int
+oden_get_render_target_format(const cmd & c, int index)
+{
+	return oden_get_render_target_format(index == 0 ? c.set_render_target.fmt : c.set_render_target.fmts[index]);
+}
+
+inline bool
+oden_is_block_format(int fmt)
+{
+	return fmt >= FMT_BC1_UNORM && fmt <= FMT_BC7_UNORM;
+}
+
+//Bytes of a pixel, or of a 4x4 block for BC formats. 0 : FMT_DEFAULT or invalid.
+inline int
+oden_get_format_bytes(int fmt)
+{
+	static const int tbl[FMT_MAX] = {0, 4, 8, 4, 4, 1, 8, 8, 16, 16, 4};
+	return (fmt >= 0 && fmt < FMT_MAX) ? tbl[fmt] : 0;
+}
+
+inline uint64_t
+oden_get_format_size(int fmt, int w, int h)
+{
+	if (oden_is_block_format(fmt))
+		return uint64_t((w + 3) / 4) * uint64_t((h + 3) / 4) * oden_get_format_bytes(fmt);
+	return uint64_t(w) * uint64_t(h) * oden_get_format_bytes(fmt);
+}
+
+//Offset of a level in CMD_SET_TEXTURE data. Level 0 rows are stride_size apart (0 : packed),
+//the smaller levels follow it packed. level == mips returns the size of all of them.
+inline uint64_t
+oden_get_texture_level_offset(int fmt, int w, int h, int level, size_t stride_size)
+{
+	uint64_t offset = 0;
+	for (int i = 0; i < level; i++) {
+		int lw = (std::max)(w >> i, 1);
+		int lh = (std::max)(h >> i, 1);
+		int rows = oden_is_block_format(fmt) ? (lh + 3) / 4 : lh;
+		if (i == 0 && stride_size)
+			offset += uint64_t(stride_size) * rows;
+		else
+			offset += oden_get_format_size(fmt, lw, lh);
+	}
+	return offset;
+}
+
+//Rows (block rows) of h texels and the bytes of a w texel row.
+inline int
+oden_get_texture_rows(int fmt, int h)
+{
+	return oden_is_block_format(fmt) ? (h + 3) / 4 : h;
+}
+
+inline uint64_t
+oden_get_texture_row_bytes(int fmt, int w)
+{
+	return oden_get_format_size(fmt, w, 1);
+}
+
+//Rect of CMD_UPDATE_TEXTURE in level of a w x h texture. BC rects start on a block and
+//cover whole blocks, but at the right / bottom edge of the level.
+inline bool
+oden_is_texture_rect_valid(int fmt, int w, int h, int level, int x, int y, int rw, int rh)
+{
+	int lw = (std::max)(w >> level, 1);
+	int lh = (std::max)(h >> level, 1);
+	if (x < 0 || y < 0 || rw <= 0 || rh <= 0 || x + rw > lw || y + rh > lh)
+		return false;
+	if (oden_is_block_format(fmt))
+		return (x % 4) == 0 && (y % 4) == 0 && ((rw % 4) == 0 || x + rw == lw) && ((rh % 4) == 0 || y + rh == lh);
+	return true;
+}
+
+//Bytes of a rect with rows stride_size apart (0 : packed).
+inline uint64_t
+oden_get_texture_rect_size(int fmt, int w, int h, size_t stride_size)
+{
+	auto row_bytes = oden_get_texture_row_bytes(fmt, w);
+	auto rows = oden_get_texture_rows(fmt, h);
+	if (stride_size == 0)
+		return row_bytes * rows;
+	return uint64_t(stride_size) * (rows - 1) + row_bytes;
+}
+
+//Data of CMD_SET_TEXTURE / UPDATE_TEXTURE / VERTEX / INDEX, ext_data or buf.
+inline const uint8_t *
+oden_get_cmd_data(const cmd & c)
+{
+	return c.ext_data ? c.ext_data : c.buf.data();
+}
+
+inline size_t
+oden_get_cmd_size(const cmd & c)
+{
+	return c.ext_data ? c.ext_size : c.buf.size();
+}
+
+inline const char *
+oden_get_format_name(int fmt)
+{
+	static const char *tbl[FMT_MAX] = {
+		"FMT_DEFAULT",
+		"FMT_R8G8B8A8_UNORM",
+		"FMT_R16G16B16A16_FLOAT",
+		"FMT_R11G11B10_FLOAT",
+		"FMT_R16G16_FLOAT",
+		"FMT_R8_UNORM",
+		"FMT_BC1_UNORM",
+		"FMT_BC4_UNORM",
+		"FMT_BC5_UNORM",
+		"FMT_BC7_UNORM",
+		"FMT_R32_FLOAT",
+	};
+	return (fmt >= 0 && fmt < FMT_MAX) ? tbl[fmt] : "__FMT_UNKNOWN__";
+}
+
 inline const char *
 oden_get_cmd_name(int c)
 {
@@ -200,7 +609,81 @@ oden_get_cmd_name(int c)
 		return "CMD_DRAW";
 	if (c == CMD_DISPATCH)
 		return "CMD_DISPATCH";
+	if (c == CMD_GENERATE_MIPS)
+		return "CMD_GENERATE_MIPS";
+	if (c == CMD_RELEASE)
+		return "CMD_RELEASE";
+	if (c == CMD_UPDATE_TEXTURE)
+		return "CMD_UPDATE_TEXTURE";
+	if (c == CMD_SET_BUFFER)
+		return "CMD_SET_BUFFER";
+	if (c == CMD_SET_BUFFER_UAV)
+		return "CMD_SET_BUFFER_UAV";
+	if (c == CMD_UPDATE_BUFFER)
+		return "CMD_UPDATE_BUFFER";
+	if (c == CMD_DRAW_INDEX_INDIRECT)
+		return "CMD_DRAW_INDEX_INDIRECT";
+	if (c == CMD_DRAW_INDEX_INSTANCED)
+		return "CMD_DRAW_INDEX_INSTANCED";
+	if (c == CMD_DRAW_INSTANCED)
+		return "CMD_DRAW_INSTANCED";
 	return "__CMD_UNKNOWN__";
 }
 
+inline const char *
+oden_get_memory_category_name(int c)
+{
+	if (c == MEMORY_RT_COLOR)
+		return "rt_color";
+	if (c == MEMORY_RT_DEPTH)
+		return "rt_depth";
+	if (c == MEMORY_TEXTURE)
+		return "texture";
+	if (c == MEMORY_CONSTANT)
+		return "constant";
+	if (c == MEMORY_VERTEX)
+		return "vertex";
+	if (c == MEMORY_INDEX)
+		return "index";
+	if (c == MEMORY_STAGING)
+		return "staging";
+	if (c == MEMORY_BUFFER)
+		return "buffer";
+	return "__MEMORY_UNKNOWN__";
+}
+
+//kind,name,category,heap,bytes rows. kind is resource, category, heap, total or high_water.
+inline bool
+oden_write_memory_stats_csv(const char *filename)
+{
+	std::map<std::string, memory_stats> mstats;
+	uint64_t high_water = 0;
+	oden_get_memory_stats(mstats, high_water);
+
+	FILE *fp = fopen(filename, "w");
+	if (fp == nullptr)
+		return false;
+	std::vector<uint64_t> vcategory(MEMORY_MAX);
+	std::map<std::string, uint64_t> mheap;
+	uint64_t total = 0;
+	fprintf(fp, "kind,name,category,heap,bytes\n");
+	for (auto & x : mstats) {
+		auto category = oden_get_memory_category_name(x.second.category);
+		fprintf(fp, "resource,%s,%s,%s,%llu\n", x.first.c_str(), category, x.second.heap.c_str(),
+			(unsigned long long)x.second.bytes);
+		if (x.second.category >= 0 && x.second.category < MEMORY_MAX)
+			vcategory[x.second.category] += x.second.bytes;
+		mheap[x.second.heap] += x.second.bytes;
+		total += x.second.bytes;
+	}
+	for (int i = 0; i < MEMORY_MAX; i++)
+		fprintf(fp, "category,,%s,,%llu\n", oden_get_memory_category_name(i), (unsigned long long)vcategory[i]);
+	for (auto & x : mheap)
+		fprintf(fp, "heap,,,%s,%llu\n", x.first.c_str(), (unsigned long long)x.second);
+	fprintf(fp, "total,,,,%llu\n", (unsigned long long)total);
+	fprintf(fp, "high_water,,,,%llu\n", (unsigned long long)high_water);
+	fclose(fp);
+	return true;
+}
+
 } //oden
@@ -24,13 +24,16 @@
 #pragma once
 
 #include <stdio.h>
-#include <windows.h>
+#include <stdlib.h>
 #include <map>
 #include <vector>
 #include <string>
 #include <vector>
 #include <algorithm>
 
+#ifdef _WIN32
+#include <windows.h>
+
 static LRESULT WINAPI
 MsgProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
@@ -104,3 +107,46 @@ Update()
 	}
 	return is_active;
 }
+
+#else
+
+#include "ODEN.h"
+
+//No window system. Run the sample headless for ODEN_FRAMES frames.
+enum {
+	VK_F1 = 0x70,
+	VK_F2,
+	VK_F3,
+	VK_F4,
+	VK_F5,
+	VK_F6,
+	VK_F7,
+	VK_F8,
+};
+
+static inline short
+GetAsyncKeyState(int /*key*/)
+{
+	return 0;
+}
+
+static inline void *
+InitWindow(const char *name, int w, int h)
+{
+	printf("%s : headless %dx%d\n", name, w, h);
+	return oden::oden_get_headless_handle();
+}
+
+static inline int
+Update()
+{
+	static int64_t frame = 0;
+	static int64_t frame_max = -1;
+	if (frame_max < 0) {
+		auto env = getenv("ODEN_FRAMES");
+		frame_max = env ? strtoll(env, nullptr, 10) : 300;
+	}
+	return frame++ < frame_max;
+}
+
+#endif //_WIN32
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Vulkan render pass recording threads (ODEN_VK_THREADS) against inline recording. run from Source/.
+#   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json sh batfiles/bench_vk_threads.sh [threads]
+# First a short run of the threaded path with VK_LAYER_KHRONOS_validation, then the timed runs without it.
+# Compare the median present (recording and submit on the render thread) of the summaries.
+set -e
+threads=${1:-$(nproc)}
+sh batfiles/make_vk_headless.sh
+for scene in draws passes; do
+	if ! ODEN_VK_THREADS=$threads VK_INSTANCE_LAYERS=VK_LAYER_KHRONOS_validation ./oden_stress_vk --scene $scene --frames 20 > bench_vk_threads.log 2>&1 ||
+		grep -q "Validation Error\|vkdbg: ERROR" bench_vk_threads.log; then
+		echo "bench_vk_threads : $scene with $threads threads is not validation clean, see bench_vk_threads.log"
+		exit 1
+	fi
+done
+for n in 1 $threads; do
+	echo "ODEN_VK_THREADS=$n"
+	ODEN_VK_THREADS=$n ./oden_stress_vk --scene draws --count 20000 --frames 100 --csv bench_vk_threads_$n.csv | grep "summary"
+done
@@ -0,0 +1,16 @@
+#!/bin/sh
+# BC encoder check : the SSE2 and the scalar (ODEN_BC_NO_SIMD) builds must write the same blocks. run from Source/.
+set -e
+SRC="oden_trace.cpp oden_util.cpp oden_bc.cpp oden_pack.cpp oden_packer.cpp"
+g++ -O2 -std=c++17 $SRC -lpthread -o oden_packer_simd
+g++ -O2 -std=c++17 -DODEN_BC_NO_SIMD $SRC -lpthread -o oden_packer_ref
+for fmt in bc1 bc4 bc5 bc7; do
+	./oden_packer_simd -o check_simd.pack --fmt $fmt --generate 2 > /dev/null
+	./oden_packer_ref -o check_ref.pack --fmt $fmt --generate 2 > /dev/null
+	if ! cmp -s check_simd.pack check_ref.pack; then
+		echo "check_bc : $fmt differs"
+		exit 1
+	fi
+	echo "check_bc : $fmt ok"
+done
+rm -f check_simd.pack check_ref.pack oden_packer_simd oden_packer_ref
@@ -0,0 +1,18 @@
+rem DX11 / DX12 check with the debug layer (Graphics Tools installed). run from Source/ in a developer command prompt.
+rem /DDEBUG enables the layer and breaks on its errors, so a scene without a debugger exits with an error.
+rem The sample runs in a window until closed : check its output, then close it.
+cl /nologo /Ox /EHsc /GS- /std:c++latest /DDEBUG dx11_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp oden_stream.cpp oden_stress.cpp /Feoden_stress_dx11.exe || exit /b 1
+cl /nologo /Ox /EHsc /GS- /std:c++latest /DDEBUG dx12_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp oden_stream.cpp oden_stress.cpp /Feoden_stress_dx12.exe || exit /b 1
+cl /nologo /Ox /EHsc /GS- /std:c++latest /DDEBUG dx11_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp sample_code.cpp /Fesample_code_dx11.exe || exit /b 1
+cl /nologo /Ox /EHsc /GS- /std:c++latest /DDEBUG dx12_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp sample_code.cpp /Fesample_code_dx12.exe || exit /b 1
+for %%b in (dx11 dx12) do (
+	for %%s in (draws textures passes mips stream video gbuffer cull) do (
+		oden_stress_%%b.exe --scene %%s --frames 20 > nul || (echo check_dx : %%b %%s failed & exit /b 1)
+		echo check_dx : %%b %%s ok
+	)
+	oden_stress_%%b.exe --scene draws --count 1000 --frames 20 --prepass --async > nul || (echo check_dx : %%b prepass async failed & exit /b 1)
+	oden_stress_%%b.exe --scene draws --count 1000 --frames 20 --instanced > nul || (echo check_dx : %%b instanced failed & exit /b 1)
+	echo check_dx : %%b ok
+)
+sample_code_dx11.exe
+sample_code_dx12.exe
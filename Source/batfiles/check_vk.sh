@@ -0,0 +1,28 @@
+#!/bin/sh
+# Vulkan headless check with the validation layer (Vulkan SDK, lavapipe or SwiftShader as the ICD). run from Source/.
+#   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json sh batfiles/check_vk.sh
+# The sample and every stress scene must exit 0 without a validation error, check_vk.log holds the output of the one that failed.
+set -e
+if ! vulkaninfo --summary 2> /dev/null | grep -q VK_LAYER_KHRONOS_validation; then
+	echo "check_vk : VK_LAYER_KHRONOS_validation is not installed"
+	exit 1
+fi
+sh batfiles/make_vk_headless.sh
+export VK_INSTANCE_LAYERS=VK_LAYER_KHRONOS_validation
+check() {
+	name=$1
+	shift
+	if ! "$@" > check_vk.log 2>&1 || grep -q "Validation Error\|vkdbg: ERROR" check_vk.log; then
+		echo "check_vk : $name failed"
+		exit 1
+	fi
+	echo "check_vk : $name ok"
+}
+check sample env ODEN_FRAMES=30 ODEN_READBACK=check_vk.ppm ./oden_vk_headless
+for scene in draws textures passes mips stream video gbuffer cull; do
+	check $scene ./oden_stress_vk --scene $scene --frames 20
+done
+check prepass ./oden_stress_vk --scene draws --frames 20 --prepass
+check instanced ./oden_stress_vk --scene draws --frames 20 --instanced
+check async ./oden_stress_vk --scene draws --frames 20 --async
+rm -f check_vk.ppm
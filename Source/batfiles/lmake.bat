@@ -1,4 +1,4 @@
-cl /nologo /Ox /EHsc /GS- oden_lua.cpp oden_util.cpp user32.lib gdi32.lib lua.lib dx12_oden.cpp /Fe:oden_lua_dx12.exe
+cl /nologo /Ox /EHsc /GS- oden_lua.cpp oden_util.cpp oden_bc.cpp user32.lib gdi32.lib lua.lib dx12_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp /Fe:oden_lua_dx12.exe
 
-cl /nologo /Ox /EHsc /GS- oden_lua.cpp oden_util.cpp user32.lib gdi32.lib lua.lib dx11_oden.cpp /Fe:oden_lua_dx11.exe
-cl /nologo /Ox /EHsc /GS- oden_lua.cpp oden_util.cpp user32.lib gdi32.lib lua.lib vk_oden.cpp /Fe:oden_lua_vk.exe
+cl /nologo /Ox /EHsc /GS- oden_lua.cpp oden_util.cpp oden_bc.cpp user32.lib gdi32.lib lua.lib dx11_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp /Fe:oden_lua_dx11.exe
+cl /nologo /Ox /EHsc /GS- oden_lua.cpp oden_util.cpp oden_bc.cpp user32.lib gdi32.lib lua.lib vk_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp /Fe:oden_lua_vk.exe
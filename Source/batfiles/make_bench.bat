@@ -0,0 +1,2 @@
+cl /nologo /Ox /EHsc /GS- /std:c++latest /DODEN_BENCH_BACKEND#\"null\" null_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp oden_bench.cpp /Feoden_bench_null.exe
+cl /nologo /Ox /EHsc /GS- /std:c++latest /DODEN_BENCH_BACKEND#\"sw\" sw_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_spirv.cpp oden_util.cpp oden_bc.cpp oden_bench.cpp /Feoden_bench_sw.exe
@@ -0,0 +1,7 @@
+#!/bin/sh
+# Microbenchmarks. run from Source/, results go to oden_bench_<backend>.json.
+#   ./oden_bench_null --samples 50 --out result.json
+g++ -O2 -g -std=c++17 -DODEN_BENCH_BACKEND='"null"' null_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp oden_bench.cpp -lpthread -o oden_bench_null
+g++ -O2 -g -std=c++17 -DODEN_BENCH_BACKEND='"sw"' sw_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_spirv.cpp oden_util.cpp oden_bc.cpp oden_bench.cpp -lpthread -o oden_bench_sw
+./oden_bench_null --out oden_bench_null.json
+./oden_bench_sw --out oden_bench_sw.json
@@ -1 +1 @@
-cl sample_code.cpp oden_util.cpp dx12_oden.cpp /osample_code_dx12.exe  /EHsc /Ox /GS- 
+cl sample_code.cpp oden_util.cpp oden_bc.cpp dx12_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp /osample_code_dx12.exe  /EHsc /Ox /GS- 
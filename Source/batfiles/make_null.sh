@@ -0,0 +1,4 @@
+#!/bin/sh
+# Null backend sample. no gpu needed. run from Source/.
+#   ODEN_FRAMES=1000 ./oden_null
+g++ -O2 -g -std=c++17 null_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp sample_code.cpp -lpthread -o oden_null
@@ -0,0 +1 @@
+cl /nologo /Ox /EHsc /GS- /std:c++latest oden_trace.cpp oden_util.cpp oden_bc.cpp oden_pack.cpp oden_packer.cpp /Feoden_packer.exe
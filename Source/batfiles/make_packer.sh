@@ -0,0 +1,5 @@
+#!/bin/sh
+# Asset pack tool. run from Source/.
+#   ./oden_packer -o scene.pack --fmt bc1 --texture rock rock.ppm --vertex rock_vb rock.vb 36 --index rock_ib rock.ib
+#   ./oden_packer -o big.pack --generate 256 && ./oden_packer --read big.pack
+g++ -O2 -g -std=c++17 oden_trace.cpp oden_util.cpp oden_bc.cpp oden_pack.cpp oden_packer.cpp -lpthread -o oden_packer
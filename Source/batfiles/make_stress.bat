@@ -0,0 +1 @@
+cl /nologo /Ox /EHsc /GS- /std:c++latest null_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp oden_stream.cpp oden_stress.cpp /Feoden_stress_null.exe
@@ -0,0 +1,7 @@
+#!/bin/sh
+# Stress scenes. run from Source/.
+#   ./oden_stress_null --scene draws --count 100000 --frames 100 --csv draws.csv
+#   scenes : draws, textures, passes, mips (count is the render target edge), stream, video (count is the bands per frame), gbuffer.
+#   --prepass draws the cubes to a depth only target first (draws, textures, stream).
+g++ -O2 -g -std=c++17 null_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp oden_stream.cpp oden_stress.cpp -lpthread -o oden_stress_null
+g++ -O2 -g -std=c++17 sw_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_spirv.cpp oden_util.cpp oden_bc.cpp oden_stream.cpp oden_stress.cpp -lpthread -o oden_stress_sw
@@ -0,0 +1 @@
+cl /nologo /Ox /EHsc /GS- /std:c++latest sw_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_spirv.cpp oden_util.cpp oden_bc.cpp sample_code.cpp
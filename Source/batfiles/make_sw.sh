@@ -0,0 +1,6 @@
+#!/bin/sh
+# Software rasterizer sample. no gpu needed. run from Source/.
+#   ODEN_FRAMES=10 ODEN_READBACK=out.ppm ./oden_sw
+#   ODEN_SW_THREADS=n overrides the thread count.
+#   ODEN_SW_SPIRV=1 runs compute shaders by the SPIR-V interpreter (needs glslangValidator).
+g++ -O2 -g -std=c++17 sw_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_spirv.cpp oden_util.cpp oden_bc.cpp sample_code.cpp -lpthread -o oden_sw
@@ -1 +1 @@
-cl /nologo /Ox /EHsc /GS- /std:c++latest vk_oden.cpp oden_util.cpp sample_code.cpp /IC:\VulkanSDK\1.2.148.1\Include
+cl /nologo /Ox /EHsc /GS- /std:c++latest vk_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp sample_code.cpp /IC:\VulkanSDK\1.2.148.1\Include
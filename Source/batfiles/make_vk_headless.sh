@@ -0,0 +1,6 @@
+#!/bin/sh
+# Headless vulkan sample for linux (lavapipe/SwiftShader). run from Source/.
+#   ODEN_FRAMES=300 ODEN_READBACK=out.ppm ./oden_vk_headless
+# Render pass recording threads against inline recording : batfiles/bench_vk_threads.sh
+g++ -O2 -g -std=c++17 vk_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp sample_code.cpp -lvulkan -lpthread -o oden_vk_headless
+g++ -O2 -g -std=c++17 vk_oden.cpp oden_trace.cpp oden_log.cpp oden_render_thread.cpp oden_util.cpp oden_bc.cpp oden_stream.cpp oden_stress.cpp -lvulkan -lpthread -o oden_stress_vk
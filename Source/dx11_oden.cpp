@@ -22,10 +22,14 @@
  */
 
 #include "ODEN.h"
+#include "oden_trace.h"
+#include "oden_log.h"
+#include "oden_platform.h"
 
 #include <stdio.h>
 #include <windows.h>
 #include <d3d11.h>
+#include <d3d11_4.h>
 #include <d3dcommon.h>
 #include <D3Dcompiler.h>
 
@@ -34,6 +38,8 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#include <chrono>
 #include <DirectXMath.h>
 
 #pragma comment(lib, "gdi32.lib")
@@ -47,13 +53,208 @@
 
 #pragma warning(disable:4838)
 
-#define info_printf(...) printf("INFO:" __FUNCTION__ ":" __VA_ARGS__)
-#define err_printf(...) printf("ERR:" __FUNCTION__ ":" __VA_ARGS__)
+#define info_printf(...) ODEN_LOG_INFO(__VA_ARGS__)
+#define err_printf(...) ODEN_LOG_ERR(__VA_ARGS__)
+
+//Written by oden_set_frames_in_flight on the app thread, read by the render thread.
+static std::atomic<uint32_t> frames_in_flight_request {0};
+
+static uint32_t
+get_frames_in_flight(uint32_t num)
+{
+	uint32_t request = frames_in_flight_request.load();
+	return request ? request : num;
+}
+
+static std::mutex frame_stats_mtx;
+static std::vector<oden::frame_stats> vframe_stats;
+static std::vector<oden::cmd_stats> vcmd_stats(oden::CMD_MAX);
+static std::map<std::string, oden::pass_stats> mpass_stats;
+static bool is_pass_stats_updated = false;
+static std::map<std::string, oden::memory_stats> mmemory_stats;
+static uint64_t memory_total = 0;
+static uint64_t memory_high_water = 0;
+
+//Commands up to a draw / dispatch, see oden_get_pass_stats.
+struct pass_segment {
+	std::string name;
+	double cpu_ms;
+	double gpu_ms;
+};
+
+static double
+get_time_ms()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double, std::milli>(now).count();
+}
+
+static void
+push_frame_stats(oden::frame_stats stats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (vframe_stats.size() >= 4096)
+		vframe_stats.erase(vframe_stats.begin(), vframe_stats.begin() + 2048);
+	vframe_stats.push_back(stats);
+}
+
+void
+oden::oden_set_frames_in_flight(uint32_t num)
+{
+	frames_in_flight_request = num;
+}
+
+void
+oden::oden_get_frame_stats(std::vector<frame_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats.insert(vstats.end(), vframe_stats.begin(), vframe_stats.end());
+	vframe_stats.clear();
+}
+
+void
+oden::oden_get_cmd_stats(std::vector<cmd_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats = vcmd_stats;
+	for (auto & x : vcmd_stats)
+		x = {};
+}
+
+static bool
+is_pass_end(int type)
+{
+	return type == oden::CMD_DRAW_INDEX || type == oden::CMD_DRAW || type == oden::CMD_DISPATCH ||
+		type == oden::CMD_GENERATE_MIPS || type == oden::CMD_DRAW_INDEX_INDIRECT ||
+		type == oden::CMD_DRAW_INDEX_INSTANCED || type == oden::CMD_DRAW_INSTANCED;
+}
+
+//The gpu trace track lays the passes back to back from the submit.
+static void
+push_pass_stats(uint64_t frame, const std::vector<pass_segment> & vsegments, double submit_ms)
+{
+	auto gpu_start = submit_ms;
+	for (auto & x : vsegments) {
+		if (x.gpu_ms < 0.0)
+			continue;
+		oden::trace_complete("gpu", x.name, gpu_start, gpu_start + x.gpu_ms, oden::ODEN_TRACE_TRACK_GPU);
+		gpu_start += x.gpu_ms;
+	}
+
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mpass_stats.clear();
+	for (auto & x : vsegments) {
+		auto & stats = mpass_stats[x.name];
+		stats.frame = frame;
+		stats.count++;
+		stats.cpu_ms += x.cpu_ms;
+		stats.gpu_ms = x.gpu_ms < 0.0 ? -1.0 : stats.gpu_ms + x.gpu_ms;
+	}
+	is_pass_stats_updated = true;
+}
+
+bool
+oden::oden_get_pass_stats(std::map<std::string, pass_stats> & mstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (!is_pass_stats_updated)
+		return false;
+	mstats = mpass_stats;
+	is_pass_stats_updated = false;
+	return true;
+}
+
+//Replaces the previous entry of the name.
+static void
+account_memory(const std::string & name, int category, const char *heap, uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto & stats = mmemory_stats[name];
+	memory_total = memory_total - stats.bytes + bytes;
+	stats = {category, heap, bytes};
+	memory_high_water = (std::max)(memory_high_water, memory_total);
+}
+
+static void
+release_memory(const std::string & name)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto it = mmemory_stats.find(name);
+	if (it == mmemory_stats.end())
+		return;
+	memory_total -= it->second.bytes;
+	mmemory_stats.erase(it);
+}
+
+static void
+release_memory_all(void)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mmemory_stats.clear();
+	memory_total = 0;
+}
+
+void
+oden::oden_get_memory_stats(std::map<std::string, oden::memory_stats> & mstats, uint64_t & high_water)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mstats = mmemory_stats;
+	high_water = memory_high_water;
+}
+
+bool
+oden::oden_get_backbuffer_readback(std::vector<uint32_t> & vdata, uint32_t & w, uint32_t & h)
+{
+	//Headless readback is implemented by the vulkan backend only.
+	return false;
+}
+
+static DXGI_FORMAT
+get_dxgi_format(int fmt)
+{
+	static const DXGI_FORMAT tbl[FMT_MAX] = {
+		DXGI_FORMAT_UNKNOWN,
+		DXGI_FORMAT_R8G8B8A8_UNORM,
+		DXGI_FORMAT_R16G16B16A16_FLOAT,
+		DXGI_FORMAT_R11G11B10_FLOAT,
+		DXGI_FORMAT_R16G16_FLOAT,
+		DXGI_FORMAT_R8_UNORM,
+		DXGI_FORMAT_BC1_UNORM,
+		DXGI_FORMAT_BC4_UNORM,
+		DXGI_FORMAT_BC5_UNORM,
+		DXGI_FORMAT_BC7_UNORM,
+		DXGI_FORMAT_R32_FLOAT,
+	};
+	return (fmt >= 0 && fmt < FMT_MAX) ? tbl[fmt] : DXGI_FORMAT_UNKNOWN;
+}
+
+static int
+get_oden_format(DXGI_FORMAT fmt)
+{
+	for (int i = FMT_DEFAULT + 1; i < FMT_MAX; i++)
+		if (get_dxgi_format(i) == fmt)
+			return i;
+	return FMT_DEFAULT;
+}
+
+//Formats created by this backend only. The depth R32_TYPELESS is 4 bytes as R8G8B8A8.
+static uint64_t
+get_texture_bytes(const D3D11_TEXTURE2D_DESC & desc)
+{
+	int fmt = get_oden_format(desc.Format);
+	if (fmt == FMT_DEFAULT)
+		fmt = FMT_R8G8B8A8_UNORM;
+	uint64_t ret = 0;
+	for (UINT i = 0; i < desc.MipLevels; i++)
+		ret += oden_get_format_size(fmt, (std::max)(desc.Width >> i, 1u), (std::max)(desc.Height >> i, 1u));
+	return ret * desc.ArraySize;
+}
 
 static HRESULT
 CompileShaderFromFile(std::string name,
 	LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
 {
+	oden::trace_scope trace("shader", name + ":" + szEntryPoint);
 	HRESULT hr = S_OK;
 	ID3DBlob* perrblob = NULL;
 	std::vector<WCHAR> wfname;
@@ -65,7 +266,7 @@ CompileShaderFromFile(std::string name,
 			D3D_COMPILE_STANDARD_FILE_INCLUDE,
 			szEntryPoint, szShaderModel, flags, 0, ppBlobOut, &perrblob);
 	if (FAILED(hr)) {
-		err_printf("name=%s: %s\n", name.c_str(), perrblob ? perrblob->GetBufferPointer() : "UNKNOWN");
+		err_printf("name=%s: %s\n", name.c_str(), perrblob ? (const char *)perrblob->GetBufferPointer() : "UNKNOWN");
 	}
 	if (perrblob)
 		perrblob->Release();
@@ -88,9 +289,11 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 		ID3D11VertexShader *vs = NULL;
 		ID3D11GeometryShader *gs = NULL;
 		ID3D11PixelShader *ps = NULL;
+		ID3D11PixelShader *ps_depth = NULL; //PSDepth : alpha test on depth only targets.
 		ID3D11ComputeShader *cs = NULL;
 		ID3D11InputLayout *layout = NULL;
 		ID3D11DepthStencilState *dsstate = NULL;
+		ID3D11DepthStencilState *dsstate_equal = NULL; //DEPTH_FUNC_EQUAL
 	};
 	static std::map<std::string, ID3D11RenderTargetView *> mrtv;
 	static std::map<std::string, ID3D11ShaderResourceView *> msrv;
@@ -99,13 +302,181 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 
 	static std::map<std::string, ID3D11Texture2D *> mtex;
 	static std::map<std::string, ID3D11Buffer *> mbuf;
+	static std::map<std::string, ID3D11Buffer *> mstorage; //CMD_SET_BUFFER
+	static std::map<std::string, ID3D11ShaderResourceView *> mstorage_srv;
+	static std::map<std::string, ID3D11UnorderedAccessView *> mstorage_uav;
 	static std::map<std::string, PipelineState> mpstate;
+
+	//CMD_UPDATE_TEXTURE writes one of the staging textures of a texture in turn, so the map
+	//does not wait for the copies of the frames in flight.
+	enum {
+		UpdateStagingMax = 3,
+	};
+	struct UpdateStaging {
+		ID3D11Texture2D *vtex[UpdateStagingMax] = {};
+		UINT w = 0;
+		UINT h = 0;
+		int index = 0;
+	};
+	static std::map<std::string, UpdateStaging> mupdate_staging;
+	auto release_update_staging = [&](const std::string & name) {
+		auto it = mupdate_staging.find(name);
+		if (it == mupdate_staging.end())
+			return;
+		for (auto & x : it->second.vtex)
+			if (x)
+				x->Release();
+		mupdate_staging.erase(it);
+		release_memory(name + "_staging");
+	};
 	static ID3D11SamplerState * sampler_state_point = NULL;
 	static ID3D11SamplerState * sampler_state_linear = NULL;
 	static ID3D11RasterizerState * rsstate = NULL;
 	static uint64_t device_index = 0;
 	static uint64_t frame_count = 0;
 
+	//An event query per frame slot paces the cpu. ID3D11Fence (Windows 10 1703) is signaled after it
+	//when there is one, the cpu then blocks on an event instead of polling the query.
+	static ID3D11Fence *fence = nullptr;
+	static ID3D11DeviceContext4 *ctx4 = nullptr;
+	static HANDLE fence_event = nullptr;
+	static uint64_t fence_value = 0;
+	struct FrameSlot {
+		ID3D11Query *query = nullptr;
+		uint64_t fence_value = 0;
+		bool is_submitted = false;
+		uint64_t frame = 0;
+		double submit_ms = 0.0;
+		double cpu_wait_ms = 0.0;
+
+		//pass timestamps. vtimestamps[0] is the frame start, [n + 1] the end of vsegments[n].
+		ID3D11Query *disjoint = nullptr;
+		std::vector<ID3D11Query *> vtimestamps;
+		std::vector<pass_segment> vsegments;
+	};
+	static std::vector<FrameSlot> vframeslot;
+
+	auto release_timestamps = [&](FrameSlot & ref) {
+		if (ref.disjoint)
+			ref.disjoint->Release();
+		for (auto & x : ref.vtimestamps)
+			x->Release();
+		ref.disjoint = nullptr;
+		ref.vtimestamps.clear();
+	};
+
+	//Results of a done frame are there on the first try. Otherwise spin a little, then sleep.
+	auto get_query_data = [&](ID3D11Asynchronous *query, void *data, UINT size) {
+		for (int i = 0; ctx->GetData(query, data, size, 0) == S_FALSE; i++)
+			Sleep(i < 16 ? 0 : 1);
+	};
+
+	//DX11 has no clock calibration. A timestamp taken on an idle gpu right after the flush stands in for one.
+	//It is taken again once the gpu is idle after a disjoint frame.
+	static bool is_calibrate = true;
+	static uint64_t calibration_ticks = 0;
+	static uint64_t calibration_frequency = 0; //0 : none, latency_ms is to the query seen done.
+	static double calibration_host_ms = 0.0;
+	auto calibrate = [&]() {
+		is_calibrate = false;
+		calibration_frequency = 0;
+		ID3D11Query *disjoint = nullptr;
+		ID3D11Query *timestamp = nullptr;
+		D3D11_QUERY_DESC query_desc = {D3D11_QUERY_TIMESTAMP_DISJOINT, 0};
+		dev->CreateQuery(&query_desc, &disjoint);
+		query_desc.Query = D3D11_QUERY_TIMESTAMP;
+		dev->CreateQuery(&query_desc, &timestamp);
+		if (disjoint && timestamp) {
+			ctx->Begin(disjoint);
+			ctx->End(timestamp);
+			ctx->End(disjoint);
+			ctx->Flush();
+			auto host_ms = oden_platform_get_host_ms(oden_platform_get_host_ticks());
+			uint64_t ticks = 0;
+			D3D11_QUERY_DATA_TIMESTAMP_DISJOINT data = {};
+			get_query_data(timestamp, &ticks, sizeof(ticks));
+			get_query_data(disjoint, &data, sizeof(data));
+			if (!data.Disjoint) {
+				calibration_ticks = ticks;
+				calibration_frequency = data.Frequency;
+				calibration_host_ms = host_ms;
+			}
+		}
+		if (disjoint)
+			disjoint->Release();
+		if (timestamp)
+			timestamp->Release();
+	};
+
+	auto collect_frame_stats = [&](FrameSlot & ref, bool is_wait) {
+		if (!ref.is_submitted)
+			return;
+		if (is_wait) {
+			trace_scope trace("wait", "frame query");
+			if (fence && fence->GetCompletedValue() < ref.fence_value) {
+				fence->SetEventOnCompletion(ref.fence_value, fence_event);
+				ctx->Flush();
+				WaitForSingleObject(fence_event, INFINITE);
+			}
+			get_query_data(ref.query, NULL, 0);
+		} else if (ctx->GetData(ref.query, NULL, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) {
+			return;
+		}
+		frame_stats stats = {};
+		stats.frame = ref.frame;
+		stats.frames_in_flight = (uint32_t)vframeslot.size();
+		stats.cpu_wait_ms = ref.cpu_wait_ms;
+		//Without the calibration, to the query seen done.
+		stats.latency_ms = get_time_ms() - ref.submit_ms;
+		ref.is_submitted = false;
+
+		//The event query is done, so are the timestamps before it.
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+		if (ref.disjoint && ref.vtimestamps.size() > ref.vsegments.size()) {
+			get_query_data(ref.disjoint, &disjoint, sizeof(disjoint));
+		}
+		if (disjoint.Frequency && !disjoint.Disjoint) {
+			std::vector<uint64_t> vticks(ref.vsegments.size() + 1);
+			for (size_t i = 0; i < vticks.size(); i++)
+				get_query_data(ref.vtimestamps[i], &vticks[i], sizeof(uint64_t));
+			for (size_t i = 0; i < ref.vsegments.size(); i++)
+				ref.vsegments[i].gpu_ms = double(vticks[i + 1] - vticks[i]) * 1000.0 / double(disjoint.Frequency);
+
+			//The end of frame timestamp on the host clock of the calibration, then on get_time_ms.
+			if (calibration_frequency == disjoint.Frequency) {
+				auto ticks = double(int64_t(vticks.back() - calibration_ticks));
+				auto end_ms = calibration_host_ms + ticks * 1000.0 / double(disjoint.Frequency);
+				auto host_ms = oden_platform_get_host_ms(oden_platform_get_host_ticks());
+				stats.latency_ms = end_ms + (get_time_ms() - host_ms) - ref.submit_ms;
+			} else {
+				is_calibrate = true;
+			}
+		} else if (disjoint.Disjoint) {
+			is_calibrate = true;
+		}
+		push_frame_stats(stats);
+		push_pass_stats(ref.frame, ref.vsegments, ref.submit_ms);
+	};
+
+	auto set_frames_in_flight = [&](uint32_t count) {
+		for (auto & x : vframeslot) {
+			collect_frame_stats(x, true);
+			x.query->Release();
+			release_timestamps(x);
+		}
+		vframeslot.clear();
+		vframeslot.resize(count);
+		D3D11_QUERY_DESC query_desc = {D3D11_QUERY_EVENT, 0};
+		for (auto & x : vframeslot)
+			dev->CreateQuery(&query_desc, &x.query);
+
+		IDXGIDevice1 *dxgidev = nullptr;
+		if (SUCCEEDED(dev->QueryInterface(IID_PPV_ARGS(&dxgidev)))) {
+			dxgidev->SetMaximumFrameLatency(count);
+			dxgidev->Release();
+		}
+	};
+
 	if (dev == nullptr) {
 		DXGI_SWAP_CHAIN_DESC d3dsddesc = {
 			{
@@ -118,15 +489,33 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 			DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH,
 		};
 
+		UINT device_flags = 0;
+#ifdef DEBUG
+		device_flags |= D3D11_CREATE_DEVICE_DEBUG;
+#endif //DEBUG
 		D3D11CreateDeviceAndSwapChain(
 			NULL, D3D_DRIVER_TYPE_HARDWARE,
-			NULL, 0, NULL, 0, D3D11_SDK_VERSION,
+			NULL, device_flags, NULL, 0, D3D11_SDK_VERSION,
 			&d3dsddesc, &swapchain, &dev, NULL, &ctx);
+#ifdef DEBUG
+		//Break on the errors of the debug layer, a run without a debugger then fails (batfiles/check_dx.bat).
+		ID3D11InfoQueue *info_queue = nullptr;
+		if (dev && SUCCEEDED(dev->QueryInterface(__uuidof(ID3D11InfoQueue), (void **)&info_queue))) {
+			info_queue->SetBreakOnSeverity(D3D11_MESSAGE_SEVERITY_CORRUPTION, TRUE);
+			info_queue->SetBreakOnSeverity(D3D11_MESSAGE_SEVERITY_ERROR, TRUE);
+			info_queue->Release();
+		}
+#endif //DEBUG
 		ID3D11Texture2D *backtex = nullptr;
 		ID3D11RenderTargetView *backrtv = nullptr;
 		swapchain->GetBuffer(0, __uuidof(ID3D11Texture2D),
 			(LPVOID *) &backtex);
 		dev->CreateRenderTargetView(backtex, NULL, &backrtv);
+		if (backtex) {
+			D3D11_TEXTURE2D_DESC desc = {};
+			backtex->GetDesc(&desc);
+			account_memory(oden_get_backbuffer_basename(), MEMORY_RT_COLOR, "swapchain", get_texture_bytes(desc) * num);
+		}
 		for (uint32_t i = 0; i < num; i++) {
 			auto name = oden_get_backbuffer_name(i);
 			mtex[name] = backtex;
@@ -152,12 +541,27 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 		rsstate_desc.DepthClipEnable = TRUE;
 		rsstate_desc.ScissorEnable = TRUE;
 		dev->CreateRasterizerState(&rsstate_desc, &rsstate);
+
+		ID3D11Device5 *dev5 = nullptr;
+		if (SUCCEEDED(dev->QueryInterface(IID_PPV_ARGS(&dev5)))) {
+			dev5->CreateFence(0, D3D11_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence));
+			dev5->Release();
+		}
+		if (fence && SUCCEEDED(ctx->QueryInterface(IID_PPV_ARGS(&ctx4)))) {
+			fence_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		} else if (fence) {
+			fence->Release();
+			fence = nullptr;
+		}
+		if (fence == nullptr)
+			info_printf("No ID3D11Fence, the frame wait polls its query\n");
+		set_frames_in_flight(get_frames_in_flight(num));
 	};
 
 	if (hwnd == nullptr) {
 		auto release = [](auto & a, const char * name = nullptr) {
 			if (a) {
-				printf("release : %p : name=%s\n",
+				info_printf("release : %p : name=%s\n",
 					a, name ? name : "noname");
 				a->Release();
 			}
@@ -168,26 +572,67 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 				release(p.second, p.first.c_str());
 		};
 
+		for (auto & x : vframeslot) {
+			collect_frame_stats(x, true);
+			release(x.query);
+			release_timestamps(x);
+		}
+		vframeslot.clear();
+		while (!mupdate_staging.empty())
+			release_update_staging(mupdate_staging.begin()->first);
 		mrelease(muav);
 		mrelease(mdsv);
 		mrelease(mrtv);
 		mrelease(mtex);
 		mrelease(mbuf);
+		mrelease(mstorage_uav);
+		mrelease(mstorage_srv);
+		mrelease(mstorage);
+		release_memory_all();
 		for (auto & p : mpstate) {
 			release(p.second.vs, (p.first + ": VS").c_str());
 			release(p.second.gs, (p.first + ": GS").c_str());
 			release(p.second.ps, (p.first + ": PS").c_str());
+			release(p.second.ps_depth, (p.first + ": PS depth").c_str());
 			release(p.second.layout, (p.first + ": IA").c_str());
 		}
 		release(sampler_state_point);
 		release(sampler_state_linear);
 		release(rsstate);
+		release(fence);
+		release(ctx4);
+		if (fence_event)
+			CloseHandle(fence_event);
+		fence_event = nullptr;
 		release(swapchain);
 		release(ctx);
 		release(dev);
+		log_flush();
 		return;
 	}
 
+	//Frame pacing
+	for (auto & x : vframeslot)
+		collect_frame_stats(x, false);
+
+	uint32_t frames_in_flight = get_frames_in_flight(num);
+	if (vframeslot.size() != frames_in_flight) {
+		info_printf("frames in flight %zu -> %u\n", vframeslot.size(), frames_in_flight);
+		set_frames_in_flight(frames_in_flight);
+	}
+	if (is_calibrate && std::none_of(vframeslot.begin(), vframeslot.end(), [](const FrameSlot & x) {
+		return x.is_submitted;
+	}))
+		calibrate();
+
+	trace_scope trace_frame("frame", "frame " + std::to_string(frame_count));
+	auto & slot = vframeslot[frame_count % vframeslot.size()];
+	{
+		auto start = get_time_ms();
+		collect_frame_stats(slot, true);
+		slot.cpu_wait_ms = get_time_ms() - start;
+	}
+
 	ctx->IASetInputLayout(NULL);
 	ctx->VSSetShader(NULL, NULL, 0);
 	ctx->GSSetShader(NULL, NULL, 0);
@@ -199,58 +644,134 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 	ctx->PSSetSamplers(1, 1, &sampler_state_linear);
 	ctx->RSSetState(rsstate);
 
+	//One timestamp per draw / dispatch, and the frame start and end.
+	{
+		size_t query_count = 2;
+		for (auto & c : vcmd)
+			if (is_pass_end(c.type))
+				query_count++;
+		D3D11_QUERY_DESC query_desc = {D3D11_QUERY_TIMESTAMP_DISJOINT, 0};
+		if (slot.disjoint == nullptr)
+			dev->CreateQuery(&query_desc, &slot.disjoint);
+		query_desc.Query = D3D11_QUERY_TIMESTAMP;
+		while (slot.vtimestamps.size() < query_count) {
+			ID3D11Query *query = nullptr;
+			if (FAILED(dev->CreateQuery(&query_desc, &query)))
+				break;
+			slot.vtimestamps.push_back(query);
+		}
+	}
+	slot.vsegments.clear();
+	bool is_timestamp = slot.disjoint && !slot.vtimestamps.empty();
+	if (is_timestamp) {
+		ctx->Begin(slot.disjoint);
+		ctx->End(slot.vtimestamps[0]);
+	}
+
+	std::vector<cmd_stats> vstats(CMD_MAX);
+	bool is_depth_only = false;
+
+	//The runtime binds a null SRV for a resource which is still a compute UAV, and refuses
+	//it as the arguments of an indirect draw. The names of the UAV slots unbind them first.
+	std::vector<std::string> vcs_uav(slotmax);
+	auto unbind_cs_uav = [&](const std::string & name) {
+		ID3D11UnorderedAccessView *uavnull = nullptr;
+		for (uint32_t i = 0; i < slotmax; i++) {
+			if (vcs_uav[i] != name)
+				continue;
+			ctx->CSSetUnorderedAccessViews(i, 1, &uavnull, nullptr);
+			vcs_uav[i].clear();
+		}
+	};
+	double segment_cpu_ms = 0.0;
+	double segment_start = get_time_ms();
+	auto end_segment = [&](const std::string & name) {
+		slot.vsegments.push_back({name, segment_cpu_ms, is_timestamp ? 0.0 : -1.0});
+		segment_cpu_ms = 0.0;
+		auto segment_end = get_time_ms();
+		trace_complete("translate", name, segment_start, segment_end);
+		segment_start = segment_end;
+		if (is_timestamp && slot.vsegments.size() < slot.vtimestamps.size())
+			ctx->End(slot.vtimestamps[slot.vsegments.size()]);
+	};
+
 	for (auto & c : vcmd) {
 		auto type = c.type;
 		auto name = c.name;
+		auto cmd_start = get_time_ms();
 
-		auto fmt_color = DXGI_FORMAT_R16G16B16A16_FLOAT;
 		auto fmt_depth = DXGI_FORMAT_D32_FLOAT;
 
 		//CMD_SET_RENDER_TARGET
 		if (type == CMD_SET_RENDER_TARGET) {
 			auto name_depth = oden_get_depth_render_target_name(name);
-			auto tex = mtex[name];
-			if (tex == nullptr) {
-				int maxmips = oden_get_mipmap_max(c.set_render_target.rect.w, c.set_render_target.rect.h);
-				D3D11_TEXTURE2D_DESC desc = {
-					c.set_render_target.rect.w, c.set_render_target.rect.h, maxmips, 1, fmt_color, {1, 0},
-					D3D11_USAGE_DEFAULT, D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS, 0,  0,
-				};
-				dev->CreateTexture2D(&desc, NULL, &tex);
-				if (tex) {
-					mtex[name] = tex;
-				} else {
-					err_printf("CMD_SET_RENDER_TARGET name=%s, tex=%p, maxmips=%d\n", name.c_str(), tex, maxmips);
-					exit(1);
+			int rw = 0;
+			int rh = 0;
+			oden_get_render_target_size(c, rw, rh);
+			is_depth_only = c.set_render_target.is_depth_only;
+			auto rt_count = is_depth_only ? 0 : oden_get_render_target_count(c);
+			ID3D11RenderTargetView *vrtv[RENDER_TARGET_MAX] = {};
+			if (c.set_render_target.is_backbuffer && (rt_count > 1 || is_depth_only)) {
+				err_printf("ERROR CMD_SET_RENDER_TARGET name=%s, backbuffer with count=%d\n", name.c_str(), rt_count);
+				exit(1);
+			}
+			for (int i = 0; i < rt_count; i++) {
+				auto name_color = oden_get_color_render_target_name(name, i);
+				auto tex = mtex[name_color];
+				if (tex == nullptr) {
+					trace_scope trace("resource", name_color);
+					int maxmips = oden_get_mipmap_max(rw, rh);
+					auto fmt = oden_get_render_target_format(c, i);
+					auto fmt_color = get_dxgi_format(fmt);
+					if (fmt_color == DXGI_FORMAT_UNKNOWN || oden_is_block_format(fmt)) {
+						err_printf("ERROR CMD_SET_RENDER_TARGET name=%s, fmt=%s\n", name_color.c_str(), oden_get_format_name(fmt));
+						exit(1);
+					}
+					D3D11_TEXTURE2D_DESC desc = {
+						(UINT)rw, (UINT)rh, maxmips, 1, fmt_color, {1, 0},
+						D3D11_USAGE_DEFAULT, D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS, 0,
+						D3D11_RESOURCE_MISC_GENERATE_MIPS,
+					};
+					dev->CreateTexture2D(&desc, NULL, &tex);
+					if (tex) {
+						mtex[name_color] = tex;
+						account_memory(name_color, MEMORY_RT_COLOR, "default", get_texture_bytes(desc));
+					} else {
+						err_printf("CMD_SET_RENDER_TARGET name=%s, tex=%p, maxmips=%d\n", name_color.c_str(), tex, maxmips);
+						exit(1);
+					}
+					info_printf("CreateTexture2D(rtv) name=%s, tex=%p, maxmips=%d\n", name_color.c_str(), tex, maxmips);
+				}
+				auto rtv = mrtv[name_color];
+				if (rtv == nullptr) {
+					dev->CreateRenderTargetView(tex, nullptr, &rtv);
+					info_printf("CreateRenderTargetView name=%s, rtv=%p\n", name_color.c_str(), rtv);
+					if (rtv) {
+						mrtv[name_color] = rtv;
+					} else {
+						err_printf("ERROR CMD_SET_RENDER_TARGET : CreateRenderTargetView name=%s, tex=%p\n", name_color.c_str(), tex);
+						exit(1);
+					}
 				}
-				info_printf("CreateTexture2D(rtv) name=%s, tex=%p, maxmips=%d\n", name.c_str(), tex, maxmips);
+				vrtv[i] = rtv;
 			}
 			auto tex_depth = mtex[name_depth];
 			if (tex_depth == nullptr) {
+				trace_scope trace("resource", name_depth);
 				D3D11_TEXTURE2D_DESC desc = {
-					c.set_render_target.rect.w, c.set_render_target.rect.h, 1, 1, DXGI_FORMAT_R32_TYPELESS, {1, 0},
+					(UINT)rw, (UINT)rh, 1, 1, DXGI_FORMAT_R32_TYPELESS, {1, 0},
 					D3D11_USAGE_DEFAULT, D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE, 0,  0,
 				};
 				dev->CreateTexture2D(&desc, NULL, &tex_depth);
 				if (tex_depth) {
 					mtex[name_depth] = tex_depth;
+					account_memory(name_depth, MEMORY_RT_DEPTH, "default", get_texture_bytes(desc));
 				} else {
 					err_printf("ERROR CMD_SET_RENDER_TARGET name_depth=%s, tex=%p\n", name_depth.c_str(), tex_depth);
 					exit(1);
 				}
 				info_printf("CreateTexture2D(dsv) name=%s, tex_depth=%p\n", name_depth.c_str(), tex_depth);
 			}
-			auto rtv = mrtv[name];
-			if (rtv == nullptr) {
-				dev->CreateRenderTargetView(tex, nullptr, &rtv);
-				info_printf("CreateRenderTargetView name=%s, rtv=%p\n", name.c_str(), rtv);
-				if (rtv) {
-					mrtv[name] = rtv;
-				} else {
-					err_printf("ERROR CMD_SET_RENDER_TARGET : CreateRenderTargetView name=%s, tex=%p\n", name.c_str(), tex);
-					exit(1);
-				}
-			}
 
 			auto dsv = mdsv[name];
 			if (dsv == nullptr) {
@@ -262,17 +783,17 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 				if (dsv) {
 					mdsv[name] = dsv;
 				} else {
-					err_printf("ERROR CMD_SET_RENDER_TARGET : CreateDepthStencilView name=%s, tex=%p\n", name.c_str(), tex);
+					err_printf("ERROR CMD_SET_RENDER_TARGET : CreateDepthStencilView name=%s, tex=%p\n", name.c_str(), tex_depth);
 					exit(1);
 				}
 			}
-			auto vw = c.set_render_target.rect.w;
-			auto vh = c.set_render_target.rect.h;
-			D3D11_RECT rc = { 0, 0, vw, vh };
-			D3D11_VIEWPORT vp = { 0.0f, 0.0f, (FLOAT) vw, (FLOAT) vh, 0.0f, 1.0f, };
+			//targets keep their size, the rect draws into a part of them.
+			auto & rect = c.set_render_target.rect;
+			D3D11_RECT rc = { rect.x, rect.y, rect.x + rect.w, rect.y + rect.h };
+			D3D11_VIEWPORT vp = { (FLOAT) rect.x, (FLOAT) rect.y, (FLOAT) rect.w, (FLOAT) rect.h, 0.0f, 1.0f, };
 			ctx->RSSetScissorRects(1, &rc);
 			ctx->RSSetViewports(1, &vp);
-			ctx->OMSetRenderTargets(1, &rtv, dsv);
+			ctx->OMSetRenderTargets(rt_count, vrtv, dsv);
 		}
 
 		//CMD_SET_TEXTURE
@@ -283,23 +804,48 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 			auto rtv = mrtv[name];
 			auto dsv = mdsv[name];
 			auto uav = muav[name];
-			auto data = c.buf.data();
-			auto size = c.buf.size();
+			auto data = oden_get_cmd_data(c);
+			auto size = oden_get_cmd_size(c);
 			if (tex == nullptr) {
-				fmt_color = DXGI_FORMAT_R8G8B8A8_UNORM;
+				trace_scope trace("upload", name);
+				auto fmt = oden_get_texture_format(c.set_texture.fmt);
+				auto fmt_color = get_dxgi_format(fmt);
+				if (fmt_color == DXGI_FORMAT_UNKNOWN) {
+					err_printf("ERROR CMD_SET_TEXTURE name=%s, fmt=%s\n", name.c_str(), oden_get_format_name(fmt));
+					exit(1);
+				}
+				//Block compressed formats can not be UAV.
+				UINT bind = D3D11_BIND_SHADER_RESOURCE;
+				if (!oden_is_block_format(fmt))
+					bind |= D3D11_BIND_UNORDERED_ACCESS;
+				auto tw = c.set_texture.rect.w;
+				auto th = c.set_texture.rect.h;
+				UINT mips = (std::max)(c.set_texture.mips, 1);
 				D3D11_TEXTURE2D_DESC desc = {
-					c.set_texture.rect.w, c.set_texture.rect.h, 1, 1, fmt_color, {1, 0},
-					D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS, 0,  0,
+					tw, th, mips, 1, fmt_color, {1, 0},
+					D3D11_USAGE_DEFAULT, bind, 0,  0,
 				};
-				D3D11_SUBRESOURCE_DATA initdata = {};
-				initdata.pSysMem = data;
-				initdata.SysMemPitch = c.set_texture.stride_size;
-				initdata.SysMemSlicePitch = size;
-				dev->CreateTexture2D(&desc, &initdata, &tex);
+				//level 0 has stride_size, the smaller levels are packed after it.
+				std::vector<D3D11_SUBRESOURCE_DATA> vinitdata(mips);
+				for (UINT i = 0; i < mips; i++) {
+					auto lw = (std::max)(tw >> i, 1);
+					auto & initdata = vinitdata[i];
+					initdata.pSysMem = data + oden_get_texture_level_offset(fmt, tw, th, i, c.set_texture.stride_size);
+					initdata.SysMemPitch = i == 0 ? c.set_texture.stride_size : 0;
+					if (initdata.SysMemPitch == 0)
+						initdata.SysMemPitch = oden_get_format_size(fmt, lw, 1);
+					initdata.SysMemSlicePitch = 0;
+				}
+				if (size && size < oden_get_texture_level_offset(fmt, tw, th, mips, c.set_texture.stride_size)) {
+					err_printf("ERROR CMD_SET_TEXTURE name=%s, size=%zu, mips=%u\n", name.c_str(), size, mips);
+					exit(1);
+				}
+				dev->CreateTexture2D(&desc, vinitdata.data(), &tex);
 				info_printf("CreateTexture2D : name=%s, tex=%p\n", name.c_str(), tex);
-				if (tex)
+				if (tex) {
 					mtex[name] = tex;
-				else {
+					account_memory(name, MEMORY_TEXTURE, "default", get_texture_bytes(desc));
+				} else {
 					err_printf("ERROR CMD_SET_TEXTURE name=%s, tex=%p\n", name.c_str(), tex);
 					exit(1);
 				}
@@ -311,11 +857,11 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 			if (type == CMD_SET_TEXTURE) {
 				if (srv == nullptr) {
 					D3D11_SHADER_RESOURCE_VIEW_DESC desc = {
-						fmt_color,
+						texdesc.Format,
 						D3D11_SRV_DIMENSION_TEXTURE2D,
 						{0, 0},
 					};
-					desc.Texture2D.MipLevels = 1;
+					desc.Texture2D.MipLevels = texdesc.MipLevels;
 					if (rtv)
 						desc.Texture2D.MipLevels = texdesc.MipLevels - 1;
 					if (dsv)
@@ -324,9 +870,9 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 					if (name.find("depth") != std::string::npos) {
 						desc.Format = fmt_depth;
 						if (desc.Format == DXGI_FORMAT_D32_FLOAT)
-							printf("!!!!! DXGI_FORMAT_D32_FLOAT\n");
+							info_printf("DXGI_FORMAT_D32_FLOAT\n");
 						if (desc.Format == DXGI_FORMAT_R32_FLOAT)
-							printf("!!!!! DXGI_FORMAT_R32_FLOAT\n");
+							info_printf("DXGI_FORMAT_R32_FLOAT\n");
 						desc.Format = DXGI_FORMAT_R32_FLOAT;
 					}
 					info_printf("CMD_SET_TEXTURE name=%s, tex=%p, srv=%p, rtv=%p, miplevels=%d\n",
@@ -341,11 +887,33 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 					info_printf("CreateShaderResourceView : name=%s, srv=%p\n", name.c_str(), srv);
 				}
 
+				//A view from miplevel, the finer levels are not read.
+				auto miplevel = (std::min)((std::max)(c.set_texture.miplevel, 0), int(texdesc.MipLevels) - 1);
+				if (miplevel > 0 && srv) {
+					auto name_level = oden_get_mipmap_name(name, miplevel) + "_srv";
+					auto srv_level = msrv[name_level];
+					if (srv_level == nullptr) {
+						D3D11_SHADER_RESOURCE_VIEW_DESC desc = {};
+						srv->GetDesc(&desc);
+						desc.Texture2D.MostDetailedMip = miplevel;
+						desc.Texture2D.MipLevels = (std::max)(int(desc.Texture2D.MipLevels) - miplevel, 1);
+						dev->CreateShaderResourceView(tex, &desc, &srv_level);
+						msrv[name_level] = srv_level;
+					}
+					if (srv_level)
+						srv = srv_level;
+				}
+
 				ID3D11UnorderedAccessView * uavnull[1] = { nullptr };
 				ctx->CSSetUnorderedAccessViews(0, 1, uavnull, nullptr);
-				if (srv) {
+				vcs_uav[0].clear();
+				unbind_cs_uav(name);
+				if (slot < 0) {
+					//created only.
+				} else if (srv) {
 					ctx->VSSetShaderResources(slot, 1, &srv);
 					ctx->PSSetShaderResources(slot, 1, &srv);
+					ctx->CSSetShaderResources(slot, 1, &srv);
 				} else {
 					err_printf("CMD_SET_TEXTURE : name=%s, srv=%p\n", name.c_str(), srv);
 					exit(1);
@@ -377,6 +945,75 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 				uav = muav[mipname];
 				//printf("DEBUG CMD_SET_TEXTURE_UAV name=%s, uav=%p\n", mipname.c_str(), uav);
 				ctx->CSSetUnorderedAccessViews(slot, 1, &uav, nullptr);
+				if (slot >= 0 && slot < int(slotmax))
+					vcs_uav[slot] = name;
+			}
+		}
+
+		//CMD_SET_BUFFER
+		//Raw views, ByteAddressBuffer t(slot) and RWByteAddressBuffer u(slot).
+		if (type == CMD_SET_BUFFER || type == CMD_SET_BUFFER_UAV) {
+			auto slot = c.set_buffer.slot;
+			auto buf = mstorage[name];
+			if (buf == nullptr) {
+				trace_scope trace("upload", name);
+				auto size = UINT(c.set_buffer.size);
+				auto data = oden_get_cmd_data(c);
+				std::vector<uint8_t> vinit(size);
+				memcpy(vinit.data(), data, (std::min)(oden_get_cmd_size(c), vinit.size()));
+				D3D11_BUFFER_DESC bd = {
+					size, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS, 0,
+					D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS | D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS, 0
+				};
+				D3D11_SUBRESOURCE_DATA initdata = {vinit.data(), 0, 0};
+				dev->CreateBuffer(&bd, &initdata, &buf);
+				if (buf == nullptr) {
+					err_printf("ERROR CMD_SET_BUFFER name=%s, size=%u\n", name.c_str(), size);
+					exit(1);
+				}
+				mstorage[name] = buf;
+				account_memory(name, MEMORY_BUFFER, "default", size);
+
+				D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+				srv_desc.Format = DXGI_FORMAT_R32_TYPELESS;
+				srv_desc.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
+				srv_desc.BufferEx.NumElements = size / 4;
+				srv_desc.BufferEx.Flags = D3D11_BUFFEREX_SRV_FLAG_RAW;
+				dev->CreateShaderResourceView(buf, &srv_desc, &mstorage_srv[name]);
+
+				D3D11_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
+				uav_desc.Format = DXGI_FORMAT_R32_TYPELESS;
+				uav_desc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+				uav_desc.Buffer.NumElements = size / 4;
+				uav_desc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+				dev->CreateUnorderedAccessView(buf, &uav_desc, &mstorage_uav[name]);
+				info_printf("CreateBuffer(storage) name=%s, buf=%p, size=%u\n", name.c_str(), buf, size);
+			}
+			if (type == CMD_SET_BUFFER && slot >= 0) {
+				auto srv = mstorage_srv[name];
+				unbind_cs_uav(name);
+				ctx->VSSetShaderResources(slot, 1, &srv);
+				ctx->PSSetShaderResources(slot, 1, &srv);
+				ctx->CSSetShaderResources(slot, 1, &srv);
+			}
+			if (type == CMD_SET_BUFFER_UAV) {
+				auto uav = mstorage_uav[name];
+				ctx->CSSetUnorderedAccessViews(slot, 1, &uav, nullptr);
+				if (slot < int(slotmax))
+					vcs_uav[slot] = name;
+			}
+		}
+
+		//CMD_UPDATE_BUFFER
+		if (type == CMD_UPDATE_BUFFER) {
+			auto buf = mstorage[name];
+			auto offset = UINT(c.set_buffer.offset);
+			auto size = UINT(oden_get_cmd_size(c));
+			if (buf && size) {
+				D3D11_BOX box = {offset, 0, 0, offset + size, 1, 1};
+				ctx->UpdateSubresource(buf, 0, &box, oden_get_cmd_data(c), 0, 0);
+			} else {
+				err_printf("Invalid update buffer name=%s\n", name.c_str());
 			}
 		}
 
@@ -395,6 +1032,7 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 				info_printf("CreateBuffer : name=%s, cb=%p\n", name.c_str(), cb);
 				if (cb) {
 					mbuf[name] = cb;
+					account_memory(name, MEMORY_CONSTANT, "default", size);
 				} else {
 					err_printf("CreateBuffer : name=%s, cb=%p\n", name.c_str(), cb);
 					exit(1);
@@ -409,10 +1047,11 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 		//CMD_SET_VERTEX
 		if (type == CMD_SET_VERTEX) {
 			auto vb = mbuf[name];
-			auto data = c.buf.data();
-			auto size = c.buf.size();
+			auto data = oden_get_cmd_data(c);
+			auto size = oden_get_cmd_size(c);
 
 			if (vb == nullptr) {
+				trace_scope trace("upload", name);
 				D3D11_BUFFER_DESC bd = {
 					size, D3D11_USAGE_DYNAMIC, D3D11_BIND_VERTEX_BUFFER, 0, 0, 0
 				};
@@ -421,6 +1060,7 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 				info_printf("CreateBuffer : name=%s, vb=%p\n", name.c_str(), vb);
 				if (vb) {
 					mbuf[name] = vb;
+					account_memory(name, MEMORY_VERTEX, "dynamic", size);
 				} else {
 					info_printf("CreateBuffer : name=%s, vb=%p\n", name.c_str(), vb);
 					exit(0);
@@ -448,10 +1088,12 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 			auto pstate = mpstate[name];
 			if (is_update) {
 				if (pstate.dsstate) pstate.dsstate->Release();
+				if (pstate.dsstate_equal) pstate.dsstate_equal->Release();
 				if (pstate.layout) pstate.layout->Release();
 				if (pstate.vs) pstate.vs->Release();
 				if (pstate.gs) pstate.gs->Release();
 				if (pstate.ps) pstate.ps->Release();
+				if (pstate.ps_depth) pstate.ps_depth->Release();
 				mpstate.erase(name);
 				pstate = mpstate[name];
 			}
@@ -459,10 +1101,12 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 				ID3DBlob *pBlobVS = NULL;
 				ID3DBlob *pBlobGS = NULL;
 				ID3DBlob *pBlobPS = NULL;
+				ID3DBlob *pBlobPSDepth = NULL;
 				ID3DBlob *pBlobCS = NULL;
 				CompileShaderFromFile(std::string(name + ".hlsl").c_str(), "VSMain", "vs_5_0", &pBlobVS);
 				CompileShaderFromFile(std::string(name + ".hlsl").c_str(), "GSMain", "gs_5_0", &pBlobGS);
 				CompileShaderFromFile(std::string(name + ".hlsl").c_str(), "PSMain", "ps_5_0", &pBlobPS);
+				CompileShaderFromFile(std::string(name + ".hlsl").c_str(), "PSDepth", "ps_5_0", &pBlobPSDepth);
 				CompileShaderFromFile(std::string(name + ".hlsl").c_str(), "CSMain", "cs_5_0", &pBlobCS);
 
 				if (pBlobVS)
@@ -474,6 +1118,9 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 				if (pBlobPS)
 					dev->CreatePixelShader(
 						pBlobPS->GetBufferPointer(), pBlobPS->GetBufferSize(), NULL, &pstate.ps);
+				if (pBlobPSDepth)
+					dev->CreatePixelShader(
+						pBlobPSDepth->GetBufferPointer(), pBlobPSDepth->GetBufferSize(), NULL, &pstate.ps_depth);
 				if (pBlobCS)
 					dev->CreateComputeShader(
 						pBlobCS->GetBufferPointer(), pBlobCS->GetBufferSize(), NULL, &pstate.cs);
@@ -504,6 +1151,11 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 					dsstate_desc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
 					dsstate_desc.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
 					dev->CreateDepthStencilState(&dsstate_desc, &pstate.dsstate);
+
+					//depth equal to the prepass. the depth is already there, so no write.
+					dsstate_desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+					dsstate_desc.DepthFunc = D3D11_COMPARISON_EQUAL;
+					dev->CreateDepthStencilState(&dsstate_desc, &pstate.dsstate_equal);
 				}
 				info_printf("pstate.layout= %p\n", pstate.layout);
 				info_printf("pstate.dsstate= %p\n", pstate.dsstate);
@@ -515,28 +1167,33 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 					mpstate[name] = pstate;
 				} else {
 					if (pstate.dsstate) pstate.dsstate->Release();
+					if (pstate.dsstate_equal) pstate.dsstate_equal->Release();
 					if (pstate.layout) pstate.layout->Release();
 					if (pstate.vs) pstate.vs->Release();
 					if (pstate.gs) pstate.gs->Release();
 					if (pstate.ps) pstate.ps->Release();
+					if (pstate.ps_depth) pstate.ps_depth->Release();
 					if (pstate.cs) pstate.cs->Release();
 					mpstate.erase(name);
 
-					printf("Error SET_SHADER name=%s\n", name.c_str());
+					err_printf("Error SET_SHADER name=%s\n", name.c_str());
 					Sleep(1000);
 				}
 
 				if (pBlobVS) pBlobVS->Release();
 				if (pBlobGS) pBlobGS->Release();
 				if (pBlobPS) pBlobPS->Release();
+				if (pBlobPSDepth) pBlobPSDepth->Release();
 				if (pBlobCS) pBlobCS->Release();
 			}
 			if (pstate.vs) {
-				ctx->OMSetDepthStencilState(pstate.dsstate, 0);
+				auto dsstate = c.set_shader.depth_func == DEPTH_FUNC_EQUAL ? pstate.dsstate_equal : pstate.dsstate;
+				ctx->OMSetDepthStencilState(dsstate, 0);
 				ctx->IASetInputLayout(pstate.layout);
 				ctx->VSSetShader(pstate.vs, NULL, 0);
 				ctx->GSSetShader(pstate.gs, NULL, 0);
-				ctx->PSSetShader(pstate.ps, NULL, 0);
+				//depth only targets run no pixel shader unless it has an alpha test.
+				ctx->PSSetShader(is_depth_only ? pstate.ps_depth : pstate.ps, NULL, 0);
 				ctx->CSSetShader(NULL, NULL, 0);
 			}
 			if (pstate.cs) {
@@ -551,7 +1208,7 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 			if (rtv)
 				ctx->ClearRenderTargetView(rtv, c.clear.color);
 			else
-				printf("Error CMD_CLEAR name=%s not found\n", name.c_str());
+				err_printf("Error CMD_CLEAR name=%s not found\n", name.c_str());
 		}
 
 		//CMD_CLEAR_DEPTH
@@ -560,23 +1217,26 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 			if (dsv)
 				ctx->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH, c.clear_depth.value, 0);
 			else
-				printf("Error CMD_CLEAR name=%s not found\n", name.c_str());
+				err_printf("Error CMD_CLEAR name=%s not found\n", name.c_str());
 		}
 
 
 		//CMD_SET_INDEX
 		if (type == CMD_SET_INDEX) {
 			auto ib = mbuf[name];
-			auto data = c.buf.data();
-			auto size = c.buf.size();
+			auto data = oden_get_cmd_data(c);
+			auto size = oden_get_cmd_size(c);
 			if (size && ib == nullptr) {
+				trace_scope trace("upload", name);
 				D3D11_BUFFER_DESC bd = {
 					size, D3D11_USAGE_DYNAMIC, D3D11_BIND_INDEX_BUFFER, 0, 0, 0
 				};
 				bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 				auto hr = dev->CreateBuffer(&bd, nullptr, &ib);
 				mbuf[name] = ib;
-				printf("name=%s, ib=%p size=%d\n", name.c_str(), ib, size);
+				if (ib)
+					account_memory(name, MEMORY_INDEX, "dynamic", size);
+				info_printf("name=%s, ib=%p size=%zu\n", name.c_str(), ib, size);
 
 				D3D11_MAPPED_SUBRESOURCE msr = {};
 				ctx->Map(ib, 0, D3D11_MAP_WRITE_DISCARD, 0, &msr);
@@ -605,6 +1265,26 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 			ctx->DrawInstanced(count, 1, 0, 0);
 		}
 
+		//CMD_DRAW_INDEX_INSTANCED, CMD_DRAW_INSTANCED
+		if (type == CMD_DRAW_INDEX_INSTANCED) {
+			auto & d = c.draw_instanced;
+			ctx->DrawIndexedInstanced(d.count, d.instance_count, d.start, 0, 0);
+		}
+		if (type == CMD_DRAW_INSTANCED) {
+			auto & d = c.draw_instanced;
+			ctx->DrawInstanced(d.count, d.instance_count, 0, 0);
+		}
+
+		//CMD_DRAW_INDEX_INDIRECT
+		if (type == CMD_DRAW_INDEX_INDIRECT) {
+			auto buf = mstorage[name];
+			unbind_cs_uav(name);
+			if (buf)
+				ctx->DrawIndexedInstancedIndirect(buf, UINT(c.draw_index_indirect.offset));
+			else
+				err_printf("Invalid draw indirect name=%s\n", name.c_str());
+		}
+
 		//CMD_DISPATCH
 		if (type == CMD_DISPATCH) {
 			auto x = c.dispatch.x;
@@ -612,7 +1292,154 @@ oden::oden_present_graphics(const char * appname, std::vector<oden::cmd> & vcmd,
 			auto z = c.dispatch.z;
 			ctx->Dispatch(x, y, z);
 		}
+
+		//CMD_RELEASE
+		//Bound views keep a reference and the runtime defers the destruction until the gpu is done with it.
+		if (type == CMD_RELEASE) {
+			auto tex = mtex[name];
+			if (tex == nullptr || mrtv[name] || mdsv[name]) {
+				err_printf("Invalid release name=%s\n", name.c_str());
+			} else {
+				for (auto it = muav.begin(); it != muav.end();) {
+					if (it->first == name || it->first.find(name + "_miplevel_") == 0) {
+						//muav[name] is also the level 0 entry.
+						if (it->first != name && it->second)
+							it->second->Release();
+						it = muav.erase(it);
+					} else {
+						it++;
+					}
+				}
+				for (auto it = msrv.begin(); it != msrv.end();) {
+					if (it->first == name || it->first.find(name + "_miplevel_") == 0) {
+						if (it->second)
+							it->second->Release();
+						it = msrv.erase(it);
+					} else {
+						it++;
+					}
+				}
+				tex->Release();
+				mtex.erase(name);
+				release_memory(name);
+				release_update_staging(name);
+			}
+		}
+
+		//CMD_UPDATE_TEXTURE
+		if (type == CMD_UPDATE_TEXTURE) {
+			auto tex = mtex[name];
+			D3D11_TEXTURE2D_DESC texdesc = {};
+			if (tex)
+				tex->GetDesc(&texdesc);
+			auto fmt = get_oden_format(texdesc.Format);
+			auto & r = c.set_texture.rect;
+			auto level = c.set_texture.miplevel;
+			auto row_bytes = oden_get_texture_row_bytes(fmt, r.w);
+			auto rows = oden_get_texture_rows(fmt, r.h);
+			size_t stride = c.set_texture.stride_size ? c.set_texture.stride_size : size_t(row_bytes);
+			if (tex == nullptr || mrtv[name] || mdsv[name] || fmt == FMT_DEFAULT || level < 0 || level >= int(texdesc.MipLevels) ||
+				!oden_is_texture_rect_valid(fmt, int(texdesc.Width), int(texdesc.Height), level, r.x, r.y, r.w, r.h) ||
+				oden_get_cmd_size(c) < oden_get_texture_rect_size(fmt, r.w, r.h, stride)) {
+				err_printf("Invalid update name=%s\n", name.c_str());
+			} else {
+				trace_scope trace("upload", name);
+				//Block formats copy whole blocks, also past the edge of the small levels.
+				bool is_block = oden_is_block_format(fmt);
+				UINT sw = is_block ? (r.w + 3) & ~3 : r.w;
+				UINT sh = is_block ? (r.h + 3) & ~3 : r.h;
+				auto & staging = mupdate_staging[name];
+				if (staging.w != sw || staging.h != sh) {
+					release_update_staging(name);
+					auto & fresh = mupdate_staging[name];
+					D3D11_TEXTURE2D_DESC desc = {
+						sw, sh, 1, 1, texdesc.Format, {1, 0},
+						D3D11_USAGE_STAGING, 0, D3D11_CPU_ACCESS_WRITE, 0,
+					};
+					for (auto & x : fresh.vtex)
+						dev->CreateTexture2D(&desc, nullptr, &x);
+					fresh.w = sw;
+					fresh.h = sh;
+					account_memory(name + "_staging", MEMORY_STAGING, "staging", get_texture_bytes(desc) * UpdateStagingMax);
+				}
+				auto & ring = mupdate_staging[name];
+				auto stex = ring.vtex[ring.index];
+				ring.index = (ring.index + 1) % UpdateStagingMax;
+				D3D11_MAPPED_SUBRESOURCE mapped = {};
+				if (stex && SUCCEEDED(ctx->Map(stex, 0, D3D11_MAP_WRITE, 0, &mapped))) {
+					auto data = oden_get_cmd_data(c);
+					for (int i = 0; i < rows; i++)
+						memcpy((uint8_t *)mapped.pData + size_t(mapped.RowPitch) * i, data + stride * i, size_t(row_bytes));
+					ctx->Unmap(stex, 0);
+					D3D11_BOX box = {0, 0, 0, sw, sh, 1};
+					ctx->CopySubresourceRegion(tex, D3D11CalcSubresource(level, 0, texdesc.MipLevels), r.x, r.y, 0, stex, 0, &box);
+				} else {
+					err_printf("ERROR CMD_UPDATE_TEXTURE can't map staging name=%s\n", name.c_str());
+				}
+			}
+		}
+
+		//CMD_GENERATE_MIPS
+		//Feature level 11_0 has 8 compute UAV slots, fewer than a mip chain. The runtime's
+		//GenerateMips makes the whole chain in one call instead of shaders/genmips.hlsl.
+		if (type == CMD_GENERATE_MIPS) {
+			auto tex = mtex[name];
+			D3D11_TEXTURE2D_DESC texdesc = {};
+			if (tex)
+				tex->GetDesc(&texdesc);
+			auto levels = texdesc.MipLevels;
+			if (c.generate_mips.miplevel > 0)
+				levels = (std::min)(levels, (UINT)c.generate_mips.miplevel);
+			auto name_srv = "__genmips__" + name + std::to_string(levels);
+			auto srv = msrv[name_srv];
+			if (srv == nullptr && (texdesc.MiscFlags & D3D11_RESOURCE_MISC_GENERATE_MIPS)) {
+				D3D11_SHADER_RESOURCE_VIEW_DESC desc = {
+					texdesc.Format,
+					D3D11_SRV_DIMENSION_TEXTURE2D,
+					{0, 0},
+				};
+				desc.Texture2D.MipLevels = levels;
+				dev->CreateShaderResourceView(tex, &desc, &srv);
+				msrv[name_srv] = srv;
+			}
+			if (srv)
+				ctx->GenerateMips(srv);
+			else
+				err_printf("Invalid generate mips name=%s\n", name.c_str());
+		}
+
+		auto cmd_ms = get_time_ms() - cmd_start;
+		if (type >= 0 && type < CMD_MAX) {
+			vstats[type].count++;
+			vstats[type].cpu_ms += cmd_ms;
+		}
+
+		segment_cpu_ms += cmd_ms;
+		if (is_pass_end(type))
+			end_segment(name);
+	}
+	if (!vcmd.empty() && !is_pass_end(vcmd.back().type))
+		end_segment(vcmd.back().name);
+	if (is_timestamp)
+		ctx->End(slot.disjoint);
+
+	{
+		std::lock_guard<std::mutex> lock(frame_stats_mtx);
+		for (int i = 0 ; i < CMD_MAX; i++) {
+			vcmd_stats[i].count += vstats[i].count;
+			vcmd_stats[i].cpu_ms += vstats[i].cpu_ms;
+		}
+	}
+
+	slot.submit_ms = get_time_ms();
+	ctx->End(slot.query);
+	if (fence) {
+		ctx4->Signal(fence, ++fence_value);
+		slot.fence_value = fence_value;
 	}
+	slot.is_submitted = true;
+	slot.frame = frame_count;
 	swapchain->Present(1, 0);
+	frame_count++;
 }
 
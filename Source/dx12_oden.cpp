@@ -21,6 +21,9 @@
  *
  */
 #include "ODEN.h"
+#include "oden_trace.h"
+#include "oden_log.h"
+#include "oden_platform.h"
 
 #include <stdio.h>
 #include <windows.h>
@@ -33,6 +36,8 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#include <chrono>
 #include <DirectXMath.h>
 
 #pragma comment(lib, "gdi32.lib")
@@ -45,8 +50,8 @@
 #pragma comment(lib, "d3d12.lib")
 #pragma comment(lib, "D3DCompiler.lib")
 
-#define info_printf(...) printf("INFO:" __FUNCTION__ ":" __VA_ARGS__)
-#define err_printf(...) printf("ERR:" __FUNCTION__ ":" __VA_ARGS__)
+#define info_printf(...) ODEN_LOG_INFO(__VA_ARGS__)
+#define err_printf(...) ODEN_LOG_ERR(__VA_ARGS__)
 
 #ifdef ODEN_SUPPORT_DXR
 #define ID3D12DeviceIF ID3D12Device5
@@ -58,11 +63,203 @@
 
 using namespace oden;
 
+//Written by oden_set_frames_in_flight on the app thread, read by the render thread.
+static std::atomic<uint32_t> frames_in_flight_request {0};
+
+static uint32_t
+get_frames_in_flight(uint32_t num)
+{
+	uint32_t request = frames_in_flight_request.load();
+	return request ? request : num;
+}
+
+static std::mutex frame_stats_mtx;
+static std::vector<frame_stats> vframe_stats;
+static std::vector<cmd_stats> vcmd_stats(CMD_MAX);
+static std::map<std::string, pass_stats> mpass_stats;
+static bool is_pass_stats_updated = false;
+static std::map<std::string, memory_stats> mmemory_stats;
+static uint64_t memory_total = 0;
+static uint64_t memory_high_water = 0;
+
+//Commands up to a draw / dispatch, see oden_get_pass_stats.
+struct pass_segment {
+	std::string name;
+	double cpu_ms;
+	double gpu_ms;
+};
+
+static double
+get_time_ms()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double, std::milli>(now).count();
+}
+
+static void
+push_frame_stats(frame_stats stats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (vframe_stats.size() >= 4096)
+		vframe_stats.erase(vframe_stats.begin(), vframe_stats.begin() + 2048);
+	vframe_stats.push_back(stats);
+}
+
+void
+oden::oden_set_frames_in_flight(uint32_t num)
+{
+	frames_in_flight_request = num;
+}
+
+void
+oden::oden_get_frame_stats(std::vector<frame_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats.insert(vstats.end(), vframe_stats.begin(), vframe_stats.end());
+	vframe_stats.clear();
+}
+
+void
+oden::oden_get_cmd_stats(std::vector<cmd_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats = vcmd_stats;
+	for (auto & x : vcmd_stats)
+		x = {};
+}
+
+static bool
+is_pass_end(int type)
+{
+	return type == CMD_DRAW_INDEX || type == CMD_DRAW || type == CMD_DISPATCH || type == CMD_GENERATE_MIPS ||
+		type == CMD_DRAW_INDEX_INDIRECT || type == CMD_DRAW_INDEX_INSTANCED || type == CMD_DRAW_INSTANCED;
+}
+
+//The gpu trace track lays the passes back to back from the submit.
+static void
+push_pass_stats(uint64_t frame, const std::vector<pass_segment> & vsegments, double submit_ms)
+{
+	auto gpu_start = submit_ms;
+	for (auto & x : vsegments) {
+		if (x.gpu_ms < 0.0)
+			continue;
+		trace_complete("gpu", x.name, gpu_start, gpu_start + x.gpu_ms, ODEN_TRACE_TRACK_GPU);
+		gpu_start += x.gpu_ms;
+	}
+
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mpass_stats.clear();
+	for (auto & x : vsegments) {
+		auto & stats = mpass_stats[x.name];
+		stats.frame = frame;
+		stats.count++;
+		stats.cpu_ms += x.cpu_ms;
+		stats.gpu_ms = x.gpu_ms < 0.0 ? -1.0 : stats.gpu_ms + x.gpu_ms;
+	}
+	is_pass_stats_updated = true;
+}
+
+bool
+oden::oden_get_pass_stats(std::map<std::string, pass_stats> & mstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (!is_pass_stats_updated)
+		return false;
+	mstats = mpass_stats;
+	is_pass_stats_updated = false;
+	return true;
+}
+
+//Replaces the previous entry of the name.
+static void
+account_memory(const std::string & name, int category, const char *heap, uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto & stats = mmemory_stats[name];
+	memory_total = memory_total - stats.bytes + bytes;
+	stats = {category, heap, bytes};
+	memory_high_water = (std::max)(memory_high_water, memory_total);
+}
+
+static void
+release_memory(const std::string & name)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto it = mmemory_stats.find(name);
+	if (it == mmemory_stats.end())
+		return;
+	memory_total -= it->second.bytes;
+	mmemory_stats.erase(it);
+}
+
+static void
+release_memory_all(void)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mmemory_stats.clear();
+	memory_total = 0;
+}
+
+void
+oden::oden_get_memory_stats(std::map<std::string, memory_stats> & mstats, uint64_t & high_water)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mstats = mmemory_stats;
+	high_water = memory_high_water;
+}
+
+bool
+oden::oden_get_backbuffer_readback(std::vector<uint32_t> & vdata, uint32_t & w, uint32_t & h)
+{
+	//Headless readback is implemented by the vulkan backend only.
+	return false;
+}
+
+//One event per queue fence, reused every frame.
+static void
+wait_fence(ID3D12Fence *fence, uint64_t value, HANDLE hevent)
+{
+	if (fence->GetCompletedValue() >= value)
+		return;
+	trace_scope trace("wait", "fence " + std::to_string(value));
+	fence->SetEventOnCompletion(value, hevent);
+	WaitForSingleObject(hevent, INFINITE);
+}
+
+static DXGI_FORMAT
+get_dxgi_format(int fmt)
+{
+	static const DXGI_FORMAT tbl[FMT_MAX] = {
+		DXGI_FORMAT_UNKNOWN,
+		DXGI_FORMAT_R8G8B8A8_UNORM,
+		DXGI_FORMAT_R16G16B16A16_FLOAT,
+		DXGI_FORMAT_R11G11B10_FLOAT,
+		DXGI_FORMAT_R16G16_FLOAT,
+		DXGI_FORMAT_R8_UNORM,
+		DXGI_FORMAT_BC1_UNORM,
+		DXGI_FORMAT_BC4_UNORM,
+		DXGI_FORMAT_BC5_UNORM,
+		DXGI_FORMAT_BC7_UNORM,
+		DXGI_FORMAT_R32_FLOAT,
+	};
+	return (fmt >= 0 && fmt < FMT_MAX) ? tbl[fmt] : DXGI_FORMAT_UNKNOWN;
+}
+
+static int
+get_oden_format(DXGI_FORMAT fmt)
+{
+	for (int i = FMT_DEFAULT + 1; i < FMT_MAX; i++)
+		if (get_dxgi_format(i) == fmt)
+			return i;
+	return FMT_DEFAULT;
+}
+
 static ID3D12Resource *
-create_resource(std::string name, ID3D12Device *dev,
+create_resource(std::string name, int category, ID3D12Device *dev,
 	int w, int h, DXGI_FORMAT fmt, D3D12_RESOURCE_FLAGS flags,
-	BOOL is_upload = FALSE, void *data = 0, size_t size = 0)
+	BOOL is_upload = FALSE, const void *data = 0, size_t size = 0, int mips = 0)
 {
+	trace_scope trace(data ? "upload" : "resource", name);
 	ID3D12Resource *res = nullptr;
 	D3D12_RESOURCE_DESC desc = {
 		D3D12_RESOURCE_DIMENSION_TEXTURE2D, 0, UINT64(w), UINT(h), 1, 1, fmt,
@@ -73,8 +270,9 @@ create_resource(std::string name, ID3D12Device *dev,
 		D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
 		D3D12_MEMORY_POOL_UNKNOWN, 1, 1,
 	};
+	//0 : the whole chain.
 	int maxmips = oden_get_mipmap_max(w, h);
-	desc.MipLevels = maxmips;
+	desc.MipLevels = mips > 0 ? (std::min)(mips, maxmips) : maxmips;
 
 	if (is_upload) {
 		hprop.Type = D3D12_HEAP_TYPE_UPLOAD;
@@ -87,6 +285,10 @@ create_resource(std::string name, ID3D12Device *dev,
 	auto hr = dev->CreateCommittedResource(&hprop, D3D12_HEAP_FLAG_NONE, &desc, state, nullptr, IID_PPV_ARGS(&res));
 	if (hr)
 		err_printf("name=%s: w=%d, h=%d, flags=%08X, hr=%08X\n", name.c_str(), w, h, flags, hr);
+	if (res) {
+		auto info = dev->GetResourceAllocationInfo(0, 1, &desc);
+		account_memory(name, category, is_upload ? "upload" : "default", info.SizeInBytes);
+	}
 	info_printf("name=%s: w=%d, h=%d, flags=%08X\n", name.c_str(), w, h, flags);
 	if (res && is_upload && data) {
 		UINT8 *dest = nullptr;
@@ -119,6 +321,7 @@ static D3D12_SHADER_BYTECODE
 create_shader_from_file(std::string fstr, std::string entry, std::string profile,
 	std::vector<uint8_t> &shader_code)
 {
+	trace_scope trace("shader", fstr + ":" + entry);
 	ID3DBlob *blob = nullptr;
 	ID3DBlob *blob_err = nullptr;
 	ID3DBlob *blob_sig = nullptr;
@@ -131,11 +334,11 @@ create_shader_from_file(std::string fstr, std::string entry, std::string profile
 	D3DCompileFromFile(&wfname[0], NULL, D3D_COMPILE_STANDARD_FILE_INCLUDE,
 		entry.c_str(), profile.c_str(), flags, 0, &blob, &blob_err);
 	if (blob_err) {
-		printf("%s:\n%s\n", __FUNCTION__, (char *) blob_err->GetBufferPointer());
+		err_printf("\n%s\n", (char *) blob_err->GetBufferPointer());
 		blob_err->Release();
 	}
 	if (!blob && !blob_err)
-		printf("File Not found : %s\n", fstr.c_str());
+		err_printf("File Not found : %s\n", fstr.c_str());
 	if (!blob)
 		return {nullptr, 0};
 	shader_code.resize(blob->GetBufferSize());
@@ -157,30 +360,136 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		RDT_SLOT_UAV,
 		RDT_SLOT_MAX,
 	};
+	//CMD_GENERATE_MIPS : shaders/genmips.hlsl binds every level of a render target as mip[GENMIPS_MAX].
+	enum {
+		GENMIPS_MAX = 16,
+		GENMIPS_TILE = 64,
+		RDT_GENMIPS_CONSTANT = 0,
+		RDT_GENMIPS_UAV,
+		RDT_GENMIPS_COUNTER,
+		RDT_GENMIPS_MAX,
+	};
 	struct DeviceBuffer {
 		ID3D12CommandAllocator *cmdalloc = nullptr;
 		ID3D12GraphicsCommandListIF *cmdlist = nullptr;
-		ID3D12Fence *fence = nullptr;
 		std::vector<ID3D12Resource *> vscratch;
+		std::vector<std::string> vscratch_names;
+		std::vector<uint64_t> vfree_handles; //of released textures, reusable once the frame completed.
 		uint64_t value = 0;
+
+		//staging of CMD_UPDATE_TEXTURE, mapped while it lives. A full one goes to vscratch and a larger one replaces it.
+		ID3D12Resource *upload = nullptr;
+		uint8_t *upload_data = nullptr;
+		uint64_t upload_size = 0;
+		uint64_t upload_offset = 0;
+
+		//frame pacing
+		bool is_submitted = false;
+		uint64_t frame = 0;
+		double submit_ms = 0.0;
+		double cpu_wait_ms = 0.0;
+
+		//pass timestamps. query 0 is the frame start, query n + 1 the end of vsegments[n].
+		ID3D12QueryHeap *query_heap = nullptr;
+		ID3D12Resource *query_readback = nullptr;
+		uint32_t query_max = 0;
+		std::vector<pass_segment> vsegments;
 	};
 	static std::vector<DeviceBuffer> devicebuffer;
 	static ID3D12Device *dev = nullptr;
 	static ID3D12CommandQueue *queue = nullptr;
+	static ID3D12Fence *fence = nullptr;
+	static HANDLE fence_event = nullptr;
+	static uint64_t fence_value = 0;
 	static IDXGISwapChain3 *swapchain = nullptr;
+	static HANDLE frame_latency_waitable = nullptr;
 	static ID3D12DescriptorHeap *heap_rtv = nullptr;
 	static ID3D12DescriptorHeap *heap_dsv = nullptr;
 	static ID3D12DescriptorHeap *heap_shader = nullptr;
 	static ID3D12RootSignature *rootsig = nullptr;
+	static ID3D12RootSignature *rootsig_genmips = nullptr;
+	static ID3D12PipelineState *pstate_genmips = nullptr;
+	static ID3D12CommandSignature *cmdsig_draw_index = nullptr; //CMD_DRAW_INDEX_INDIRECT
 	static std::map<std::string, ID3D12Resource *> mres;
 	static std::map<std::string, ID3D12PipelineState *> mpstate;
 	static std::map<std::string, uint64_t> mcpu_handle;
 	static std::map<std::string, uint64_t> mgpu_handle;
+	static std::map<std::string, D3D12_RESOURCE_STATES> mbuffer_state; //CMD_SET_BUFFER, kept over the frames.
 	static uint64_t handle_index_rtv = 0;
 	static uint64_t handle_index_dsv = 0;
 	static uint64_t handle_index_shader = 0;
+	static std::vector<uint64_t> vfree_shader_handles;
 	static uint64_t deviceindex = 0;
 	static uint64_t frame_count = 0;
+	static uint64_t timestamp_frequency = 0;
+
+	auto create_frame_resources = [&](uint32_t num) {
+		devicebuffer.resize(num);
+		for (auto & x : devicebuffer) {
+			dev->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&x.cmdalloc));
+			dev->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, x.cmdalloc, nullptr, IID_PPV_ARGS(&x.cmdlist));
+			x.cmdlist->Close();
+		}
+		swapchain->SetMaximumFrameLatency(num);
+	};
+
+	auto collect_frame_stats = [&](DeviceBuffer & ref) {
+		if (!ref.is_submitted)
+			return;
+		frame_stats stats = {};
+		stats.frame = ref.frame;
+		stats.frames_in_flight = (uint32_t)devicebuffer.size();
+		stats.cpu_wait_ms = ref.cpu_wait_ms;
+		//Without the timestamps, to the fence seen signaled.
+		stats.latency_ms = get_time_ms() - ref.submit_ms;
+		ref.is_submitted = false;
+
+		uint64_t *timestamps = nullptr;
+		D3D12_RANGE range = {0, sizeof(uint64_t) * (ref.vsegments.size() + 1)};
+		if (ref.query_readback && timestamp_frequency)
+			ref.query_readback->Map(0, &range, (void **)&timestamps);
+		if (timestamps) {
+			for (size_t i = 0; i < ref.vsegments.size(); i++)
+				ref.vsegments[i].gpu_ms = double(timestamps[i + 1] - timestamps[i]) * 1000.0 / double(timestamp_frequency);
+
+			//The end of frame timestamp on QueryPerformanceCounter, then on get_time_ms.
+			UINT64 gpu_now = 0;
+			UINT64 cpu_now = 0;
+			auto host_ms = oden_platform_get_host_ms(oden_platform_get_host_ticks());
+			auto now_ms = get_time_ms();
+			if (!ref.vsegments.empty() && SUCCEEDED(queue->GetClockCalibration(&gpu_now, &cpu_now))) {
+				auto ticks = gpu_now - timestamps[ref.vsegments.size()];
+				auto end_ms = oden_platform_get_host_ms(cpu_now) - double(ticks) * 1000.0 / double(timestamp_frequency);
+				stats.latency_ms = end_ms + (now_ms - host_ms) - ref.submit_ms;
+			}
+			D3D12_RANGE written = {0, 0};
+			ref.query_readback->Unmap(0, &written);
+		}
+		push_frame_stats(stats);
+		push_pass_stats(ref.frame, ref.vsegments, ref.submit_ms);
+	};
+
+	auto destroy_frame_resources = [&]() {
+		for (size_t i = 0; i < devicebuffer.size(); i++) {
+			auto & ref = devicebuffer[i];
+			wait_fence(fence, ref.value, fence_event);
+			collect_frame_stats(ref);
+			for (auto & scratch : ref.vscratch)
+				scratch->Release();
+			for (auto & name : ref.vscratch_names)
+				release_memory(name);
+			if (ref.upload) {
+				ref.upload->Unmap(0, nullptr);
+				ref.upload->Release();
+			}
+			release_memory("__upload__" + std::to_string(i));
+			if (ref.query_heap) ref.query_heap->Release();
+			if (ref.query_readback) ref.query_readback->Release();
+			if (ref.cmdlist) ref.cmdlist->Release();
+			if (ref.cmdalloc) ref.cmdalloc->Release();
+		}
+		devicebuffer.clear();
+	};
 
 	if (dev == nullptr) {
 		D3D12_COMMAND_QUEUE_DESC cqdesc = {};
@@ -195,6 +504,15 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		}
 #endif //DEBUG
 		D3D12CreateDevice(NULL, D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&dev));
+#ifdef DEBUG
+		//Break on the errors of the debug layer, a run without a debugger then fails (batfiles/check_dx.bat).
+		ID3D12InfoQueue *info_queue = nullptr;
+		if (dev && SUCCEEDED(dev->QueryInterface(IID_PPV_ARGS(&info_queue)))) {
+			info_queue->SetBreakOnSeverity(D3D12_MESSAGE_SEVERITY_CORRUPTION, TRUE);
+			info_queue->SetBreakOnSeverity(D3D12_MESSAGE_SEVERITY_ERROR, TRUE);
+			info_queue->Release();
+		}
+#endif //DEBUG
 #ifdef ODEN_SUPPORT_DXR
 		{
 			D3D12_FEATURE_DATA_D3D12_OPTIONS5 options5 = {};
@@ -205,6 +523,9 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		}
 #endif //ODEN_SUPPORT_DXR
 		dev->CreateCommandQueue(&cqdesc, IID_PPV_ARGS(&queue));
+		queue->GetTimestampFrequency(&timestamp_frequency);
+		dev->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence));
+		fence_event = CreateEvent(NULL, FALSE, FALSE, NULL);
 		dev->CreateDescriptorHeap(&dhdesc_rtv, IID_PPV_ARGS(&heap_rtv));
 		dev->CreateDescriptorHeap(&dhdesc_dsv, IID_PPV_ARGS(&heap_dsv));
 		dev->CreateDescriptorHeap(&dhdesc_shader, IID_PPV_ARGS(&heap_shader));
@@ -229,21 +550,19 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		temp->QueryInterface(IID_PPV_ARGS(&swapchain));
 		temp->Release();
 		factory->Release();
+		frame_latency_waitable = swapchain->GetFrameLatencyWaitableObject();
 
-		devicebuffer.resize(num);
-		for (int i = 0; i < num; i++) {
-			auto & x = devicebuffer[i];
-			dev->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&x.cmdalloc));
-			dev->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, x.cmdalloc, nullptr, IID_PPV_ARGS(&x.cmdlist));
-			dev->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&x.fence));
-			x.cmdlist->Close();
-			x.value = i;
-		}
+		create_frame_resources(get_frames_in_flight(num));
 
 		for (int i = 0 ; i < num; i++) {
 			ID3D12Resource *res = nullptr;
 			swapchain->GetBuffer(i, IID_PPV_ARGS(&res));
 			mres[oden_get_backbuffer_name(i)] = res;
+			if (res) {
+				auto desc = res->GetDesc();
+				auto info = dev->GetResourceAllocationInfo(0, 1, &desc);
+				account_memory(oden_get_backbuffer_name(i), MEMORY_RT_COLOR, "swapchain", info.SizeInBytes);
+			}
 		}
 
 		D3D12_ROOT_SIGNATURE_DESC root_signature_desc = {};
@@ -302,6 +621,32 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		hr = dev->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&rootsig));
 		if (perrblob) perrblob->Release();
 		if (signature) signature->Release();
+		perrblob = nullptr;
+		signature = nullptr;
+
+		//genmips : b0 {mips, groups}, u0-u15 levels, u0 space1 counter.
+		D3D12_DESCRIPTOR_RANGE genmips_range = {D3D12_DESCRIPTOR_RANGE_TYPE_UAV, GENMIPS_MAX, 0, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND};
+		D3D12_ROOT_PARAMETER genmips_param[RDT_GENMIPS_MAX] = {};
+		genmips_param[RDT_GENMIPS_CONSTANT].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+		genmips_param[RDT_GENMIPS_CONSTANT].Constants = {0, 0, 2};
+		genmips_param[RDT_GENMIPS_UAV].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+		genmips_param[RDT_GENMIPS_UAV].DescriptorTable = {1, &genmips_range};
+		genmips_param[RDT_GENMIPS_COUNTER].ParameterType = D3D12_ROOT_PARAMETER_TYPE_UAV;
+		genmips_param[RDT_GENMIPS_COUNTER].Descriptor = {0, 1};
+		D3D12_ROOT_SIGNATURE_DESC genmips_desc = {RDT_GENMIPS_MAX, genmips_param, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE};
+		hr = D3D12SerializeRootSignature(&genmips_desc, D3D_ROOT_SIGNATURE_VERSION_1_0, &signature, &perrblob);
+		if (hr && perrblob) {
+			err_printf("Failed D3D12SerializeRootSignature(genmips):\n%s\n", (char *) perrblob->GetBufferPointer());
+			exit(1);
+		}
+		hr = dev->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&rootsig_genmips));
+		if (perrblob) perrblob->Release();
+		if (signature) signature->Release();
+
+		//draw_index_indirect_args is D3D12_DRAW_INDEXED_ARGUMENTS.
+		D3D12_INDIRECT_ARGUMENT_DESC indirect_arg = {D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED};
+		D3D12_COMMAND_SIGNATURE_DESC cmdsig_desc = {sizeof(draw_index_indirect_args), 1, &indirect_arg, 0};
+		dev->CreateCommandSignature(&cmdsig_desc, nullptr, IID_PPV_ARGS(&cmdsig_draw_index));
 	};
 
 	{
@@ -313,22 +658,40 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 	}
 
 	std::map<std::string, D3D12_RESOURCE_TRANSITION_BARRIER> mbarrier;
-	deviceindex = swapchain->GetCurrentBackBufferIndex();
 
-	auto & ref = devicebuffer[deviceindex];
+	//Frame pacing. frames in flight is independent of the swapchain buffer count.
+	for (auto & x : devicebuffer)
+		if (x.is_submitted && fence->GetCompletedValue() >= x.value)
+			collect_frame_stats(x);
 
-	queue->Signal(ref.fence, ref.value);
-	if (ref.fence->GetCompletedValue() < ref.value) {
-		auto hevent = CreateEvent(NULL, FALSE, FALSE, NULL);
-		ref.fence->SetEventOnCompletion(ref.value, hevent);
-		WaitForSingleObject(hevent, INFINITE);
-		CloseHandle(hevent);
+	uint32_t frames_in_flight = get_frames_in_flight(num);
+	if (hwnd && devicebuffer.size() != frames_in_flight) {
+		info_printf("frames in flight %zu -> %u\n", devicebuffer.size(), frames_in_flight);
+		destroy_frame_resources();
+		create_frame_resources(frames_in_flight);
+	}
+
+	trace_scope trace_frame("frame", "frame " + std::to_string(frame_count));
+	deviceindex = frame_count % devicebuffer.size();
+	auto & ref = devicebuffer[deviceindex];
+	{
+		auto start = get_time_ms();
+		if (hwnd && frame_latency_waitable)
+			WaitForSingleObjectEx(frame_latency_waitable, 1000, TRUE);
+		wait_fence(fence, ref.value, fence_event);
+		collect_frame_stats(ref);
+		ref.cpu_wait_ms = get_time_ms() - start;
 	}
-	ref.value++;
 
 	for (auto & scratch : ref.vscratch)
 		scratch->Release();
 	ref.vscratch.clear();
+	for (auto & name : ref.vscratch_names)
+		release_memory(name);
+	ref.vscratch_names.clear();
+	vfree_shader_handles.insert(vfree_shader_handles.end(), ref.vfree_handles.begin(), ref.vfree_handles.end());
+	ref.vfree_handles.clear();
+	ref.upload_offset = 0;
 
 	if (hwnd == nullptr) {
 		auto release = [](auto & x) {
@@ -338,18 +701,25 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		auto mrelease = [](auto & m, auto release) {
 			for (auto & p : m) {
 				if (p.second)
-					printf("%s : release=%s\n", __FUNCTION__, p.first.c_str());
+					info_printf("release=%s\n", p.first.c_str());
 				release(p.second);
 			}
 			m.clear();
 		};
-		for (auto & ref : devicebuffer) {
-			release(ref.fence);
-			release(ref.cmdlist);
-			release(ref.cmdalloc);
-		}
+		destroy_frame_resources();
+		release(fence);
+		CloseHandle(fence_event);
+		fence_event = nullptr;
+		if (frame_latency_waitable)
+			CloseHandle(frame_latency_waitable);
+		frame_latency_waitable = nullptr;
 		mrelease(mres, release);
+		mbuffer_state.clear();
+		release_memory_all();
 		mrelease(mpstate, release);
+		release(cmdsig_draw_index);
+		release(pstate_genmips);
+		release(rootsig_genmips);
 		release(rootsig);
 		release(heap_shader);
 		release(heap_dsv);
@@ -357,6 +727,7 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		release(swapchain);
 		release(queue);
 		release(dev);
+		log_flush();
 		return;
 	}
 
@@ -366,13 +737,102 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 	ref.cmdlist->SetComputeRootSignature(rootsig);
 	ref.cmdlist->SetDescriptorHeaps(1, &heap_shader);
 
+	//One timestamp per draw / dispatch, and the frame start and end.
+	{
+		uint32_t query_count = 2;
+		for (auto & c : vcmd)
+			if (is_pass_end(c.type))
+				query_count++;
+		if (query_count > ref.query_max) {
+			if (ref.query_heap) ref.query_heap->Release();
+			if (ref.query_readback) ref.query_readback->Release();
+			ref.query_heap = nullptr;
+			ref.query_readback = nullptr;
+			ref.query_max = query_count * 2;
+
+			D3D12_QUERY_HEAP_DESC qhdesc = { D3D12_QUERY_HEAP_TYPE_TIMESTAMP, ref.query_max, 0 };
+			D3D12_HEAP_PROPERTIES hprop = {
+				D3D12_HEAP_TYPE_READBACK,
+				D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+				D3D12_MEMORY_POOL_UNKNOWN, 1, 1,
+			};
+			D3D12_RESOURCE_DESC desc = {
+				D3D12_RESOURCE_DIMENSION_BUFFER, 0, sizeof(uint64_t) * ref.query_max, 1, 1, 1, DXGI_FORMAT_UNKNOWN,
+				{1, 0}, D3D12_TEXTURE_LAYOUT_ROW_MAJOR, D3D12_RESOURCE_FLAG_NONE
+			};
+			dev->CreateQueryHeap(&qhdesc, IID_PPV_ARGS(&ref.query_heap));
+			dev->CreateCommittedResource(&hprop, D3D12_HEAP_FLAG_NONE, &desc,
+				D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&ref.query_readback));
+		}
+	}
+	ref.vsegments.clear();
+	if (ref.query_heap)
+		ref.cmdlist->EndQuery(ref.query_heap, D3D12_QUERY_TYPE_TIMESTAMP, 0);
+
+	std::vector<cmd_stats> vstats(CMD_MAX);
+	double segment_cpu_ms = 0.0;
+	double segment_start = get_time_ms();
+	auto end_segment = [&](const std::string & name) {
+		ref.vsegments.push_back({name, segment_cpu_ms, timestamp_frequency ? 0.0 : -1.0});
+		segment_cpu_ms = 0.0;
+		auto segment_end = get_time_ms();
+		trace_complete("translate", name, segment_start, segment_end);
+		segment_start = segment_end;
+		if (ref.query_heap)
+			ref.cmdlist->EndQuery(ref.query_heap, D3D12_QUERY_TYPE_TIMESTAMP, (UINT)ref.vsegments.size());
+	};
+
+	//The upload ring of the frame slot for CMD_UPDATE_TEXTURE and the buffers. Returns the offset of bytes.
+	auto alloc_upload = [&](const std::string & name, uint64_t bytes, uint64_t alignment) {
+		auto offset = (ref.upload_offset + alignment - 1) & ~(alignment - 1);
+		if (offset + bytes > ref.upload_size) {
+			//The copies recorded before read the full one until this frame completes.
+			if (ref.upload) {
+				ref.upload->Unmap(0, nullptr);
+				ref.vscratch.push_back(ref.upload);
+			}
+			ref.upload_size = (std::max)(ref.upload_size * 2, (bytes + 0xFFFF) & ~uint64_t(0xFFFF));
+			ref.upload = create_resource("__upload__" + std::to_string(deviceindex), MEMORY_STAGING, dev,
+					int(ref.upload_size), 1, DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE);
+			ref.upload_data = nullptr;
+			if (ref.upload)
+				ref.upload->Map(0, nullptr, (void **)&ref.upload_data);
+			if (ref.upload_data == nullptr) {
+				err_printf("CAN'T MAP upload name=%s, size=%llu\n", name.c_str(), ref.upload_size);
+				exit(1);
+			}
+			offset = 0;
+		}
+		ref.upload_offset = offset + bytes;
+		return offset;
+	};
+
+	//Buffers change the state on use. UAV to UAV waits for the previous writes.
+	auto transition_buffer = [&](const std::string & name, D3D12_RESOURCE_STATES after) {
+		auto res = mres[name];
+		auto & state = mbuffer_state[name];
+		D3D12_RESOURCE_BARRIER barrier = get_barrier(res, state, after);
+		if (state == after && after == D3D12_RESOURCE_STATE_UNORDERED_ACCESS) {
+			barrier = {};
+			barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+			barrier.UAV.pResource = res;
+		} else if (state == after) {
+			return;
+		}
+		ref.cmdlist->ResourceBarrier(1, &barrier);
+		state = after;
+	};
+
+	//Pipeline states are made for the formats of the bound render targets.
+	DXGI_FORMAT fmt_rt[RENDER_TARGET_MAX] = {DXGI_FORMAT_R16G16B16A16_FLOAT};
+	int rt_count = 1;
+	bool is_depth_only = false;
 	for (auto & c : vcmd) {
 		auto type = c.type;
 		auto name = c.name;
+		auto cmd_start = get_time_ms();
 		auto res = mres[name];
-		auto pstate = mpstate[name];
 
-		auto fmt_color = DXGI_FORMAT_R16G16B16A16_FLOAT;
 		auto fmt_depth = DXGI_FORMAT_D32_FLOAT;
 
 		//CMD_SET_BARRIER
@@ -401,25 +861,39 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		if (type == CMD_SET_RENDER_TARGET) {
 			auto x = c.set_render_target.rect.x;
 			auto y = c.set_render_target.rect.y;
-			auto w = c.set_render_target.rect.w;
-			auto h = c.set_render_target.rect.h;
-			auto name_color = name;
+			int w = 0;
+			int h = 0;
+			oden_get_render_target_size(c, w, h);
 			auto name_depth = oden_get_depth_render_target_name(name);
-			auto cpu_handle_color = heap_rtv->GetCPUDescriptorHandleForHeapStart();
 			auto cpu_handle_depth = heap_dsv->GetCPUDescriptorHandleForHeapStart();
+			D3D12_CPU_DESCRIPTOR_HANDLE vcpu_handle_color[RENDER_TARGET_MAX] = {};
+			is_depth_only = c.set_render_target.is_depth_only;
+			rt_count = is_depth_only ? 0 : oden_get_render_target_count(c);
+			if (c.set_render_target.is_backbuffer && (rt_count > 1 || is_depth_only)) {
+				err_printf("CMD_SET_RENDER_TARGET name=%s, backbuffer with count=%d\n", name.c_str(), rt_count);
+				exit(1);
+			}
 
-			{
+			for (int i = 0; i < rt_count; i++) {
+				auto name_color = oden_get_color_render_target_name(name, i);
 				auto res = mres[name_color];
 				if (res == nullptr) {
-					res = create_resource(name_color, dev, w, h, fmt_color,
+					auto fmt = oden_get_render_target_format(c, i);
+					auto fmt_color = get_dxgi_format(fmt);
+					if (fmt_color == DXGI_FORMAT_UNKNOWN || oden_is_block_format(fmt)) {
+						err_printf("create_resource(rtv) name=%s, fmt=%s\n", name_color.c_str(), oden_get_format_name(fmt));
+						exit(1);
+					}
+					res = create_resource(name_color, MEMORY_RT_COLOR, dev, w, h, fmt_color,
 							D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 					if (!res) {
-						err_printf("create_resource(rtv) name=%s\n", name.c_str());
+						err_printf("create_resource(rtv) name=%s\n", name_color.c_str());
 						exit(1);
 					}
 					mres[name_color] = res;
 				}
 
+				auto cpu_handle_color = heap_rtv->GetCPUDescriptorHandleForHeapStart();
 				if (mcpu_handle.count(name_color) == 0) {
 					D3D12_RENDER_TARGET_VIEW_DESC desc = {};
 					auto res_desc = res->GetDesc();
@@ -434,12 +908,21 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 
 				auto cpu_index = mcpu_handle[name_color];
 				cpu_handle_color.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * cpu_index;
+				vcpu_handle_color[i] = cpu_handle_color;
+				fmt_rt[i] = res->GetDesc().Format;
+
+				if (mbarrier.count(name_color)) {
+					D3D12_RESOURCE_BARRIER barrier = get_barrier(nullptr, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON);
+					barrier.Transition = mbarrier[name_color];
+					barrier.Transition.pResource = mres[name_color];
+					ref.cmdlist->ResourceBarrier(1, &barrier);
+				}
 			}
 
 			{
 				auto res = mres[name_depth];
 				if (res == nullptr) {
-					res = create_resource(name_depth, dev, w, h, fmt_depth, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+					res = create_resource(name_depth, MEMORY_RT_DEPTH, dev, w, h, fmt_depth, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
 					if (!res) {
 						err_printf("create_resource(dsv) name=%s\n", name.c_str());
 						exit(1);
@@ -460,12 +943,6 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 				auto cpu_index = mcpu_handle[name_depth];
 				cpu_handle_depth.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV) * cpu_index;
 			}
-			if (mbarrier.count(name_color)) {
-				D3D12_RESOURCE_BARRIER barrier = get_barrier(nullptr, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON);
-				barrier.Transition = mbarrier[name_color];
-				barrier.Transition.pResource = mres[name_color];
-				ref.cmdlist->ResourceBarrier(1, &barrier);
-			}
 
 			if (mbarrier.count(name_depth)) {
 				D3D12_RESOURCE_BARRIER barrier = get_barrier(nullptr, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON);
@@ -475,11 +952,14 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 			}
 
 
-			D3D12_VIEWPORT viewport = { FLOAT(x), FLOAT(y), FLOAT(w), FLOAT(h), 0.0f, 1.0f };
-			D3D12_RECT rect = { x, y, w, h };
+			//targets keep their size, the rect draws into a part of them.
+			auto rw = c.set_render_target.rect.w;
+			auto rh = c.set_render_target.rect.h;
+			D3D12_VIEWPORT viewport = { FLOAT(x), FLOAT(y), FLOAT(rw), FLOAT(rh), 0.0f, 1.0f };
+			D3D12_RECT rect = { x, y, x + rw, y + rh };
 			ref.cmdlist->RSSetViewports(1, &viewport);
 			ref.cmdlist->RSSetScissorRects(1, &rect);
-			ref.cmdlist->OMSetRenderTargets(1, &cpu_handle_color, FALSE, &cpu_handle_depth);
+			ref.cmdlist->OMSetRenderTargets(rt_count, vcpu_handle_color, FALSE, &cpu_handle_depth);
 		}
 
 		//CMD_SET_TEXTURE
@@ -491,57 +971,95 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 			auto slot = c.set_texture.slot;
 
 			if (res == nullptr) {
-				auto data = c.buf.data();
-				auto size = c.buf.size();
+				auto data = oden_get_cmd_data(c);
+				auto size = oden_get_cmd_size(c);
 				info_printf("res=null : name=%s\n", name.c_str());
-				fmt_color = DXGI_FORMAT_R8G8B8A8_UNORM;
-				res = create_resource(name, dev, w, h, fmt_color, D3D12_RESOURCE_FLAG_NONE);
+				auto fmt = oden_get_texture_format(c.set_texture.fmt);
+				if (get_dxgi_format(fmt) == DXGI_FORMAT_UNKNOWN) {
+					err_printf("create_resource(texture) name=%s, fmt=%s\n", name.c_str(), oden_get_format_name(fmt));
+					exit(1);
+				}
+				auto mips = (std::max)(c.set_texture.mips, 1);
+				if (size && size < oden_get_texture_level_offset(fmt, w, h, mips, c.set_texture.stride_size)) {
+					err_printf("create_resource(texture) name=%s, size=%zu, mips=%d\n", name.c_str(), size, mips);
+					exit(1);
+				}
+				res = create_resource(name, MEMORY_TEXTURE, dev, w, h, get_dxgi_format(fmt), D3D12_RESOURCE_FLAG_NONE,
+						FALSE, nullptr, 0, mips);
 				if (!res) {
 					err_printf("create_resource(texture) name=%s\n", name.c_str());
 					exit(1);
 				}
-				auto scratch = create_resource(name, dev, size, 1,
-						DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, data, size);
+				mres[name] = res;
+
+				D3D12_RESOURCE_DESC desc_res = res->GetDesc();
+				UINT levels = desc_res.MipLevels;
+				std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> vfootprint(levels);
+				std::vector<UINT64> vrow_bytes(levels);
+				std::vector<UINT> vnum_rows(levels);
+				UINT64 total_bytes = 0;
+				dev->GetCopyableFootprints(&desc_res, 0, levels, 0, vfootprint.data(), vnum_rows.data(), vrow_bytes.data(), &total_bytes);
+
+				//Rows (block rows) of the staging buffer are RowPitch aligned. Levels after 0 are packed in data.
+				std::vector<uint8_t> vstaging(total_bytes);
+				for (UINT l = 0; l < levels && size; l++) {
+					auto & footprint = vfootprint[l];
+					auto row_bytes = size_t(vrow_bytes[l]);
+					size_t stride = (l == 0 && c.set_texture.stride_size) ? c.set_texture.stride_size : row_bytes;
+					auto src_data = data + oden_get_texture_level_offset(fmt, w, h, l, c.set_texture.stride_size);
+					for (UINT i = 0; i < vnum_rows[l]; i++)
+						memcpy(vstaging.data() + footprint.Offset + footprint.Footprint.RowPitch * i, src_data + stride * i, row_bytes);
+				}
+				auto scratch_name = name + "_staging";
+				auto scratch = create_resource(scratch_name, MEMORY_STAGING, dev, int(total_bytes), 1,
+						DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, vstaging.data(), vstaging.size());
 				if (!scratch) {
 					err_printf("create_resource(texture scratch) name=%s\n", name.c_str());
 					exit(1);
 				}
 				ref.vscratch.push_back(scratch);
-				mres[name] = res;
-
-				D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
-				D3D12_TEXTURE_COPY_LOCATION dest = {};
-				D3D12_TEXTURE_COPY_LOCATION src = {};
-				D3D12_RESOURCE_DESC desc_res = res->GetDesc();
-				UINT64 total_bytes = 0;
-				UINT subres_index = 0;
-
-				dev->GetCopyableFootprints(&desc_res, subres_index, 1, 0, &footprint, nullptr, nullptr, &total_bytes);
-				dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-				src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-				dest.pResource = res;
-				src.pResource = scratch;
-
-				dest.SubresourceIndex = subres_index;
-				src.PlacedFootprint = footprint;
-				ref.cmdlist->CopyTextureRegion(&dest, 0, 0, 0, &src, nullptr);
+				ref.vscratch_names.push_back(scratch_name);
+
+				for (UINT l = 0; l < levels; l++) {
+					D3D12_TEXTURE_COPY_LOCATION dest = {};
+					D3D12_TEXTURE_COPY_LOCATION src = {};
+					dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+					src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+					dest.pResource = res;
+					src.pResource = scratch;
+					dest.SubresourceIndex = l;
+					src.PlacedFootprint = vfootprint[l];
+					ref.cmdlist->CopyTextureRegion(&dest, 0, 0, 0, &src, nullptr);
+				}
 				D3D12_RESOURCE_BARRIER barrier = get_barrier(res, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
 				ref.cmdlist->ResourceBarrier(1, &barrier);
 			}
 			D3D12_RESOURCE_DESC desc_res = res->GetDesc();
 			if (type == CMD_SET_TEXTURE) {
-				if (mgpu_handle.count(name) == 0) {
+				//A view from miplevel, the finer levels are not read.
+				auto miplevel = (std::min)((std::max)(c.set_texture.miplevel, 0), int(desc_res.MipLevels) - 1);
+				auto name_srv = miplevel > 0 ? oden_get_mipmap_name(name, miplevel) + "_srv" : name;
+				if (mgpu_handle.count(name_srv) == 0) {
 					D3D12_SHADER_RESOURCE_VIEW_DESC desc = {};
-					desc.Format = fmt_color;
+					desc.Format = desc_res.Format;
 					if (name.find("depth") != std::string::npos)
 						desc.Format = DXGI_FORMAT_R32_FLOAT;
 					desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
 					desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-					desc.Texture2D.MipLevels = desc_res.MipLevels;
-					cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * handle_index_shader;
+					desc.Texture2D.MostDetailedMip = miplevel;
+					desc.Texture2D.MipLevels = desc_res.MipLevels - miplevel;
+					//reuse the descriptor of a released texture.
+					uint64_t index = handle_index_shader;
+					if (vfree_shader_handles.empty()) {
+						handle_index_shader++;
+					} else {
+						index = vfree_shader_handles.back();
+						vfree_shader_handles.pop_back();
+					}
+					cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * index;
 					dev->CreateShaderResourceView(res, &desc, cpu_handle);
-					info_printf("CMD_SET_TEXTURE CreateShaderResourceView name=%s, fmt=%d\n", name.c_str(), desc.Format);
-					mgpu_handle[name] = handle_index_shader++;
+					info_printf("CMD_SET_TEXTURE CreateShaderResourceView name=%s, fmt=%d\n", name_srv.c_str(), desc.Format);
+					mgpu_handle[name_srv] = index;
 				}
 
 				if (mbarrier.count(name) && (desc_res.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)) {
@@ -551,9 +1069,12 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 					ref.cmdlist->ResourceBarrier(1, &barrier);
 				}
 				mbarrier.erase(name);
-				auto gpu_index = mgpu_handle[name];
+				auto gpu_index = mgpu_handle[name_srv];
 				gpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * gpu_index;
-				ref.cmdlist->SetGraphicsRootDescriptorTable((slot * RDT_SLOT_MAX) + RDT_SLOT_SRV, gpu_handle);
+				if (slot >= 0) {
+					ref.cmdlist->SetGraphicsRootDescriptorTable((slot * RDT_SLOT_MAX) + RDT_SLOT_SRV, gpu_handle);
+					ref.cmdlist->SetComputeRootDescriptorTable((slot * RDT_SLOT_MAX) + RDT_SLOT_SRV, gpu_handle);
+				}
 			}
 			if (type == CMD_SET_TEXTURE_UAV) {
 				if (mgpu_handle.count(name) == 0) {
@@ -586,6 +1107,91 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 			}
 		}
 
+		//CMD_SET_BUFFER
+		//Raw views, ByteAddressBuffer t(slot) and RWByteAddressBuffer u(slot). name is the SRV, name_uav the UAV.
+		if (type == CMD_SET_BUFFER || type == CMD_SET_BUFFER_UAV) {
+			auto slot = c.set_buffer.slot;
+			auto name_uav = name + "_uav";
+			auto size = c.set_buffer.size;
+			auto increment = dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+			if (res == nullptr) {
+				trace_scope trace("upload", name);
+				D3D12_HEAP_PROPERTIES hprop = {
+					D3D12_HEAP_TYPE_DEFAULT,
+					D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+					D3D12_MEMORY_POOL_UNKNOWN, 1, 1,
+				};
+				D3D12_RESOURCE_DESC desc = {
+					D3D12_RESOURCE_DIMENSION_BUFFER, 0, UINT64(size), 1, 1, 1, DXGI_FORMAT_UNKNOWN,
+					{1, 0}, D3D12_TEXTURE_LAYOUT_ROW_MAJOR, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+				};
+				dev->CreateCommittedResource(&hprop, D3D12_HEAP_FLAG_NONE, &desc,
+					D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&res));
+				if (!res) {
+					err_printf("create_resource(buffer) name=%s, size=%zu\n", name.c_str(), size);
+					exit(1);
+				}
+				mres[name] = res;
+				mbuffer_state[name] = D3D12_RESOURCE_STATE_COPY_DEST;
+				account_memory(name, MEMORY_BUFFER, "default", size);
+
+				//default heaps start zeroed, the data is copied through the upload ring.
+				auto data_size = (std::min)(oden_get_cmd_size(c), size);
+				if (data_size) {
+					auto offset = alloc_upload(name, data_size, 4);
+					memcpy(ref.upload_data + offset, oden_get_cmd_data(c), data_size);
+					ref.cmdlist->CopyBufferRegion(res, 0, ref.upload, offset, data_size);
+				}
+
+				auto cpu_handle = heap_shader->GetCPUDescriptorHandleForHeapStart();
+				D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+				srv_desc.Format = DXGI_FORMAT_R32_TYPELESS;
+				srv_desc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+				srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+				srv_desc.Buffer.NumElements = UINT(size / 4);
+				srv_desc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+				cpu_handle.ptr += increment * handle_index_shader;
+				dev->CreateShaderResourceView(res, &srv_desc, cpu_handle);
+				mgpu_handle[name] = handle_index_shader++;
+
+				D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
+				uav_desc.Format = DXGI_FORMAT_R32_TYPELESS;
+				uav_desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+				uav_desc.Buffer.NumElements = UINT(size / 4);
+				uav_desc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
+				cpu_handle = heap_shader->GetCPUDescriptorHandleForHeapStart();
+				cpu_handle.ptr += increment * handle_index_shader;
+				dev->CreateUnorderedAccessView(res, nullptr, &uav_desc, cpu_handle);
+				mgpu_handle[name_uav] = handle_index_shader++;
+			}
+			auto gpu_handle = heap_shader->GetGPUDescriptorHandleForHeapStart();
+			if (type == CMD_SET_BUFFER && slot >= 0) {
+				transition_buffer(name, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+				gpu_handle.ptr += increment * mgpu_handle[name];
+				ref.cmdlist->SetGraphicsRootDescriptorTable((slot * RDT_SLOT_MAX) + RDT_SLOT_SRV, gpu_handle);
+				ref.cmdlist->SetComputeRootDescriptorTable((slot * RDT_SLOT_MAX) + RDT_SLOT_SRV, gpu_handle);
+			}
+			if (type == CMD_SET_BUFFER_UAV) {
+				transition_buffer(name, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+				gpu_handle.ptr += increment * mgpu_handle[name_uav];
+				ref.cmdlist->SetComputeRootDescriptorTable((slot * RDT_SLOT_MAX) + RDT_SLOT_UAV, gpu_handle);
+			}
+		}
+
+		//CMD_UPDATE_BUFFER
+		if (type == CMD_UPDATE_BUFFER) {
+			auto size = oden_get_cmd_size(c);
+			if (res && mbuffer_state.count(name) && size) {
+				trace_scope trace("upload", name);
+				auto offset = alloc_upload(name, size, 4);
+				memcpy(ref.upload_data + offset, oden_get_cmd_data(c), size);
+				transition_buffer(name, D3D12_RESOURCE_STATE_COPY_DEST);
+				ref.cmdlist->CopyBufferRegion(res, c.set_buffer.offset, ref.upload, offset, size);
+			} else {
+				err_printf("Invalid update buffer name=%s\n", name.c_str());
+			}
+		}
+
 		//CMD_SET_CONSTANT
 		if (type == CMD_SET_CONSTANT) {
 			auto cpu_handle = heap_shader->GetCPUDescriptorHandleForHeapStart();
@@ -594,7 +1200,7 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 			auto data = c.buf.data();
 			auto size = (c.buf.size() + 255) & ~255;
 			if (res == nullptr) {
-				res = create_resource(name, dev, size, 1, DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, data, size);
+				res = create_resource(name, MEMORY_CONSTANT, dev, size, 1, DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, data, size);
 				if (!res) {
 					err_printf("create_resource(cbv) name=%s\n", name.c_str());
 					exit(1);
@@ -612,6 +1218,7 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 			auto gpu_index = mgpu_handle[name];
 			gpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * gpu_index;
 			ref.cmdlist->SetGraphicsRootDescriptorTable((slot * RDT_SLOT_MAX) + RDT_SLOT_CBV, gpu_handle);
+			ref.cmdlist->SetComputeRootDescriptorTable((slot * RDT_SLOT_MAX) + RDT_SLOT_CBV, gpu_handle);
 			{
 				UINT8 *dest = nullptr;
 				res->Map(0, NULL, reinterpret_cast<void **>(&dest));
@@ -619,17 +1226,17 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 					memcpy(dest, data, size);
 					res->Unmap(0, NULL);
 				} else {
-					printf("%s : can't map\n", __FUNCTION__);
+					err_printf("can't map\n");
 				}
 			}
 		}
 
 		//CMD_SET_VERTEX
 		if (type == CMD_SET_VERTEX) {
-			auto data = c.buf.data();
-			auto size = c.buf.size();
+			auto data = oden_get_cmd_data(c);
+			auto size = oden_get_cmd_size(c);
 			if (res == nullptr) {
-				res = create_resource(name, dev, size, 1, DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, data, size);
+				res = create_resource(name, MEMORY_VERTEX, dev, size, 1, DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, data, size);
 				if (!res) {
 					err_printf("create_resource(buffer vertex) name=%s\n", name.c_str());
 					exit(1);
@@ -646,10 +1253,10 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		//CMD_SET_INDEX
 		if (type == CMD_SET_INDEX) {
 			auto res = mres[name];
-			auto data = c.buf.data();
-			auto size = c.buf.size();
+			auto data = oden_get_cmd_data(c);
+			auto size = oden_get_cmd_size(c);
 			if (res == nullptr) {
-				res = create_resource(name, dev, size, 1, DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, data, size);
+				res = create_resource(name, MEMORY_INDEX, dev, size, 1, DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, data, size);
 				if (!res) {
 					err_printf("create_resource(buffer index) name=%s\n", name.c_str());
 					exit(1);
@@ -668,15 +1275,24 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 
 		//CMD_SET_SHADER
 		if (type == CMD_SET_SHADER) {
+			auto pstate_name = name;
+			for (int i = 0; i < rt_count; i++)
+				pstate_name += "_" + std::to_string(fmt_rt[i]);
+			if (is_depth_only)
+				pstate_name += "_depth_only";
+			if (c.set_shader.depth_func == DEPTH_FUNC_EQUAL)
+				pstate_name += "_depth_equal";
+			auto pstate = mpstate[pstate_name];
 			if (pstate == nullptr || c.set_shader.is_update) {
 				if (pstate)
 					pstate->Release();
 				pstate = nullptr;
-				mpstate[name] = nullptr;
+				mpstate[pstate_name] = nullptr;
 
 				std::vector<uint8_t> vs;
 				std::vector<uint8_t> gs;
 				std::vector<uint8_t> ps;
+				std::vector<uint8_t> ps_depth;
 				std::vector<uint8_t> cs;
 				D3D12_GRAPHICS_PIPELINE_STATE_DESC gpstate_desc = {};
 				D3D12_COMPUTE_PIPELINE_STATE_DESC cpstate_desc = {};
@@ -690,6 +1306,11 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 				gpstate_desc.DepthStencilState.DepthEnable = c.set_shader.is_enable_depth ? TRUE : FALSE;
 				gpstate_desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
 				gpstate_desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+				if (c.set_shader.depth_func == DEPTH_FUNC_EQUAL) {
+					//depth equal to the prepass. the depth is already there, so no write.
+					gpstate_desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+					gpstate_desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_EQUAL;
+				}
 
 				//IA
 				gpstate_desc.InputLayout.pInputElementDescs = layout;
@@ -709,10 +1330,13 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 					bs.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
 				}
 				gpstate_desc.pRootSignature = rootsig;
-				gpstate_desc.NumRenderTargets = _countof(gpstate_desc.BlendState.RenderTarget);
+				gpstate_desc.NumRenderTargets = rt_count;
 				gpstate_desc.VS = create_shader_from_file(std::string(name + ".hlsl"), "VSMain", "vs_5_0", vs);
 				gpstate_desc.GS = create_shader_from_file(std::string(name + ".hlsl"), "GSMain", "gs_5_0", gs);
 				gpstate_desc.PS = create_shader_from_file(std::string(name + ".hlsl"), "PSMain", "ps_5_0", ps);
+				//depth only targets run no pixel shader unless it has an alpha test.
+				if (is_depth_only && !ps.empty())
+					gpstate_desc.PS = create_shader_from_file(std::string(name + ".hlsl"), "PSDepth", "ps_5_0", ps_depth);
 				gpstate_desc.SampleDesc.Count = 1;
 				gpstate_desc.SampleMask = UINT_MAX;
 				gpstate_desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
@@ -720,8 +1344,8 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 				gpstate_desc.RasterizerState.DepthClipEnable = TRUE;
 				gpstate_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
 
-				for (auto & fmt : gpstate_desc.RTVFormats)
-					fmt = fmt_color;
+				for (int i = 0; i < rt_count; i++)
+					gpstate_desc.RTVFormats[i] = fmt_rt[i];
 				gpstate_desc.DSVFormat = fmt_depth;
 
 				cpstate_desc.pRootSignature = rootsig;
@@ -730,7 +1354,7 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 				if (!vs.empty() && !ps.empty()) {
 					auto status = dev->CreateGraphicsPipelineState(&gpstate_desc, IID_PPV_ARGS(&pstate));
 					if (pstate)
-						mpstate[name] = pstate;
+						mpstate[pstate_name] = pstate;
 					else
 						err_printf("CreateGraphicsPipelineState : %s : status=0x%08X\n", name.c_str(), status);
 				}
@@ -738,7 +1362,7 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 				if (!cs.empty()) {
 					auto status = dev->CreateComputePipelineState(&cpstate_desc, IID_PPV_ARGS(&pstate));
 					if (pstate)
-						mpstate[name] = pstate;
+						mpstate[pstate_name] = pstate;
 					else
 						err_printf("CreateComputePipelineState : %s : status=0x%08X\n", name.c_str(), status);
 				}
@@ -779,13 +1403,212 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 			ref.cmdlist->DrawInstanced(vertex_count, 1, 0, 0);
 		}
 
+		//CMD_DRAW_INDEX_INSTANCED, CMD_DRAW_INSTANCED
+		if (type == CMD_DRAW_INDEX_INSTANCED) {
+			auto & d = c.draw_instanced;
+			ref.cmdlist->DrawIndexedInstanced(d.count, d.instance_count, d.start, 0, 0);
+		}
+		if (type == CMD_DRAW_INSTANCED) {
+			auto & d = c.draw_instanced;
+			ref.cmdlist->DrawInstanced(d.count, d.instance_count, 0, 0);
+		}
+
+		//CMD_DRAW_INDEX_INDIRECT
+		if (type == CMD_DRAW_INDEX_INDIRECT) {
+			if (res && mbuffer_state.count(name)) {
+				transition_buffer(name, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+				ref.cmdlist->ExecuteIndirect(cmdsig_draw_index, 1, res, c.draw_index_indirect.offset, nullptr, 0);
+			} else {
+				err_printf("Invalid draw indirect name=%s\n", name.c_str());
+			}
+		}
+
 		//CMD_DISPATCH
 		if (type == CMD_DISPATCH) {
 			auto x = c.dispatch.x;
 			auto y = c.dispatch.y;
 			auto z = c.dispatch.z;
 			ref.cmdlist->Dispatch(x, y, z);
+
+			//the next dispatch reads the levels or the buffers written by this one.
+			D3D12_RESOURCE_BARRIER barrier = {};
+			barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+			barrier.UAV.pResource = nullptr;
+			ref.cmdlist->ResourceBarrier(1, &barrier);
+		}
+
+		//CMD_RELEASE
+		if (type == CMD_RELEASE) {
+			auto res = mres[name];
+			D3D12_RESOURCE_DESC desc_res = {};
+			if (res)
+				desc_res = res->GetDesc();
+			auto rt_flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+			if (res == nullptr || desc_res.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || (desc_res.Flags & rt_flags)) {
+				err_printf("Invalid release name=%s\n", name.c_str());
+			} else {
+				//This frame slot releases the resource and reuses its descriptors when its fence has passed.
+				ref.vscratch.push_back(res);
+				std::vector<uint64_t> vindex;
+				for (auto it = mgpu_handle.begin(); it != mgpu_handle.end();) {
+					if (it->first == name || it->first.find(name + "_miplevel_") == 0) {
+						vindex.push_back(it->second);
+						it = mgpu_handle.erase(it);
+					} else {
+						it++;
+					}
+				}
+				std::sort(vindex.begin(), vindex.end());
+				vindex.erase(std::unique(vindex.begin(), vindex.end()), vindex.end());
+				ref.vfree_handles.insert(ref.vfree_handles.end(), vindex.begin(), vindex.end());
+				mres.erase(name);
+				mbarrier.erase(name);
+				release_memory(name);
+			}
+		}
+
+		//CMD_UPDATE_TEXTURE
+		if (type == CMD_UPDATE_TEXTURE) {
+			auto res = mres[name];
+			D3D12_RESOURCE_DESC desc_res = {};
+			if (res)
+				desc_res = res->GetDesc();
+			auto fmt = get_oden_format(desc_res.Format);
+			auto & r = c.set_texture.rect;
+			auto level = c.set_texture.miplevel;
+			auto rt_flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+			auto row_bytes = oden_get_texture_row_bytes(fmt, r.w);
+			auto rows = oden_get_texture_rows(fmt, r.h);
+			size_t stride = c.set_texture.stride_size ? c.set_texture.stride_size : size_t(row_bytes);
+			if (res == nullptr || desc_res.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || (desc_res.Flags & rt_flags) ||
+				fmt == FMT_DEFAULT || level < 0 || level >= desc_res.MipLevels ||
+				!oden_is_texture_rect_valid(fmt, int(desc_res.Width), int(desc_res.Height), level, r.x, r.y, r.w, r.h) ||
+				oden_get_cmd_size(c) < oden_get_texture_rect_size(fmt, r.w, r.h, stride)) {
+				err_printf("Invalid update name=%s\n", name.c_str());
+			} else {
+				trace_scope trace("upload", name);
+				auto pitch = (row_bytes + D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1) & ~uint64_t(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+				auto offset = alloc_upload(name, pitch * rows, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+				auto data = oden_get_cmd_data(c);
+				if (stride == pitch) {
+					memcpy(ref.upload_data + offset, data, size_t(oden_get_texture_rect_size(fmt, r.w, r.h, stride)));
+				} else {
+					for (int i = 0; i < rows; i++)
+						memcpy(ref.upload_data + offset + pitch * i, data + stride * i, size_t(row_bytes));
+				}
+
+				//Block formats copy whole blocks, also past the edge of the small levels.
+				bool is_block = oden_is_block_format(fmt);
+				D3D12_TEXTURE_COPY_LOCATION dest = {};
+				D3D12_TEXTURE_COPY_LOCATION src = {};
+				dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+				dest.pResource = res;
+				dest.SubresourceIndex = UINT(level);
+				src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+				src.pResource = ref.upload;
+				src.PlacedFootprint.Offset = offset;
+				src.PlacedFootprint.Footprint.Format = desc_res.Format;
+				src.PlacedFootprint.Footprint.Width = UINT(is_block ? (r.w + 3) & ~3 : r.w);
+				src.PlacedFootprint.Footprint.Height = UINT(is_block ? (r.h + 3) & ~3 : r.h);
+				src.PlacedFootprint.Footprint.Depth = 1;
+				src.PlacedFootprint.Footprint.RowPitch = UINT(pitch);
+				D3D12_RESOURCE_BARRIER barrier = get_barrier(res, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+				ref.cmdlist->ResourceBarrier(1, &barrier);
+				ref.cmdlist->CopyTextureRegion(&dest, UINT(r.x), UINT(r.y), 0, &src, nullptr);
+				barrier = get_barrier(res, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
+				ref.cmdlist->ResourceBarrier(1, &barrier);
+			}
+		}
+
+		//CMD_GENERATE_MIPS
+		if (type == CMD_GENERATE_MIPS) {
+			//Last group counter of shaders/genmips.hlsl. Default heaps are zeroed and the shader resets it.
+			auto name_counter = std::string("__genmips_counter__");
+			auto counter = mres[name_counter];
+			if (counter == nullptr) {
+				trace_scope trace("resource", name_counter);
+				D3D12_HEAP_PROPERTIES hprop = {
+					D3D12_HEAP_TYPE_DEFAULT,
+					D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+					D3D12_MEMORY_POOL_UNKNOWN, 1, 1,
+				};
+				D3D12_RESOURCE_DESC desc = {
+					D3D12_RESOURCE_DIMENSION_BUFFER, 0, sizeof(uint32_t), 1, 1, 1, DXGI_FORMAT_UNKNOWN,
+					{1, 0}, D3D12_TEXTURE_LAYOUT_ROW_MAJOR, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+				};
+				dev->CreateCommittedResource(&hprop, D3D12_HEAP_FLAG_NONE, &desc,
+					D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&counter));
+				if (counter) {
+					auto info = dev->GetResourceAllocationInfo(0, 1, &desc);
+					account_memory(name_counter, MEMORY_BUFFER, "default", info.SizeInBytes);
+				}
+				mres[name_counter] = counter;
+			}
+			if (pstate_genmips == nullptr) {
+				std::vector<uint8_t> cs;
+				D3D12_COMPUTE_PIPELINE_STATE_DESC cpstate_desc = {};
+				cpstate_desc.pRootSignature = rootsig_genmips;
+				cpstate_desc.CS = create_shader_from_file("./shaders/genmips.hlsl", "CSMain", "cs_5_1", cs);
+				if (!cs.empty())
+					dev->CreateComputePipelineState(&cpstate_desc, IID_PPV_ARGS(&pstate_genmips));
+			}
+
+			auto desc_res = res ? res->GetDesc() : D3D12_RESOURCE_DESC{};
+			if (!res || !(desc_res.Flags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS) || !counter) {
+				err_printf("Invalid generate mips name=%s\n", name.c_str());
+			} else if (pstate_genmips == nullptr) {
+				err_printf("CreateComputePipelineState : ./shaders/genmips\n");
+			} else {
+				//GENMIPS_MAX UAVs in a row. Levels past the last one repeat it, the shader never touches them.
+				auto name_table = "__genmips__" + name;
+				if (mgpu_handle.count(name_table) == 0) {
+					mgpu_handle[name_table] = handle_index_shader;
+					for (UINT i = 0; i < GENMIPS_MAX; i++) {
+						D3D12_UNORDERED_ACCESS_VIEW_DESC desc = {};
+						desc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+						desc.Texture2D.MipSlice = (std::min)(i, (UINT)desc_res.MipLevels - 1);
+						desc.Format = desc_res.Format;
+						auto cpu_handle = heap_shader->GetCPUDescriptorHandleForHeapStart();
+						cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * handle_index_shader++;
+						dev->CreateUnorderedAccessView(res, nullptr, &desc, cpu_handle);
+					}
+				}
+				auto gpu_handle = heap_shader->GetGPUDescriptorHandleForHeapStart();
+				gpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * mgpu_handle[name_table];
+
+				UINT mips = (std::min)((UINT)desc_res.MipLevels, (UINT)GENMIPS_MAX);
+				if (c.generate_mips.miplevel > 0)
+					mips = (std::min)(mips, (UINT)c.generate_mips.miplevel);
+				UINT gx = UINT((desc_res.Width + GENMIPS_TILE - 1) / GENMIPS_TILE);
+				UINT gy = (desc_res.Height + GENMIPS_TILE - 1) / GENMIPS_TILE;
+				UINT constants[2] = {mips, gx * gy};
+				ref.cmdlist->SetComputeRootSignature(rootsig_genmips);
+				ref.cmdlist->SetPipelineState(pstate_genmips);
+				ref.cmdlist->SetComputeRoot32BitConstants(RDT_GENMIPS_CONSTANT, 2, constants, 0);
+				ref.cmdlist->SetComputeRootDescriptorTable(RDT_GENMIPS_UAV, gpu_handle);
+				ref.cmdlist->SetComputeRootUnorderedAccessView(RDT_GENMIPS_COUNTER, counter->GetGPUVirtualAddress());
+				ref.cmdlist->Dispatch(gx, gy, 1);
+
+				//The levels are read by the following passes, the counter by the next generation.
+				D3D12_RESOURCE_BARRIER barrier = {};
+				barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+				barrier.UAV.pResource = nullptr;
+				ref.cmdlist->ResourceBarrier(1, &barrier);
+
+				//Compute bindings are lost with the root signature, SetShader again before a dispatch.
+				ref.cmdlist->SetComputeRootSignature(rootsig);
+			}
 		}
+
+		auto cmd_ms = get_time_ms() - cmd_start;
+		if (type >= 0 && type < CMD_MAX) {
+			vstats[type].count++;
+			vstats[type].cpu_ms += cmd_ms;
+		}
+
+		segment_cpu_ms += cmd_ms;
+		if (is_pass_end(type))
+			end_segment(name);
 	}
 	for (auto & tb : mbarrier) {
 		D3D12_RESOURCE_BARRIER barrier = get_barrier(nullptr, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON);
@@ -793,11 +1616,29 @@ oden::oden_present_graphics(const char * appname, std::vector<cmd> & vcmd,
 		barrier.Transition.pResource = mres[tb.first];
 		ref.cmdlist->ResourceBarrier(1, &barrier);
 	}
+	if (!vcmd.empty() && !is_pass_end(vcmd.back().type))
+		end_segment(vcmd.back().name);
+	if (ref.query_heap && ref.query_readback)
+		ref.cmdlist->ResolveQueryData(ref.query_heap, D3D12_QUERY_TYPE_TIMESTAMP, 0,
+			(UINT)ref.vsegments.size() + 1, ref.query_readback, 0);
+
+	{
+		std::lock_guard<std::mutex> lock(frame_stats_mtx);
+		for (int i = 0 ; i < CMD_MAX; i++) {
+			vcmd_stats[i].count += vstats[i].count;
+			vcmd_stats[i].cpu_ms += vstats[i].cpu_ms;
+		}
+	}
 	ref.cmdlist->Close();
 	ID3D12CommandList *pplists[] = {
 		ref.cmdlist,
 	};
+	ref.submit_ms = get_time_ms();
 	queue->ExecuteCommandLists(1, pplists);
+	ref.value = ++fence_value;
+	queue->Signal(fence, ref.value);
+	ref.is_submitted = true;
+	ref.frame = frame_count;
 	swapchain->Present(1, 0);
 	frame_count++;
 }
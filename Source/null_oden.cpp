@@ -0,0 +1,693 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Null backend. No GPU. Runs resource bookkeeping, validation and state
+//tracking of the command stream and records per command type cpu cost.
+
+#include "ODEN.h"
+#include "oden_platform.h"
+#include "oden_trace.h"
+#include "oden_log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <vector>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+
+#define LOG_INFO(...) ODEN_LOG_INFO(__VA_ARGS__)
+#define LOG_ERR(...) ODEN_LOG_ERR(__VA_ARGS__)
+
+using namespace oden;
+
+//Written by oden_set_frames_in_flight on the app thread, read by the render thread.
+static std::atomic<uint32_t> frames_in_flight_request {0};
+
+static uint32_t
+get_frames_in_flight(uint32_t num)
+{
+	uint32_t request = frames_in_flight_request.load();
+	return request ? request : num;
+}
+
+static std::mutex frame_stats_mtx;
+static std::vector<frame_stats> vframe_stats;
+static std::vector<cmd_stats> vcmd_stats(CMD_MAX);
+static std::map<std::string, pass_stats> mpass_stats;
+static bool is_pass_stats_updated = false;
+static std::map<std::string, memory_stats> mmemory_stats;
+static uint64_t memory_total = 0;
+static uint64_t memory_high_water = 0;
+
+//Commands up to a draw / dispatch, see oden_get_pass_stats.
+struct pass_segment {
+	std::string name;
+	double cpu_ms;
+	double gpu_ms;
+};
+
+static double
+get_time_ms()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double, std::milli>(now).count();
+}
+
+static void
+push_frame_stats(frame_stats stats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (vframe_stats.size() >= 4096)
+		vframe_stats.erase(vframe_stats.begin(), vframe_stats.begin() + 2048);
+	vframe_stats.push_back(stats);
+}
+
+void
+oden::oden_set_frames_in_flight(uint32_t num)
+{
+	frames_in_flight_request = num;
+}
+
+void
+oden::oden_get_frame_stats(std::vector<frame_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats.insert(vstats.end(), vframe_stats.begin(), vframe_stats.end());
+	vframe_stats.clear();
+}
+
+void
+oden::oden_get_cmd_stats(std::vector<cmd_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats = vcmd_stats;
+	for (auto & x : vcmd_stats)
+		x = {};
+}
+
+static bool
+is_pass_end(int type)
+{
+	return type == CMD_DRAW_INDEX || type == CMD_DRAW || type == CMD_DISPATCH || type == CMD_GENERATE_MIPS ||
+		type == CMD_DRAW_INDEX_INDIRECT || type == CMD_DRAW_INDEX_INSTANCED || type == CMD_DRAW_INSTANCED;
+}
+
+//The gpu trace track lays the passes back to back from the submit.
+static void
+push_pass_stats(uint64_t frame, const std::vector<pass_segment> & vsegments, double submit_ms)
+{
+	auto gpu_start = submit_ms;
+	for (auto & x : vsegments) {
+		if (x.gpu_ms < 0.0)
+			continue;
+		trace_complete("gpu", x.name, gpu_start, gpu_start + x.gpu_ms, ODEN_TRACE_TRACK_GPU);
+		gpu_start += x.gpu_ms;
+	}
+
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mpass_stats.clear();
+	for (auto & x : vsegments) {
+		auto & stats = mpass_stats[x.name];
+		stats.frame = frame;
+		stats.count++;
+		stats.cpu_ms += x.cpu_ms;
+		stats.gpu_ms = x.gpu_ms < 0.0 ? -1.0 : stats.gpu_ms + x.gpu_ms;
+	}
+	is_pass_stats_updated = true;
+}
+
+bool
+oden::oden_get_pass_stats(std::map<std::string, pass_stats> & mstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (!is_pass_stats_updated)
+		return false;
+	mstats = mpass_stats;
+	is_pass_stats_updated = false;
+	return true;
+}
+
+//Replaces the previous entry of the name.
+static void
+account_memory(const std::string & name, int category, const char *heap, uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto & stats = mmemory_stats[name];
+	memory_total = memory_total - stats.bytes + bytes;
+	stats = {category, heap, bytes};
+	memory_high_water = (std::max)(memory_high_water, memory_total);
+}
+
+static void
+release_memory(const std::string & name)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto it = mmemory_stats.find(name);
+	if (it == mmemory_stats.end())
+		return;
+	memory_total -= it->second.bytes;
+	mmemory_stats.erase(it);
+}
+
+static void
+release_memory_all(void)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mmemory_stats.clear();
+	memory_total = 0;
+}
+
+void
+oden::oden_get_memory_stats(std::map<std::string, memory_stats> & mstats, uint64_t & high_water)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mstats = mmemory_stats;
+	high_water = memory_high_water;
+}
+
+bool
+oden::oden_get_backbuffer_readback(std::vector<uint32_t> & /*vdata*/, uint32_t & /*w*/, uint32_t & /*h*/)
+{
+	return false;
+}
+
+static bool
+read_file(std::string filename, std::string & str)
+{
+	FILE *fp = fopen(filename.c_str(), "rb");
+	if (fp == nullptr)
+		return false;
+	char buf[4096];
+	size_t len = 0;
+	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+		str.append(buf, len);
+	fclose(fp);
+	return true;
+}
+
+void
+oden::oden_present_graphics(
+	const char * appname, std::vector<cmd> & vcmd,
+	void *handle, uint32_t w, uint32_t h,
+	uint32_t count, uint32_t heapcount, uint32_t slotmax)
+{
+	struct Image {
+		int w = 0;
+		int h = 0;
+		int maxmips = 1;
+		int fmt = FMT_R8G8B8A8_UNORM;
+		bool is_rendertarget = false;
+		bool is_depth = false;
+		bool is_backbuffer = false;
+		std::vector<uint8_t> data;
+	};
+
+	struct Shader {
+		bool is_compute = false;
+		bool is_cull = false;
+		bool is_enable_depth = false;
+	};
+
+	static std::map<std::string, Image> mimages;
+	static std::map<std::string, std::vector<uint8_t>> mbuffers;
+	static std::map<std::string, std::vector<uint8_t>> mstorage_buffers;
+	static std::map<std::string, size_t> mvertex_strides;
+	static std::map<std::string, Shader> mshaders;
+	static uint64_t frame_count = 0;
+	static uint64_t descriptor_count = 0;
+
+	struct selected_handle {
+		std::string rendertarget;
+		std::vector<std::string> vrendertargets; //color targets of rendertarget.
+		std::string shader;
+		std::string vertex;
+		std::string index;
+		std::vector<std::string> vtextures;
+		std::vector<std::string> vconstants;
+		bool is_compute = false;
+	};
+	selected_handle rec = {};
+	rec.vtextures.resize(slotmax);
+	rec.vconstants.resize(slotmax);
+	uint32_t error_count = 0;
+
+	auto error = [&](const cmd & c, const char *msg) {
+		if (error_count++ < 16)
+			LOG_ERR("frame=%llu %s name=%s : %s\n",
+				(unsigned long long)frame_count, oden_get_cmd_name(c.type), c.name.c_str(), msg);
+	};
+
+	auto create_rendertarget = [&](std::string name, int w, int h, int fmt) {
+		trace_scope trace("resource", name);
+		auto & image = mimages[name];
+		image.w = w;
+		image.h = h;
+		image.is_rendertarget = true;
+		image.maxmips = oden_get_mipmap_max(w, h);
+		uint64_t bytes = 0;
+		for (int i = 0 ; i < image.maxmips; i++) {
+			auto & mip = mimages[oden_get_mipmap_name(name, i)];
+			mip.w = w >> i;
+			mip.h = h >> i;
+			bytes += oden_get_format_size(fmt, mip.w, mip.h);
+		}
+		//What the gpu backends allocate. The format with the mip chain.
+		account_memory(name, MEMORY_RT_COLOR, "none", bytes);
+	};
+
+	if (mimages.empty() && handle) {
+		LOG_INFO("appname=%s, w=%u, h=%u, count=%u, heapcount=%u, slotmax=%u\n",
+			appname, w, h, count, heapcount, slotmax);
+		for (uint32_t i = 0 ; i < count; i++) {
+			auto name = oden_get_backbuffer_name(i);
+			auto & image = mimages[name];
+			image.w = w;
+			image.h = h;
+			image.is_rendertarget = true;
+			image.is_backbuffer = true;
+			account_memory(name, MEMORY_RT_COLOR, "none", (uint64_t)w * h * 4);
+		}
+	}
+
+	if (handle == nullptr) {
+		LOG_INFO("handle == nullptr. Start terminate...\n");
+		LOG_INFO("frame_count=%llu, images=%zu, buffers=%zu, shaders=%zu\n",
+			(unsigned long long)frame_count, mimages.size(), mbuffers.size(), mshaders.size());
+		mimages.clear();
+		mbuffers.clear();
+		mstorage_buffers.clear();
+		mvertex_strides.clear();
+		mshaders.clear();
+		release_memory_all();
+		frame_count = 0;
+		LOG_INFO("handle == nullptr. End terminate...\n");
+		log_flush();
+		return;
+	}
+
+	trace_scope trace_frame("frame", "frame " + std::to_string(frame_count));
+	auto frame_start = get_time_ms();
+	std::vector<cmd_stats> vstats(CMD_MAX);
+	std::vector<pass_segment> vsegments;
+	double segment_cpu_ms = 0.0;
+	double segment_start = frame_start;
+	for (auto & c : vcmd) {
+		auto type = c.type;
+		auto & name = c.name;
+		auto cmd_start = get_time_ms();
+
+		if (type < 0 || type >= CMD_MAX) {
+			error(c, "unknown command");
+			continue;
+		}
+
+		//CMD_SET_BARRIER
+		if (type == CMD_SET_BARRIER) {
+			if (mimages.count(name) == 0)
+				error(c, "barrier to unknown resource");
+		}
+
+		//CMD_SET_RENDER_TARGET
+		if (type == CMD_SET_RENDER_TARGET) {
+			auto & rect = c.set_render_target.rect;
+			int rw = 0;
+			int rh = 0;
+			oden_get_render_target_size(c, rw, rh);
+			auto rt_count = oden_get_render_target_count(c);
+			if (oden_get_mipmap_max(rw, rh) == 0 || rect.w <= 0 || rect.h <= 0)
+				error(c, "invalid size");
+			if (c.set_render_target.is_backbuffer && mimages.count(name) == 0)
+				error(c, "unknown backbuffer");
+			if (c.set_render_target.count > RENDER_TARGET_MAX)
+				error(c, "render target count out of range");
+			if (c.set_render_target.is_backbuffer && rt_count > 1)
+				error(c, "backbuffer with multiple render targets");
+			if (c.set_render_target.is_depth_only && c.set_render_target.is_backbuffer)
+				error(c, "depth only backbuffer");
+			rec.vrendertargets.clear();
+			for (int i = 0; i < rt_count && !c.set_render_target.is_depth_only; i++) {
+				auto name_color = oden_get_color_render_target_name(name, i);
+				auto fmt = oden_get_render_target_format(c, i);
+				if (fmt < 0 || fmt >= FMT_MAX || oden_is_block_format(fmt)) {
+					error(c, "invalid render target format");
+					fmt = FMT_R16G16B16A16_FLOAT;
+				}
+				if (mimages.count(name_color) == 0)
+					create_rendertarget(name_color, rw, rh, fmt);
+				rec.vrendertargets.push_back(name_color);
+			}
+			auto name_depth = oden_get_depth_render_target_name(name);
+			if (mimages.count(name_depth) == 0) {
+				auto & depth = mimages[name_depth];
+				depth.w = rw;
+				depth.h = rh;
+				depth.is_rendertarget = true;
+				depth.is_depth = true;
+				account_memory(name_depth, MEMORY_RT_DEPTH, "none", (uint64_t)rw * rh * 4);
+			}
+			//targets keep the size they are created with, the rect draws into a part of them.
+			auto & depth = mimages[name_depth];
+			if (rect.x < 0 || rect.y < 0 || rect.x + rect.w > depth.w || rect.y + rect.h > depth.h)
+				error(c, "rect out of the render target");
+			rec.rendertarget = name;
+			rec.vtextures.assign(slotmax, std::string());
+			rec.vconstants.assign(slotmax, std::string());
+			descriptor_count++;
+		}
+
+		//CMD_SET_TEXTURE
+		if (type == CMD_SET_TEXTURE || type == CMD_SET_TEXTURE_UAV) {
+			auto slot = c.set_texture.slot;
+			auto data = oden_get_cmd_data(c);
+			auto data_size = oden_get_cmd_size(c);
+			if (slot >= (int)slotmax || (slot < 0 && (type == CMD_SET_TEXTURE_UAV || data_size == 0))) {
+				error(c, "slot out of range");
+			} else {
+				if (mimages.count(name) == 0) {
+					if (data_size == 0 && c.set_texture.rect.w == 0)
+						error(c, "texture is not created");
+					auto fmt = oden_get_texture_format(c.set_texture.fmt);
+					if (fmt < 0 || fmt >= FMT_MAX) {
+						error(c, "invalid texture format");
+						fmt = FMT_R8G8B8A8_UNORM;
+					}
+					if (type == CMD_SET_TEXTURE_UAV && oden_is_block_format(fmt))
+						error(c, "block format is not writable");
+					auto tw = c.set_texture.rect.w;
+					auto th = c.set_texture.rect.h;
+					auto mips = (std::max)(c.set_texture.mips, 1);
+					if (mips > oden_get_mipmap_max(tw, th)) {
+						error(c, "mips out of range");
+						mips = 1;
+					}
+					auto size = oden_get_texture_level_offset(fmt, tw, th, mips, c.set_texture.stride_size);
+					if (data_size && data_size < size)
+						error(c, "texture data is smaller than the format");
+					trace_scope trace("upload", name);
+					auto & image = mimages[name];
+					image.w = tw;
+					image.h = th;
+					image.maxmips = mips;
+					image.fmt = fmt;
+					image.data.assign(data, data + data_size);
+					account_memory(name, MEMORY_TEXTURE, "none", oden_get_texture_level_offset(fmt, tw, th, mips, 0));
+				}
+				auto & image = mimages[name];
+				if (c.set_texture.miplevel < 0 || c.set_texture.miplevel >= image.maxmips)
+					error(c, "miplevel out of range");
+				auto & vrt = rec.vrendertargets;
+				if (type == CMD_SET_TEXTURE && slot >= 0 && std::find(vrt.begin(), vrt.end(), name) != vrt.end())
+					error(c, "texture is bound as render target");
+				if (slot >= 0)
+					rec.vtextures[slot] = name;
+			}
+		}
+
+		//CMD_SET_CONSTANT
+		if (type == CMD_SET_CONSTANT) {
+			auto slot = c.set_constant.slot;
+			if (slot < 0 || slot >= (int)slotmax) {
+				error(c, "slot out of range");
+			} else {
+				if (c.buf.empty())
+					error(c, "empty constant");
+				//constants are uploaded every time as the gpu backends do.
+				auto & buffer = mbuffers[name];
+				buffer.resize(c.buf.size());
+				memcpy(buffer.data(), c.buf.data(), c.buf.size());
+				account_memory(name, MEMORY_CONSTANT, "none", buffer.size());
+				rec.vconstants[slot] = name;
+			}
+		}
+
+		//CMD_SET_VERTEX
+		if (type == CMD_SET_VERTEX) {
+			if (mbuffers.count(name) == 0) {
+				if (oden_get_cmd_size(c) == 0 || c.set_vertex.stride_size == 0)
+					error(c, "invalid vertex buffer");
+				trace_scope trace("upload", name);
+				mbuffers[name].assign(oden_get_cmd_data(c), oden_get_cmd_data(c) + oden_get_cmd_size(c));
+				mvertex_strides[name] = c.set_vertex.stride_size;
+				account_memory(name, MEMORY_VERTEX, "none", oden_get_cmd_size(c));
+			}
+			rec.vertex = name;
+		}
+
+		//CMD_SET_INDEX
+		if (type == CMD_SET_INDEX) {
+			if (mbuffers.count(name) == 0) {
+				if (oden_get_cmd_size(c) == 0 || (oden_get_cmd_size(c) % sizeof(uint32_t)))
+					error(c, "invalid index buffer");
+				trace_scope trace("upload", name);
+				mbuffers[name].assign(oden_get_cmd_data(c), oden_get_cmd_data(c) + oden_get_cmd_size(c));
+				account_memory(name, MEMORY_INDEX, "none", oden_get_cmd_size(c));
+			}
+			rec.index = name;
+		}
+
+		//CMD_SET_SHADER
+		if (type == CMD_SET_SHADER) {
+			if (c.set_shader.depth_func != DEPTH_FUNC_DEFAULT && c.set_shader.depth_func != DEPTH_FUNC_EQUAL)
+				error(c, "invalid depth func");
+			if (mshaders.count(name) == 0 || c.set_shader.is_update) {
+				//Read the source as the gpu backends do, compute if it has a CS entry.
+				trace_scope trace("shader", name);
+				Shader shader;
+				std::string hlsl;
+				std::string glsl;
+				if (!read_file(name + ".hlsl", hlsl) && !read_file(name + ".glsl", glsl))
+					error(c, "shader source not found");
+				shader.is_compute =
+					hlsl.find("CSMain") != std::string::npos ||
+					glsl.find("local_size_x") != std::string::npos;
+				shader.is_cull = c.set_shader.is_cull;
+				shader.is_enable_depth = c.set_shader.is_enable_depth;
+				mshaders[name] = shader;
+			}
+			rec.shader = name;
+			rec.is_compute = mshaders[name].is_compute;
+			descriptor_count++;
+		}
+
+		//CMD_CLEAR
+		if (type == CMD_CLEAR) {
+			auto & vrt = rec.vrendertargets;
+			if (std::find(vrt.begin(), vrt.end(), name) == vrt.end())
+				error(c, "clear target is not bound");
+		}
+
+		//CMD_CLEAR_DEPTH
+		if (type == CMD_CLEAR_DEPTH) {
+			if (mimages.count(oden_get_depth_render_target_name(name)) == 0)
+				error(c, "depth target is not created");
+		}
+
+		//CMD_SET_BUFFER, CMD_SET_BUFFER_UAV
+		if (type == CMD_SET_BUFFER || type == CMD_SET_BUFFER_UAV) {
+			auto slot = c.set_buffer.slot;
+			if (slot >= (int)slotmax || (slot < 0 && (type == CMD_SET_BUFFER_UAV || slot != -1))) {
+				error(c, "slot out of range");
+			} else if (mstorage_buffers.count(name) == 0) {
+				auto size = c.set_buffer.size;
+				if (size == 0 || (size % sizeof(uint32_t)))
+					error(c, "invalid buffer size");
+				if (c.buf.size() > size)
+					error(c, "buffer data is larger than the buffer");
+				if (slotmax * 3 > BUFFER_BINDING_BASE)
+					error(c, "texture bindings of slotmax overlap the buffer bindings");
+				trace_scope trace("upload", name);
+				auto & buffer = mstorage_buffers[name];
+				buffer.assign(size, 0);
+				memcpy(buffer.data(), c.buf.data(), (std::min)(c.buf.size(), size));
+				account_memory(name, MEMORY_BUFFER, "none", size);
+			}
+		}
+
+		//CMD_UPDATE_BUFFER
+		if (type == CMD_UPDATE_BUFFER) {
+			auto it = mstorage_buffers.find(name);
+			if (it == mstorage_buffers.end()) {
+				error(c, "update of unknown buffer");
+			} else if ((c.set_buffer.offset % sizeof(uint32_t)) || (c.buf.size() % sizeof(uint32_t)) ||
+				c.set_buffer.offset + c.buf.size() > it->second.size()) {
+				error(c, "update out of the buffer");
+			} else {
+				trace_scope trace("upload", name);
+				memcpy(it->second.data() + c.set_buffer.offset, c.buf.data(), c.buf.size());
+			}
+		}
+
+		//CMD_DRAW_INDEX, CMD_DRAW, CMD_DRAW_INDEX_INDIRECT, CMD_DRAW_INDEX_INSTANCED, CMD_DRAW_INSTANCED
+		if (type == CMD_DRAW_INDEX || type == CMD_DRAW || type == CMD_DRAW_INDEX_INDIRECT ||
+			type == CMD_DRAW_INDEX_INSTANCED || type == CMD_DRAW_INSTANCED) {
+			if (rec.rendertarget.empty())
+				error(c, "no render target");
+			if (rec.shader.empty() || rec.is_compute)
+				error(c, "no graphics shader");
+			if (rec.vertex.empty())
+				error(c, "no vertex buffer");
+		}
+
+		if (type == CMD_DRAW_INDEX) {
+			if (rec.index.empty()) {
+				error(c, "no index buffer");
+			} else {
+				auto last = (size_t)c.draw_index.start + (size_t)c.draw_index.count;
+				if (c.draw_index.start < 0 || last * sizeof(uint32_t) > mbuffers[rec.index].size())
+					error(c, "index out of range");
+			}
+		}
+
+		if (type == CMD_DRAW_INDEX_INDIRECT) {
+			//the arguments are written by the gpu, only where they are is known here.
+			auto it = mstorage_buffers.find(name);
+			if (rec.index.empty())
+				error(c, "no index buffer");
+			if (it == mstorage_buffers.end())
+				error(c, "arguments of unknown buffer");
+			else if ((c.draw_index_indirect.offset % sizeof(uint32_t)) ||
+				c.draw_index_indirect.offset + sizeof(draw_index_indirect_args) > it->second.size())
+				error(c, "arguments out of the buffer");
+		}
+
+		if (type == CMD_DRAW) {
+			if (rec.vertex.size()) {
+				auto stride = mvertex_strides[rec.vertex];
+				if (stride && (size_t)c.draw.vertex_count * stride > mbuffers[rec.vertex].size())
+					error(c, "vertex out of range");
+			}
+		}
+
+		if (type == CMD_DRAW_INDEX_INSTANCED || type == CMD_DRAW_INSTANCED) {
+			auto & d = c.draw_instanced;
+			if (d.count < 0 || d.instance_count < 0)
+				error(c, "negative count");
+			if (type == CMD_DRAW_INDEX_INSTANCED) {
+				if (rec.index.empty())
+					error(c, "no index buffer");
+				else if (d.start < 0 || ((size_t)d.start + (size_t)d.count) * sizeof(uint32_t) > mbuffers[rec.index].size())
+					error(c, "index out of range");
+			} else if (d.start != 0) {
+				error(c, "start of a non indexed draw");
+			} else if (rec.vertex.size()) {
+				auto stride = mvertex_strides[rec.vertex];
+				if (stride && (size_t)d.count * stride > mbuffers[rec.vertex].size())
+					error(c, "vertex out of range");
+			}
+		}
+
+		//CMD_DISPATCH
+		if (type == CMD_DISPATCH) {
+			if (rec.shader.empty() || !rec.is_compute)
+				error(c, "no compute shader");
+			if (c.dispatch.x <= 0 || c.dispatch.y <= 0 || c.dispatch.z <= 0)
+				error(c, "empty dispatch");
+			//discard dispatch desc set and increase.
+			descriptor_count++;
+		}
+
+		//CMD_GENERATE_MIPS
+		if (type == CMD_GENERATE_MIPS) {
+			auto it = mimages.find(name);
+			if (it == mimages.end() || !it->second.is_rendertarget || it->second.is_depth)
+				error(c, "generate mips of unknown render target");
+			else if (c.generate_mips.miplevel > it->second.maxmips)
+				error(c, "miplevel out of range");
+			//one desc set for every level.
+			descriptor_count++;
+		}
+
+		//CMD_RELEASE
+		if (type == CMD_RELEASE) {
+			auto it = mimages.find(name);
+			if (it == mimages.end() || it->second.is_rendertarget) {
+				error(c, "release of unknown texture");
+			} else {
+				mimages.erase(it);
+				release_memory(name);
+				for (auto & x : rec.vtextures)
+					if (x == name)
+						x.clear();
+			}
+		}
+
+		//CMD_UPDATE_TEXTURE
+		if (type == CMD_UPDATE_TEXTURE) {
+			auto it = mimages.find(name);
+			auto & r = c.set_texture.rect;
+			if (it == mimages.end() || it->second.is_rendertarget) {
+				error(c, "update of unknown texture");
+			} else if (c.set_texture.miplevel < 0 || c.set_texture.miplevel >= it->second.maxmips ||
+				!oden_is_texture_rect_valid(it->second.fmt, it->second.w, it->second.h, c.set_texture.miplevel, r.x, r.y, r.w, r.h)) {
+				error(c, "update rect out of range");
+			} else if (c.set_texture.stride_size && c.set_texture.stride_size < oden_get_texture_row_bytes(it->second.fmt, r.w)) {
+				error(c, "update stride is smaller than a row");
+			} else if (oden_get_cmd_size(c) < oden_get_texture_rect_size(it->second.fmt, r.w, r.h, c.set_texture.stride_size)) {
+				error(c, "update data is smaller than the rect");
+			} else {
+				trace_scope trace("upload", name);
+			}
+		}
+
+		auto cmd_ms = get_time_ms() - cmd_start;
+		vstats[type].count++;
+		vstats[type].cpu_ms += cmd_ms;
+
+		//There is no gpu. draws and dispatches only close a cpu segment.
+		segment_cpu_ms += cmd_ms;
+		if (is_pass_end(type)) {
+			vsegments.push_back({name, segment_cpu_ms, -1.0});
+			segment_cpu_ms = 0.0;
+			trace_complete("translate", name, segment_start, cmd_start + cmd_ms);
+			segment_start = cmd_start + cmd_ms;
+		}
+	}
+	if (!vcmd.empty() && !is_pass_end(vcmd.back().type)) {
+		vsegments.push_back({vcmd.back().name, segment_cpu_ms, -1.0});
+		trace_complete("translate", vcmd.back().name, segment_start, get_time_ms());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(frame_stats_mtx);
+		for (int i = 0 ; i < CMD_MAX; i++) {
+			vcmd_stats[i].count += vstats[i].count;
+			vcmd_stats[i].cpu_ms += vstats[i].cpu_ms;
+		}
+	}
+
+	//There is no gpu. the frame completes when translation ends.
+	frame_stats stats = {};
+	stats.frame = frame_count;
+	stats.frames_in_flight = get_frames_in_flight(count);
+	stats.cpu_wait_ms = 0.0;
+	stats.latency_ms = get_time_ms() - frame_start;
+	push_frame_stats(stats);
+	push_pass_stats(frame_count, vsegments, frame_start);
+
+	frame_count++;
+}
@@ -0,0 +1,344 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Block compression of runtime generated textures.
+//Endpoints are the extent of the block along its principal axis, indices are the
+//projection onto the endpoint line, 4 pixels per step.
+
+#include "oden_util.h"
+
+#include <string.h>
+#include <math.h>
+
+//ODEN_BC_NO_SIMD builds the scalar path, batfiles/check_bc.sh compares the two.
+#if !defined(ODEN_BC_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define ODEN_BC_SSE2
+#endif
+
+namespace odenutil
+{
+
+//16 pixels of a block, a row of floats per channel.
+struct bc_block {
+	float ch[4][16];
+};
+
+struct bc_bits {
+	uint64_t v[2] = {0, 0};
+	int pos = 0;
+
+	void put(uint64_t val, int n)
+	{
+		int i = pos >> 6;
+		int s = pos & 63;
+		v[i] |= val << s;
+		if (s + n > 64)
+			v[i + 1] |= val >> (64 - s);
+		pos += n;
+	}
+};
+
+static void
+load_block(bc_block & blk, const uint32_t *rgba, int w, int h, size_t stride, int bx, int by)
+{
+	//Edge blocks repeat the last pixel.
+	for (int y = 0; y < 4; y++) {
+		int sy = (std::min)(by * 4 + y, h - 1);
+		auto src = (const uint8_t *)rgba + stride * sy;
+		for (int x = 0; x < 4; x++) {
+			int sx = (std::min)(bx * 4 + x, w - 1);
+			for (int c = 0; c < 4; c++)
+				blk.ch[c][y * 4 + x] = src[sx * 4 + c];
+		}
+	}
+}
+
+//Index of every pixel on e0 -> e1 in steps, rounded to nearest.
+static void
+fit_indices(const bc_block & blk, int chbase, int nch, const float *e0, const float *e1, int steps, int *idx)
+{
+	float d[4] = {};
+	float dd = 0.0f;
+	for (int c = 0; c < nch; c++) {
+		d[c] = e1[c] - e0[c];
+		dd += d[c] * d[c];
+	}
+	if (dd == 0.0f) {
+		for (int i = 0; i < 16; i++)
+			idx[i] = 0;
+		return;
+	}
+	float scale = float(steps) / dd;
+#ifdef ODEN_BC_SSE2
+	for (int i = 0; i < 16; i += 4) {
+		__m128 t = _mm_setzero_ps();
+		for (int c = 0; c < nch; c++) {
+			__m128 p = _mm_sub_ps(_mm_loadu_ps(&blk.ch[chbase + c][i]), _mm_set1_ps(e0[c]));
+			t = _mm_add_ps(t, _mm_mul_ps(p, _mm_set1_ps(d[c])));
+		}
+		t = _mm_mul_ps(t, _mm_set1_ps(scale));
+		t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(float(steps)));
+		//t + 0.5 truncated like the scalar path, _mm_cvtps_epi32 would round half to even.
+		_mm_storeu_si128((__m128i *)&idx[i], _mm_cvttps_epi32(_mm_add_ps(t, _mm_set1_ps(0.5f))));
+	}
+#else
+	for (int i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (int c = 0; c < nch; c++)
+			t += (blk.ch[chbase + c][i] - e0[c]) * d[c];
+		t = (std::min)((std::max)(t * scale, 0.0f), float(steps));
+		idx[i] = int(t + 0.5f);
+	}
+#endif
+}
+
+//Extent of the block along the principal axis of nch channels.
+static void
+find_endpoints(const bc_block & blk, int nch, float *lo, float *hi)
+{
+	float mean[4] = {};
+	float vmin[4], vmax[4];
+	for (int c = 0; c < nch; c++) {
+		vmin[c] = vmax[c] = blk.ch[c][0];
+		for (int i = 0; i < 16; i++) {
+			mean[c] += blk.ch[c][i];
+			vmin[c] = (std::min)(vmin[c], blk.ch[c][i]);
+			vmax[c] = (std::max)(vmax[c], blk.ch[c][i]);
+		}
+		mean[c] /= 16.0f;
+	}
+
+	float cov[4][4] = {};
+	for (int i = 0; i < 16; i++)
+		for (int a = 0; a < nch; a++)
+			for (int b = a; b < nch; b++)
+				cov[a][b] += (blk.ch[a][i] - mean[a]) * (blk.ch[b][i] - mean[b]);
+	for (int a = 0; a < nch; a++)
+		for (int b = 0; b < a; b++)
+			cov[a][b] = cov[b][a];
+
+	//Power iteration from the bounding box diagonal.
+	float axis[4] = {};
+	for (int c = 0; c < nch; c++)
+		axis[c] = vmax[c] - vmin[c];
+	for (int n = 0; n < 8; n++) {
+		float next[4] = {};
+		float len = 0.0f;
+		for (int a = 0; a < nch; a++) {
+			for (int b = 0; b < nch; b++)
+				next[a] += cov[a][b] * axis[b];
+			len = (std::max)(len, fabsf(next[a]));
+		}
+		if (len == 0.0f)
+			break;
+		for (int c = 0; c < nch; c++)
+			axis[c] = next[c] / len;
+	}
+	float len = 0.0f;
+	for (int c = 0; c < nch; c++)
+		len += axis[c] * axis[c];
+	if (len == 0.0f) {
+		for (int c = 0; c < nch; c++)
+			lo[c] = hi[c] = mean[c];
+		return;
+	}
+	len = 1.0f / sqrtf(len);
+	for (int c = 0; c < nch; c++)
+		axis[c] *= len;
+
+	float tmin = 0.0f, tmax = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (int c = 0; c < nch; c++)
+			t += (blk.ch[c][i] - mean[c]) * axis[c];
+		tmin = (std::min)(tmin, t);
+		tmax = (std::max)(tmax, t);
+	}
+	for (int c = 0; c < nch; c++) {
+		lo[c] = (std::min)((std::max)(mean[c] + axis[c] * tmin, 0.0f), 255.0f);
+		hi[c] = (std::min)((std::max)(mean[c] + axis[c] * tmax, 0.0f), 255.0f);
+	}
+}
+
+static uint16_t
+pack_565(const float *c)
+{
+	int r = int(c[0] * 31.0f / 255.0f + 0.5f);
+	int g = int(c[1] * 63.0f / 255.0f + 0.5f);
+	int b = int(c[2] * 31.0f / 255.0f + 0.5f);
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void
+unpack_565(uint16_t v, float *c)
+{
+	int r = (v >> 11) & 31;
+	int g = (v >> 5) & 63;
+	int b = v & 31;
+	c[0] = float((r << 3) | (r >> 2));
+	c[1] = float((g << 2) | (g >> 4));
+	c[2] = float((b << 3) | (b >> 2));
+}
+
+//4 color mode : c0 > c1, palette c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1.
+static void
+encode_bc1(const bc_block & blk, uint8_t *dst)
+{
+	float lo[4], hi[4];
+	find_endpoints(blk, 3, lo, hi);
+	uint16_t c0 = pack_565(hi);
+	uint16_t c1 = pack_565(lo);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1) {
+		static const uint32_t remap[4] = {0, 2, 3, 1};
+		float e0[3], e1[3];
+		int idx[16];
+		unpack_565(c0, e0);
+		unpack_565(c1, e1);
+		fit_indices(blk, 0, 3, e0, e1, 3, idx);
+		for (int i = 0; i < 16; i++)
+			indices |= remap[idx[i]] << (i * 2);
+	}
+	memcpy(dst + 0, &c0, 2);
+	memcpy(dst + 2, &c1, 2);
+	memcpy(dst + 4, &indices, 4);
+}
+
+//8 value mode : r0 > r1, index 0 is r0, 1 is r1, 2 - 7 step from r0 to r1.
+static void
+encode_bc4(const bc_block & blk, int ch, uint8_t *dst)
+{
+	float lo = blk.ch[ch][0], hi = blk.ch[ch][0];
+	for (int i = 1; i < 16; i++) {
+		lo = (std::min)(lo, blk.ch[ch][i]);
+		hi = (std::max)(hi, blk.ch[ch][i]);
+	}
+	uint64_t indices = 0;
+	if (lo != hi) {
+		int idx[16];
+		fit_indices(blk, ch, 1, &lo, &hi, 7, idx);
+		for (int i = 0; i < 16; i++) {
+			uint64_t k = idx[i] == 7 ? 0 : idx[i] == 0 ? 1 : 8 - idx[i];
+			indices |= k << (i * 3);
+		}
+	}
+	dst[0] = uint8_t(hi);
+	dst[1] = uint8_t(lo);
+	for (int i = 0; i < 6; i++)
+		dst[2 + i] = uint8_t(indices >> (i * 8));
+}
+
+//7 bit endpoint and the p-bit closest to 8 bit value c.
+static void
+quantize_bc7_endpoint(const float *c, int *q, int & pbit)
+{
+	float best = -1.0f;
+	for (int p = 0; p < 2; p++) {
+		int t[4];
+		float err = 0.0f;
+		for (int i = 0; i < 4; i++) {
+			t[i] = (std::min)((std::max)(int((c[i] - p) * 0.5f + 0.5f), 0), 127);
+			float d = c[i] - float((t[i] << 1) | p);
+			err += d * d;
+		}
+		if (best < 0.0f || err < best) {
+			best = err;
+			pbit = p;
+			memcpy(q, t, sizeof(t));
+		}
+	}
+}
+
+//Mode 6 only : one subset, RGBA 7 bit endpoints with a p-bit each, 4 bit indices.
+static void
+encode_bc7(const bc_block & blk, uint8_t *dst)
+{
+	float lo[4], hi[4];
+	find_endpoints(blk, 4, lo, hi);
+	int q[2][4], pbit[2];
+	quantize_bc7_endpoint(lo, q[0], pbit[0]);
+	quantize_bc7_endpoint(hi, q[1], pbit[1]);
+	float e[2][4];
+	for (int n = 0; n < 2; n++)
+		for (int i = 0; i < 4; i++)
+			e[n][i] = float((q[n][i] << 1) | pbit[n]);
+	int idx[16];
+	fit_indices(blk, 0, 4, e[0], e[1], 15, idx);
+
+	//The first index is stored without its msb.
+	if (idx[0] & 8) {
+		std::swap(q[0], q[1]);
+		std::swap(pbit[0], pbit[1]);
+		for (int i = 0; i < 16; i++)
+			idx[i] = 15 - idx[i];
+	}
+
+	bc_bits bits;
+	bits.put(1 << 6, 7);
+	for (int i = 0; i < 4; i++) {
+		bits.put(q[0][i], 7);
+		bits.put(q[1][i], 7);
+	}
+	bits.put(pbit[0], 1);
+	bits.put(pbit[1], 1);
+	for (int i = 0; i < 16; i++)
+		bits.put(idx[i], i == 0 ? 3 : 4);
+	memcpy(dst, bits.v, 16);
+}
+
+bool EncodeBC(int fmt, const uint32_t *rgba, int w, int h, size_t stride, std::vector<uint8_t> & vout)
+{
+	if (!oden_is_block_format(fmt) || rgba == nullptr || w <= 0 || h <= 0)
+		return false;
+	if (stride == 0)
+		stride = w * sizeof(uint32_t);
+	int bw = (w + 3) / 4;
+	int bh = (h + 3) / 4;
+	size_t bytes = oden_get_format_bytes(fmt);
+	vout.resize(bw * bh * bytes);
+
+	bc_block blk;
+	for (int by = 0; by < bh; by++) {
+		for (int bx = 0; bx < bw; bx++) {
+			auto dst = vout.data() + (by * bw + bx) * bytes;
+			load_block(blk, rgba, w, h, stride, bx, by);
+			if (fmt == FMT_BC1_UNORM)
+				encode_bc1(blk, dst);
+			if (fmt == FMT_BC4_UNORM)
+				encode_bc4(blk, 0, dst);
+			if (fmt == FMT_BC5_UNORM) {
+				encode_bc4(blk, 0, dst);
+				encode_bc4(blk, 1, dst + 8);
+			}
+			if (fmt == FMT_BC7_UNORM)
+				encode_bc7(blk, dst);
+		}
+	}
+	return true;
+}
+
+};
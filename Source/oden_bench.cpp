@@ -0,0 +1,604 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Microbenchmarks for command recording and backend translation.
+//Every benchmark runs a fixed number of iterations per sample and a fixed
+//number of samples, and reports per iteration time statistics as JSON.
+//The backend is chosen at link time, see batfiles/make_bench_*.
+//
+//  oden_bench [--out oden_bench.json] [--samples 30] [--quick]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+#include "oden_util.h"
+#include "oden_platform.h"
+
+#include "MatrixStack.h"
+#include "Win.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define bench_dup _dup
+#define bench_dup2 _dup2
+#define bench_open _open
+#define bench_close _close
+#define bench_fileno _fileno
+#define BENCH_NULL_DEVICE "NUL"
+#else
+#include <unistd.h>
+#define bench_dup dup
+#define bench_dup2 dup2
+#define bench_open open
+#define bench_close close
+#define bench_fileno fileno
+#define BENCH_NULL_DEVICE "/dev/null"
+#endif //_WIN32
+
+#pragma comment(lib, "gdi32.lib")
+#pragma comment(lib, "user32.lib")
+#pragma comment(lib, "winmm.lib")
+#pragma comment(lib, "advapi32.lib")
+
+//Name reported in the JSON, and the import library on Windows.
+#ifndef ODEN_BENCH_BACKEND
+#define ODEN_BENCH_BACKEND "null"
+#endif //ODEN_BENCH_BACKEND
+
+#ifndef ODEN_BENCH_BACKEND_LIB
+#define ODEN_BENCH_BACKEND_LIB "NULL_ODEN.lib"
+#endif //ODEN_BENCH_BACKEND_LIB
+
+#pragma comment(lib, ODEN_BENCH_BACKEND_LIB)
+
+using namespace oden;
+using namespace odenutil;
+
+enum {
+	Width = 1280,
+	Height = 720,
+
+	BufferMax = 2,
+	ShaderSlotMax = 8,
+	ResourceMax = 8192,
+
+	TextureHeight = 256,
+	TextureWidth = 256,
+};
+
+struct bench_result {
+	std::string name;
+	uint32_t iterations;
+	std::vector<double> vsamples; //ns per iteration
+};
+
+struct bench_context {
+	uint32_t samples = 30;
+	uint32_t scale = 1;
+	void *handle = nullptr;
+	uint64_t frame = 0;
+	std::vector<bench_result> vresults;
+};
+
+static double
+get_time_ns()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double, std::nano>(now).count();
+}
+
+//fn(iterations) runs the timed work. setup runs untimed before each sample.
+template<typename F, typename S>
+static void
+run_bench(bench_context & ctx, std::string name, uint32_t iterations, S setup, F fn)
+{
+	bench_result result;
+	result.name = name;
+	result.iterations = iterations;
+
+	//warm up once, not recorded.
+	setup();
+	fn(iterations);
+	for (uint32_t i = 0; i < ctx.samples; i++) {
+		setup();
+		double start = get_time_ns();
+		fn(iterations);
+		result.vsamples.push_back((get_time_ns() - start) / iterations);
+	}
+	auto v = result.vsamples;
+	std::sort(v.begin(), v.end());
+	printf("%-48s median %12.1f ns  min %12.1f ns\n", name.c_str(), v[v.size() / 2], v[0]);
+	ctx.vresults.push_back(result);
+}
+
+template<typename F>
+static void
+run_bench(bench_context & ctx, std::string name, uint32_t iterations, F fn)
+{
+	run_bench(ctx, name, iterations, []() {}, fn);
+}
+
+//DebugPrint writes to stdout. Send it to the null device while timing.
+static int
+mute_stdout()
+{
+	fflush(stdout);
+	int saved = bench_dup(bench_fileno(stdout));
+	int fd = bench_open(BENCH_NULL_DEVICE, O_WRONLY);
+	if (fd >= 0) {
+		bench_dup2(fd, bench_fileno(stdout));
+		bench_close(fd);
+	}
+	return saved;
+}
+
+static void
+unmute_stdout(int saved)
+{
+	fflush(stdout);
+	if (saved >= 0) {
+		bench_dup2(saved, bench_fileno(stdout));
+		bench_close(saved);
+	}
+}
+
+struct vertex_format {
+	float pos[4];
+	float nor[3];
+	float uv[2];
+};
+
+static const vertex_format vtx_rect[] = {
+	{{-1, 1, 0, 1}, {0,  1,  1}, { 0, 1}},
+	{{-1, -1, 0, 1}, {0,  1,  1}, { 0, 0}},
+	{{ 1, 1, 0, 1}, {0,  1,  1}, { 1, 1}},
+	{{ 1, -1, 0, 1}, {0,  1,  1}, { 1, 0}},
+};
+
+static const uint32_t idx_rect[] = {
+	0, 1, 2,
+	2, 1, 3
+};
+
+static const vertex_format vtx_cube[] = {
+	{{-1, -1,  1, 1}, {0, 0, -1}, {-1, -1}},
+	{{ 1, -1,  1, 1}, {0, 0, -1}, { 1, -1}},
+	{{ 1,  1,  1, 1}, {0, 0, -1}, { 1,  1}},
+	{{-1,  1,  1, 1}, {0, 0, -1}, {-1,  1}},
+	{{-1, -1, -1, 1}, {0, 0,  1}, {-1, -1}},
+	{{ 1, -1, -1, 1}, {0, 0,  1}, { 1, -1}},
+	{{ 1,  1, -1, 1}, {0, 0,  1}, { 1,  1}},
+	{{-1,  1, -1, 1}, {0, 0,  1}, {-1,  1}},
+};
+
+static const uint32_t idx_cube[] = {
+	0, 1, 2, 2, 3, 0,
+	3, 2, 6, 6, 7, 3,
+	7, 6, 5, 5, 4, 7,
+	4, 5, 1, 1, 0, 4,
+	4, 0, 3, 3, 7, 4,
+	1, 5, 6, 6, 2, 1,
+};
+
+struct constdata {
+	float time[4];
+	float misc[4];
+	float world[16];
+	float proj[16];
+	float view[16];
+};
+
+static std::vector<uint32_t> &
+get_test_texture()
+{
+	static std::vector<uint32_t> vtex;
+	if (vtex.empty())
+		for (int y = 0; y < TextureHeight; y++)
+			for (int x = 0; x < TextureWidth; x++)
+				vtex.push_back((x ^ y) * 1110);
+	return vtex;
+}
+
+//The sample uploads it as BC1.
+static std::vector<uint8_t> &
+get_test_texture_bc1()
+{
+	static std::vector<uint8_t> vtex_bc;
+	if (vtex_bc.empty()) {
+		auto & vtex = get_test_texture();
+		EncodeBC(FMT_BC1_UNORM, vtex.data(), TextureWidth, TextureHeight, TextureWidth * sizeof(uint32_t), vtex_bc);
+	}
+	return vtex_bc;
+}
+
+//Same passes as sample_code.cpp : offscreen cubes, bloom, present, depth view.
+static void
+record_sample_frame(std::vector<cmd> & vcmd, uint64_t frame)
+{
+	auto buffer_index = frame % BufferMax;
+	auto index_name = std::to_string(buffer_index);
+	auto backbuffer_name = oden_get_backbuffer_name(buffer_index);
+	auto offscreen_name = "offscreen" + index_name;
+	auto offscreen_depth_name = oden_get_depth_render_target_name(offscreen_name);
+	auto constant_name = "constcommon" + index_name;
+	auto & vtex_bc = get_test_texture_bc1();
+	float clear_color[] = {0, 1, 1, 1};
+	constdata cdata = {};
+	MatrixStack stack;
+
+	cdata.time[0] = float (frame) / 1000.0f;
+	stack.Reset();
+	stack.Scaling(16, 16, 16);
+	stack.GetTop(cdata.world);
+	stack.Reset();
+	float tm = float (frame) * 0.01f;
+	stack.LoadLookAt(64.0f * cos(tm), 64.0f * sin(tm * 0.3f), 64.0f * sin(tm * 0.8f), 0, 0, 0, 0, 1, 0);
+	stack.GetTop(cdata.view);
+	stack.Reset();
+	stack.LoadPerspective((3.141592653f / 180.0f) * 90.0f, float (Width) / float (Height), 0.5f, 1024.0f);
+	stack.GetTop(cdata.proj);
+
+	SetRenderTarget(vcmd, offscreen_name, Width, Height);
+	SetShader(vcmd, "./shaders/clear", false, false, false);
+	ClearRenderTarget(vcmd, offscreen_name, clear_color);
+	ClearDepthRenderTarget(vcmd, offscreen_name, 1.0f);
+	SetConstant(vcmd, constant_name, 0, &cdata, sizeof(cdata));
+	SetVertex(vcmd, "clear_vb", (void *)vtx_rect, sizeof(vtx_rect), sizeof(vertex_format));
+	SetIndex(vcmd, "clear_ib", (void *)idx_rect, sizeof(idx_rect));
+	DrawIndex(vcmd, "clear_draw", 0, _countof(idx_rect));
+
+	ClearDepthRenderTarget(vcmd, offscreen_name, 1.0f);
+	SetShader(vcmd, "./shaders/model", false, false, true);
+	cdata.misc[0] = 0.0f;
+	SetConstant(vcmd, constant_name, 0, &cdata, sizeof(cdata));
+	SetTexture(vcmd, "testtex", 0, TextureWidth, TextureHeight, vtex_bc.data(), vtex_bc.size(), vtex_bc.size() / ((TextureHeight + 3) / 4), FMT_BC1_UNORM);
+	SetVertex(vcmd, "cube_vb", (void *)vtx_cube, sizeof(vtx_cube), sizeof(vertex_format));
+	SetIndex(vcmd, "cube_ib", (void *)idx_cube, sizeof(idx_cube));
+	DrawIndex(vcmd, "cube_draw", 0, _countof(idx_cube));
+
+	SetShader(vcmd, "./shaders/model", false, false, true);
+	cdata.misc[0] = 1.0f;
+	SetConstant(vcmd, constant_name + "head", 0, &cdata, sizeof(cdata));
+	SetTexture(vcmd, "testtex", 0);
+	DrawIndex(vcmd, "cube_draw", 0, _countof(idx_cube));
+
+	BloomParams bparams;
+	bparams.threshold = 0.5f;
+	float presentinfo[8];
+	auto bloomscreen_name = Bloom(vcmd, offscreen_name, "bloom" + index_name, Width, Height, bparams, presentinfo + 4);
+	GetScaledUv(Width, Height, Width, Height, presentinfo);
+
+	SetRenderTarget(vcmd, backbuffer_name, Width, Height, true);
+	SetShader(vcmd, "./shaders/present", false, false, false);
+	ClearRenderTarget(vcmd, backbuffer_name, clear_color);
+	ClearDepthRenderTarget(vcmd, backbuffer_name, 1.0f);
+	SetConstant(vcmd, "presentinfo" + index_name, 0, presentinfo, sizeof(presentinfo));
+	SetTexture(vcmd, offscreen_name, 0);
+	SetTexture(vcmd, bloomscreen_name, 1);
+	SetVertex(vcmd, "present_vb", (void *)vtx_rect, sizeof(vtx_rect), sizeof(vertex_format));
+	SetIndex(vcmd, "present_ib", (void *)idx_rect, sizeof(idx_rect));
+	DrawIndex(vcmd, "present_draw", 0, _countof(idx_rect));
+
+	SetRenderTarget(vcmd, backbuffer_name, Width, Height, true);
+	SetShader(vcmd, "./shaders/showdepth", false, false, false);
+	SetTexture(vcmd, offscreen_depth_name, 0);
+	SetVertex(vcmd, "present_vb", (void *)vtx_rect, sizeof(vtx_rect), sizeof(vertex_format));
+	SetIndex(vcmd, "present_ib", (void *)idx_rect, sizeof(idx_rect));
+	DrawIndex(vcmd, "present_draw", 0, _countof(idx_rect));
+
+	SetBarrierToPresent(vcmd, backbuffer_name);
+}
+
+static void
+present(bench_context & ctx, std::vector<cmd> & vcmd)
+{
+	oden_present_graphics("oden_bench", vcmd, ctx.handle, Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
+	vcmd.clear();
+	ctx.frame++;
+}
+
+static void
+bench_builders(bench_context & ctx)
+{
+	const uint32_t n = 1024 * ctx.scale;
+	std::vector<cmd> vcmd;
+	float color[4] = {0, 1, 1, 1};
+	uint8_t constant[sizeof(constdata)] = {};
+	auto & vtex = get_test_texture();
+	auto & vtex_bc = get_test_texture_bc1();
+	auto reset = [&]() {
+		vcmd.clear();
+		vcmd.reserve(n);
+	};
+
+	run_bench(ctx, "builder/SetBarrierToPresent", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetBarrierToPresent(vcmd, "backbuffer0");
+	});
+	run_bench(ctx, "builder/SetBarrierToRenderTarget", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetBarrierToRenderTarget(vcmd, "offscreen0");
+	});
+	run_bench(ctx, "builder/SetBarrierToTexture", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetBarrierToTexture(vcmd, "offscreen0");
+	});
+	run_bench(ctx, "builder/SetRenderTarget", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetRenderTarget(vcmd, "offscreen0", Width, Height);
+	});
+	run_bench(ctx, "builder/SetShader", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetShader(vcmd, "./shaders/model", false, false, true);
+	});
+	run_bench(ctx, "builder/ClearRenderTarget", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			ClearRenderTarget(vcmd, "offscreen0", color);
+	});
+	run_bench(ctx, "builder/ClearDepthRenderTarget", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			ClearDepthRenderTarget(vcmd, "offscreen0", 1.0f);
+	});
+	run_bench(ctx, "builder/SetConstant", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetConstant(vcmd, "constcommon0", 0, constant, sizeof(constant));
+	});
+	run_bench(ctx, "builder/SetVertex", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetVertex(vcmd, "cube_vb", (void *)vtx_cube, sizeof(vtx_cube), sizeof(vertex_format));
+	});
+	run_bench(ctx, "builder/SetIndex", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetIndex(vcmd, "cube_ib", (void *)idx_cube, sizeof(idx_cube));
+	});
+	run_bench(ctx, "builder/SetTexture", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetTexture(vcmd, "testtex", 0);
+	});
+	run_bench(ctx, "builder/SetTexture_upload_256x256", n / 16, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetTexture(vcmd, "testtex", 0, TextureWidth, TextureHeight, vtex.data(), vtex.size() * sizeof(uint32_t), TextureWidth * sizeof(uint32_t));
+	});
+	run_bench(ctx, "builder/SetTexture_upload_256x256_bc1", n / 16, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetTexture(vcmd, "testtex", 0, TextureWidth, TextureHeight, vtex_bc.data(), vtex_bc.size(), vtex_bc.size() / ((TextureHeight + 3) / 4), FMT_BC1_UNORM);
+	});
+	run_bench(ctx, "builder/SetTextureUav", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			SetTextureUav(vcmd, "offscreen0", 1, 0, 0, 1, nullptr, 0);
+	});
+	run_bench(ctx, "builder/DrawIndex", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			DrawIndex(vcmd, "cube_draw", 0, _countof(idx_cube));
+	});
+	run_bench(ctx, "builder/Draw", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			Draw(vcmd, "cube_draw", 36);
+	});
+	run_bench(ctx, "builder/Dispatch", n, reset, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++)
+			Dispatch(vcmd, "mipoffscreen0", 640, 360, 1);
+	});
+
+	static const char *bloom_names[BLOOM_QUALITY_MAX] = {"low", "medium", "high"};
+	for (int q = 0; q < BLOOM_QUALITY_MAX; q++) {
+		BloomParams bparams;
+		bparams.quality = q;
+		run_bench(ctx, std::string("builder/Bloom_") + bloom_names[q], n / 16, reset, [&](uint32_t count) {
+			for (uint32_t i = 0; i < count; i++)
+				Bloom(vcmd, "offscreen0", "bloom0", Width, Height, bparams);
+		});
+	}
+
+	static const int bc_formats[] = {FMT_BC1_UNORM, FMT_BC4_UNORM, FMT_BC5_UNORM, FMT_BC7_UNORM};
+	static const char *bc_names[] = {"bc1", "bc4", "bc5", "bc7"};
+	std::vector<uint8_t> vout;
+	for (int i = 0; i < 4; i++) {
+		run_bench(ctx, std::string("builder/EncodeBC_256x256_") + bc_names[i], (std::max)(n / 256, 1u), reset, [&](uint32_t count) {
+			for (uint32_t k = 0; k < count; k++)
+				EncodeBC(bc_formats[i], vtex.data(), TextureWidth, TextureHeight, TextureWidth * sizeof(uint32_t), vout);
+		});
+	}
+}
+
+static void
+bench_recording(bench_context & ctx)
+{
+	const uint32_t n = 64 * ctx.scale;
+	std::vector<cmd> vcmd;
+
+	run_bench(ctx, "record/sample_frame", n, [&]() {
+		vcmd.clear();
+	}, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++) {
+			vcmd.clear();
+			record_sample_frame(vcmd, i);
+		}
+	});
+
+	vcmd.clear();
+	record_sample_frame(vcmd, 0);
+	run_bench(ctx, "debugprint/sample_frame", 16 * ctx.scale, [&](uint32_t count) {
+		int saved = mute_stdout();
+		for (uint32_t i = 0; i < count; i++)
+			DebugPrint(vcmd);
+		unmute_stdout(saved);
+	});
+}
+
+//Whole frames through the linked backend, then the backend's own per command split.
+static void
+bench_translation(bench_context & ctx)
+{
+	const uint32_t n = 8 * ctx.scale;
+	std::vector<cmd> vcmd;
+	std::vector<cmd_stats> vstats;
+	std::vector<std::vector<double>> vcmd_ns(CMD_MAX);
+
+	//first frames create resources and pipelines.
+	for (int i = 0; i < BufferMax * 2; i++) {
+		record_sample_frame(vcmd, ctx.frame);
+		present(ctx, vcmd);
+	}
+	oden_get_cmd_stats(vstats);
+
+	run_bench(ctx, "present/sample_frame", n, [&](uint32_t count) {
+		for (uint32_t i = 0; i < count; i++) {
+			record_sample_frame(vcmd, ctx.frame);
+			present(ctx, vcmd);
+		}
+		oden_get_cmd_stats(vstats);
+		for (size_t t = 0; t < vstats.size() && t < CMD_MAX; t++)
+			if (vstats[t].count)
+				vcmd_ns[t].push_back(vstats[t].cpu_ms * 1.0e6 / vstats[t].count);
+	});
+
+	//The warm up sample is first. Backends without cmd_stats report nothing.
+	for (int t = 0; t < CMD_MAX; t++) {
+		if (vcmd_ns[t].size() < 2)
+			continue;
+		bench_result result;
+		result.name = std::string("translate/") + oden_get_cmd_name(t);
+		result.iterations = 1;
+		result.vsamples.assign(vcmd_ns[t].begin() + 1, vcmd_ns[t].end());
+		ctx.vresults.push_back(result);
+	}
+}
+
+//SetTexture by name with more and more live textures in the backend.
+static void
+bench_lookup(bench_context & ctx)
+{
+	const uint32_t n = 1024 * ctx.scale;
+	const uint32_t vcounts[] = {16, 256, 4096};
+	uint32_t created = 0;
+	uint32_t texel[4 * 4] = {};
+	std::vector<cmd> vcmd;
+	std::vector<cmd_stats> vstats;
+
+	for (auto count : vcounts) {
+		//A frame needs a target to be valid for every backend.
+		for (; created < count; created++)
+			SetTexture(vcmd, "lookup" + std::to_string(created), 0, 4, 4, texel, sizeof(texel), 4 * sizeof(uint32_t));
+		SetRenderTarget(vcmd, oden_get_backbuffer_name(ctx.frame % BufferMax), Width, Height, true);
+		SetBarrierToPresent(vcmd, oden_get_backbuffer_name(ctx.frame % BufferMax));
+		present(ctx, vcmd);
+
+		std::vector<std::string> vnames;
+		uint32_t seed = 12345;
+		for (uint32_t i = 0; i < n; i++) {
+			seed = seed * 1664525 + 1013904223;
+			vnames.push_back("lookup" + std::to_string((seed >> 8) % count));
+		}
+		run_bench(ctx, "lookup/SetTexture/resources=" + std::to_string(count), n, [&]() {
+			vcmd.clear();
+			auto backbuffer_name = oden_get_backbuffer_name(ctx.frame % BufferMax);
+			SetRenderTarget(vcmd, backbuffer_name, Width, Height, true);
+			for (auto & name : vnames)
+				SetTexture(vcmd, name, 0);
+			SetBarrierToPresent(vcmd, backbuffer_name);
+		}, [&](uint32_t) {
+			present(ctx, vcmd);
+		});
+	}
+}
+
+static void
+write_json(bench_context & ctx, const char *filename)
+{
+	FILE *fp = fopen(filename, "w");
+	if (fp == nullptr) {
+		printf("ERR : cannot open %s\n", filename);
+		return;
+	}
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"backend\": \"%s\",\n", ODEN_BENCH_BACKEND);
+	fprintf(fp, "  \"unit\": \"ns\",\n");
+	fprintf(fp, "  \"samples\": %u,\n", ctx.samples);
+	fprintf(fp, "  \"benchmarks\": [\n");
+	for (size_t i = 0; i < ctx.vresults.size(); i++) {
+		auto & r = ctx.vresults[i];
+		auto v = r.vsamples;
+		std::sort(v.begin(), v.end());
+		double mean = 0.0;
+		for (auto x : v)
+			mean += x;
+		mean /= v.size();
+		double var = 0.0;
+		for (auto x : v)
+			var += (x - mean) * (x - mean);
+		double stddev = v.size() > 1 ? sqrt(var / (v.size() - 1)) : 0.0;
+		fprintf(fp, "    {\"name\": \"%s\", \"iterations\": %u, \"samples\": %zu, "
+			"\"min\": %.3f, \"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f, \"p90\": %.3f, \"max\": %.3f}%s\n",
+			r.name.c_str(), r.iterations, v.size(),
+			v.front(), v[v.size() / 2], mean, stddev, v[(v.size() * 9) / 10], v.back(),
+			i + 1 < ctx.vresults.size() ? "," : "");
+	}
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+	fclose(fp);
+	printf("write : %s\n", filename);
+}
+
+int main(int argc, char *argv[])
+{
+	bench_context ctx;
+	const char *out = "oden_bench.json";
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--out" && i + 1 < argc)
+			out = argv[++i];
+		else if (arg == "--samples" && i + 1 < argc)
+			ctx.samples = (std::max)(atoi(argv[++i]), 2);
+		else if (arg == "--quick")
+			ctx.samples = 5;
+		else {
+			printf("unknown option %s\n", argv[i]);
+			printf("usage : %s [--out oden_bench.json] [--samples 30] [--quick]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("backend : %s, samples : %u\n", ODEN_BENCH_BACKEND, ctx.samples);
+	ctx.handle = InitWindow("oden_bench", Width, Height);
+
+	bench_builders(ctx);
+	bench_recording(ctx);
+	bench_translation(ctx);
+	bench_lookup(ctx);
+
+	std::vector<cmd> vcmd;
+	oden_present_graphics("oden_bench", vcmd, nullptr, Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
+
+	write_json(ctx, out);
+	return 0;
+}
@@ -0,0 +1,263 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Per thread single producer / single consumer rings of log records.
+//The producer is the owning thread, the consumer is whoever holds drain_mtx.
+
+#include "ODEN.h"
+#include "oden_log.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+using namespace oden;
+
+static_assert(sizeof(log_record) == ODEN_LOG_RECORD_SIZE, "log_record size");
+
+enum {
+	LOG_RING_SIZE = 1024, //power of 2.
+	LOG_WRITER_INTERVAL_MS = 5,
+};
+
+struct log_ring {
+	std::atomic<uint32_t> head{0};
+	std::atomic<uint32_t> tail{0};
+	std::atomic<uint32_t> dropped{0};
+	log_record vrecords[LOG_RING_SIZE];
+};
+
+std::atomic<int> oden::log_level(ODEN_LOG_LEVEL_INFO);
+
+static std::mutex ring_mtx;
+static std::vector<log_ring *> vrings;
+static std::mutex drain_mtx;
+
+//Rings live until exit, a thread may end before its records are written.
+static thread_local log_ring *ring = nullptr;
+
+static void
+format_record(const log_record & r, std::string & line)
+{
+	char buf[512];
+	if (r.level == ODEN_LOG_LEVEL_MAIN)
+		line = "MAIN : ";
+	else if (r.level == ODEN_LOG_LEVEL_INFO)
+		line = std::string("INFO : ") + r.func + ":";
+	else
+		line = std::string("ERR : ") + r.func + ":";
+
+	int argi = 0;
+	auto next = [&](uint64_t & v, bool & is_string) {
+		is_string = argi < r.argc && (r.string_mask & (1u << argi));
+		v = argi < r.argc ? r.args[argi] : 0;
+		argi++;
+	};
+	for (const char *p = r.fmt; *p; ) {
+		if (*p != '%') {
+			line += *p++;
+			continue;
+		}
+		if (p[1] == '%') {
+			line += '%';
+			p += 2;
+			continue;
+		}
+
+		//%[flags][width][.precision][length]conversion. * is taken from the args.
+		std::string spec = "%";
+		const char *q = p + 1;
+		while (*q && strchr("-+ #0", *q))
+			spec += *q++;
+		for (int i = 0; i < 2; i++) {
+			if (i == 1) {
+				if (*q != '.')
+					break;
+				spec += *q++;
+			}
+			if (*q == '*') {
+				uint64_t v = 0;
+				bool is_string = false;
+				next(v, is_string);
+				spec += std::to_string((int)v);
+				q++;
+			}
+			while (*q >= '0' && *q <= '9')
+				spec += *q++;
+		}
+		std::string length;
+		while (*q && strchr("hlLqjzt", *q))
+			length += *q++;
+		char conv = *q ? *q++ : '\0';
+		p = q;
+
+		uint64_t v = 0;
+		bool is_string = false;
+		if (conv != '\0' && conv != 'n')
+			next(v, is_string);
+
+		//Integers are printed as long long after truncating to the original width.
+		bool is_signed = conv == 'd' || conv == 'i';
+		if (is_signed || strchr("uxXoc", conv)) {
+			if (length == "hh")
+				v = is_signed ? (uint64_t)(int64_t)(signed char)v : (uint8_t)v;
+			else if (length == "h")
+				v = is_signed ? (uint64_t)(int64_t)(short)v : (uint16_t)v;
+			else if (length.empty() || conv == 'c')
+				v = is_signed ? (uint64_t)(int64_t)(int)v : (uint32_t)v;
+			else if (length == "l")
+				v = is_signed ? (uint64_t)(int64_t)(long)v : (unsigned long)v;
+			if (conv == 'c')
+				snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int)v);
+			else if (is_signed)
+				snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), (long long)v);
+			else
+				snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), (unsigned long long)v);
+		} else if (conv && strchr("fFeEgGaA", conv)) {
+			double d = 0.0;
+			memcpy(&d, &v, sizeof(d));
+			snprintf(buf, sizeof(buf), (spec + conv).c_str(), d);
+		} else if (conv == 's') {
+			snprintf(buf, sizeof(buf), (spec + "s").c_str(), is_string ? r.text + v : "(not a string)");
+		} else if (conv == 'p') {
+			snprintf(buf, sizeof(buf), (spec + "p").c_str(), (void *)(uintptr_t)v);
+		} else {
+			buf[0] = '\0';
+		}
+		line += buf;
+	}
+}
+
+static void
+drain_rings(void)
+{
+	std::vector<log_ring *> vtemp;
+	{
+		std::lock_guard<std::mutex> lock(ring_mtx);
+		vtemp = vrings;
+	}
+	std::string line;
+	for (auto x : vtemp) {
+		auto tail = x->tail.load(std::memory_order_relaxed);
+		auto head = x->head.load(std::memory_order_acquire);
+		for (; tail != head; tail++) {
+			format_record(x->vrecords[tail & (LOG_RING_SIZE - 1)], line);
+			fputs(line.c_str(), stdout);
+		}
+		x->tail.store(tail, std::memory_order_release);
+		auto dropped = x->dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped)
+			printf("LOG : %u records dropped, the ring was full\n", dropped);
+	}
+	fflush(stdout);
+}
+
+struct log_writer {
+	std::thread thread;
+	std::atomic<bool> is_stop{false};
+
+	void start(void)
+	{
+		thread = std::thread([this] {
+			while (!is_stop.load()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(LOG_WRITER_INTERVAL_MS));
+				std::lock_guard<std::mutex> lock(drain_mtx);
+				drain_rings();
+			}
+		});
+	}
+
+	~log_writer()
+	{
+		is_stop = true;
+#ifdef _WIN32
+		//Other threads are already gone at DLL detach, joining would wait on the loader lock.
+		if (thread.joinable())
+			thread.detach();
+#else
+		if (thread.joinable())
+			thread.join();
+#endif //_WIN32
+		std::unique_lock<std::mutex> lock(drain_mtx, std::try_to_lock);
+		if (lock.owns_lock())
+			drain_rings();
+	}
+};
+
+static log_writer writer;
+
+log_record *
+oden::log_begin(int level, const char *func, const char *fmt)
+{
+	if (ring == nullptr) {
+		std::lock_guard<std::mutex> lock(ring_mtx);
+		ring = new log_ring();
+		vrings.push_back(ring);
+		if (!writer.thread.joinable())
+			writer.start();
+	}
+	auto head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_SIZE) {
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	auto & r = ring->vrecords[head & (LOG_RING_SIZE - 1)];
+	r.fmt = fmt;
+	r.func = func;
+	r.level = (uint8_t)level;
+	r.argc = 0;
+	r.text_size = 0;
+	r.string_mask = 0;
+	return &r;
+}
+
+void
+oden::log_commit(log_record *r)
+{
+	auto level = r->level;
+	ring->head.fetch_add(1, std::memory_order_release);
+	if (level >= ODEN_LOG_LEVEL_ERR)
+		log_flush();
+}
+
+void
+oden::log_flush(void)
+{
+	std::lock_guard<std::mutex> lock(drain_mtx);
+	drain_rings();
+}
+
+void
+oden::oden_log_set_level(int level)
+{
+	log_level = level;
+}
+
+void
+oden::oden_log_flush(void)
+{
+	log_flush();
+}
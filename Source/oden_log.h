@@ -0,0 +1,168 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#pragma once
+
+//Binary log records for the backends.
+//A record is the format string pointer, the function name and up to
+//ODEN_LOG_ARG_MAX arguments stored as 8 byte slots. Strings are copied into
+//the record. The calling thread only fills a record in its own ring, a
+//writer thread formats them later. Records of a full ring are dropped and
+//counted, the hot thread never waits.
+//
+//Levels below ODEN_LOG_LEVEL are compiled out, arguments are not evaluated.
+//The rest are filtered at runtime by oden_log_set_level.
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+
+//Same values as oden_log_set_level in ODEN.h.
+#define ODEN_LOG_LEVEL_MAIN 0 //verbose per command diagnostics.
+#define ODEN_LOG_LEVEL_INFO 1
+#define ODEN_LOG_LEVEL_ERR  2 //formatted before the call returns, errors often end with exit().
+#define ODEN_LOG_LEVEL_NONE 3
+
+//MAIN is compiled out by default, it is in the per command paths.
+#ifndef ODEN_LOG_LEVEL
+#define ODEN_LOG_LEVEL ODEN_LOG_LEVEL_INFO
+#endif //ODEN_LOG_LEVEL
+
+namespace oden
+{
+
+enum {
+	ODEN_LOG_ARG_MAX = 8,
+	ODEN_LOG_RECORD_SIZE = 256,
+};
+
+struct log_record {
+	const char *fmt;
+	const char *func;
+	uint8_t level;
+	uint8_t argc;
+	uint16_t text_size;
+	uint32_t string_mask; //bit n : args[n] is an offset in text.
+	uint64_t args[ODEN_LOG_ARG_MAX];
+	char text[ODEN_LOG_RECORD_SIZE - 24 - 8 * ODEN_LOG_ARG_MAX];
+};
+
+extern std::atomic<int> log_level;
+
+inline bool
+log_is_enabled(int level)
+{
+	return level >= ODEN_LOG_LEVEL && level >= log_level.load(std::memory_order_relaxed);
+}
+
+//nullptr when the ring is full.
+log_record *
+log_begin(int level, const char *func, const char *fmt);
+
+void
+log_commit(log_record *r);
+
+//Format every pending record now.
+void
+log_flush(void);
+
+inline void
+log_arg(log_record & r, const char *s)
+{
+	if (s == nullptr)
+		s = "(null)";
+	size_t room = sizeof(r.text) - r.text_size;
+	size_t len = room ? (std::min)(strlen(s), room - 1) : 0;
+	r.string_mask |= 1u << r.argc;
+	r.args[r.argc++] = r.text_size;
+	if (room == 0)
+		return;
+	memcpy(r.text + r.text_size, s, len);
+	r.text[r.text_size + len] = '\0';
+	r.text_size += (uint16_t)(len + 1);
+}
+
+inline void
+log_arg(log_record & r, char *s)
+{
+	log_arg(r, (const char *)s);
+}
+
+template<typename T>
+inline void
+log_arg(log_record & r, T *p)
+{
+	r.args[r.argc++] = (uint64_t)(uintptr_t)p;
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+log_arg(log_record & r, T v)
+{
+	r.args[r.argc++] = (uint64_t)(int64_t)v;
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+log_arg(log_record & r, T v)
+{
+	double d = (double)v;
+	memcpy(&r.args[r.argc++], &d, sizeof(d));
+}
+
+//fmt must be a string literal, the writer reads it later.
+template<typename... Args>
+inline void
+log_write(int level, const char *func, const char *fmt, Args... args)
+{
+	static_assert(sizeof...(Args) <= ODEN_LOG_ARG_MAX, "too many log arguments");
+	if (!log_is_enabled(level))
+		return;
+	auto r = log_begin(level, func, fmt);
+	if (r == nullptr)
+		return;
+	int expand[] = {0, (log_arg(*r, args), 0)...};
+	(void)expand;
+	log_commit(r);
+}
+
+} //oden
+
+#if ODEN_LOG_LEVEL <= ODEN_LOG_LEVEL_MAIN
+#define ODEN_LOG_MAIN(...) oden::log_write(ODEN_LOG_LEVEL_MAIN, __func__, __VA_ARGS__)
+#else
+#define ODEN_LOG_MAIN(...) ((void)0)
+#endif
+
+#if ODEN_LOG_LEVEL <= ODEN_LOG_LEVEL_INFO
+#define ODEN_LOG_INFO(...) oden::log_write(ODEN_LOG_LEVEL_INFO, __func__, __VA_ARGS__)
+#else
+#define ODEN_LOG_INFO(...) ((void)0)
+#endif
+
+#if ODEN_LOG_LEVEL <= ODEN_LOG_LEVEL_ERR
+#define ODEN_LOG_ERR(...) oden::log_write(ODEN_LOG_LEVEL_ERR, __func__, __VA_ARGS__)
+#else
+#define ODEN_LOG_ERR(...) ((void)0)
+#endif
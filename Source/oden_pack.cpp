@@ -0,0 +1,413 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "oden_pack.h"
+
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif //_WIN32
+
+namespace odenutil
+{
+
+static const char pack_magic[8] = {'O', 'D', 'E', 'N', 'P', 'A', 'C', 'K'};
+
+//Chunk of a reader thread. Large enough for the device queue, small enough to spread over threads.
+static const uint64_t pack_read_chunk = 8ull << 20;
+
+static uint64_t
+pack_align(uint64_t x)
+{
+	return (x + PACK_ALIGN - 1) & ~(PACK_ALIGN - 1);
+}
+
+static bool
+pack_read_at(void *file, uint8_t *dest, uint64_t offset, uint64_t size)
+{
+	while (size) {
+#ifdef _WIN32
+		OVERLAPPED ov = {};
+		ov.Offset = DWORD(offset);
+		ov.OffsetHigh = DWORD(offset >> 32);
+		DWORD len = DWORD((std::min)(size, uint64_t(1) << 30));
+		DWORD done = 0;
+		if (!ReadFile((HANDLE)file, dest, len, &done, &ov) || done == 0)
+			return false;
+#else
+		auto done = pread((int)(intptr_t)file, dest, size_t((std::min)(size, uint64_t(1) << 30)), off_t(offset));
+		if (done < 0 && errno == EINTR)
+			continue;
+		if (done <= 0)
+			return false;
+#endif //_WIN32
+		dest += done;
+		offset += done;
+		size -= done;
+	}
+	return true;
+}
+
+AssetPack::~AssetPack()
+{
+	Close();
+}
+
+void AssetPack::Close()
+{
+#ifdef _WIN32
+	if (is_mapped)
+		UnmapViewOfFile(base);
+	if (mapping)
+		CloseHandle((HANDLE)mapping);
+	if (file)
+		CloseHandle((HANDLE)file);
+	mapping = nullptr;
+	file = nullptr;
+#else
+	if (is_mapped)
+		munmap((void *)base, size_t(size));
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+#endif //_WIN32
+	vread.reset();
+	base = nullptr;
+	size = 0;
+	is_mapped = false;
+	ventries.clear();
+	mentries.clear();
+}
+
+//Threads take the chunks in order, so the reads stay close to sequential on the device.
+bool AssetPack::read_threads(int threads)
+{
+	if (threads <= 0)
+		threads = (int)(std::max)(std::thread::hardware_concurrency(), 1u);
+	uint64_t chunks = (size + pack_read_chunk - 1) / pack_read_chunk;
+	threads = (int)(std::min)(uint64_t(threads), (std::max)(chunks, uint64_t(1)));
+	vread.reset(new uint8_t[size_t(size + PACK_ALIGN)]);
+	auto dest = (uint8_t *)pack_align(uint64_t(uintptr_t(vread.get())));
+#ifdef _WIN32
+	void *handle = file;
+#else
+	void *handle = (void *)(intptr_t)fd;
+	posix_fadvise(fd, 0, off_t(size), POSIX_FADV_SEQUENTIAL);
+#endif //_WIN32
+
+	std::atomic<uint64_t> next(0);
+	std::atomic<bool> is_ok(true);
+	auto reader = [&]() {
+		for (;;) {
+			auto i = next.fetch_add(1);
+			if (i >= chunks || !is_ok)
+				break;
+			auto offset = i * pack_read_chunk;
+			if (!pack_read_at(handle, dest + offset, offset, (std::min)(pack_read_chunk, size - offset)))
+				is_ok = false;
+		}
+	};
+	std::vector<std::thread> vthreads;
+	for (int i = 1; i < threads; i++)
+		vthreads.emplace_back(reader);
+	reader();
+	for (auto & t : vthreads)
+		t.join();
+	base = dest;
+	return is_ok;
+}
+
+//Same checks as AssetPackWriter::AddTexture, the commands of the entry read e.size bytes.
+static bool
+is_texture_entry(const pack_entry & e)
+{
+	int w = int(e.w);
+	int h = int(e.h);
+	int fmt = int(e.fmt);
+	int mips = int(e.mips);
+	if (w <= 0 || h <= 0 || fmt <= FMT_DEFAULT || fmt >= FMT_MAX || mips < 1 || mips > oden_get_mipmap_max(w, h))
+		return false;
+	return e.size == oden_get_texture_level_offset(fmt, w, h, mips, 0);
+}
+
+//Same checks as AddVertex / AddIndex, the backends divide by the stride and read whole indices.
+static bool
+is_typed_entry(const pack_entry & e)
+{
+	if (e.type == PACK_TEXTURE)
+		return is_texture_entry(e);
+	if (e.type == PACK_VERTEX)
+		return e.stride_size != 0 && e.size % e.stride_size == 0;
+	if (e.type == PACK_INDEX)
+		return e.size % sizeof(uint32_t) == 0;
+	return true;
+}
+
+bool AssetPack::Open(const std::string & path, int mode, int threads)
+{
+	Close();
+	this->path = path;
+	auto start = oden_trace_get_time_ms();
+#ifdef _WIN32
+	auto h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (h == INVALID_HANDLE_VALUE) {
+		printf("AssetPack : can't open %s\n", path.c_str());
+		return false;
+	}
+	file = h;
+	LARGE_INTEGER file_size = {};
+	GetFileSizeEx(h, &file_size);
+	size = uint64_t(file_size.QuadPart);
+#else
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		printf("AssetPack : can't open %s\n", path.c_str());
+		return false;
+	}
+	struct stat st = {};
+	fstat(fd, &st);
+	size = uint64_t(st.st_size);
+#endif //_WIN32
+	if (size < sizeof(pack_header)) {
+		printf("AssetPack : %s is not a pack\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	bool is_ok = true;
+	if (mode == PACK_OPEN_MAP) {
+#ifdef _WIN32
+		mapping = CreateFileMappingA((HANDLE)file, NULL, PAGE_READONLY, 0, 0, NULL);
+		base = mapping ? (const uint8_t *)MapViewOfFile((HANDLE)mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+		auto p = mmap(nullptr, size_t(size), PROT_READ, MAP_SHARED, fd, 0);
+		base = p == MAP_FAILED ? nullptr : (const uint8_t *)p;
+		//Start readahead of the whole pack, the first commands then find most pages present.
+		if (base)
+			madvise(p, size_t(size), MADV_WILLNEED);
+#endif //_WIN32
+		is_mapped = base != nullptr;
+		is_ok = is_mapped;
+	} else {
+		is_ok = read_threads(threads);
+	}
+	if (!is_ok) {
+		printf("AssetPack : can't read %s\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	pack_header header = {};
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, pack_magic, sizeof(pack_magic)) || header.version != PACK_VERSION ||
+		header.entry_offset > size || header.count > (size - header.entry_offset) / sizeof(pack_entry)) {
+		printf("AssetPack : %s is not a pack of version %u\n", path.c_str(), PACK_VERSION);
+		Close();
+		return false;
+	}
+	ventries.resize(header.count);
+	memcpy(ventries.data(), base + header.entry_offset, ventries.size() * sizeof(pack_entry));
+	for (size_t i = 0; i < ventries.size(); i++) {
+		auto & e = ventries[i];
+		e.name[PACK_NAME_MAX - 1] = 0;
+		//subtracted, a sum of broken fields can wrap around.
+		if (e.type >= PACK_MAX || e.size > size || e.offset > size - e.size || !is_typed_entry(e)) {
+			printf("AssetPack : broken entry %s in %s\n", e.name, path.c_str());
+			Close();
+			return false;
+		}
+		mentries[e.name] = i;
+	}
+	oden_trace_event("pack", path.c_str(), start, oden_trace_get_time_ms());
+	return true;
+}
+
+const pack_entry *AssetPack::Find(const std::string & name) const
+{
+	auto it = mentries.find(name);
+	return it == mentries.end() ? nullptr : &ventries[it->second];
+}
+
+const uint8_t *AssetPack::GetData(const pack_entry & e) const
+{
+	return base + e.offset;
+}
+
+bool AssetPack::SetVertex(std::vector<cmd> & vcmd, std::string name) const
+{
+	auto e = Find(name);
+	if (!e || e->type != PACK_VERTEX)
+		return false;
+	cmd c = {};
+	c.type = CMD_SET_VERTEX;
+	c.name = name;
+	c.set_vertex = {};
+	c.ext_data = GetData(*e);
+	c.ext_size = size_t(e->size);
+	c.set_vertex.stride_size = e->stride_size;
+	vcmd.push_back(c);
+	return true;
+}
+
+bool AssetPack::SetIndex(std::vector<cmd> & vcmd, std::string name) const
+{
+	auto e = Find(name);
+	if (!e || e->type != PACK_INDEX)
+		return false;
+	cmd c = {};
+	c.type = CMD_SET_INDEX;
+	c.name = name;
+	c.ext_data = GetData(*e);
+	c.ext_size = size_t(e->size);
+	vcmd.push_back(c);
+	return true;
+}
+
+bool AssetPack::SetTexture(std::vector<cmd> & vcmd, std::string name, int slot) const
+{
+	auto e = Find(name);
+	if (!e || e->type != PACK_TEXTURE)
+		return false;
+	cmd c = {};
+	c.type = CMD_SET_TEXTURE;
+	c.name = name;
+	c.set_texture = {};
+	c.ext_data = GetData(*e);
+	c.ext_size = size_t(e->size);
+	c.set_texture.fmt = int(e->fmt);
+	c.set_texture.slot = slot;
+	c.set_texture.stride_size = 0;
+	c.set_texture.rect.w = int(e->w);
+	c.set_texture.rect.h = int(e->h);
+	c.set_texture.mips = int(e->mips);
+	vcmd.push_back(c);
+	return true;
+}
+
+bool AssetPackWriter::add(std::string name, pack_entry e, const void *data)
+{
+	if (name.empty() || name.size() >= PACK_NAME_MAX || e.size == 0) {
+		printf("AssetPackWriter : invalid entry %s\n", name.c_str());
+		return false;
+	}
+	for (auto & x : ventries) {
+		if (name == x.name) {
+			printf("AssetPackWriter : %s is added twice\n", name.c_str());
+			return false;
+		}
+	}
+	memcpy(e.name, name.c_str(), name.size() + 1);
+	ventries.push_back(e);
+	vdata.emplace_back((const uint8_t *)data, (const uint8_t *)data + e.size);
+	return true;
+}
+
+bool AssetPackWriter::AddVertex(std::string name, const void *data, size_t size, size_t stride_size)
+{
+	if (stride_size == 0 || size % stride_size) {
+		printf("AssetPackWriter : %s is not vertices of stride %zu\n", name.c_str(), stride_size);
+		return false;
+	}
+	pack_entry e = {};
+	e.type = PACK_VERTEX;
+	e.stride_size = uint32_t(stride_size);
+	e.size = size;
+	return add(name, e, data);
+}
+
+bool AssetPackWriter::AddIndex(std::string name, const void *data, size_t size)
+{
+	if (size % sizeof(uint32_t)) {
+		printf("AssetPackWriter : %s is not uint32_t indices\n", name.c_str());
+		return false;
+	}
+	pack_entry e = {};
+	e.type = PACK_INDEX;
+	e.size = size;
+	return add(name, e, data);
+}
+
+bool AssetPackWriter::AddTexture(std::string name, int w, int h, int fmt, int mips, const void *data, size_t size)
+{
+	fmt = oden_get_texture_format(fmt);
+	if (w <= 0 || h <= 0 || fmt <= FMT_DEFAULT || fmt >= FMT_MAX || mips < 1 || mips > oden_get_mipmap_max(w, h) ||
+		size != oden_get_texture_level_offset(fmt, w, h, mips, 0)) {
+		printf("AssetPackWriter : invalid texture %s %dx%d %s mips=%d\n", name.c_str(), w, h, oden_get_format_name(fmt), mips);
+		return false;
+	}
+	pack_entry e = {};
+	e.type = PACK_TEXTURE;
+	e.fmt = uint32_t(fmt);
+	e.w = uint32_t(w);
+	e.h = uint32_t(h);
+	e.mips = uint32_t(mips);
+	e.size = size;
+	return add(name, e, data);
+}
+
+//Header and entries in the first pages, then every blob at a PACK_ALIGN offset.
+bool AssetPackWriter::Write(const std::string & path)
+{
+	pack_header header = {};
+	memcpy(header.magic, pack_magic, sizeof(pack_magic));
+	header.version = PACK_VERSION;
+	header.count = uint32_t(ventries.size());
+	header.entry_offset = sizeof(pack_header);
+	uint64_t offset = pack_align(header.entry_offset + ventries.size() * sizeof(pack_entry));
+	for (auto & e : ventries) {
+		e.offset = offset;
+		offset = pack_align(offset + e.size);
+	}
+
+	FILE *fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		printf("AssetPackWriter : can't open %s\n", path.c_str());
+		return false;
+	}
+	static const uint8_t zero[PACK_ALIGN] = {};
+	uint64_t pos = 0;
+	auto put = [&](const void *data, uint64_t size) {
+		pos += size;
+		return fwrite(data, 1, size_t(size), fp) == size;
+	};
+	bool is_ok = put(&header, sizeof(header)) && put(ventries.data(), ventries.size() * sizeof(pack_entry));
+	for (size_t i = 0; is_ok && i < ventries.size(); i++)
+		is_ok = put(zero, ventries[i].offset - pos) && put(vdata[i].data(), vdata[i].size());
+	//Pad the end, so the last blob can be read in whole pages too.
+	is_ok = is_ok && put(zero, pack_align(pos) - pos);
+	is_ok = fclose(fp) == 0 && is_ok;
+	if (!is_ok)
+		printf("AssetPackWriter : can't write %s\n", path.c_str());
+	return is_ok;
+}
+
+};
@@ -0,0 +1,136 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#pragma once
+
+//Asset pack : vertex, index and texture data in the layout the commands take, read without a copy (oden_pack.cpp).
+//
+//  header  : "ODENPACK", version, entry count, offset of the entries
+//  entries : pack_entry[count]
+//  data    : one blob per entry at a PACK_ALIGN offset. Vertices are interleaved stride_size apart,
+//            indices are uint32_t and textures are their levels packed (oden_get_texture_level_offset, stride 0).
+//
+//The commands of AssetPack point into the pack (cmd::ext_data), the backends copy them to staging memory directly.
+//oden_packer (oden_packer.cpp) makes packs.
+
+#include "oden_util.h"
+
+#include <memory>
+
+namespace odenutil
+{
+
+enum {
+	PACK_VERTEX,
+	PACK_INDEX,
+	PACK_TEXTURE,
+	PACK_MAX,
+};
+
+enum {
+	PACK_OPEN_MAP,  //map the file, pages are read on first use.
+	PACK_OPEN_READ, //read the whole file with threads into memory.
+};
+
+static const uint32_t PACK_VERSION = 1;
+static const uint64_t PACK_ALIGN = 4096;
+static const int PACK_NAME_MAX = 96;
+
+struct pack_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint64_t entry_offset;
+};
+
+struct pack_entry {
+	char name[PACK_NAME_MAX];
+	uint32_t type;        //PACK_*
+	uint32_t fmt;         //texture FMT_*
+	uint32_t w, h, mips;  //texture
+	uint32_t stride_size; //vertex
+	uint64_t offset;
+	uint64_t size;
+};
+
+class AssetPack {
+public:
+	AssetPack() {}
+	~AssetPack();
+	AssetPack(const AssetPack &) = delete;
+	AssetPack & operator=(const AssetPack &) = delete;
+
+	//threads : PACK_OPEN_READ readers, 0 is the core count.
+	bool Open(const std::string & path, int mode = PACK_OPEN_MAP, int threads = 0);
+	//The commands pointing into the pack must be presented before.
+	void Close();
+
+	const pack_entry *Find(const std::string & name) const;
+	const uint8_t *GetData(const pack_entry & e) const;
+	const std::vector<pack_entry> & GetEntries() const
+	{
+		return ventries;
+	}
+	uint64_t GetSize() const
+	{
+		return size;
+	}
+
+	//Same as odenutil::SetVertex / SetIndex / SetTexture with the data of the entry. false if it is not in the pack.
+	bool SetVertex(std::vector<cmd> & vcmd, std::string name) const;
+	bool SetIndex(std::vector<cmd> & vcmd, std::string name) const;
+	bool SetTexture(std::vector<cmd> & vcmd, std::string name, int slot) const;
+
+private:
+	bool read_threads(int threads);
+
+	std::string path;
+	std::vector<pack_entry> ventries;
+	std::map<std::string, size_t> mentries;
+	const uint8_t *base = nullptr;
+	uint64_t size = 0;
+	std::unique_ptr<uint8_t[]> vread;
+#ifdef _WIN32
+	void *file = nullptr;
+	void *mapping = nullptr;
+#else
+	int fd = -1;
+#endif //_WIN32
+	bool is_mapped = false;
+};
+
+class AssetPackWriter {
+public:
+	bool AddVertex(std::string name, const void *data, size_t size, size_t stride_size);
+	bool AddIndex(std::string name, const void *data, size_t size);
+	//data : mips levels of w x h, the smaller ones packed after level 0.
+	bool AddTexture(std::string name, int w, int h, int fmt, int mips, const void *data, size_t size);
+	bool Write(const std::string & path);
+
+private:
+	bool add(std::string name, pack_entry e, const void *data);
+
+	std::vector<pack_entry> ventries;
+	std::vector<std::vector<uint8_t>> vdata;
+};
+
+};
@@ -0,0 +1,363 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Makes and reads asset packs (oden_pack.h).
+//
+//  oden_packer -o out.pack [--vertex name file stride] [--index name file]
+//              [--fmt rgba8|bc1|bc4|bc5|bc7] [--mips N] [--texture name file.ppm] [--generate N]
+//  oden_packer --read file.pack [--threads N]
+//  oden_packer --list file.pack
+//
+//vertex / index files are raw, already in the layout of SetVertex / SetIndex (uint32_t indices).
+//--fmt and --mips apply to the textures after them, mips 0 (default) is the whole chain.
+//--generate adds N cubes and N 1024x1024 textures with a pattern, to measure a large pack.
+//--read drops the pack from the page cache and reads it by PACK_OPEN_READ and PACK_OPEN_MAP, then prints MB/s.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+#include "oden_pack.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif //_WIN32
+
+using namespace oden;
+using namespace odenutil;
+
+static double
+get_time_ms()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double, std::milli>(now).count();
+}
+
+static bool
+load_file(const char *filename, std::vector<uint8_t> & vout)
+{
+	FILE *fp = fopen(filename, "rb");
+	if (!fp) {
+		printf("can't open %s\n", filename);
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	vout.resize(size_t(ftell(fp)));
+	fseek(fp, 0, SEEK_SET);
+	bool is_ok = fread(vout.data(), 1, vout.size(), fp) == vout.size();
+	fclose(fp);
+	return is_ok;
+}
+
+//Binary ppm (P6, 255) to RGBA8 with R in the low byte.
+static bool
+load_ppm(const char *filename, int & w, int & h, std::vector<uint32_t> & vout)
+{
+	std::vector<uint8_t> vfile;
+	if (!load_file(filename, vfile))
+		return false;
+	size_t pos = 0;
+	auto next_value = [&]() {
+		for (;;) {
+			while (pos < vfile.size() && isspace(vfile[pos]))
+				pos++;
+			if (pos < vfile.size() && vfile[pos] == '#') {
+				while (pos < vfile.size() && vfile[pos] != '\n')
+					pos++;
+				continue;
+			}
+			break;
+		}
+		int value = 0;
+		while (pos < vfile.size() && isdigit(vfile[pos]))
+			value = value * 10 + (vfile[pos++] - '0');
+		return value;
+	};
+	if (vfile.size() < 2 || vfile[0] != 'P' || vfile[1] != '6') {
+		printf("%s is not a binary ppm\n", filename);
+		return false;
+	}
+	pos = 2;
+	w = next_value();
+	h = next_value();
+	int maxval = next_value();
+	pos++;
+	if (w <= 0 || h <= 0 || maxval != 255 || vfile.size() - pos < size_t(w) * h * 3) {
+		printf("%s : unsupported ppm\n", filename);
+		return false;
+	}
+	vout.resize(size_t(w) * h);
+	for (size_t i = 0; i < vout.size(); i++) {
+		auto p = &vfile[pos + i * 3];
+		vout[i] = 0xFF000000 | (p[2] << 16) | (p[1] << 8) | p[0];
+	}
+	return true;
+}
+
+//2x2 box filter, the last row / column repeats on odd sizes.
+static void
+make_level(const std::vector<uint32_t> & vsrc, int w, int h, std::vector<uint32_t> & vdst)
+{
+	int dw = (std::max)(w >> 1, 1);
+	int dh = (std::max)(h >> 1, 1);
+	vdst.resize(size_t(dw) * dh);
+	for (int y = 0; y < dh; y++) {
+		for (int x = 0; x < dw; x++) {
+			int x0 = (std::min)(x * 2, w - 1);
+			int x1 = (std::min)(x * 2 + 1, w - 1);
+			int y0 = (std::min)(y * 2, h - 1);
+			int y1 = (std::min)(y * 2 + 1, h - 1);
+			uint32_t p[4] = {vsrc[y0 * w + x0], vsrc[y0 * w + x1], vsrc[y1 * w + x0], vsrc[y1 * w + x1]};
+			uint32_t v = 0;
+			for (int c = 0; c < 32; c += 8) {
+				uint32_t sum = 2;
+				for (auto q : p)
+					sum += (q >> c) & 0xFF;
+				v |= (sum / 4) << c;
+			}
+			vdst[size_t(y) * dw + x] = v;
+		}
+	}
+}
+
+//Levels of the format packed after each other, the data of SetTexture.
+static bool
+make_texture(const std::vector<uint32_t> & vpixels, int w, int h, int fmt, int & mips, std::vector<uint8_t> & vout)
+{
+	int maxmips = oden_get_mipmap_max(w, h);
+	mips = (mips <= 0 || mips > maxmips) ? maxmips : mips;
+	vout.clear();
+	std::vector<uint32_t> vlevel = vpixels;
+	std::vector<uint32_t> vnext;
+	for (int i = 0; i < mips; i++) {
+		int lw = (std::max)(w >> i, 1);
+		int lh = (std::max)(h >> i, 1);
+		if (oden_is_block_format(fmt)) {
+			std::vector<uint8_t> vblocks;
+			if (!EncodeBC(fmt, vlevel.data(), lw, lh, size_t(lw) * sizeof(uint32_t), vblocks))
+				return false;
+			vout.insert(vout.end(), vblocks.begin(), vblocks.end());
+		} else {
+			auto p = (const uint8_t *)vlevel.data();
+			vout.insert(vout.end(), p, p + vlevel.size() * sizeof(uint32_t));
+		}
+		if (i + 1 < mips) {
+			make_level(vlevel, lw, lh, vnext);
+			vlevel.swap(vnext);
+		}
+	}
+	return true;
+}
+
+//Cubes in the vertex layout of sample_code.cpp : float4 position, float3 normal, float2 uv.
+static void
+generate(AssetPackWriter & writer, int count, int fmt)
+{
+	static const int size = 1024;
+	std::vector<float> vvertex;
+	std::vector<uint32_t> vindex;
+	for (int face = 0; face < 6; face++) {
+		int axis = face % 3;
+		float sign = face < 3 ? 1.0f : -1.0f;
+		uint32_t base = uint32_t(vvertex.size() / 9);
+		for (int i = 0; i < 4; i++) {
+			float u = (i & 1) ? 1.0f : -1.0f;
+			float v = (i & 2) ? 1.0f : -1.0f;
+			float pos[3];
+			pos[axis] = sign;
+			pos[(axis + 1) % 3] = u;
+			pos[(axis + 2) % 3] = v;
+			float nrm[3] = {};
+			nrm[axis] = sign;
+			float attr[9] = {pos[0], pos[1], pos[2], 1.0f, nrm[0], nrm[1], nrm[2], u * 0.5f + 0.5f, v * 0.5f + 0.5f};
+			vvertex.insert(vvertex.end(), attr, attr + 9);
+		}
+		uint32_t quad[6] = {base, base + 1, base + 2, base + 2, base + 1, base + 3};
+		vindex.insert(vindex.end(), quad, quad + 6);
+	}
+	std::vector<uint32_t> vpixels(size * size);
+	std::vector<uint8_t> vdata;
+	for (int n = 0; n < count; n++) {
+		auto index = std::to_string(n);
+		writer.AddVertex("vb" + index, vvertex.data(), vvertex.size() * sizeof(float), sizeof(float) * 9);
+		writer.AddIndex("ib" + index, vindex.data(), vindex.size() * sizeof(uint32_t));
+		for (int y = 0; y < size; y++)
+			for (int x = 0; x < size; x++)
+				vpixels[y * size + x] = 0xFF000000 | (((x ^ y) >> 2) * (1110 + n * 77) & 0x7F7F7F);
+		int mips = 0;
+		make_texture(vpixels, size, size, fmt, mips, vdata);
+		writer.AddTexture("tex" + index, size, size, fmt, mips, vdata.data(), vdata.size());
+	}
+}
+
+//Pages of the pack leave the page cache, so the next read comes from the device.
+static void
+drop_cache(const char *filename)
+{
+#ifdef _WIN32
+	//No unprivileged way to drop a file from the cache, the reads are warm.
+	(void)filename;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd >= 0) {
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+#endif //_WIN32
+}
+
+static int
+read_pack(const char *filename, int threads)
+{
+	AssetPack pack;
+	static const char *mode_names[] = {"map", "read"};
+	for (int mode : {PACK_OPEN_READ, PACK_OPEN_MAP}) {
+		drop_cache(filename);
+		auto start = get_time_ms();
+		if (!pack.Open(filename, mode, threads))
+			return 1;
+		//Touch every page of the blobs as the uploads of the first frame would.
+		uint64_t sum = 0;
+		for (auto & e : pack.GetEntries()) {
+			auto p = pack.GetData(e);
+			for (uint64_t i = 0; i < e.size; i += PACK_ALIGN)
+				sum += p[i];
+		}
+		auto ms = get_time_ms() - start;
+		auto mb = double(pack.GetSize()) / (1024.0 * 1024.0);
+		printf("%s : %s %.1fMB in %.3fms, %.1fMB/s (%llu)\n", filename, mode_names[mode], mb, ms, mb * 1000.0 / ms, (unsigned long long)(sum & 0xFF));
+		pack.Close();
+	}
+	return 0;
+}
+
+static int
+list_pack(const char *filename)
+{
+	static const char *type_names[PACK_MAX] = {"vertex", "index", "texture"};
+	AssetPack pack;
+	if (!pack.Open(filename))
+		return 1;
+	for (auto & e : pack.GetEntries()) {
+		printf("%-32s %-8s offset=%llu size=%llu", e.name, type_names[e.type], (unsigned long long)e.offset, (unsigned long long)e.size);
+		if (e.type == PACK_VERTEX)
+			printf(" stride=%u", e.stride_size);
+		if (e.type == PACK_TEXTURE)
+			printf(" %ux%u %s mips=%u", e.w, e.h, oden_get_format_name(e.fmt), e.mips);
+		printf("\n");
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		int fmt;
+	} formats[] = {
+		{"rgba8", FMT_R8G8B8A8_UNORM},
+		{"bc1", FMT_BC1_UNORM},
+		{"bc4", FMT_BC4_UNORM},
+		{"bc5", FMT_BC5_UNORM},
+		{"bc7", FMT_BC7_UNORM},
+	};
+	AssetPackWriter writer;
+	const char *out_name = nullptr;
+	int fmt = FMT_BC1_UNORM;
+	int mips = 0;
+	int threads = 0;
+	const char *read_name = nullptr;
+
+	if (argc < 2) {
+		printf("usage : %s -o out.pack [--vertex name file stride] [--index name file] [--fmt rgba8|bc1|bc4|bc5|bc7] [--mips N] [--texture name file.ppm] [--generate N]\n", argv[0]);
+		printf("        %s --read file.pack [--threads N]\n", argv[0]);
+		printf("        %s --list file.pack\n", argv[0]);
+		return 1;
+	}
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool is_ok = true;
+		if (arg == "-o" && i + 1 < argc) {
+			out_name = argv[++i];
+		} else if (arg == "--vertex" && i + 3 < argc) {
+			std::vector<uint8_t> vdata;
+			is_ok = load_file(argv[i + 2], vdata) && writer.AddVertex(argv[i + 1], vdata.data(), vdata.size(), strtoul(argv[i + 3], nullptr, 10));
+			i += 3;
+		} else if (arg == "--index" && i + 2 < argc) {
+			std::vector<uint8_t> vdata;
+			is_ok = load_file(argv[i + 2], vdata) && writer.AddIndex(argv[i + 1], vdata.data(), vdata.size());
+			i += 2;
+		} else if (arg == "--fmt" && i + 1 < argc) {
+			std::string name = argv[++i];
+			fmt = -1;
+			for (auto & f : formats)
+				if (name == f.name)
+					fmt = f.fmt;
+			is_ok = fmt >= 0;
+		} else if (arg == "--mips" && i + 1 < argc) {
+			mips = atoi(argv[++i]);
+		} else if (arg == "--texture" && i + 2 < argc) {
+			int w = 0;
+			int h = 0;
+			int levels = mips;
+			std::vector<uint32_t> vpixels;
+			std::vector<uint8_t> vdata;
+			is_ok = load_ppm(argv[i + 2], w, h, vpixels) && make_texture(vpixels, w, h, fmt, levels, vdata) &&
+				writer.AddTexture(argv[i + 1], w, h, fmt, levels, vdata.data(), vdata.size());
+			i += 2;
+		} else if (arg == "--generate" && i + 1 < argc) {
+			generate(writer, atoi(argv[++i]), fmt);
+		} else if (arg == "--threads" && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (arg == "--read" && i + 1 < argc) {
+			read_name = argv[++i];
+		} else if (arg == "--list" && i + 1 < argc) {
+			return list_pack(argv[++i]);
+		} else {
+			printf("unknown option %s\n", argv[i]);
+			return 1;
+		}
+		if (!is_ok) {
+			printf("failed at %s\n", arg.c_str());
+			return 1;
+		}
+	}
+	if (read_name)
+		return read_pack(read_name, threads);
+	if (!out_name) {
+		printf("no output, -o out.pack\n");
+		return 1;
+	}
+	auto start = get_time_ms();
+	if (!writer.Write(out_name))
+		return 1;
+	printf("%s : written in %.3fms\n", out_name, get_time_ms() - start);
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#pragma once
+
+//Tiny portability layer for the backends and samples.
+//Only what ODEN needs: spawn a tool, sleep, delete a file, the process id, temp files, the host clock.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif //_WIN32
+
+#ifndef _countof
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#endif //_countof
+
+namespace oden
+{
+
+//Run command line and wait for exit. returns exit code, -1 on spawn failure.
+inline int
+oden_platform_exec_wait(const char *command)
+{
+#ifdef _WIN32
+	PROCESS_INFORMATION pi;
+	STARTUPINFO si = {};
+	DWORD code = (DWORD)-1;
+
+	si.cb = sizeof(si);
+	if (!CreateProcess(NULL, (LPTSTR)command, NULL, NULL, FALSE, NORMAL_PRIORITY_CLASS, NULL, NULL, &si, &pi))
+		return -1;
+	WaitForSingleObject(pi.hProcess, INFINITE);
+	GetExitCodeProcess(pi.hProcess, &code);
+	CloseHandle(pi.hProcess);
+	CloseHandle(pi.hThread);
+	return (int)code;
+#else
+	pid_t pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		execl("/bin/sh", "sh", "-c", command, (char *)nullptr);
+		_exit(127);
+	}
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR)
+			return -1;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif //_WIN32
+}
+
+inline void
+oden_platform_sleep(uint32_t ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	usleep((useconds_t)ms * 1000);
+#endif //_WIN32
+}
+
+inline void
+oden_platform_delete_file(const char *filename)
+{
+	remove(filename);
+}
+
+inline uint32_t
+oden_platform_get_pid(void)
+{
+#ifdef _WIN32
+	return (uint32_t)GetCurrentProcessId();
+#else
+	return (uint32_t)getpid();
+#endif //_WIN32
+}
+
+//Unique name in the system temp directory for the output of a tool, so it does not land in a watched directory
+//and calls from several threads / processes do not collide : the process id and a counter, then suffix.
+inline std::string
+oden_platform_get_temp_filename(const std::string & suffix)
+{
+	static std::atomic<uint32_t> count {0};
+#ifdef _WIN32
+	char dir[MAX_PATH + 1] = {};
+	std::string ret = GetTempPathA(sizeof(dir), dir) ? dir : ".\\";
+#else
+	const char *env = getenv("TMPDIR");
+	std::string ret = std::string(env && env[0] ? env : "/tmp") + "/";
+#endif //_WIN32
+	return ret + "oden_" + std::to_string(oden_platform_get_pid()) + "_" + std::to_string(count++) + suffix;
+}
+
+//Host clock the gpu timestamps are calibrated against : QueryPerformanceCounter on windows
+//(VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT, GetClockCalibration), CLOCK_MONOTONIC in ns elsewhere.
+inline uint64_t
+oden_platform_get_host_ticks(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER now = {};
+	QueryPerformanceCounter(&now);
+	return (uint64_t)now.QuadPart;
+#else
+	struct timespec ts = {};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif //_WIN32
+}
+
+inline double
+oden_platform_get_host_ms(uint64_t ticks)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq = {};
+	QueryPerformanceFrequency(&freq);
+	return double(ticks) * 1000.0 / double(freq.QuadPart);
+#else
+	return double(ticks) / 1000000.0;
+#endif //_WIN32
+}
+
+} //oden
@@ -0,0 +1,184 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Render thread of oden_present_graphics_async.
+//Frames pass through a single producer / single consumer ring. The app thread
+//only writes tail and the render thread only writes head. The mutex is taken
+//only to park a thread that has nothing to do.
+
+#include "ODEN.h"
+#include "oden_trace.h"
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+using namespace oden;
+
+enum {
+	PRESENT_QUEUE_MAX = 8,
+};
+
+struct present_frame {
+	std::string appname;
+	std::vector<cmd> vcmd;
+	void *handle = nullptr;
+	uint32_t w = 0;
+	uint32_t h = 0;
+	uint32_t buffernum = 0;
+	uint32_t heapcount = 0;
+	uint32_t slotmax = 0;
+};
+
+struct present_queue {
+	present_frame vframes[PRESENT_QUEUE_MAX];
+	std::atomic<uint64_t> head{0}; //frames presented.
+	std::atomic<uint64_t> tail{0}; //frames queued.
+	std::atomic<uint32_t> depth{1};
+	std::atomic<int> waiters{0};
+	std::atomic<bool> is_stop{false};
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::thread thread;
+
+	//Sleep until pred holds. The other side calls wake after changing what pred reads.
+	template <typename F>
+	void wait(F pred)
+	{
+		if (pred())
+			return;
+		waiters++;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, pred);
+		}
+		waiters--;
+	}
+
+	void wake(bool is_force = false)
+	{
+		if (!is_force && waiters.load() == 0)
+			return;
+		std::lock_guard<std::mutex> lock(mtx);
+		cv.notify_all();
+	}
+
+	void run()
+	{
+		for (;;) {
+			auto index = head.load(std::memory_order_relaxed);
+			wait([&]() {
+				return is_stop.load() || tail.load() != index;
+			});
+			if (tail.load() == index)
+				return;
+
+			auto & f = vframes[index % PRESENT_QUEUE_MAX];
+			oden_present_graphics(f.appname.c_str(), f.vcmd, f.handle, f.w, f.h, f.buffernum, f.heapcount, f.slotmax);
+			//keep the capacity for the app.
+			f.vcmd.clear();
+			bool is_terminated = f.handle == nullptr;
+			head.store(index + 1);
+			wake();
+			if (is_terminated)
+				return;
+		}
+	}
+
+	~present_queue()
+	{
+		is_stop = true;
+		wake(true);
+#ifdef _WIN32
+		//Other threads are already gone at DLL detach, joining would wait on the loader lock.
+		if (thread.joinable())
+			thread.detach();
+#else
+		if (thread.joinable())
+			thread.join();
+#endif //_WIN32
+	}
+};
+
+static present_queue queue;
+
+void
+oden::oden_present_graphics_async(const char * appname, std::vector<cmd> & vcmd,
+	void *handle, uint32_t w, uint32_t h,
+	uint32_t buffernum, uint32_t heapcount, uint32_t slotmax)
+{
+	if (!queue.thread.joinable()) {
+		queue.is_stop = false;
+		queue.thread = std::thread([]() {
+			queue.run();
+		});
+	}
+
+	//bounded depth. wait for a frame to be presented.
+	auto index = queue.tail.load(std::memory_order_relaxed);
+	auto is_free = [&]() {
+		return index - queue.head.load() < queue.depth.load();
+	};
+	if (!is_free()) {
+		auto start = trace_get_time_ms();
+		queue.wait(is_free);
+		trace_complete("wait", "present queue", start, trace_get_time_ms());
+	}
+
+	auto & f = queue.vframes[index % PRESENT_QUEUE_MAX];
+	f.appname = appname;
+	f.vcmd.swap(vcmd);
+	f.handle = handle;
+	f.w = w;
+	f.h = h;
+	f.buffernum = buffernum;
+	f.heapcount = heapcount;
+	f.slotmax = slotmax;
+	queue.tail.store(index + 1);
+	queue.wake();
+
+	//terminate. the render thread ends after it.
+	if (handle == nullptr) {
+		oden_flush_graphics();
+		queue.thread.join();
+	}
+}
+
+void
+oden::oden_set_present_queue_depth(uint32_t depth)
+{
+	depth = (std::max)(depth, 1u);
+	depth = (std::min)(depth, (uint32_t)PRESENT_QUEUE_MAX);
+	queue.depth = depth;
+}
+
+void
+oden::oden_flush_graphics(void)
+{
+	queue.wait([]() {
+		return queue.head.load() == queue.tail.load();
+	});
+}
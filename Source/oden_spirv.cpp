@@ -0,0 +1,2055 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//SPIR-V compute interpreter.
+//Every value is stored as components x lanes of 32bit words, lane minor,
+//so one instruction runs for a whole lane group in tight loops the compiler vectorizes.
+//Control flow keeps a block per lane and always runs the lowest block that has
+//lanes waiting. Structured SPIR-V places merge blocks after their constructs,
+//so diverged lanes meet again at the merge block.
+
+#include "oden_spirv.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <map>
+#include <atomic>
+#include <algorithm>
+
+using namespace oden;
+
+enum {
+	SPV_LANES = ODEN_SPIRV_LANES,
+	SPV_BUFFER_OFFSET_BITS = 20,
+	SPV_DONE = 0xFFFFFFFF,
+};
+
+static const uint32_t SPV_FULL_MASK = (SPV_LANES >= 32) ? 0xFFFFFFFF : ((1u << SPV_LANES) - 1);
+
+//Opcodes of the supported subset. Values from the SPIR-V specification.
+enum {
+	SpvOpNop = 0,
+	SpvOpUndef = 1,
+	SpvOpSourceContinued = 2,
+	SpvOpSource = 3,
+	SpvOpSourceExtension = 4,
+	SpvOpName = 5,
+	SpvOpMemberName = 6,
+	SpvOpString = 7,
+	SpvOpLine = 8,
+	SpvOpExtension = 10,
+	SpvOpExtInstImport = 11,
+	SpvOpExtInst = 12,
+	SpvOpMemoryModel = 14,
+	SpvOpEntryPoint = 15,
+	SpvOpExecutionMode = 16,
+	SpvOpCapability = 17,
+	SpvOpTypeVoid = 19,
+	SpvOpTypeBool = 20,
+	SpvOpTypeInt = 21,
+	SpvOpTypeFloat = 22,
+	SpvOpTypeVector = 23,
+	SpvOpTypeMatrix = 24,
+	SpvOpTypeImage = 25,
+	SpvOpTypeSampler = 26,
+	SpvOpTypeSampledImage = 27,
+	SpvOpTypeArray = 28,
+	SpvOpTypeRuntimeArray = 29,
+	SpvOpTypeStruct = 30,
+	SpvOpTypePointer = 32,
+	SpvOpTypeFunction = 33,
+	SpvOpConstantTrue = 41,
+	SpvOpConstantFalse = 42,
+	SpvOpConstant = 43,
+	SpvOpConstantComposite = 44,
+	SpvOpConstantNull = 46,
+	SpvOpSpecConstantTrue = 48,
+	SpvOpSpecConstantFalse = 49,
+	SpvOpSpecConstant = 50,
+	SpvOpSpecConstantComposite = 51,
+	SpvOpFunction = 54,
+	SpvOpFunctionParameter = 55,
+	SpvOpFunctionEnd = 56,
+	SpvOpFunctionCall = 57,
+	SpvOpVariable = 59,
+	SpvOpLoad = 61,
+	SpvOpStore = 62,
+	SpvOpAccessChain = 65,
+	SpvOpInBoundsAccessChain = 66,
+	SpvOpDecorate = 71,
+	SpvOpMemberDecorate = 72,
+	SpvOpVectorExtractDynamic = 77,
+	SpvOpVectorInsertDynamic = 78,
+	SpvOpVectorShuffle = 79,
+	SpvOpCompositeConstruct = 80,
+	SpvOpCompositeExtract = 81,
+	SpvOpCompositeInsert = 82,
+	SpvOpCopyObject = 83,
+	SpvOpTranspose = 84,
+	SpvOpSampledImage = 86,
+	SpvOpImageSampleExplicitLod = 88,
+	SpvOpImageFetch = 95,
+	SpvOpImageRead = 98,
+	SpvOpImageWrite = 99,
+	SpvOpImage = 100,
+	SpvOpImageQuerySizeLod = 103,
+	SpvOpImageQuerySize = 104,
+	SpvOpConvertFToU = 109,
+	SpvOpConvertFToS = 110,
+	SpvOpConvertSToF = 111,
+	SpvOpConvertUToF = 112,
+	SpvOpUConvert = 113,
+	SpvOpSConvert = 114,
+	SpvOpFConvert = 115,
+	SpvOpBitcast = 124,
+	SpvOpSNegate = 126,
+	SpvOpFNegate = 127,
+	SpvOpIAdd = 128,
+	SpvOpFAdd = 129,
+	SpvOpISub = 130,
+	SpvOpFSub = 131,
+	SpvOpIMul = 132,
+	SpvOpFMul = 133,
+	SpvOpUDiv = 134,
+	SpvOpSDiv = 135,
+	SpvOpFDiv = 136,
+	SpvOpUMod = 137,
+	SpvOpSRem = 138,
+	SpvOpSMod = 139,
+	SpvOpFRem = 140,
+	SpvOpFMod = 141,
+	SpvOpVectorTimesScalar = 142,
+	SpvOpMatrixTimesScalar = 143,
+	SpvOpVectorTimesMatrix = 144,
+	SpvOpMatrixTimesVector = 145,
+	SpvOpMatrixTimesMatrix = 146,
+	SpvOpDot = 148,
+	SpvOpAny = 154,
+	SpvOpAll = 155,
+	SpvOpIsNan = 156,
+	SpvOpIsInf = 157,
+	SpvOpLogicalEqual = 164,
+	SpvOpLogicalNotEqual = 165,
+	SpvOpLogicalOr = 166,
+	SpvOpLogicalAnd = 167,
+	SpvOpLogicalNot = 168,
+	SpvOpSelect = 169,
+	SpvOpIEqual = 170,
+	SpvOpINotEqual = 171,
+	SpvOpUGreaterThan = 172,
+	SpvOpSGreaterThan = 173,
+	SpvOpUGreaterThanEqual = 174,
+	SpvOpSGreaterThanEqual = 175,
+	SpvOpULessThan = 176,
+	SpvOpSLessThan = 177,
+	SpvOpULessThanEqual = 178,
+	SpvOpSLessThanEqual = 179,
+	SpvOpFOrdEqual = 180,
+	SpvOpFUnordEqual = 181,
+	SpvOpFOrdNotEqual = 182,
+	SpvOpFUnordNotEqual = 183,
+	SpvOpFOrdLessThan = 184,
+	SpvOpFUnordLessThan = 185,
+	SpvOpFOrdGreaterThan = 186,
+	SpvOpFUnordGreaterThan = 187,
+	SpvOpFOrdLessThanEqual = 188,
+	SpvOpFUnordLessThanEqual = 189,
+	SpvOpFOrdGreaterThanEqual = 190,
+	SpvOpFUnordGreaterThanEqual = 191,
+	SpvOpShiftRightLogical = 194,
+	SpvOpShiftRightArithmetic = 195,
+	SpvOpShiftLeftLogical = 196,
+	SpvOpBitwiseOr = 197,
+	SpvOpBitwiseXor = 198,
+	SpvOpBitwiseAnd = 199,
+	SpvOpNot = 200,
+	SpvOpControlBarrier = 224,
+	SpvOpMemoryBarrier = 225,
+	SpvOpPhi = 245,
+	SpvOpLoopMerge = 246,
+	SpvOpSelectionMerge = 247,
+	SpvOpLabel = 248,
+	SpvOpBranch = 249,
+	SpvOpBranchConditional = 250,
+	SpvOpSwitch = 251,
+	SpvOpKill = 252,
+	SpvOpReturn = 253,
+	SpvOpReturnValue = 254,
+	SpvOpUnreachable = 255,
+	SpvOpNoLine = 317,
+	SpvOpModuleProcessed = 330,
+};
+
+enum {
+	SpvDecorationRowMajor = 4,
+	SpvDecorationArrayStride = 6,
+	SpvDecorationMatrixStride = 7,
+	SpvDecorationBuiltIn = 11,
+	SpvDecorationBinding = 33,
+	SpvDecorationOffset = 35,
+
+	SpvBuiltInNumWorkgroups = 24,
+	SpvBuiltInWorkgroupId = 26,
+	SpvBuiltInLocalInvocationId = 27,
+	SpvBuiltInGlobalInvocationId = 28,
+	SpvBuiltInLocalInvocationIndex = 29,
+
+	SpvStorageClassUniformConstant = 0,
+	SpvStorageClassInput = 1,
+	SpvStorageClassUniform = 2,
+	SpvStorageClassWorkgroup = 4,
+	SpvStorageClassPrivate = 6,
+	SpvStorageClassFunction = 7,
+	SpvStorageClassPushConstant = 9,
+	SpvStorageClassStorageBuffer = 12,
+
+	SpvExecutionModelGLCompute = 5,
+	SpvExecutionModeLocalSize = 17,
+	SpvImageOperandsLodMask = 0x2,
+};
+
+//GLSL.std.450
+enum {
+	GLSLstd450Round = 1,
+	GLSLstd450RoundEven = 2,
+	GLSLstd450Trunc = 3,
+	GLSLstd450FAbs = 4,
+	GLSLstd450SAbs = 5,
+	GLSLstd450FSign = 6,
+	GLSLstd450SSign = 7,
+	GLSLstd450Floor = 8,
+	GLSLstd450Ceil = 9,
+	GLSLstd450Fract = 10,
+	GLSLstd450Radians = 11,
+	GLSLstd450Degrees = 12,
+	GLSLstd450Sin = 13,
+	GLSLstd450Cos = 14,
+	GLSLstd450Tan = 15,
+	GLSLstd450Asin = 16,
+	GLSLstd450Acos = 17,
+	GLSLstd450Atan = 18,
+	GLSLstd450Atan2 = 25,
+	GLSLstd450Pow = 26,
+	GLSLstd450Exp = 27,
+	GLSLstd450Log = 28,
+	GLSLstd450Exp2 = 29,
+	GLSLstd450Log2 = 30,
+	GLSLstd450Sqrt = 31,
+	GLSLstd450InverseSqrt = 32,
+	GLSLstd450FMin = 37,
+	GLSLstd450UMin = 38,
+	GLSLstd450SMin = 39,
+	GLSLstd450FMax = 40,
+	GLSLstd450UMax = 41,
+	GLSLstd450SMax = 42,
+	GLSLstd450FClamp = 43,
+	GLSLstd450UClamp = 44,
+	GLSLstd450SClamp = 45,
+	GLSLstd450FMix = 46,
+	GLSLstd450Step = 48,
+	GLSLstd450SmoothStep = 49,
+	GLSLstd450Fma = 50,
+	GLSLstd450Length = 66,
+	GLSLstd450Distance = 67,
+	GLSLstd450Cross = 68,
+	GLSLstd450Normalize = 69,
+	GLSLstd450NMin = 79,
+	GLSLstd450NMax = 80,
+	GLSLstd450NClamp = 81,
+};
+
+struct spv_type {
+	uint32_t op = 0;
+	uint32_t comps = 0;      //flattened 32bit components
+	uint32_t elem = 0;       //vector, matrix column, array element, pointee
+	uint32_t count = 0;      //vector size, matrix columns, array length
+	uint32_t storage = 0;    //pointer storage class
+	uint32_t array_stride = 0;
+	bool is_float = false;
+	bool is_signed = false;
+	std::vector<uint32_t> vmembers;
+	std::vector<uint32_t> vmember_comps;    //component offset of each member
+	std::vector<uint32_t> vmember_offsets;  //byte offset in a buffer block
+	std::vector<uint32_t> vmember_matrix_stride;
+	std::vector<uint8_t> vmember_row_major;
+};
+
+struct spv_inst {
+	uint32_t op;
+	uint32_t word;
+};
+
+struct spv_block {
+	uint32_t first;
+	uint32_t end;
+};
+
+struct spv_function {
+	std::vector<uint32_t> vparams;
+	std::vector<spv_block> vblocks;
+};
+
+struct spv_builtin {
+	uint32_t kind;
+	uint32_t offset;
+};
+
+struct oden::spirv_program {
+	uint64_t serial = 0;
+	uint32_t bound = 0;
+	std::vector<uint32_t> vcode;
+	std::vector<spv_inst> vinsts;
+	std::vector<spv_type> vtypes;
+	std::vector<uint32_t> vresult_type;
+	std::vector<uint32_t> voffset;         //value of each id in state
+	std::vector<uint32_t> vblock_index;    //label -> block index in its function
+	std::vector<int32_t> vfunction_index;  //function id -> vfunctions
+	std::vector<spv_function> vfunctions;
+	std::vector<uint32_t> vinit;           //constants and global variable pointers
+	std::vector<std::pair<uint32_t, uint32_t>> vprivate_init; //reset per lane group
+	std::vector<spv_builtin> vbuiltins;
+	uint32_t glsl_ext = 0;
+	int32_t entry = -1;
+	int local_size[3] = {1, 1, 1};
+};
+
+struct spv_state {
+	uint64_t serial = 0;
+	const spirv_program *program = nullptr;
+	const spirv_bindings *bindings = nullptr;
+	std::vector<uint32_t> vdata;
+	std::vector<uint32_t> vmeta;  //matrix stride and row major of buffer pointers
+	std::vector<uint32_t> vtemp;
+
+	uint32_t *val(uint32_t id)
+	{
+		return &vdata[program->voffset[id]];
+	}
+
+	uint32_t comps(uint32_t id) const
+	{
+		return program->vtypes[program->vresult_type[id]].comps;
+	}
+
+	const spv_type & type_of(uint32_t id) const
+	{
+		return program->vtypes[program->vresult_type[id]];
+	}
+};
+
+static inline float
+u2f(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+static inline uint32_t
+f2u(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static bool
+is_buffer_storage(uint32_t storage)
+{
+	return storage == SpvStorageClassUniform ||
+		storage == SpvStorageClassPushConstant ||
+		storage == SpvStorageClassStorageBuffer;
+}
+
+//Full groups take the branch free path.
+template<typename F>
+static inline void
+for_lanes(uint32_t mask, F f)
+{
+	if (mask == SPV_FULL_MASK) {
+		for (uint32_t l = 0; l < SPV_LANES; l++)
+			f(l);
+	} else {
+		for (uint32_t l = 0; l < SPV_LANES; l++)
+			if ((mask >> l) & 1)
+				f(l);
+	}
+}
+
+//w[1] type, w[2] result, w[3] operand. Scalar operands broadcast.
+template<typename F>
+static void
+op_unary(spv_state & st, const uint32_t *w, uint32_t mask, F f)
+{
+	uint32_t comps = st.comps(w[2]);
+	uint32_t ca = st.comps(w[3]);
+	uint32_t *r = st.val(w[2]);
+	const uint32_t *a = st.val(w[3]);
+	for (uint32_t c = 0; c < comps; c++) {
+		uint32_t *pr = r + c * SPV_LANES;
+		const uint32_t *pa = a + (ca == 1 ? 0 : c) * SPV_LANES;
+		for_lanes(mask, [&](uint32_t l) {
+			pr[l] = f(pa[l]);
+		});
+	}
+}
+
+template<typename F>
+static void
+op_binary(spv_state & st, uint32_t result, uint32_t ida, uint32_t idb, uint32_t mask, F f)
+{
+	uint32_t comps = st.comps(result);
+	uint32_t ca = st.comps(ida);
+	uint32_t cb = st.comps(idb);
+	uint32_t *r = st.val(result);
+	const uint32_t *a = st.val(ida);
+	const uint32_t *b = st.val(idb);
+	for (uint32_t c = 0; c < comps; c++) {
+		uint32_t *pr = r + c * SPV_LANES;
+		const uint32_t *pa = a + (ca == 1 ? 0 : c) * SPV_LANES;
+		const uint32_t *pb = b + (cb == 1 ? 0 : c) * SPV_LANES;
+		for_lanes(mask, [&](uint32_t l) {
+			pr[l] = f(pa[l], pb[l]);
+		});
+	}
+}
+
+template<typename F>
+static void
+op_ternary(spv_state & st, uint32_t result, uint32_t ida, uint32_t idb, uint32_t idc, uint32_t mask, F f)
+{
+	uint32_t comps = st.comps(result);
+	uint32_t ca = st.comps(ida);
+	uint32_t cb = st.comps(idb);
+	uint32_t cc = st.comps(idc);
+	uint32_t *r = st.val(result);
+	const uint32_t *a = st.val(ida);
+	const uint32_t *b = st.val(idb);
+	const uint32_t *d = st.val(idc);
+	for (uint32_t c = 0; c < comps; c++) {
+		uint32_t *pr = r + c * SPV_LANES;
+		const uint32_t *pa = a + (ca == 1 ? 0 : c) * SPV_LANES;
+		const uint32_t *pb = b + (cb == 1 ? 0 : c) * SPV_LANES;
+		const uint32_t *pc = d + (cc == 1 ? 0 : c) * SPV_LANES;
+		for_lanes(mask, [&](uint32_t l) {
+			pr[l] = f(pa[l], pb[l], pc[l]);
+		});
+	}
+}
+
+#define SPV_UNARY_F(expr) op_unary(st, w, mask, [](uint32_t ua) { float a = u2f(ua); return f2u(expr); })
+#define SPV_UNARY_I(expr) op_unary(st, w, mask, [](uint32_t ua) { int32_t a = (int32_t)ua; return (uint32_t)(expr); })
+#define SPV_UNARY_U(expr) op_unary(st, w, mask, [](uint32_t a) { return (uint32_t)(expr); })
+#define SPV_BINARY_F(expr) op_binary(st, w[2], w[3], w[4], mask, [](uint32_t ua, uint32_t ub) { float a = u2f(ua), b = u2f(ub); return f2u(expr); })
+#define SPV_BINARY_I(expr) op_binary(st, w[2], w[3], w[4], mask, [](uint32_t ua, uint32_t ub) { int32_t a = (int32_t)ua, b = (int32_t)ub; return (uint32_t)(expr); })
+#define SPV_BINARY_U(expr) op_binary(st, w[2], w[3], w[4], mask, [](uint32_t a, uint32_t b) { return (uint32_t)(expr); })
+#define SPV_COMPARE_F(expr) op_binary(st, w[2], w[3], w[4], mask, [](uint32_t ua, uint32_t ub) { float a = u2f(ua), b = u2f(ub); return (uint32_t)((expr) ? 1 : 0); })
+
+static int32_t
+float_to_int(float a)
+{
+	if (!(a > -2147483648.0f))
+		return a != a ? 0 : INT32_MIN;
+	if (a >= 2147483648.0f)
+		return INT32_MAX;
+	return (int32_t)a;
+}
+
+static uint32_t
+float_to_uint(float a)
+{
+	if (!(a > 0.0f))
+		return 0;
+	if (a >= 4294967296.0f)
+		return UINT32_MAX;
+	return (uint32_t)a;
+}
+
+static int32_t
+sdiv(int32_t a, int32_t b)
+{
+	if (b == 0)
+		return 0;
+	if (a == INT32_MIN && b == -1)
+		return a;
+	return a / b;
+}
+
+static int32_t
+srem(int32_t a, int32_t b)
+{
+	if (b == 0 || b == -1)
+		return 0;
+	return a % b;
+}
+
+static int32_t
+smod(int32_t a, int32_t b)
+{
+	int32_t r = srem(a, b);
+	return (r != 0 && ((r < 0) != (b < 0))) ? r + b : r;
+}
+
+//Component offset of a constant index path into a flattened composite.
+static uint32_t
+composite_offset(const spirv_program & p, uint32_t type, const uint32_t *indices, uint32_t num, uint32_t & result_type)
+{
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < num; i++) {
+		auto & t = p.vtypes[type];
+		if (t.op == SpvOpTypeStruct) {
+			offset += t.vmember_comps[indices[i]];
+			type = t.vmembers[indices[i]];
+		} else {
+			offset += indices[i] * p.vtypes[t.elem].comps;
+			type = t.elem;
+		}
+	}
+	result_type = type;
+	return offset;
+}
+
+//Buffer block read with explicit layout. out is lane strided.
+static void
+read_layout(const spirv_program & p, uint32_t type, const uint8_t *base, size_t size, size_t offset,
+	uint32_t matrix_stride, bool is_row_major, uint32_t *out)
+{
+	auto & t = p.vtypes[type];
+	auto read32 = [&](size_t at) {
+		uint32_t v = 0;
+		if (base && at + 4 <= size)
+			memcpy(&v, base + at, 4);
+		return v;
+	};
+	switch (t.op) {
+	case SpvOpTypeBool:
+		out[0] = read32(offset) ? 1 : 0;
+		break;
+	case SpvOpTypeInt:
+	case SpvOpTypeFloat:
+		out[0] = read32(offset);
+		break;
+	case SpvOpTypeVector:
+		for (uint32_t i = 0; i < t.count; i++)
+			out[i * SPV_LANES] = read32(offset + i * 4);
+		break;
+	case SpvOpTypeMatrix: {
+		uint32_t rows = p.vtypes[t.elem].count;
+		for (uint32_t col = 0; col < t.count; col++)
+			for (uint32_t row = 0; row < rows; row++)
+				out[(col * rows + row) * SPV_LANES] = is_row_major ?
+					read32(offset + row * matrix_stride + col * 4) :
+					read32(offset + col * matrix_stride + row * 4);
+		break;
+	}
+	case SpvOpTypeArray: {
+		uint32_t comps = p.vtypes[t.elem].comps;
+		for (uint32_t i = 0; i < t.count; i++)
+			read_layout(p, t.elem, base, size, offset + i * t.array_stride,
+				matrix_stride, is_row_major, out + i * comps * SPV_LANES);
+		break;
+	}
+	case SpvOpTypeStruct:
+		for (size_t i = 0; i < t.vmembers.size(); i++)
+			read_layout(p, t.vmembers[i], base, size, offset + t.vmember_offsets[i],
+				t.vmember_matrix_stride[i], t.vmember_row_major[i] != 0,
+				out + t.vmember_comps[i] * SPV_LANES);
+		break;
+	}
+}
+
+static void exec_function(spv_state & st, uint32_t function, uint32_t mask, uint32_t result);
+
+static void
+exec_ext_glsl(spv_state & st, const uint32_t *w, uint32_t mask)
+{
+	//w[1] type, w[2] result, w[3] set, w[4] instruction, w[5..] operands
+	uint32_t inst = w[4];
+	uint32_t result = w[2];
+	const uint32_t *o = w + 5;
+	auto unary_f = [&](float (*f)(float)) {
+		op_binary(st, result, o[0], o[0], mask, [f](uint32_t a, uint32_t) {
+			return f2u(f(u2f(a)));
+		});
+	};
+
+	switch (inst) {
+	case GLSLstd450Round:
+		unary_f(roundf);
+		break;
+	case GLSLstd450RoundEven:
+		unary_f(nearbyintf);
+		break;
+	case GLSLstd450Trunc:
+		unary_f(truncf);
+		break;
+	case GLSLstd450FAbs:
+		unary_f(fabsf);
+		break;
+	case GLSLstd450SAbs:
+		op_binary(st, result, o[0], o[0], mask, [](uint32_t a, uint32_t) {
+			return (int32_t)a < 0 ? 0u - a : a;
+		});
+		break;
+	case GLSLstd450FSign:
+		unary_f([](float a) {
+			return a > 0.0f ? 1.0f : (a < 0.0f ? -1.0f : 0.0f);
+		});
+		break;
+	case GLSLstd450SSign:
+		op_binary(st, result, o[0], o[0], mask, [](uint32_t a, uint32_t) {
+			int32_t s = (int32_t)a;
+			return (uint32_t)(s > 0 ? 1 : (s < 0 ? -1 : 0));
+		});
+		break;
+	case GLSLstd450Floor:
+		unary_f(floorf);
+		break;
+	case GLSLstd450Ceil:
+		unary_f(ceilf);
+		break;
+	case GLSLstd450Fract:
+		unary_f([](float a) {
+			return a - floorf(a);
+		});
+		break;
+	case GLSLstd450Radians:
+		unary_f([](float a) {
+			return a * 0.017453292519943295f;
+		});
+		break;
+	case GLSLstd450Degrees:
+		unary_f([](float a) {
+			return a * 57.29577951308232f;
+		});
+		break;
+	case GLSLstd450Sin:
+		unary_f(sinf);
+		break;
+	case GLSLstd450Cos:
+		unary_f(cosf);
+		break;
+	case GLSLstd450Tan:
+		unary_f(tanf);
+		break;
+	case GLSLstd450Asin:
+		unary_f(asinf);
+		break;
+	case GLSLstd450Acos:
+		unary_f(acosf);
+		break;
+	case GLSLstd450Atan:
+		unary_f(atanf);
+		break;
+	case GLSLstd450Exp:
+		unary_f(expf);
+		break;
+	case GLSLstd450Log:
+		unary_f(logf);
+		break;
+	case GLSLstd450Exp2:
+		unary_f(exp2f);
+		break;
+	case GLSLstd450Log2:
+		unary_f(log2f);
+		break;
+	case GLSLstd450Sqrt:
+		unary_f(sqrtf);
+		break;
+	case GLSLstd450InverseSqrt:
+		unary_f([](float a) {
+			return 1.0f / sqrtf(a);
+		});
+		break;
+	case GLSLstd450Atan2:
+		op_binary(st, result, o[0], o[1], mask, [](uint32_t a, uint32_t b) {
+			return f2u(atan2f(u2f(a), u2f(b)));
+		});
+		break;
+	case GLSLstd450Pow:
+		op_binary(st, result, o[0], o[1], mask, [](uint32_t a, uint32_t b) {
+			return f2u(powf(u2f(a), u2f(b)));
+		});
+		break;
+	case GLSLstd450FMin:
+	case GLSLstd450NMin:
+		op_binary(st, result, o[0], o[1], mask, [](uint32_t a, uint32_t b) {
+			return f2u(fminf(u2f(a), u2f(b)));
+		});
+		break;
+	case GLSLstd450FMax:
+	case GLSLstd450NMax:
+		op_binary(st, result, o[0], o[1], mask, [](uint32_t a, uint32_t b) {
+			return f2u(fmaxf(u2f(a), u2f(b)));
+		});
+		break;
+	case GLSLstd450UMin:
+		op_binary(st, result, o[0], o[1], mask, [](uint32_t a, uint32_t b) {
+			return (std::min)(a, b);
+		});
+		break;
+	case GLSLstd450UMax:
+		op_binary(st, result, o[0], o[1], mask, [](uint32_t a, uint32_t b) {
+			return (std::max)(a, b);
+		});
+		break;
+	case GLSLstd450SMin:
+		op_binary(st, result, o[0], o[1], mask, [](uint32_t a, uint32_t b) {
+			return (uint32_t)(std::min)((int32_t)a, (int32_t)b);
+		});
+		break;
+	case GLSLstd450SMax:
+		op_binary(st, result, o[0], o[1], mask, [](uint32_t a, uint32_t b) {
+			return (uint32_t)(std::max)((int32_t)a, (int32_t)b);
+		});
+		break;
+	case GLSLstd450Step:
+		op_binary(st, result, o[0], o[1], mask, [](uint32_t edge, uint32_t x) {
+			return f2u(u2f(x) < u2f(edge) ? 0.0f : 1.0f);
+		});
+		break;
+	case GLSLstd450FClamp:
+	case GLSLstd450NClamp:
+		op_ternary(st, result, o[0], o[1], o[2], mask, [](uint32_t x, uint32_t lo, uint32_t hi) {
+			return f2u(fminf(fmaxf(u2f(x), u2f(lo)), u2f(hi)));
+		});
+		break;
+	case GLSLstd450UClamp:
+		op_ternary(st, result, o[0], o[1], o[2], mask, [](uint32_t x, uint32_t lo, uint32_t hi) {
+			return (std::min)((std::max)(x, lo), hi);
+		});
+		break;
+	case GLSLstd450SClamp:
+		op_ternary(st, result, o[0], o[1], o[2], mask, [](uint32_t x, uint32_t lo, uint32_t hi) {
+			return (uint32_t)(std::min)((std::max)((int32_t)x, (int32_t)lo), (int32_t)hi);
+		});
+		break;
+	case GLSLstd450FMix:
+		op_ternary(st, result, o[0], o[1], o[2], mask, [](uint32_t x, uint32_t y, uint32_t a) {
+			return f2u(u2f(x) + (u2f(y) - u2f(x)) * u2f(a));
+		});
+		break;
+	case GLSLstd450SmoothStep:
+		op_ternary(st, result, o[0], o[1], o[2], mask, [](uint32_t e0, uint32_t e1, uint32_t x) {
+			float t = (u2f(x) - u2f(e0)) / (u2f(e1) - u2f(e0));
+			t = fminf(fmaxf(t, 0.0f), 1.0f);
+			return f2u(t * t * (3.0f - 2.0f * t));
+		});
+		break;
+	case GLSLstd450Fma:
+		op_ternary(st, result, o[0], o[1], o[2], mask, [](uint32_t a, uint32_t b, uint32_t c) {
+			return f2u(u2f(a) * u2f(b) + u2f(c));
+		});
+		break;
+	case GLSLstd450Length:
+	case GLSLstd450Distance: {
+		uint32_t n = st.comps(o[0]);
+		const uint32_t *a = st.val(o[0]);
+		const uint32_t *b = inst == GLSLstd450Distance ? st.val(o[1]) : nullptr;
+		uint32_t *r = st.val(result);
+		for_lanes(mask, [&](uint32_t l) {
+			float sum = 0.0f;
+			for (uint32_t c = 0; c < n; c++) {
+				float d = u2f(a[c * SPV_LANES + l]) - (b ? u2f(b[c * SPV_LANES + l]) : 0.0f);
+				sum += d * d;
+			}
+			r[l] = f2u(sqrtf(sum));
+		});
+		break;
+	}
+	case GLSLstd450Normalize: {
+		uint32_t n = st.comps(o[0]);
+		const uint32_t *a = st.val(o[0]);
+		uint32_t *r = st.val(result);
+		for_lanes(mask, [&](uint32_t l) {
+			float sum = 0.0f;
+			for (uint32_t c = 0; c < n; c++)
+				sum += u2f(a[c * SPV_LANES + l]) * u2f(a[c * SPV_LANES + l]);
+			float inv = 1.0f / sqrtf(sum);
+			for (uint32_t c = 0; c < n; c++)
+				r[c * SPV_LANES + l] = f2u(u2f(a[c * SPV_LANES + l]) * inv);
+		});
+		break;
+	}
+	case GLSLstd450Cross: {
+		const uint32_t *a = st.val(o[0]);
+		const uint32_t *b = st.val(o[1]);
+		uint32_t *r = st.val(result);
+		for_lanes(mask, [&](uint32_t l) {
+			float ax = u2f(a[l]), ay = u2f(a[SPV_LANES + l]), az = u2f(a[2 * SPV_LANES + l]);
+			float bx = u2f(b[l]), by = u2f(b[SPV_LANES + l]), bz = u2f(b[2 * SPV_LANES + l]);
+			r[l] = f2u(ay * bz - az * by);
+			r[SPV_LANES + l] = f2u(az * bx - ax * bz);
+			r[2 * SPV_LANES + l] = f2u(ax * by - ay * bx);
+		});
+		break;
+	}
+	}
+}
+
+static bool
+is_supported_glsl(uint32_t inst)
+{
+	switch (inst) {
+	case GLSLstd450Round:
+	case GLSLstd450RoundEven:
+	case GLSLstd450Trunc:
+	case GLSLstd450FAbs:
+	case GLSLstd450SAbs:
+	case GLSLstd450FSign:
+	case GLSLstd450SSign:
+	case GLSLstd450Floor:
+	case GLSLstd450Ceil:
+	case GLSLstd450Fract:
+	case GLSLstd450Radians:
+	case GLSLstd450Degrees:
+	case GLSLstd450Sin:
+	case GLSLstd450Cos:
+	case GLSLstd450Tan:
+	case GLSLstd450Asin:
+	case GLSLstd450Acos:
+	case GLSLstd450Atan:
+	case GLSLstd450Atan2:
+	case GLSLstd450Pow:
+	case GLSLstd450Exp:
+	case GLSLstd450Log:
+	case GLSLstd450Exp2:
+	case GLSLstd450Log2:
+	case GLSLstd450Sqrt:
+	case GLSLstd450InverseSqrt:
+	case GLSLstd450FMin:
+	case GLSLstd450UMin:
+	case GLSLstd450SMin:
+	case GLSLstd450FMax:
+	case GLSLstd450UMax:
+	case GLSLstd450SMax:
+	case GLSLstd450FClamp:
+	case GLSLstd450UClamp:
+	case GLSLstd450SClamp:
+	case GLSLstd450FMix:
+	case GLSLstd450Step:
+	case GLSLstd450SmoothStep:
+	case GLSLstd450Fma:
+	case GLSLstd450Length:
+	case GLSLstd450Distance:
+	case GLSLstd450Cross:
+	case GLSLstd450Normalize:
+	case GLSLstd450NMin:
+	case GLSLstd450NMax:
+	case GLSLstd450NClamp:
+		return true;
+	}
+	return false;
+}
+
+//Non terminator instructions.
+static void
+exec_inst(spv_state & st, const spv_inst & inst, const uint32_t *w, uint32_t mask)
+{
+	auto & p = *st.program;
+	auto & b = *st.bindings;
+
+	switch (inst.op) {
+	case SpvOpVariable: {
+		//w[1] type, w[2] result, w[3] storage, w[4] initializer
+		if ((w[0] >> 16) > 4) {
+			uint32_t comps = st.comps(w[4]);
+			const uint32_t *src = st.val(w[4]);
+			const uint32_t *ptr = st.val(w[2]);
+			for_lanes(mask, [&](uint32_t l) {
+				for (uint32_t c = 0; c < comps; c++)
+					st.vdata[ptr[l] + c * SPV_LANES] = src[c * SPV_LANES + l];
+			});
+		}
+		break;
+	}
+	case SpvOpLoad: {
+		uint32_t comps = st.comps(w[2]);
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *ptr = st.val(w[3]);
+		uint32_t storage = st.type_of(w[3]).storage;
+		if (storage == SpvStorageClassUniformConstant) {
+			for_lanes(mask, [&](uint32_t l) {
+				r[l] = ptr[l];
+			});
+		} else if (is_buffer_storage(storage)) {
+			uint32_t meta = st.vmeta[w[3]];
+			uint32_t matrix_stride = meta ? (meta & 0x7FFFFFFF) : 16;
+			bool is_row_major = (meta >> 31) != 0;
+			uint32_t binding = SPV_DONE;
+			const uint8_t *data = nullptr;
+			size_t size = 0;
+			for_lanes(mask, [&](uint32_t l) {
+				uint32_t addr = ptr[l];
+				if ((addr >> SPV_BUFFER_OFFSET_BITS) != binding) {
+					binding = addr >> SPV_BUFFER_OFFSET_BITS;
+					data = b.uniform ? b.uniform(binding, size) : nullptr;
+				}
+				read_layout(p, p.vresult_type[w[2]], data, size,
+					addr & ((1u << SPV_BUFFER_OFFSET_BITS) - 1),
+					matrix_stride, is_row_major, r + l);
+			});
+		} else {
+			for_lanes(mask, [&](uint32_t l) {
+				for (uint32_t c = 0; c < comps; c++)
+					r[c * SPV_LANES + l] = st.vdata[ptr[l] + c * SPV_LANES];
+			});
+		}
+		break;
+	}
+	case SpvOpStore: {
+		//w[1] pointer, w[2] object
+		uint32_t comps = st.comps(w[2]);
+		const uint32_t *src = st.val(w[2]);
+		const uint32_t *ptr = st.val(w[1]);
+		for_lanes(mask, [&](uint32_t l) {
+			for (uint32_t c = 0; c < comps; c++)
+				st.vdata[ptr[l] + c * SPV_LANES] = src[c * SPV_LANES + l];
+		});
+		break;
+	}
+	case SpvOpAccessChain:
+	case SpvOpInBoundsAccessChain: {
+		uint32_t num = (w[0] >> 16) - 4;
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *base = st.val(w[3]);
+		auto & base_type = st.type_of(w[3]);
+		bool is_buffer = is_buffer_storage(base_type.storage);
+		uint32_t type = base_type.elem;
+		uint32_t meta = st.vmeta[w[3]];
+		uint32_t matrix_stride = meta ? (meta & 0x7FFFFFFF) : 16;
+		uint32_t is_row_major = meta >> 31;
+		for_lanes(mask, [&](uint32_t l) {
+			r[l] = base[l];
+		});
+		for (uint32_t i = 0; i < num; i++) {
+			auto & t = p.vtypes[type];
+			const uint32_t *index = st.val(w[4 + i]);
+			if (t.op == SpvOpTypeStruct) {
+				uint32_t m = index[0];
+				uint32_t add = is_buffer ? t.vmember_offsets[m] : t.vmember_comps[m] * SPV_LANES;
+				if (is_buffer) {
+					matrix_stride = t.vmember_matrix_stride[m];
+					is_row_major = t.vmember_row_major[m];
+				}
+				for_lanes(mask, [&](uint32_t l) {
+					r[l] += add;
+				});
+				type = t.vmembers[m];
+				continue;
+			}
+			uint32_t stride = p.vtypes[t.elem].comps * SPV_LANES;
+			if (is_buffer) {
+				if (t.op == SpvOpTypeMatrix)
+					stride = is_row_major ? 4 : matrix_stride;
+				else if (t.op == SpvOpTypeVector)
+					stride = is_row_major && p.vtypes[type].op == SpvOpTypeVector ? matrix_stride : 4;
+				else
+					stride = t.array_stride;
+			}
+			for_lanes(mask, [&](uint32_t l) {
+				r[l] += index[l] * stride;
+			});
+			type = t.elem;
+		}
+		st.vmeta[w[2]] = is_buffer ? (matrix_stride | (is_row_major << 31)) : 0;
+		break;
+	}
+	case SpvOpFunctionCall: {
+		//w[1] type, w[2] result, w[3] function, w[4..] arguments
+		auto index = p.vfunction_index[w[3]];
+		auto & fn = p.vfunctions[index];
+		for (size_t i = 0; i < fn.vparams.size(); i++) {
+			uint32_t comps = st.comps(fn.vparams[i]);
+			uint32_t *dst = st.val(fn.vparams[i]);
+			const uint32_t *src = st.val(w[4 + i]);
+			st.vmeta[fn.vparams[i]] = st.vmeta[w[4 + i]];
+			for (uint32_t c = 0; c < comps; c++)
+				for_lanes(mask, [&](uint32_t l) {
+					dst[c * SPV_LANES + l] = src[c * SPV_LANES + l];
+				});
+		}
+		exec_function(st, index, mask, p.vtypes[w[1]].op == SpvOpTypeVoid ? 0 : w[2]);
+		break;
+	}
+	case SpvOpExtInst:
+		exec_ext_glsl(st, w, mask);
+		break;
+
+	case SpvOpCompositeConstruct: {
+		uint32_t *r = st.val(w[2]);
+		uint32_t num = (w[0] >> 16) - 3;
+		for (uint32_t i = 0; i < num; i++) {
+			uint32_t comps = st.comps(w[3 + i]);
+			const uint32_t *src = st.val(w[3 + i]);
+			for (uint32_t c = 0; c < comps; c++)
+				for_lanes(mask, [&](uint32_t l) {
+					r[c * SPV_LANES + l] = src[c * SPV_LANES + l];
+				});
+			r += comps * SPV_LANES;
+		}
+		break;
+	}
+	case SpvOpCompositeExtract:
+	case SpvOpCompositeInsert: {
+		bool is_insert = inst.op == SpvOpCompositeInsert;
+		uint32_t composite = is_insert ? w[4] : w[3];
+		const uint32_t *indices = w + (is_insert ? 5 : 4);
+		uint32_t num = (w[0] >> 16) - (is_insert ? 5 : 4);
+		uint32_t part_type = 0;
+		uint32_t offset = composite_offset(p, p.vresult_type[composite], indices, num, part_type);
+		uint32_t part = p.vtypes[part_type].comps;
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *src = st.val(composite);
+		if (is_insert) {
+			uint32_t comps = st.comps(w[2]);
+			const uint32_t *obj = st.val(w[3]);
+			for (uint32_t c = 0; c < comps; c++)
+				for_lanes(mask, [&](uint32_t l) {
+					r[c * SPV_LANES + l] = (c >= offset && c < offset + part) ?
+						obj[(c - offset) * SPV_LANES + l] : src[c * SPV_LANES + l];
+				});
+		} else {
+			for (uint32_t c = 0; c < part; c++)
+				for_lanes(mask, [&](uint32_t l) {
+					r[c * SPV_LANES + l] = src[(offset + c) * SPV_LANES + l];
+				});
+		}
+		break;
+	}
+	case SpvOpVectorShuffle: {
+		uint32_t n1 = st.comps(w[3]);
+		uint32_t comps = st.comps(w[2]);
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *a = st.val(w[3]);
+		const uint32_t *v = st.val(w[4]);
+		for (uint32_t c = 0; c < comps; c++) {
+			uint32_t sel = w[5 + c];
+			const uint32_t *src = sel == SPV_DONE ? nullptr : (sel < n1 ? a + sel * SPV_LANES : v + (sel - n1) * SPV_LANES);
+			for_lanes(mask, [&](uint32_t l) {
+				r[c * SPV_LANES + l] = src ? src[l] : 0;
+			});
+		}
+		break;
+	}
+	case SpvOpVectorExtractDynamic: {
+		uint32_t n = st.comps(w[3]);
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *v = st.val(w[3]);
+		const uint32_t *index = st.val(w[4]);
+		for_lanes(mask, [&](uint32_t l) {
+			r[l] = index[l] < n ? v[index[l] * SPV_LANES + l] : 0;
+		});
+		break;
+	}
+	case SpvOpVectorInsertDynamic: {
+		uint32_t n = st.comps(w[3]);
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *v = st.val(w[3]);
+		const uint32_t *comp = st.val(w[4]);
+		const uint32_t *index = st.val(w[5]);
+		for_lanes(mask, [&](uint32_t l) {
+			for (uint32_t c = 0; c < n; c++)
+				r[c * SPV_LANES + l] = c == index[l] ? comp[l] : v[c * SPV_LANES + l];
+		});
+		break;
+	}
+	case SpvOpCopyObject:
+	case SpvOpBitcast:
+	case SpvOpUConvert:
+	case SpvOpSConvert:
+	case SpvOpFConvert:
+	case SpvOpSampledImage:
+	case SpvOpImage:
+		SPV_UNARY_U(a);
+		st.vmeta[w[2]] = st.vmeta[w[3]];
+		break;
+	case SpvOpTranspose: {
+		auto & t = st.type_of(w[2]);
+		uint32_t rows = p.vtypes[t.elem].count;
+		uint32_t cols = t.count;
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *m = st.val(w[3]);
+		for (uint32_t col = 0; col < cols; col++)
+			for (uint32_t row = 0; row < rows; row++)
+				for_lanes(mask, [&](uint32_t l) {
+					r[(col * rows + row) * SPV_LANES + l] = m[(row * cols + col) * SPV_LANES + l];
+				});
+		break;
+	}
+
+	case SpvOpConvertFToU:
+		SPV_UNARY_U(float_to_uint(u2f(a)));
+		break;
+	case SpvOpConvertFToS:
+		SPV_UNARY_U((uint32_t)float_to_int(u2f(a)));
+		break;
+	case SpvOpConvertSToF:
+		SPV_UNARY_I(f2u((float)a));
+		break;
+	case SpvOpConvertUToF:
+		SPV_UNARY_U(f2u((float)a));
+		break;
+
+	case SpvOpSNegate:
+		SPV_UNARY_U(0u - a);
+		break;
+	case SpvOpFNegate:
+		SPV_UNARY_F(-a);
+		break;
+	case SpvOpNot:
+		SPV_UNARY_U(~a);
+		break;
+	case SpvOpLogicalNot:
+		SPV_UNARY_U(a ? 0 : 1);
+		break;
+	case SpvOpIsNan:
+		SPV_UNARY_U(isnan(u2f(a)) ? 1 : 0);
+		break;
+	case SpvOpIsInf:
+		SPV_UNARY_U(isinf(u2f(a)) ? 1 : 0);
+		break;
+
+	case SpvOpIAdd:
+		SPV_BINARY_U(a + b);
+		break;
+	case SpvOpISub:
+		SPV_BINARY_U(a - b);
+		break;
+	case SpvOpIMul:
+		SPV_BINARY_U(a * b);
+		break;
+	case SpvOpUDiv:
+		SPV_BINARY_U(b ? a / b : 0);
+		break;
+	case SpvOpUMod:
+		SPV_BINARY_U(b ? a % b : 0);
+		break;
+	case SpvOpSDiv:
+		SPV_BINARY_I(sdiv(a, b));
+		break;
+	case SpvOpSRem:
+		SPV_BINARY_I(srem(a, b));
+		break;
+	case SpvOpSMod:
+		SPV_BINARY_I(smod(a, b));
+		break;
+	case SpvOpFAdd:
+		SPV_BINARY_F(a + b);
+		break;
+	case SpvOpFSub:
+		SPV_BINARY_F(a - b);
+		break;
+	case SpvOpFMul:
+	case SpvOpVectorTimesScalar:
+	case SpvOpMatrixTimesScalar:
+		SPV_BINARY_F(a * b);
+		break;
+	case SpvOpFDiv:
+		SPV_BINARY_F(a / b);
+		break;
+	case SpvOpFRem:
+		SPV_BINARY_F(fmodf(a, b));
+		break;
+	case SpvOpFMod:
+		SPV_BINARY_F(a - b * floorf(a / b));
+		break;
+	case SpvOpShiftRightLogical:
+		SPV_BINARY_U(a >> (b & 31));
+		break;
+	case SpvOpShiftRightArithmetic:
+		SPV_BINARY_I(a >> (b & 31));
+		break;
+	case SpvOpShiftLeftLogical:
+		SPV_BINARY_U(a << (b & 31));
+		break;
+	case SpvOpBitwiseOr:
+	case SpvOpLogicalOr:
+		SPV_BINARY_U(a | b);
+		break;
+	case SpvOpBitwiseXor:
+		SPV_BINARY_U(a ^ b);
+		break;
+	case SpvOpBitwiseAnd:
+	case SpvOpLogicalAnd:
+		SPV_BINARY_U(a & b);
+		break;
+	case SpvOpLogicalEqual:
+	case SpvOpIEqual:
+		SPV_BINARY_U(a == b ? 1 : 0);
+		break;
+	case SpvOpLogicalNotEqual:
+	case SpvOpINotEqual:
+		SPV_BINARY_U(a != b ? 1 : 0);
+		break;
+	case SpvOpUGreaterThan:
+		SPV_BINARY_U(a > b ? 1 : 0);
+		break;
+	case SpvOpUGreaterThanEqual:
+		SPV_BINARY_U(a >= b ? 1 : 0);
+		break;
+	case SpvOpULessThan:
+		SPV_BINARY_U(a < b ? 1 : 0);
+		break;
+	case SpvOpULessThanEqual:
+		SPV_BINARY_U(a <= b ? 1 : 0);
+		break;
+	case SpvOpSGreaterThan:
+		SPV_BINARY_I(a > b ? 1 : 0);
+		break;
+	case SpvOpSGreaterThanEqual:
+		SPV_BINARY_I(a >= b ? 1 : 0);
+		break;
+	case SpvOpSLessThan:
+		SPV_BINARY_I(a < b ? 1 : 0);
+		break;
+	case SpvOpSLessThanEqual:
+		SPV_BINARY_I(a <= b ? 1 : 0);
+		break;
+	case SpvOpFOrdEqual:
+		SPV_COMPARE_F(a == b);
+		break;
+	case SpvOpFUnordEqual:
+		SPV_COMPARE_F(!(a != b));
+		break;
+	case SpvOpFOrdNotEqual:
+		SPV_COMPARE_F(a < b || a > b);
+		break;
+	case SpvOpFUnordNotEqual:
+		SPV_COMPARE_F(a != b);
+		break;
+	case SpvOpFOrdLessThan:
+		SPV_COMPARE_F(a < b);
+		break;
+	case SpvOpFUnordLessThan:
+		SPV_COMPARE_F(!(a >= b));
+		break;
+	case SpvOpFOrdGreaterThan:
+		SPV_COMPARE_F(a > b);
+		break;
+	case SpvOpFUnordGreaterThan:
+		SPV_COMPARE_F(!(a <= b));
+		break;
+	case SpvOpFOrdLessThanEqual:
+		SPV_COMPARE_F(a <= b);
+		break;
+	case SpvOpFUnordLessThanEqual:
+		SPV_COMPARE_F(!(a > b));
+		break;
+	case SpvOpFOrdGreaterThanEqual:
+		SPV_COMPARE_F(a >= b);
+		break;
+	case SpvOpFUnordGreaterThanEqual:
+		SPV_COMPARE_F(!(a < b));
+		break;
+	case SpvOpSelect:
+		op_ternary(st, w[2], w[3], w[4], w[5], mask, [](uint32_t c, uint32_t a, uint32_t b) {
+			return c ? a : b;
+		});
+		break;
+	case SpvOpAny:
+	case SpvOpAll: {
+		uint32_t n = st.comps(w[3]);
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *v = st.val(w[3]);
+		bool is_any = inst.op == SpvOpAny;
+		for_lanes(mask, [&](uint32_t l) {
+			uint32_t x = is_any ? 0 : 1;
+			for (uint32_t c = 0; c < n; c++)
+				x = is_any ? (x | v[c * SPV_LANES + l]) : (x & v[c * SPV_LANES + l]);
+			r[l] = x;
+		});
+		break;
+	}
+	case SpvOpDot: {
+		uint32_t n = st.comps(w[3]);
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *a = st.val(w[3]);
+		const uint32_t *v = st.val(w[4]);
+		for_lanes(mask, [&](uint32_t l) {
+			float sum = 0.0f;
+			for (uint32_t c = 0; c < n; c++)
+				sum += u2f(a[c * SPV_LANES + l]) * u2f(v[c * SPV_LANES + l]);
+			r[l] = f2u(sum);
+		});
+		break;
+	}
+	case SpvOpMatrixTimesVector:
+	case SpvOpVectorTimesMatrix:
+	case SpvOpMatrixTimesMatrix: {
+		//Columns are contiguous, a[col][row] = a[col * rows + row].
+		//Vectors are a column (right operand) or a row (left operand).
+		auto & ta = st.type_of(w[3]);
+		auto & tb = st.type_of(w[4]);
+		uint32_t a_rows = inst.op == SpvOpVectorTimesMatrix ? 1 : p.vtypes[ta.elem].count;
+		uint32_t depth = ta.count;
+		uint32_t b_cols = inst.op == SpvOpMatrixTimesVector ? 1 : tb.count;
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *a = st.val(w[3]);
+		const uint32_t *v = st.val(w[4]);
+		for (uint32_t col = 0; col < b_cols; col++) {
+			for (uint32_t row = 0; row < a_rows; row++) {
+				uint32_t *out = r + (col * a_rows + row) * SPV_LANES;
+				for_lanes(mask, [&](uint32_t l) {
+					float sum = 0.0f;
+					for (uint32_t k = 0; k < depth; k++)
+						sum += u2f(a[(k * a_rows + row) * SPV_LANES + l]) * u2f(v[(col * depth + k) * SPV_LANES + l]);
+					out[l] = f2u(sum);
+				});
+			}
+		}
+		break;
+	}
+
+	case SpvOpImageRead:
+	case SpvOpImageFetch: {
+		uint32_t comps = st.comps(w[2]);
+		bool is_float = st.type_of(w[2]).is_float;
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *image = st.val(w[3]);
+		const uint32_t *coord = st.val(w[4]);
+		for_lanes(mask, [&](uint32_t l) {
+			float color[4] = {};
+			if (b.image_read)
+				b.image_read(image[l], (int32_t)coord[l], (int32_t)coord[SPV_LANES + l], color);
+			for (uint32_t c = 0; c < comps && c < 4; c++)
+				r[c * SPV_LANES + l] = is_float ? f2u(color[c]) : (uint32_t)float_to_int(color[c]);
+		});
+		break;
+	}
+	case SpvOpImageWrite: {
+		//w[1] image, w[2] coordinate, w[3] texel
+		uint32_t comps = st.comps(w[3]);
+		bool is_float = st.type_of(w[3]).is_float;
+		const uint32_t *image = st.val(w[1]);
+		const uint32_t *coord = st.val(w[2]);
+		const uint32_t *texel = st.val(w[3]);
+		for_lanes(mask, [&](uint32_t l) {
+			float color[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+			for (uint32_t c = 0; c < comps && c < 4; c++)
+				color[c] = is_float ? u2f(texel[c * SPV_LANES + l]) : (float)(int32_t)texel[c * SPV_LANES + l];
+			if (b.image_write)
+				b.image_write(image[l], (int32_t)coord[l], (int32_t)coord[SPV_LANES + l], color);
+		});
+		break;
+	}
+	case SpvOpImageQuerySize:
+	case SpvOpImageQuerySizeLod: {
+		uint32_t comps = st.comps(w[2]);
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *image = st.val(w[3]);
+		const uint32_t *lod = inst.op == SpvOpImageQuerySizeLod ? st.val(w[4]) : nullptr;
+		for_lanes(mask, [&](uint32_t l) {
+			int size[2] = {};
+			if (b.image_size)
+				b.image_size(image[l], lod ? (int32_t)lod[l] : 0, size);
+			for (uint32_t c = 0; c < comps; c++)
+				r[c * SPV_LANES + l] = c < 2 ? (uint32_t)size[c] : 1;
+		});
+		break;
+	}
+	case SpvOpImageSampleExplicitLod: {
+		//w[3] sampled image, w[4] coordinate, w[5] operands, w[6] lod
+		uint32_t comps = st.comps(w[2]);
+		uint32_t *r = st.val(w[2]);
+		const uint32_t *image = st.val(w[3]);
+		const uint32_t *coord = st.val(w[4]);
+		bool has_lod = (w[0] >> 16) > 6 && (w[5] & SpvImageOperandsLodMask);
+		const uint32_t *lod = has_lod ? st.val(w[6]) : nullptr;
+		for_lanes(mask, [&](uint32_t l) {
+			float color[4] = {};
+			if (b.image_sample)
+				b.image_sample(image[l], u2f(coord[l]), u2f(coord[SPV_LANES + l]), lod ? u2f(lod[l]) : 0.0f, color);
+			for (uint32_t c = 0; c < comps && c < 4; c++)
+				r[c * SPV_LANES + l] = f2u(color[c]);
+		});
+		break;
+	}
+	}
+}
+
+static void
+exec_function(spv_state & st, uint32_t function, uint32_t mask, uint32_t result)
+{
+	auto & p = *st.program;
+	auto & fn = p.vfunctions[function];
+	uint32_t vblock[SPV_LANES];
+	uint32_t vprev[SPV_LANES];
+
+	for (uint32_t l = 0; l < SPV_LANES; l++) {
+		vblock[l] = ((mask >> l) & 1) ? 0 : (uint32_t)SPV_DONE;
+		vprev[l] = SPV_DONE;
+	}
+
+	for (;;) {
+		uint32_t current = SPV_DONE;
+		for (uint32_t l = 0; l < SPV_LANES; l++)
+			current = (std::min)(current, vblock[l]);
+		if (current == SPV_DONE)
+			break;
+		uint32_t m = 0;
+		for (uint32_t l = 0; l < SPV_LANES; l++)
+			if (vblock[l] == current)
+				m |= 1u << l;
+
+		auto & block = fn.vblocks[current];
+		uint32_t i = block.first;
+
+		//Phi reads all incoming values before any of them is written.
+		uint32_t phi_end = i;
+		while (phi_end < block.end && p.vinsts[phi_end].op == SpvOpPhi)
+			phi_end++;
+		if (phi_end != i) {
+			st.vtemp.clear();
+			for (uint32_t k = i; k < phi_end; k++) {
+				const uint32_t *w = &p.vcode[p.vinsts[k].word];
+				uint32_t comps = st.comps(w[2]);
+				uint32_t pairs = ((w[0] >> 16) - 3) / 2;
+				size_t at = st.vtemp.size();
+				st.vtemp.resize(at + comps * SPV_LANES);
+				for (uint32_t n = 0; n < pairs; n++) {
+					uint32_t parent = p.vblock_index[w[4 + n * 2]];
+					const uint32_t *src = st.val(w[3 + n * 2]);
+					for (uint32_t l = 0; l < SPV_LANES; l++)
+						if (((m >> l) & 1) && vprev[l] == parent)
+							for (uint32_t c = 0; c < comps; c++)
+								st.vtemp[at + c * SPV_LANES + l] = src[c * SPV_LANES + l];
+				}
+			}
+			size_t at = 0;
+			for (uint32_t k = i; k < phi_end; k++) {
+				const uint32_t *w = &p.vcode[p.vinsts[k].word];
+				uint32_t comps = st.comps(w[2]);
+				uint32_t *r = st.val(w[2]);
+				for (uint32_t c = 0; c < comps; c++)
+					for_lanes(m, [&](uint32_t l) {
+						r[c * SPV_LANES + l] = st.vtemp[at + c * SPV_LANES + l];
+					});
+				at += comps * SPV_LANES;
+			}
+			i = phi_end;
+		}
+
+		for (; i < block.end; i++) {
+			auto & inst = p.vinsts[i];
+			const uint32_t *w = &p.vcode[inst.word];
+			switch (inst.op) {
+			case SpvOpBranch: {
+				uint32_t target = p.vblock_index[w[1]];
+				for_lanes(m, [&](uint32_t l) {
+					vblock[l] = target;
+				});
+				break;
+			}
+			case SpvOpBranchConditional: {
+				const uint32_t *cond = st.val(w[1]);
+				uint32_t t = p.vblock_index[w[2]];
+				uint32_t f = p.vblock_index[w[3]];
+				for_lanes(m, [&](uint32_t l) {
+					vblock[l] = cond[l] ? t : f;
+				});
+				break;
+			}
+			case SpvOpSwitch: {
+				const uint32_t *sel = st.val(w[1]);
+				uint32_t pairs = ((w[0] >> 16) - 3) / 2;
+				for_lanes(m, [&](uint32_t l) {
+					uint32_t target = w[2];
+					for (uint32_t n = 0; n < pairs; n++)
+						if (sel[l] == w[3 + n * 2])
+							target = w[4 + n * 2];
+					vblock[l] = p.vblock_index[target];
+				});
+				break;
+			}
+			case SpvOpReturnValue: {
+				uint32_t comps = st.comps(w[1]);
+				const uint32_t *src = st.val(w[1]);
+				uint32_t *r = result ? st.val(result) : nullptr;
+				for_lanes(m, [&](uint32_t l) {
+					for (uint32_t c = 0; r && c < comps; c++)
+						r[c * SPV_LANES + l] = src[c * SPV_LANES + l];
+					vblock[l] = SPV_DONE;
+				});
+				break;
+			}
+			case SpvOpReturn:
+			case SpvOpKill:
+			case SpvOpUnreachable:
+				for_lanes(m, [&](uint32_t l) {
+					vblock[l] = SPV_DONE;
+				});
+				break;
+			default:
+				exec_inst(st, inst, w, m);
+				break;
+			}
+		}
+		for_lanes(m, [&](uint32_t l) {
+			vprev[l] = current;
+		});
+	}
+}
+
+static bool
+is_supported_op(uint32_t op)
+{
+	switch (op) {
+	case SpvOpNop:
+	case SpvOpLine:
+	case SpvOpNoLine:
+	case SpvOpVariable:
+	case SpvOpLoad:
+	case SpvOpStore:
+	case SpvOpAccessChain:
+	case SpvOpInBoundsAccessChain:
+	case SpvOpFunctionCall:
+	case SpvOpExtInst:
+	case SpvOpVectorExtractDynamic:
+	case SpvOpVectorInsertDynamic:
+	case SpvOpVectorShuffle:
+	case SpvOpCompositeConstruct:
+	case SpvOpCompositeExtract:
+	case SpvOpCompositeInsert:
+	case SpvOpCopyObject:
+	case SpvOpTranspose:
+	case SpvOpSampledImage:
+	case SpvOpImageSampleExplicitLod:
+	case SpvOpImageFetch:
+	case SpvOpImageRead:
+	case SpvOpImageWrite:
+	case SpvOpImage:
+	case SpvOpImageQuerySizeLod:
+	case SpvOpImageQuerySize:
+	case SpvOpConvertFToU:
+	case SpvOpConvertFToS:
+	case SpvOpConvertSToF:
+	case SpvOpConvertUToF:
+	case SpvOpUConvert:
+	case SpvOpSConvert:
+	case SpvOpFConvert:
+	case SpvOpBitcast:
+	case SpvOpSNegate:
+	case SpvOpFNegate:
+	case SpvOpIAdd:
+	case SpvOpFAdd:
+	case SpvOpISub:
+	case SpvOpFSub:
+	case SpvOpIMul:
+	case SpvOpFMul:
+	case SpvOpUDiv:
+	case SpvOpSDiv:
+	case SpvOpFDiv:
+	case SpvOpUMod:
+	case SpvOpSRem:
+	case SpvOpSMod:
+	case SpvOpFRem:
+	case SpvOpFMod:
+	case SpvOpVectorTimesScalar:
+	case SpvOpMatrixTimesScalar:
+	case SpvOpVectorTimesMatrix:
+	case SpvOpMatrixTimesVector:
+	case SpvOpMatrixTimesMatrix:
+	case SpvOpDot:
+	case SpvOpAny:
+	case SpvOpAll:
+	case SpvOpIsNan:
+	case SpvOpIsInf:
+	case SpvOpLogicalEqual:
+	case SpvOpLogicalNotEqual:
+	case SpvOpLogicalOr:
+	case SpvOpLogicalAnd:
+	case SpvOpLogicalNot:
+	case SpvOpSelect:
+	case SpvOpIEqual:
+	case SpvOpINotEqual:
+	case SpvOpUGreaterThan:
+	case SpvOpSGreaterThan:
+	case SpvOpUGreaterThanEqual:
+	case SpvOpSGreaterThanEqual:
+	case SpvOpULessThan:
+	case SpvOpSLessThan:
+	case SpvOpULessThanEqual:
+	case SpvOpSLessThanEqual:
+	case SpvOpFOrdEqual:
+	case SpvOpFUnordEqual:
+	case SpvOpFOrdNotEqual:
+	case SpvOpFUnordNotEqual:
+	case SpvOpFOrdLessThan:
+	case SpvOpFUnordLessThan:
+	case SpvOpFOrdGreaterThan:
+	case SpvOpFUnordGreaterThan:
+	case SpvOpFOrdLessThanEqual:
+	case SpvOpFUnordLessThanEqual:
+	case SpvOpFOrdGreaterThanEqual:
+	case SpvOpFUnordGreaterThanEqual:
+	case SpvOpShiftRightLogical:
+	case SpvOpShiftRightArithmetic:
+	case SpvOpShiftLeftLogical:
+	case SpvOpBitwiseOr:
+	case SpvOpBitwiseXor:
+	case SpvOpBitwiseAnd:
+	case SpvOpNot:
+	case SpvOpPhi:
+	case SpvOpLoopMerge:
+	case SpvOpSelectionMerge:
+	case SpvOpBranch:
+	case SpvOpBranchConditional:
+	case SpvOpSwitch:
+	case SpvOpKill:
+	case SpvOpReturn:
+	case SpvOpReturnValue:
+	case SpvOpUnreachable:
+	case SpvOpControlBarrier:
+	case SpvOpMemoryBarrier:
+		return true;
+	}
+	return false;
+}
+
+static bool
+has_result(uint32_t op)
+{
+	switch (op) {
+	case SpvOpNop:
+	case SpvOpLine:
+	case SpvOpNoLine:
+	case SpvOpStore:
+	case SpvOpImageWrite:
+	case SpvOpLoopMerge:
+	case SpvOpSelectionMerge:
+	case SpvOpBranch:
+	case SpvOpBranchConditional:
+	case SpvOpSwitch:
+	case SpvOpKill:
+	case SpvOpReturn:
+	case SpvOpReturnValue:
+	case SpvOpUnreachable:
+	case SpvOpControlBarrier:
+	case SpvOpMemoryBarrier:
+		return false;
+	}
+	return true;
+}
+
+static bool
+is_terminator(uint32_t op)
+{
+	switch (op) {
+	case SpvOpBranch:
+	case SpvOpBranchConditional:
+	case SpvOpSwitch:
+	case SpvOpKill:
+	case SpvOpReturn:
+	case SpvOpReturnValue:
+	case SpvOpUnreachable:
+		return true;
+	}
+	return false;
+}
+
+std::shared_ptr<spirv_program>
+oden::spirv_load(const void *code, size_t size, std::string & error)
+{
+	static std::atomic<uint64_t> serial {0};
+	auto program = std::make_shared<spirv_program>();
+	auto & p = *program;
+	char msg[256];
+	auto fail = [&](const char *text, uint32_t value) {
+		snprintf(msg, sizeof(msg), "%s (%u)", text, value);
+		error = msg;
+		return nullptr;
+	};
+
+	if (code == nullptr || size < 20 || (size % 4) != 0)
+		return fail("invalid module size", (uint32_t)size);
+	p.vcode.resize(size / 4);
+	memcpy(p.vcode.data(), code, size);
+	auto & vcode = p.vcode;
+	if (vcode[0] != 0x07230203)
+		return fail("invalid magic", vcode[0]);
+
+	uint32_t bound = vcode[3];
+	p.serial = ++serial;
+	p.bound = bound;
+	p.vtypes.resize(bound);
+	p.vresult_type.resize(bound, 0);
+	p.voffset.resize(bound, 0);
+	p.vblock_index.resize(bound, SPV_DONE);
+	p.vfunction_index.resize(bound, -1);
+
+	std::vector<uint32_t> vbinding(bound, 0);
+	std::vector<uint32_t> vbuiltin(bound, SPV_DONE);
+	std::vector<uint32_t> varray_stride(bound, 0);
+	//key : struct id << 32 | member
+	std::map<uint64_t, uint32_t> mmember_offset;
+	std::map<uint64_t, uint32_t> mmember_matrix_stride;
+	std::map<uint64_t, uint32_t> mmember_row_major;
+	uint32_t entry = 0;
+	spv_function *fn = nullptr;
+	bool is_block_open = false;
+
+	//State word 0 is a zero value for ids without a result.
+	p.vinit.resize(SPV_LANES, 0);
+	auto alloc = [&](uint32_t comps) {
+		uint32_t at = (uint32_t)p.vinit.size();
+		p.vinit.resize(at + comps * SPV_LANES, 0);
+		return at;
+	};
+	auto set_result = [&](uint32_t type, uint32_t id) {
+		p.vresult_type[id] = type;
+		p.voffset[id] = alloc(p.vtypes[type].comps);
+	};
+	auto broadcast = [&](uint32_t id, uint32_t comp, uint32_t value) {
+		for (uint32_t l = 0; l < SPV_LANES; l++)
+			p.vinit[p.voffset[id] + comp * SPV_LANES + l] = value;
+	};
+
+	for (size_t pos = 5; pos < vcode.size(); ) {
+		uint32_t wc = vcode[pos] >> 16;
+		uint32_t op = vcode[pos] & 0xFFFF;
+		if (wc == 0 || pos + wc > vcode.size())
+			return fail("invalid instruction size at word", (uint32_t)pos);
+		const uint32_t *w = &vcode[pos];
+		bool is_type = op >= SpvOpTypeVoid && op <= SpvOpTypeFunction;
+		bool is_value = (op >= SpvOpConstantTrue && op <= SpvOpSpecConstantComposite) ||
+			op == SpvOpVariable || op == SpvOpUndef || op == SpvOpFunction;
+		if (fn == nullptr && is_type && (wc < 2 || w[1] >= bound))
+			return fail("id out of bound", op);
+		if (fn == nullptr && is_value && (wc < 3 || w[1] >= bound || w[2] >= bound))
+			return fail("id out of bound", op);
+
+		if (fn) {
+			if (op == SpvOpFunctionEnd) {
+				if (is_block_open)
+					return fail("block without terminator", (uint32_t)pos);
+				fn = nullptr;
+			} else if (op == SpvOpFunctionParameter) {
+				set_result(w[1], w[2]);
+				fn->vparams.push_back(w[2]);
+			} else if (op == SpvOpLabel) {
+				if (is_block_open)
+					return fail("block without terminator", (uint32_t)pos);
+				p.vblock_index[w[1]] = (uint32_t)fn->vblocks.size();
+				fn->vblocks.push_back({(uint32_t)p.vinsts.size(), 0});
+				is_block_open = true;
+			} else if (op == SpvOpUndef) {
+				set_result(w[1], w[2]);
+			} else {
+				if (!is_supported_op(op))
+					return fail("unsupported opcode", op);
+				if (!is_block_open)
+					return fail("instruction outside of block", op);
+				if (op == SpvOpExtInst && (w[3] != p.glsl_ext || !is_supported_glsl(w[4])))
+					return fail("unsupported extended instruction", w[4]);
+				if (has_result(op)) {
+					if (wc < 3 || w[1] >= bound || w[2] >= bound)
+						return fail("id out of bound", op);
+					set_result(w[1], w[2]);
+				}
+				if (op == SpvOpVariable) {
+					uint32_t storage = alloc(p.vtypes[p.vtypes[w[1]].elem].comps);
+					for (uint32_t l = 0; l < SPV_LANES; l++)
+						p.vinit[p.voffset[w[2]] + l] = storage + l;
+				}
+				p.vinsts.push_back({op, (uint32_t)pos});
+				if (is_terminator(op)) {
+					fn->vblocks.back().end = (uint32_t)p.vinsts.size();
+					is_block_open = false;
+				}
+			}
+			pos += wc;
+			continue;
+		}
+
+		switch (op) {
+		case SpvOpExtInstImport:
+			if (strcmp((const char *)(w + 2), "GLSL.std.450") == 0)
+				p.glsl_ext = w[1];
+			break;
+		case SpvOpEntryPoint:
+			if (w[1] == SpvExecutionModelGLCompute && entry == 0)
+				entry = w[2];
+			break;
+		case SpvOpExecutionMode:
+			if (w[2] == SpvExecutionModeLocalSize && wc >= 6)
+				for (int i = 0; i < 3; i++)
+					p.local_size[i] = (int)(std::max)(w[3 + i], 1u);
+			break;
+		case SpvOpDecorate:
+			if (w[1] >= bound || wc < 3)
+				break;
+			if (w[2] == SpvDecorationBinding)
+				vbinding[w[1]] = w[3];
+			if (w[2] == SpvDecorationBuiltIn)
+				vbuiltin[w[1]] = w[3];
+			if (w[2] == SpvDecorationArrayStride)
+				varray_stride[w[1]] = w[3];
+			break;
+		case SpvOpMemberDecorate: {
+			uint64_t key = ((uint64_t)w[1] << 32) | w[2];
+			if (w[3] == SpvDecorationOffset)
+				mmember_offset[key] = w[4];
+			if (w[3] == SpvDecorationMatrixStride)
+				mmember_matrix_stride[key] = w[4];
+			if (w[3] == SpvDecorationRowMajor)
+				mmember_row_major[key] = 1;
+			break;
+		}
+
+		case SpvOpTypeVoid:
+		case SpvOpTypeFunction:
+			p.vtypes[w[1]].op = op;
+			break;
+		case SpvOpTypeBool:
+		case SpvOpTypeImage:
+		case SpvOpTypeSampler:
+		case SpvOpTypeSampledImage:
+			p.vtypes[w[1]].op = op;
+			p.vtypes[w[1]].comps = 1;
+			break;
+		case SpvOpTypeInt:
+		case SpvOpTypeFloat: {
+			if (w[2] != 32)
+				return fail("only 32bit scalars are supported", w[2]);
+			auto & t = p.vtypes[w[1]];
+			t.op = op;
+			t.comps = 1;
+			t.is_float = op == SpvOpTypeFloat;
+			t.is_signed = op == SpvOpTypeInt && w[3] != 0;
+			break;
+		}
+		case SpvOpTypeVector:
+		case SpvOpTypeMatrix:
+		case SpvOpTypeArray:
+		case SpvOpTypeRuntimeArray: {
+			auto & t = p.vtypes[w[1]];
+			auto & elem = p.vtypes[w[2]];
+			t.op = op;
+			t.elem = w[2];
+			t.is_float = elem.is_float;
+			t.is_signed = elem.is_signed;
+			t.array_stride = varray_stride[w[1]];
+			if (op == SpvOpTypeArray)
+				t.count = p.vinit[p.voffset[w[3]]];
+			else if (op != SpvOpTypeRuntimeArray)
+				t.count = w[3];
+			t.comps = t.count * elem.comps;
+			break;
+		}
+		case SpvOpTypeStruct: {
+			auto & t = p.vtypes[w[1]];
+			t.op = op;
+			for (uint32_t i = 2; i < wc; i++) {
+				uint64_t key = ((uint64_t)w[1] << 32) | (i - 2);
+				t.vmembers.push_back(w[i]);
+				t.vmember_comps.push_back(t.comps);
+				t.vmember_offsets.push_back(mmember_offset.count(key) ? mmember_offset[key] : 0);
+				t.vmember_matrix_stride.push_back(mmember_matrix_stride.count(key) ? mmember_matrix_stride[key] : 16);
+				t.vmember_row_major.push_back(mmember_row_major.count(key) ? 1 : 0);
+				t.comps += p.vtypes[w[i]].comps;
+			}
+			break;
+		}
+		case SpvOpTypePointer: {
+			auto & t = p.vtypes[w[1]];
+			t.op = op;
+			t.comps = 1;
+			t.storage = w[2];
+			t.elem = w[3];
+			break;
+		}
+
+		case SpvOpConstantTrue:
+		case SpvOpConstantFalse:
+		case SpvOpSpecConstantTrue:
+		case SpvOpSpecConstantFalse:
+			set_result(w[1], w[2]);
+			broadcast(w[2], 0, (op == SpvOpConstantTrue || op == SpvOpSpecConstantTrue) ? 1 : 0);
+			break;
+		case SpvOpConstant:
+		case SpvOpSpecConstant:
+			set_result(w[1], w[2]);
+			broadcast(w[2], 0, w[3]);
+			break;
+		case SpvOpConstantComposite:
+		case SpvOpSpecConstantComposite: {
+			set_result(w[1], w[2]);
+			uint32_t comp = 0;
+			for (uint32_t i = 3; i < wc; i++) {
+				uint32_t n = p.vtypes[p.vresult_type[w[i]]].comps;
+				for (uint32_t c = 0; c < n; c++)
+					broadcast(w[2], comp++, p.vinit[p.voffset[w[i]] + c * SPV_LANES]);
+			}
+			break;
+		}
+		case SpvOpConstantNull:
+		case SpvOpUndef:
+			set_result(w[1], w[2]);
+			break;
+
+		case SpvOpVariable: {
+			uint32_t storage_class = w[3];
+			uint32_t id = w[2];
+			set_result(w[1], id);
+			if (storage_class == SpvStorageClassUniformConstant) {
+				broadcast(id, 0, vbinding[id]);
+			} else if (is_buffer_storage(storage_class)) {
+				broadcast(id, 0, vbinding[id] << SPV_BUFFER_OFFSET_BITS);
+			} else if (storage_class == SpvStorageClassInput || storage_class == SpvStorageClassPrivate) {
+				uint32_t comps = p.vtypes[p.vtypes[w[1]].elem].comps;
+				uint32_t storage = alloc(comps);
+				for (uint32_t l = 0; l < SPV_LANES; l++)
+					p.vinit[p.voffset[id] + l] = storage + l;
+				if (vbuiltin[id] != SPV_DONE)
+					p.vbuiltins.push_back({vbuiltin[id], storage});
+				if (wc > 4) {
+					for (uint32_t i = 0; i < comps * SPV_LANES; i++)
+						p.vinit[storage + i] = p.vinit[p.voffset[w[4]] + i];
+					p.vprivate_init.push_back({storage, comps * SPV_LANES});
+				}
+			} else {
+				return fail("unsupported storage class", storage_class);
+			}
+			break;
+		}
+
+		case SpvOpFunction:
+			p.vfunction_index[w[2]] = (int32_t)p.vfunctions.size();
+			p.vfunctions.push_back(spv_function());
+			fn = &p.vfunctions.back();
+			break;
+
+		case SpvOpCapability:
+		case SpvOpExtension:
+		case SpvOpMemoryModel:
+		case SpvOpSource:
+		case SpvOpSourceContinued:
+		case SpvOpSourceExtension:
+		case SpvOpName:
+		case SpvOpMemberName:
+		case SpvOpString:
+		case SpvOpLine:
+		case SpvOpNoLine:
+		case SpvOpModuleProcessed:
+		case SpvOpNop:
+			break;
+		default:
+			return fail("unsupported opcode", op);
+		}
+		pos += wc;
+	}
+
+	if (entry == 0 || p.vfunction_index[entry] < 0)
+		return fail("no GLCompute entry point", entry);
+	if (fn)
+		return fail("function without end", 0);
+	p.entry = p.vfunction_index[entry];
+	return program;
+}
+
+void
+oden::spirv_get_local_size(const spirv_program & program, int *local_size)
+{
+	for (int i = 0; i < 3; i++)
+		local_size[i] = program.local_size[i];
+}
+
+uint64_t
+oden::spirv_get_invocation_count(const spirv_program & program, int x, int y, int z)
+{
+	uint64_t groups = (uint64_t)(std::max)(x, 0) * (std::max)(y, 0) * (std::max)(z, 0);
+	return groups * program.local_size[0] * program.local_size[1] * program.local_size[2];
+}
+
+//Per thread registers. Rebuilt when the thread runs another program.
+static spv_state &
+get_state(const spirv_program & program)
+{
+	static thread_local spv_state st;
+	if (st.serial != program.serial) {
+		st.serial = program.serial;
+		st.program = &program;
+		st.vdata = program.vinit;
+		st.vmeta.assign(program.bound, 0);
+	}
+	return st;
+}
+
+void
+oden::spirv_run(const spirv_program & program, const spirv_bindings & bindings,
+	int x, int y, int z, uint64_t first, uint64_t count)
+{
+	auto & st = get_state(program);
+	auto & p = program;
+	st.bindings = &bindings;
+
+	uint64_t lx = p.local_size[0];
+	uint64_t ly = p.local_size[1];
+	uint64_t local_count = lx * ly * p.local_size[2];
+	uint64_t end = (std::min)(first + count, spirv_get_invocation_count(p, x, y, z));
+
+	for (uint64_t base = first; base < end; base += SPV_LANES) {
+		uint32_t mask = 0;
+		for (uint32_t l = 0; l < SPV_LANES; l++) {
+			uint64_t invocation = base + l;
+			if (invocation >= end)
+				break;
+			mask |= 1u << l;
+
+			uint64_t group = invocation / local_count;
+			uint64_t local = invocation % local_count;
+			uint32_t local_id[3] = {
+				uint32_t(local % lx), uint32_t((local / lx) % ly), uint32_t(local / (lx * ly))
+			};
+			uint32_t group_id[3] = {
+				uint32_t(group % x), uint32_t((group / x) % y), uint32_t(group / ((uint64_t)x * y))
+			};
+			uint32_t num[3] = {uint32_t(x), uint32_t(y), uint32_t(z)};
+			for (auto & builtin : p.vbuiltins) {
+				uint32_t *dst = &st.vdata[builtin.offset + l];
+				for (int c = 0; c < 3; c++) {
+					uint32_t value = 0;
+					if (builtin.kind == SpvBuiltInGlobalInvocationId)
+						value = group_id[c] * p.local_size[c] + local_id[c];
+					if (builtin.kind == SpvBuiltInLocalInvocationId)
+						value = local_id[c];
+					if (builtin.kind == SpvBuiltInWorkgroupId)
+						value = group_id[c];
+					if (builtin.kind == SpvBuiltInNumWorkgroups)
+						value = num[c];
+					if (builtin.kind == SpvBuiltInLocalInvocationIndex) {
+						dst[0] = (uint32_t)local;
+						break;
+					}
+					dst[c * SPV_LANES] = value;
+				}
+			}
+		}
+		for (auto & range : p.vprivate_init)
+			memcpy(&st.vdata[range.first], &p.vinit[range.first], range.second * sizeof(uint32_t));
+		exec_function(st, p.entry, mask, 0);
+	}
+}
@@ -0,0 +1,74 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#pragma once
+
+//CPU interpreter for SPIR-V compute modules.
+//Subset : 32bit int/float/bool scalars, vectors, matrices, arrays and structs,
+//function/private variables, uniform blocks, storage image load/store,
+//explicit lod sampling, structured control flow, function calls and the
+//common GLSL.std.450 instructions. No shared memory and no barriers,
+//so invocations of different workgroups are packed into the same lanes.
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+//Invocations per lane group. 8 or 16.
+#ifndef ODEN_SPIRV_LANES
+#define ODEN_SPIRV_LANES 8
+#endif //ODEN_SPIRV_LANES
+
+namespace oden
+{
+
+struct spirv_program;
+
+//binding is the glsl layout binding. All callbacks may be called from several threads.
+struct spirv_bindings {
+	std::function<void(uint32_t binding, int x, int y, float *color)> image_read;
+	std::function<void(uint32_t binding, int x, int y, const float *color)> image_write;
+	std::function<void(uint32_t binding, int lod, int *size)> image_size;
+	std::function<void(uint32_t binding, float u, float v, float lod, float *color)> image_sample;
+	std::function<const uint8_t *(uint32_t binding, size_t & size)> uniform;
+};
+
+//Returns nullptr and error message on unsupported module.
+std::shared_ptr<spirv_program>
+spirv_load(const void *code, size_t size, std::string & error);
+
+void
+spirv_get_local_size(const spirv_program & program, int *local_size);
+
+//Runs invocations [first, first + count) of a dispatch of x * y * z workgroups.
+//Invocations are numbered workgroup major, so disjoint ranges can run in parallel.
+void
+spirv_run(const spirv_program & program, const spirv_bindings & bindings,
+	int x, int y, int z, uint64_t first, uint64_t count);
+
+//Total invocations of a dispatch.
+uint64_t
+spirv_get_invocation_count(const spirv_program & program, int x, int y, int z);
+
+};
@@ -0,0 +1,291 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "oden_stream.h"
+#include "oden_log.h"
+
+#include <math.h>
+#include <float.h>
+
+namespace odenutil
+{
+
+TextureStreamer::TextureStreamer(StreamLoader loader, const StreamParams & params)
+	: loader(loader), params(params)
+{
+	thread = std::thread([this]() {
+		run();
+	});
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		is_stop = true;
+	}
+	cv.notify_all();
+	if (thread.joinable())
+		thread.join();
+}
+
+//Loads the most wanted level first.
+void TextureStreamer::run()
+{
+	for (;;) {
+		load_job job;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [&]() {
+				return is_stop || !vjobs.empty();
+			});
+			if (is_stop)
+				return;
+			auto it = std::min_element(vjobs.begin(), vjobs.end(), [](const load_job & a, const load_job & b) {
+				return a.priority < b.priority;
+			});
+			job = *it;
+			vjobs.erase(it);
+		}
+		load_result result = {job.name, job.level, false, {}};
+		auto start = oden_trace_get_time_ms();
+		result.is_ok = loader(job.name, job.level, result.data);
+		oden_trace_event("stream", (job.name + " level " + std::to_string(job.level)).c_str(), start, oden_trace_get_time_ms());
+		std::lock_guard<std::mutex> lock(mtx);
+		vresults.push_back(std::move(result));
+	}
+}
+
+float TextureStreamer::GetLod(int w, int h, float screen_w, float screen_h)
+{
+	if (!(screen_w > 0.0f && screen_h > 0.0f))
+		return float(oden_get_mipmap_max(w, h));
+	float ratio = (std::max)(float(w) / screen_w, float(h) / screen_h);
+	return (std::max)(log2f(ratio), 0.0f);
+}
+
+//Bytes of the backend texture with level and the coarser ones.
+uint64_t TextureStreamer::get_bytes(const texture & t, int level)
+{
+	return oden_get_texture_level_offset(t.fmt, t.w, t.h, t.mips, 0) - oden_get_texture_level_offset(t.fmt, t.w, t.h, level, 0);
+}
+
+bool TextureStreamer::Add(std::string name, int w, int h, int fmt, int mips)
+{
+	auto maxmips = oden_get_mipmap_max(w, h);
+	fmt = oden_get_texture_format(fmt);
+	if (w <= 0 || h <= 0 || oden_get_format_bytes(fmt) == 0 || mips < 0 || mips > maxmips || mtextures.count(name)) {
+		ODEN_LOG_ERR("invalid texture name=%s\n", name.c_str());
+		return false;
+	}
+	texture t;
+	t.w = w;
+	t.h = h;
+	t.fmt = fmt;
+	t.mips = mips ? mips : maxmips;
+	t.tail = t.mips - 1;
+	while (t.tail > 0 && (std::max)(w >> (t.tail - 1), h >> (t.tail - 1)) <= params.tail_size)
+		t.tail--;
+	t.want = t.tail;
+	t.vlevels.resize(t.mips);
+	t.vloading.resize(t.mips);
+	for (int i = t.tail; i < t.mips; i++) {
+		auto & data = t.vlevels[i];
+		auto size = oden_get_format_size(fmt, (std::max)(w >> i, 1), (std::max)(h >> i, 1));
+		if (!loader(name, i, data) || data.size() < size) {
+			ODEN_LOG_ERR("failed to load name=%s level=%d\n", name.c_str(), i);
+			return false;
+		}
+		data.resize(size);
+		stats.loaded_bytes += size;
+	}
+	mtextures[name] = std::move(t);
+	return true;
+}
+
+void TextureStreamer::Request(std::string name, float lod)
+{
+	auto it = mtextures.find(name);
+	if (it == mtextures.end() || !(lod == lod))
+		return;
+	auto & t = it->second;
+	t.lod = t.is_requested ? (std::min)(t.lod, lod) : lod;
+	t.is_requested = true;
+}
+
+//Makes the backend texture of level and the coarser ones and releases the previous, so the device
+//holds only the resident levels. The stats count the bytes of the new texture, all of them are uploaded.
+void TextureStreamer::set_resident(std::vector<cmd> & vcmd, const std::string & name, texture & t, int level)
+{
+	std::vector<uint8_t> vdata;
+	vdata.reserve(get_bytes(t, level));
+	for (int i = level; i < t.mips; i++)
+		vdata.insert(vdata.end(), t.vlevels[i].begin(), t.vlevels[i].end());
+	auto resident_name = name + "@" + std::to_string(level);
+	SetTexture(vcmd, resident_name, -1, (std::max)(t.w >> level, 1), (std::max)(t.h >> level, 1),
+		vdata.data(), vdata.size(), 0, t.fmt, t.mips - level);
+	if (!t.resident_name.empty())
+		Release(vcmd, t.resident_name);
+	t.resident = level;
+	t.resident_name = resident_name;
+	stats.uploads++;
+	stats.upload_bytes += vdata.size();
+	frame_upload_bytes += vdata.size();
+}
+
+void TextureStreamer::Update(std::vector<cmd> & vcmd)
+{
+	std::vector<load_result> vdone;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		vdone.swap(vresults);
+	}
+	for (auto & r : vdone) {
+		auto it = mtextures.find(r.name);
+		if (it == mtextures.end())
+			continue;
+		auto & t = it->second;
+		auto size = oden_get_format_size(t.fmt, (std::max)(t.w >> r.level, 1), (std::max)(t.h >> r.level, 1));
+		t.vloading[r.level] = false;
+		if (!r.is_ok || r.data.size() < size) {
+			ODEN_LOG_ERR("failed to load name=%s level=%d\n", r.name.c_str(), r.level);
+			t.is_failed = true;
+			continue;
+		}
+		r.data.resize(size);
+		stats.loaded_bytes += size;
+		t.vlevels[r.level] = std::move(r.data);
+	}
+
+	//Split the budget by priority : the tails, the requested levels from the largest on screen,
+	//then the finer levels already resident in the same order. What does not fit is evicted.
+	frame_upload_bytes = 0;
+	uint64_t remain = params.budget_bytes;
+	auto use = [&](uint64_t bytes) {
+		remain -= (std::min)(remain, bytes);
+	};
+	auto fit = [&](texture & t, int level) {
+		if (level >= t.target)
+			return;
+		while (level < t.target && get_bytes(t, level) - get_bytes(t, t.target) > remain)
+			level++;
+		use(get_bytes(t, level) - get_bytes(t, t.target));
+		t.target = level;
+	};
+	std::vector<std::pair<float, std::string>> vorder;
+	for (auto & x : mtextures) {
+		auto & t = x.second;
+		if (t.resident < 0)
+			set_resident(vcmd, x.first, t, t.tail);
+		t.want = t.is_requested ? (std::min)((std::max)(int(floorf(t.lod)), 0), t.tail) : t.resident;
+		if (t.is_failed)
+			t.want = (std::max)(t.want, t.resident);
+		t.target = t.tail;
+		use(get_bytes(t, t.tail));
+		vorder.push_back({t.is_requested ? t.lod : FLT_MAX, x.first});
+	}
+	std::sort(vorder.begin(), vorder.end());
+	for (auto & x : vorder)
+		fit(mtextures[x.second], mtextures[x.second].want);
+	for (auto & x : vorder)
+		fit(mtextures[x.second], mtextures[x.second].resident);
+
+	//Coarser first, so the backend never holds more than the budget after a frame.
+	for (auto & x : vorder) {
+		auto & t = mtextures[x.second];
+		if (t.resident < t.target) {
+			set_resident(vcmd, x.second, t, t.target);
+			stats.evictions++;
+		}
+	}
+	for (auto & x : vorder) {
+		auto & t = mtextures[x.second];
+		int level = t.resident;
+		while (level > t.target && !t.vlevels[level - 1].empty())
+			level--;
+		if (level == t.resident)
+			continue;
+		if (frame_upload_bytes && frame_upload_bytes + get_bytes(t, level) > params.upload_bytes_per_frame)
+			break;
+		set_resident(vcmd, x.second, t, level);
+	}
+
+	//Load the next finer level toward the target, one per texture at a time. Drop data finer than needed.
+	std::vector<load_job> vnew_jobs;
+	stats.resident_bytes = 0;
+	stats.wanted_bytes = 0;
+	stats.pending_loads = 0;
+	for (auto & x : mtextures) {
+		auto & t = x.second;
+		int keep = (std::min)(t.resident, t.target);
+		for (int i = 0; i < keep; i++) {
+			if (!t.vlevels[i].empty() && !t.vloading[i]) {
+				stats.loaded_bytes -= t.vlevels[i].size();
+				std::vector<uint8_t>().swap(t.vlevels[i]);
+			}
+		}
+		stats.resident_bytes += get_bytes(t, t.resident);
+		stats.wanted_bytes += get_bytes(t, t.want);
+		bool is_loading = std::find(t.vloading.begin(), t.vloading.end(), true) != t.vloading.end();
+		int level = t.resident;
+		while (level > t.target && !t.vlevels[level - 1].empty())
+			level--;
+		if (!is_loading && !t.is_failed && level > t.target) {
+			t.vloading[level - 1] = true;
+			vnew_jobs.push_back({x.first, level - 1, t.lod});
+		}
+		for (auto b : t.vloading)
+			stats.pending_loads += b ? 1 : 0;
+		t.is_requested = false;
+	}
+	if (!vnew_jobs.empty()) {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			vjobs.insert(vjobs.end(), vnew_jobs.begin(), vnew_jobs.end());
+		}
+		cv.notify_one();
+	}
+}
+
+void TextureStreamer::Bind(std::vector<cmd> & vcmd, std::string name, int slot)
+{
+	auto it = mtextures.find(name);
+	if (it == mtextures.end() || it->second.resident_name.empty()) {
+		ODEN_LOG_ERR("not resident name=%s\n", name.c_str());
+		return;
+	}
+	SetTexture(vcmd, it->second.resident_name, slot);
+}
+
+int TextureStreamer::GetResidentLevel(std::string name)
+{
+	auto it = mtextures.find(name);
+	return it == mtextures.end() ? -1 : it->second.resident;
+}
+
+StreamStats TextureStreamer::GetStats()
+{
+	return stats;
+}
+
+};
@@ -0,0 +1,133 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#pragma once
+
+//Mip streaming of textures in a fixed memory budget (oden_stream.cpp).
+//Each texture is resident as one backend texture holding the levels from the finest
+//streamed one down to 1x1. A finer level makes a new one and releases the previous.
+
+#include "oden_util.h"
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace odenutil
+{
+
+//Fill vout with level of the texture, packed rows (block rows) of its format.
+//Called on the streamer thread, and on the caller of Add for the tail levels.
+typedef std::function<bool(const std::string & name, int level, std::vector<uint8_t> & vout)> StreamLoader;
+
+struct StreamParams {
+	uint64_t budget_bytes = 64ull << 20;         //of the resident textures.
+	uint64_t upload_bytes_per_frame = 8ull << 20; //of the textures one Update makes, at least one.
+	int tail_size = 64; //levels of this size and smaller are loaded by Add and never evicted.
+};
+
+struct StreamStats {
+	uint64_t resident_bytes;
+	uint64_t wanted_bytes;   //if every texture had its requested level.
+	uint64_t loaded_bytes;   //level data kept in system memory.
+	uint32_t pending_loads;
+	uint64_t uploads;        //textures made since the streamer started.
+	uint64_t upload_bytes;
+	uint64_t evictions;      //textures made coarser to stay in the budget.
+};
+
+class TextureStreamer {
+public:
+	TextureStreamer(StreamLoader loader, const StreamParams & params = StreamParams());
+	~TextureStreamer();
+
+	//mips : 0 is the whole chain. Loads the tail levels, they are resident after the next Update.
+	bool Add(std::string name, int w, int h, int fmt = FMT_DEFAULT, int mips = 0);
+
+	//Feedback of this frame, the finest level the texture is sampled at. Textures without
+	//a request keep their levels until the budget needs them.
+	void Request(std::string name, float lod);
+
+	//Records the textures finished since the last call and the releases, before the draws of the frame.
+	void Update(std::vector<cmd> & vcmd);
+
+	//SetTexture of the resident levels.
+	void Bind(std::vector<cmd> & vcmd, std::string name, int slot);
+
+	//Finest resident level, -1 before the first Update.
+	int GetResidentLevel(std::string name);
+	StreamStats GetStats();
+
+	//Level that has about one texel per pixel when the texture covers screen_w x screen_h pixels.
+	static float GetLod(int w, int h, float screen_w, float screen_h);
+
+private:
+	struct texture {
+		int w = 0;
+		int h = 0;
+		int fmt = FMT_DEFAULT;
+		int mips = 1;
+		int tail = 0;      //finest level of the tail.
+		int resident = -1; //finest level of the backend texture.
+		int want = 0;      //requested level.
+		int target = 0;    //finest level that fits the budget.
+		float lod = 0.0f;
+		bool is_requested = false;
+		bool is_failed = false;
+		std::string resident_name;
+		std::vector<std::vector<uint8_t>> vlevels;
+		std::vector<bool> vloading;
+	};
+
+	struct load_job {
+		std::string name;
+		int level;
+		float priority; //smaller first.
+	};
+
+	struct load_result {
+		std::string name;
+		int level;
+		bool is_ok;
+		std::vector<uint8_t> data;
+	};
+
+	uint64_t get_bytes(const texture & t, int level);
+	void set_resident(std::vector<cmd> & vcmd, const std::string & name, texture & t, int level);
+	void run();
+
+	StreamLoader loader;
+	StreamParams params;
+	std::map<std::string, texture> mtextures;
+	StreamStats stats = {};
+	uint64_t frame_upload_bytes = 0;
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::vector<load_job> vjobs;
+	std::vector<load_result> vresults;
+	bool is_stop = false;
+	std::thread thread;
+};
+
+};
@@ -0,0 +1,689 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Stress scenes to find where a backend stops scaling.
+//They reuse the cube / rect geometry and the shaders of sample_code.cpp.
+//
+//  oden_stress [--scene draws|textures|passes|mips|stream|video|gbuffer|cull] [--count N] [--frames N] [--csv file] [--async] [--budget MB]
+//              [--prepass] [--instanced]
+//
+//  draws    : N cubes, one constant buffer each.
+//  textures : N cubes, one constant buffer and one 64x64 texture each.
+//  passes   : N render targets, each samples the previous one.
+//  mips     : NxN render target with the full mip chain generated every frame.
+//  stream   : N cubes with a 1024x1024 BC1 texture each, mip streamed in --budget MB (default 32)
+//             by their distance to the camera. The levels are tinted by their size.
+//  video    : 3840x2160 RGBA8 texture rewritten every frame by UpdateTexture in N bands (1 is the full frame).
+//             The summary prints the upload MB/s.
+//  gbuffer  : N cubes into albedo / normal / depth targets in one pass (MRT), then a deferred light pass.
+//  cull     : N cubes around a large occluder, culled on the gpu against the frustum and the Hi-Z of the occluder.
+//             One dispatch and one indirect draw whatever N is, compare with draws.
+//
+//Every frame prints record / present cpu time, then cpu wait and latency once
+//the backend reports the frame complete (oden_get_frame_stats).
+//--async presents by oden_present_graphics_async. present is then the wait for
+//the render thread, and the frame time approaches the larger of record and translation.
+//--prepass draws the cubes of draws / textures / stream to a depth only target first, then shades them
+//with DEPTH_FUNC_EQUAL, so each pixel runs the pixel shader once.
+//--instanced draws the cubes of draws as the instances of one DrawIndexInstanced (shaders/instanced),
+//their centers and sizes in a buffer instead of a constant buffer per cube.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+#include "oden_util.h"
+#include "oden_stream.h"
+#include "oden_platform.h"
+
+#include "MatrixStack.h"
+#include "Win.h"
+
+#pragma comment(lib, "gdi32.lib")
+#pragma comment(lib, "user32.lib")
+#pragma comment(lib, "winmm.lib")
+#pragma comment(lib, "advapi32.lib")
+
+#pragma comment(lib, "DX12_ODEN.lib")
+
+using namespace oden;
+using namespace odenutil;
+
+enum {
+	Width = 1280,
+	Height = 720,
+	BufferMax = 2,
+	ShaderSlotMax = 8,
+	PassSize = 256,
+	TextureSize = 64,
+	StreamTextureSize = 1024,
+	VideoWidth = 3840,
+	VideoHeight = 2160,
+};
+
+enum {
+	SCENE_DRAWS,
+	SCENE_TEXTURES,
+	SCENE_PASSES,
+	SCENE_MIPS,
+	SCENE_STREAM,
+	SCENE_VIDEO,
+	SCENE_GBUFFER,
+	SCENE_CULL,
+	SCENE_MAX,
+};
+
+static const char *scene_names[SCENE_MAX] = {
+	"draws",
+	"textures",
+	"passes",
+	"mips",
+	"stream",
+	"video",
+	"gbuffer",
+	"cull",
+};
+
+static TextureStreamer *streamer = nullptr;
+static bool is_prepass = false;
+static bool is_instanced = false;
+
+//A frame per backbuffer, the commands point at them until the backend has copied them.
+static std::vector<uint32_t> vvideo[BufferMax];
+static uint64_t video_bytes = 0;
+
+struct vertex_format {
+	float pos[4];
+	float nor[3];
+	float uv[2];
+};
+
+static const vertex_format vtx_rect[] = {
+	{{-1, 1, 0, 1}, {0,  1,  1}, { 0, 1}},
+	{{-1, -1, 0, 1}, {0,  1,  1}, { 0, 0}},
+	{{ 1, 1, 0, 1}, {0,  1,  1}, { 1, 1}},
+	{{ 1, -1, 0, 1}, {0,  1,  1}, { 1, 0}},
+};
+
+static const uint32_t idx_rect[] = {
+	0, 1, 2,
+	2, 1, 3
+};
+
+static const vertex_format vtx_cube[] = {
+	{{-1, -1,  1, 1}, {0, 0, -1}, {-1, -1}},
+	{{ 1, -1,  1, 1}, {0, 0, -1}, { 1, -1}},
+	{{ 1,  1,  1, 1}, {0, 0, -1}, { 1,  1}},
+	{{-1,  1,  1, 1}, {0, 0, -1}, {-1,  1}},
+	{{-1, -1, -1, 1}, {0, 0,  1}, {-1, -1}},
+	{{ 1, -1, -1, 1}, {0, 0,  1}, { 1, -1}},
+	{{ 1,  1, -1, 1}, {0, 0,  1}, { 1,  1}},
+	{{-1,  1, -1, 1}, {0, 0,  1}, {-1,  1}},
+};
+
+static const uint32_t idx_cube[] = {
+	0, 1, 2, 2, 3, 0,
+	3, 2, 6, 6, 7, 3,
+	7, 6, 5, 5, 4, 7,
+	4, 5, 1, 1, 0, 4,
+	4, 0, 3, 3, 7, 4,
+	1, 5, 6, 6, 2, 1,
+};
+
+struct constdata {
+	float time[4];
+	float misc[4];
+	float world[16];
+	float proj[16];
+	float view[16];
+};
+
+struct frame_timing {
+	double record_ms;
+	double present_ms;
+};
+
+static double
+get_time_ms()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double, std::milli>(now).count();
+}
+
+//Lay out count cubes on a cube shaped grid that fits the view. Returns the half edge.
+static float
+get_cube_center(int index, int count, float *center)
+{
+	int side = (std::max)(1, (int)ceil(cbrt((double)count)));
+	float spacing = 64.0f / side;
+	center[0] = ((index % side) - (side - 1) * 0.5f) * spacing;
+	center[1] = (((index / side) % side) - (side - 1) * 0.5f) * spacing;
+	center[2] = ((index / (side * side)) - (side - 1) * 0.5f) * spacing;
+	return spacing * 0.35f;
+}
+
+static void
+get_cube_world(MatrixStack & stack, int index, int count, float *world)
+{
+	float center[3];
+	float half = get_cube_center(index, count, center);
+	stack.Reset();
+	stack.Scaling(half, half, half);
+	stack.Translation(center[0], center[1], center[2]);
+	stack.GetTop(world);
+}
+
+//SCENE_STREAM flies through the cubes, so some of them come close.
+static void
+get_camera_eye(int scene, uint64_t frame, float *eye)
+{
+	float tm = float (frame) * 0.01f;
+	float scale = scene == SCENE_STREAM ? 0.4f : 1.0f;
+	eye[0] = 72.0f * scale * cos(tm);
+	eye[1] = 48.0f * scale * sin(tm * 0.3f);
+	eye[2] = 72.0f * scale * sin(tm * 0.8f);
+}
+
+static void
+set_camera(MatrixStack & stack, constdata & cdata, int scene, uint64_t frame, float aspect)
+{
+	float eye[3];
+	get_camera_eye(scene, frame, eye);
+	cdata.time[0] = float (frame) / 1000.0f;
+	stack.Reset();
+	stack.LoadLookAt(eye[0], eye[1], eye[2], 0, 0, 0, 0, 1, 0);
+	stack.GetTop(cdata.view);
+	stack.Reset();
+	stack.LoadPerspective((3.141592653f / 180.0f) * 90.0f, aspect, 0.5f, 1024.0f);
+	stack.GetTop(cdata.proj);
+}
+
+//Cubes into target. Each draw has its own constant buffer, and its own texture for SCENE_TEXTURES.
+static void
+record_cubes(std::vector<cmd> & vcmd, int scene, int count, uint64_t frame, std::string target, int w, int h)
+{
+	static std::vector<uint32_t> vtex(TextureSize * TextureSize);
+	auto index_name = std::to_string(frame % BufferMax);
+	float clear_color[] = {0, 0.2f, 0.3f, 1};
+	MatrixStack stack;
+	constdata cdata = {};
+	bool is_instanced_draw = is_instanced && scene == SCENE_DRAWS;
+	auto shader = is_instanced_draw ? "./shaders/instanced" : "./shaders/model";
+
+	//--instanced : xyz center, w half edge of every cube, and one constant buffer for all of them.
+	auto draw_instances = [&](std::string draw_name) {
+		if (frame == 0) {
+			std::vector<float> vinstances(count * 4);
+			for (int i = 0; i < count; i++) {
+				float half = get_cube_center(i, count, &vinstances[i * 4]);
+				vinstances[i * 4 + 3] = half;
+			}
+			SetBuffer(vcmd, "stressinstances", -1, vinstances.size() * sizeof(float), vinstances.data());
+		}
+		stack.Reset();
+		stack.GetTop(cdata.world);
+		SetConstant(vcmd, "stressconst" + index_name, 0, &cdata, sizeof(cdata));
+		SetBuffer(vcmd, "stressinstances", 2);
+		DrawIndexInstanced(vcmd, draw_name, 0, _countof(idx_cube), count);
+	};
+
+	set_camera(stack, cdata, scene, frame, float (w) / float (h));
+	if (scene == SCENE_GBUFFER) {
+		//albedo, normal (w 0 : nothing drawn) and depth.
+		float clear_normal[] = {0, 0, 0, 0};
+		float clear_depth[] = {1, 0, 0, 0};
+		SetRenderTarget(vcmd, target, w, h, {FMT_R8G8B8A8_UNORM, FMT_R16G16B16A16_FLOAT, FMT_R16G16_FLOAT});
+		ClearRenderTarget(vcmd, target, clear_color);
+		ClearRenderTarget(vcmd, oden_get_color_render_target_name(target, 1), clear_normal);
+		ClearRenderTarget(vcmd, oden_get_color_render_target_name(target, 2), clear_depth);
+		ClearDepthRenderTarget(vcmd, target, 1.0f);
+		SetShader(vcmd, "./shaders/gbuffer", false, false, true);
+	} else if (is_prepass && scene != SCENE_MIPS) {
+		//depth of all the cubes, then the color pass shares it.
+		SetDepthRenderTarget(vcmd, target, w, h);
+		ClearDepthRenderTarget(vcmd, target, 1.0f);
+		SetShader(vcmd, shader, false, false, true);
+		SetVertex(vcmd, "cube_vb", (void *)vtx_cube, sizeof(vtx_cube), sizeof(vertex_format));
+		SetIndex(vcmd, "cube_ib", (void *)idx_cube, sizeof(idx_cube));
+		if (is_instanced_draw)
+			draw_instances("stress_depth_draw");
+		for (int i = 0; i < count && !is_instanced_draw; i++) {
+			get_cube_world(stack, i, count, cdata.world);
+			SetConstant(vcmd, "stressconst" + index_name + "_" + std::to_string(i), 0, &cdata, sizeof(cdata));
+			DrawIndex(vcmd, "stress_depth_draw", 0, _countof(idx_cube));
+		}
+		SetRenderTarget(vcmd, target, w, h);
+		ClearRenderTarget(vcmd, target, clear_color);
+		SetShader(vcmd, shader, false, false, true, DEPTH_FUNC_EQUAL);
+	} else {
+		SetRenderTarget(vcmd, target, w, h);
+		ClearRenderTarget(vcmd, target, clear_color);
+		ClearDepthRenderTarget(vcmd, target, 1.0f);
+		SetShader(vcmd, shader, false, false, true);
+	}
+	SetVertex(vcmd, "cube_vb", (void *)vtx_cube, sizeof(vtx_cube), sizeof(vertex_format));
+	SetIndex(vcmd, "cube_ib", (void *)idx_cube, sizeof(idx_cube));
+	if (is_instanced_draw) {
+		if (frame == 0) {
+			for (int t = 0; t < TextureSize * TextureSize; t++)
+				vtex[t] = ((t % TextureSize) ^ (t / TextureSize)) * 1110;
+			SetTexture(vcmd, "stresstex", 0, TextureSize, TextureSize, vtex.data(), vtex.size() * sizeof(uint32_t), TextureSize * sizeof(uint32_t));
+		} else {
+			SetTexture(vcmd, "stresstex", 0);
+		}
+		draw_instances("stress_draw");
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		get_cube_world(stack, i, count, cdata.world);
+		SetConstant(vcmd, "stressconst" + index_name + "_" + std::to_string(i), 0, &cdata, sizeof(cdata));
+		if (scene == SCENE_TEXTURES) {
+			//Unique contents so nothing can be deduplicated. Upload on the first frame only.
+			auto tex_name = "stresstex" + std::to_string(i);
+			if (frame == 0) {
+				for (int t = 0; t < TextureSize * TextureSize; t++)
+					vtex[t] = ((t % TextureSize) ^ (t / TextureSize)) * (1110 + i * 77);
+				SetTexture(vcmd, tex_name, 0, TextureSize, TextureSize, vtex.data(), vtex.size() * sizeof(uint32_t), TextureSize * sizeof(uint32_t));
+			} else {
+				SetTexture(vcmd, tex_name, 0);
+			}
+		} else if (scene == SCENE_STREAM) {
+			streamer->Bind(vcmd, "streamtex" + std::to_string(i), 0);
+		} else {
+			if (frame == 0) {
+				for (int t = 0; t < TextureSize * TextureSize; t++)
+					vtex[t] = ((t % TextureSize) ^ (t / TextureSize)) * 1110;
+				SetTexture(vcmd, "stresstex", 0, TextureSize, TextureSize, vtex.data(), vtex.size() * sizeof(uint32_t), TextureSize * sizeof(uint32_t));
+			} else {
+				SetTexture(vcmd, "stresstex", 0);
+			}
+		}
+		DrawIndex(vcmd, "stress_draw", 0, _countof(idx_cube));
+	}
+}
+
+//SCENE_CULL : the occluder to a depth only target, its Hi-Z, then the cubes are culled against it
+//and drawn by shaders/instanced at the visible indices.
+static void
+record_cull(std::vector<cmd> & vcmd, int count, uint64_t frame, std::string target, int w, int h)
+{
+	auto index_name = std::to_string(frame % BufferMax);
+	float clear_color[] = {0, 0.2f, 0.3f, 1};
+	MatrixStack stack;
+	constdata cdata = {};
+	constdata cdata_occluder = {};
+
+	set_camera(stack, cdata, SCENE_CULL, frame, float (w) / float (h));
+	cdata_occluder = cdata;
+	stack.Reset();
+	stack.Scaling(20, 20, 20);
+	stack.GetTop(cdata_occluder.world);
+	stack.Reset();
+	stack.GetTop(cdata.world);
+	cdata.misc[1] = 1.0f;
+	if (frame == 0) {
+		//xyz center, w half edge of the cubes / xyz center, w radius of their bounds.
+		std::vector<float> vinstances(count * 4), vbounds(count * 4);
+		for (int i = 0; i < count; i++) {
+			float half = get_cube_center(i, count, &vinstances[i * 4]);
+			vinstances[i * 4 + 3] = half;
+			memcpy(&vbounds[i * 4], &vinstances[i * 4], sizeof(float) * 3);
+			vbounds[i * 4 + 3] = half * 1.7320508f;
+		}
+		SetBuffer(vcmd, "stressinstances", -1, vinstances.size() * sizeof(float), vinstances.data());
+		SetBuffer(vcmd, "stressbounds", -1, vbounds.size() * sizeof(float), vbounds.data());
+		std::vector<uint32_t> vtex(TextureSize * TextureSize);
+		for (int t = 0; t < TextureSize * TextureSize; t++)
+			vtex[t] = ((t % TextureSize) ^ (t / TextureSize)) * 1110;
+		SetTexture(vcmd, "stresstex", -1, TextureSize, TextureSize, vtex.data(), vtex.size() * sizeof(uint32_t), TextureSize * sizeof(uint32_t));
+	}
+
+	SetDepthRenderTarget(vcmd, target, w, h);
+	ClearDepthRenderTarget(vcmd, target, 1.0f);
+	SetShader(vcmd, "./shaders/model", false, false, true);
+	SetConstant(vcmd, "stressoccluder" + index_name, 0, &cdata_occluder, sizeof(cdata_occluder));
+	SetVertex(vcmd, "cube_vb", (void *)vtx_cube, sizeof(vtx_cube), sizeof(vertex_format));
+	SetIndex(vcmd, "cube_ib", (void *)idx_cube, sizeof(idx_cube));
+	DrawIndex(vcmd, "stress_depth_draw", 0, _countof(idx_cube));
+
+	BuildHiZ(vcmd, target, "stresshiz", w, h);
+	CullParams params;
+	memcpy(params.view, cdata.view, sizeof(params.view));
+	memcpy(params.proj, cdata.proj, sizeof(params.proj));
+	params.index_count = _countof(idx_cube);
+	auto prefix = "stresscull" + index_name;
+	auto args = CullInstances(vcmd, "stressbounds", count, "stresshiz", w, h, prefix, params);
+
+	SetRenderTarget(vcmd, target, w, h);
+	ClearRenderTarget(vcmd, target, clear_color);
+	SetShader(vcmd, "./shaders/model", false, false, true, DEPTH_FUNC_EQUAL);
+	SetConstant(vcmd, "stressoccluder" + index_name, 0, &cdata_occluder, sizeof(cdata_occluder));
+	SetTexture(vcmd, "stresstex", 0);
+	SetVertex(vcmd, "cube_vb", (void *)vtx_cube, sizeof(vtx_cube), sizeof(vertex_format));
+	SetIndex(vcmd, "cube_ib", (void *)idx_cube, sizeof(idx_cube));
+	DrawIndex(vcmd, "stress_draw", 0, _countof(idx_cube));
+	SetShader(vcmd, "./shaders/instanced", false, false, true);
+	SetConstant(vcmd, "stressconst" + index_name, 0, &cdata, sizeof(cdata));
+	SetTexture(vcmd, "stresstex", 0);
+	SetBuffer(vcmd, prefix + "_visible", 1);
+	SetBuffer(vcmd, "stressinstances", 2);
+	DrawIndexIndirect(vcmd, args);
+}
+
+//Returns the texture shown on the backbuffer.
+static std::string
+record_scene(std::vector<cmd> & vcmd, int scene, int count, uint64_t frame)
+{
+	auto index_name = std::to_string(frame % BufferMax);
+	float clear_color[] = {0, 0.2f, 0.3f, 1};
+
+	if (scene == SCENE_STREAM) {
+		//Face of a cube in pixels with the 90 degree fov. The texture repeats twice on it.
+		float eye[3];
+		get_camera_eye(scene, frame, eye);
+		for (int i = 0; i < count; i++) {
+			float center[3];
+			float half = get_cube_center(i, count, center);
+			float d = sqrtf((center[0] - eye[0]) * (center[0] - eye[0]) +
+					(center[1] - eye[1]) * (center[1] - eye[1]) + (center[2] - eye[2]) * (center[2] - eye[2]));
+			float size = half * Height / (std::max)(d, 0.5f) * 0.5f;
+			streamer->Request("streamtex" + std::to_string(i), TextureStreamer::GetLod(StreamTextureSize, StreamTextureSize, size, size));
+		}
+		streamer->Update(vcmd);
+	}
+
+	if (scene == SCENE_DRAWS || scene == SCENE_TEXTURES || scene == SCENE_STREAM) {
+		auto target = "stressscreen" + index_name;
+		record_cubes(vcmd, scene, count, frame, target, Width, Height);
+		return target;
+	}
+
+	if (scene == SCENE_PASSES) {
+		MatrixStack stack;
+		constdata cdata = {};
+		std::vector<uint32_t> vtex(TextureSize * TextureSize, 0xFF8040C0);
+		std::string prev = "stresspasstex";
+
+		set_camera(stack, cdata, scene, frame, 1.0f);
+		stack.Reset();
+		stack.Scaling(24, 24, 24);
+		stack.GetTop(cdata.world);
+		if (frame == 0)
+			SetTexture(vcmd, prev, 0, TextureSize, TextureSize, vtex.data(), vtex.size() * sizeof(uint32_t), TextureSize * sizeof(uint32_t));
+		for (int i = 0; i < count; i++) {
+			auto target = "stresspass" + index_name + "_" + std::to_string(i);
+			SetRenderTarget(vcmd, target, PassSize, PassSize);
+			SetShader(vcmd, "./shaders/model", false, false, true);
+			ClearRenderTarget(vcmd, target, clear_color);
+			ClearDepthRenderTarget(vcmd, target, 1.0f);
+			SetConstant(vcmd, "stressconst" + index_name + "_" + std::to_string(i), 0, &cdata, sizeof(cdata));
+			SetTexture(vcmd, prev, 0);
+			SetVertex(vcmd, "cube_vb", (void *)vtx_cube, sizeof(vtx_cube), sizeof(vertex_format));
+			SetIndex(vcmd, "cube_ib", (void *)idx_cube, sizeof(idx_cube));
+			DrawIndex(vcmd, "stress_draw", 0, _countof(idx_cube));
+			prev = target;
+		}
+		return prev;
+	}
+
+	if (scene == SCENE_CULL) {
+		auto target = "stressscreen" + index_name;
+		record_cull(vcmd, count, frame, target, Width, Height);
+		return target;
+	}
+
+	if (scene == SCENE_GBUFFER) {
+		auto gbuffer = "stressgbuffer" + index_name;
+		auto target = "stressscreen" + index_name;
+		record_cubes(vcmd, scene, count, frame, gbuffer, Width, Height);
+		SetRenderTarget(vcmd, target, Width, Height);
+		SetShader(vcmd, "./shaders/deferred", false, false, false);
+		for (int i = 0; i < 3; i++)
+			SetTexture(vcmd, oden_get_color_render_target_name(gbuffer, i), i);
+		SetVertex(vcmd, "present_vb", (void *)vtx_rect, sizeof(vtx_rect), sizeof(vertex_format));
+		SetIndex(vcmd, "present_ib", (void *)idx_rect, sizeof(idx_rect));
+		DrawIndex(vcmd, "deferred_draw", 0, _countof(idx_rect));
+		return target;
+	}
+
+	if (scene == SCENE_VIDEO) {
+		auto & vpixel = vvideo[frame % BufferMax];
+		auto name = "stressvideo";
+		vpixel.resize(VideoWidth * VideoHeight);
+		for (int y = 0; y < VideoHeight; y++) {
+			uint32_t *line = &vpixel[y * VideoWidth];
+			uint32_t c = uint32_t((y + frame * 4) & 0xFF);
+			for (int x = 0; x < VideoWidth; x++)
+				line[x] = 0xFF000000 | (c << 16) | (uint32_t((x + frame * 8) & 0xFF) << 8) | (c ^ (x & 0xFF));
+		}
+		if (frame == 0)
+			SetTexture(vcmd, name, 0, VideoWidth, VideoHeight, vpixel.data(), vpixel.size() * sizeof(uint32_t), VideoWidth * sizeof(uint32_t));
+		int band = (VideoHeight + count - 1) / count;
+		for (int y = 0; y < VideoHeight; y += band) {
+			int h = (std::min)(band, VideoHeight - y);
+			size_t stride = VideoWidth * sizeof(uint32_t);
+			UpdateTexture(vcmd, name, 0, y, VideoWidth, h, &vpixel[y * VideoWidth], stride * h, stride, 0, false);
+			video_bytes += stride * h;
+		}
+		return name;
+	}
+
+	//SCENE_MIPS : count is the edge of the render target.
+	auto target = "stressmip" + index_name;
+	record_cubes(vcmd, scene, 1, frame, target, count, count);
+	GenerateMips(vcmd, target);
+	return target;
+}
+
+//Level of streamtexN. XOR pattern of the full size texture, tinted per level.
+static bool
+load_stream_level(const std::string & name, int level, std::vector<uint8_t> & vout)
+{
+	static const uint32_t tints[4] = {0x00000080, 0x00008000, 0x00800000, 0x00808000};
+	int index = atoi(name.c_str() + strlen("streamtex"));
+	int size = (std::max)(StreamTextureSize >> level, 1);
+	std::vector<uint32_t> vtex(size * size);
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			uint32_t v = (((x << level) ^ (y << level)) >> 2) * (1110 + index * 77);
+			vtex[y * size + x] = 0xFF000000 | ((v & 0x7F7F7F) + tints[level % 4]);
+		}
+	}
+	return EncodeBC(FMT_BC1_UNORM, vtex.data(), size, size, size * sizeof(uint32_t), vout);
+}
+
+static double
+get_median(std::vector<double> v)
+{
+	if (v.empty())
+		return 0.0;
+	std::sort(v.begin(), v.end());
+	return v[v.size() / 2];
+}
+
+int main(int argc, char *argv[])
+{
+	int scene = SCENE_DRAWS;
+	int count = 1000;
+	uint64_t frame_max = 300;
+	const char *csv_name = nullptr;
+	bool is_async = false;
+	uint64_t budget_mb = 32;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--scene" && i + 1 < argc) {
+			std::string name = argv[++i];
+			scene = -1;
+			for (int s = 0; s < SCENE_MAX; s++)
+				if (name == scene_names[s])
+					scene = s;
+			if (scene < 0) {
+				printf("unknown scene %s\n", name.c_str());
+				return 1;
+			}
+		} else if (arg == "--count" && i + 1 < argc) {
+			count = (std::max)(atoi(argv[++i]), 1);
+		} else if (arg == "--frames" && i + 1 < argc) {
+			frame_max = strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "--csv" && i + 1 < argc) {
+			csv_name = argv[++i];
+		} else if (arg == "--prepass") {
+			is_prepass = true;
+		} else if (arg == "--instanced") {
+			is_instanced = true;
+		} else if (arg == "--async") {
+			is_async = true;
+		} else if (arg == "--budget" && i + 1 < argc) {
+			budget_mb = strtoull(argv[++i], nullptr, 10);
+		} else {
+			printf("unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (scene == SCENE_MIPS)
+		count = (std::min)(count, 16384);
+	if (scene == SCENE_VIDEO)
+		count = (std::min)(count, int(VideoHeight));
+	if (scene == SCENE_STREAM) {
+		StreamParams params;
+		params.budget_bytes = budget_mb << 20;
+		streamer = new TextureStreamer(load_stream_level, params);
+		auto start = get_time_ms();
+		for (int i = 0; i < count; i++)
+			streamer->Add("streamtex" + std::to_string(i), StreamTextureSize, StreamTextureSize, FMT_BC1_UNORM);
+		printf("stream : added %d textures in %.3fms, budget=%lluMB\n", count, get_time_ms() - start, (unsigned long long)budget_mb);
+	}
+
+	//Every draw and pass has a constant buffer per backbuffer, so size the heap after count.
+	uint32_t resource_max = (std::max)(1024u, uint32_t(count) * (BufferMax + 1) + 1024u);
+	if (scene == SCENE_CULL)
+		resource_max = 1024u;
+	auto app_name = "oden_stress";
+	auto hwnd = InitWindow(app_name, Width, Height);
+	printf("scene=%s, count=%d, frames=%llu, heapcount=%u, async=%d\n",
+		scene_names[scene], count, (unsigned long long)frame_max, resource_max, is_async);
+
+	FILE *fp = stdout;
+	if (csv_name)
+		fp = fopen(csv_name, "w");
+	if (fp == nullptr) {
+		printf("ERR : cannot open %s\n", csv_name);
+		return 1;
+	}
+	fprintf(fp, "frame,commands,record_ms,present_ms,cpu_wait_ms,latency_ms\n");
+
+	std::vector<cmd> vcmd;
+	std::vector<frame_timing> vtiming;
+	std::vector<size_t> vcommands;
+	std::vector<frame_stats> vstats;
+	std::vector<double> vrecord, vpresent, vframe, vlatency;
+	uint64_t frame = 0;
+
+	//Frame stats arrive when the gpu is done, so report each frame then.
+	auto report = [&]() {
+		oden_get_frame_stats(vstats);
+		for (auto & s : vstats) {
+			if (s.frame >= vtiming.size())
+				continue;
+			auto & t = vtiming[s.frame];
+			fprintf(fp, "%llu,%zu,%.3f,%.3f,%.3f,%.3f\n", (unsigned long long)s.frame,
+				vcommands[s.frame], t.record_ms, t.present_ms, s.cpu_wait_ms, s.latency_ms);
+			//The first frames create every resource. Leave them out of the summary.
+			if (s.frame >= BufferMax) {
+				vrecord.push_back(t.record_ms);
+				vpresent.push_back(t.present_ms);
+				vframe.push_back(t.record_ms + t.present_ms);
+				vlatency.push_back(s.latency_ms);
+			}
+		}
+		vstats.clear();
+	};
+
+	//uv0 / uv1 of shaders/present, the whole of the targets.
+	static const float presentinfo[8] = {1, 1, 2, 2, 1, 1, 2, 2};
+	while (Update() && frame < frame_max) {
+		auto backbuffer_name = oden_get_backbuffer_name(frame % BufferMax);
+		float clear_color[] = {0, 0, 0, 1};
+
+		double record_start = get_time_ms();
+		auto result_name = record_scene(vcmd, scene, count, frame);
+		SetRenderTarget(vcmd, backbuffer_name, Width, Height, true);
+		SetShader(vcmd, "./shaders/present", false, false, false);
+		ClearRenderTarget(vcmd, backbuffer_name, clear_color);
+		ClearDepthRenderTarget(vcmd, backbuffer_name, 1.0f);
+		SetConstant(vcmd, "presentinfo", 0, (void *)presentinfo, sizeof(presentinfo));
+		SetTexture(vcmd, result_name, 0);
+		SetTexture(vcmd, result_name, 1);
+		SetVertex(vcmd, "present_vb", (void *)vtx_rect, sizeof(vtx_rect), sizeof(vertex_format));
+		SetIndex(vcmd, "present_ib", (void *)idx_rect, sizeof(idx_rect));
+		DrawIndex(vcmd, "present_draw", 0, _countof(idx_rect));
+		SetBarrierToPresent(vcmd, backbuffer_name);
+		double present_start = get_time_ms();
+
+		vcommands.push_back(vcmd.size());
+		if (is_async)
+			oden_present_graphics_async(app_name, vcmd, hwnd, Width, Height, BufferMax, resource_max, ShaderSlotMax);
+		else
+			oden_present_graphics(app_name, vcmd, hwnd, Width, Height, BufferMax, resource_max, ShaderSlotMax);
+		vtiming.push_back({present_start - record_start, get_time_ms() - present_start});
+		vcmd.clear();
+		frame++;
+		report();
+	}
+
+	//Terminate Oden. It waits the gpu, so the last frames are reported after.
+	if (is_async)
+		oden_present_graphics_async(app_name, vcmd, nullptr, Width, Height, BufferMax, resource_max, ShaderSlotMax);
+	else
+		oden_present_graphics(app_name, vcmd, nullptr, Width, Height, BufferMax, resource_max, ShaderSlotMax);
+	report();
+	if (fp != stdout)
+		fclose(fp);
+
+	printf("summary : scene=%s, count=%d, frames=%zu, median record=%.3fms, present=%.3fms, frame=%.3fms, latency=%.3fms\n",
+		scene_names[scene], count, vrecord.size(), get_median(vrecord), get_median(vpresent), get_median(vframe), get_median(vlatency));
+	if (scene == SCENE_VIDEO && !vframe.empty()) {
+		//Bytes of the frames in the summary over their time.
+		double total_ms = 0.0;
+		for (auto t : vframe)
+			total_ms += t;
+		double frame_bytes = double(video_bytes) / double(vtiming.size());
+		printf("video : %.1fMB per frame, upload=%.1fMB/s\n", frame_bytes / (1024.0 * 1024.0),
+			frame_bytes * vframe.size() / (1024.0 * 1024.0) / (total_ms / 1000.0));
+	}
+	if (streamer) {
+		auto stats = streamer->GetStats();
+		printf("stream : resident=%llu, wanted=%llu, loaded=%llu, uploads=%llu (%llu bytes), evictions=%llu\n",
+			(unsigned long long)stats.resident_bytes, (unsigned long long)stats.wanted_bytes, (unsigned long long)stats.loaded_bytes,
+			(unsigned long long)stats.uploads, (unsigned long long)stats.upload_bytes, (unsigned long long)stats.evictions);
+		delete streamer;
+	}
+	return 0;
+}
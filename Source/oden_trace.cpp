@@ -0,0 +1,266 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Chrome trace event JSON writer.
+//https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+//Perfetto and chrome://tracing load it as is.
+
+#include "ODEN.h"
+#include "oden_trace.h"
+
+#include <stdio.h>
+#include <set>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+using namespace oden;
+
+enum {
+	TRACE_CHUNK_EVENTS = 4096,
+};
+
+struct trace_event {
+	const char *category;
+	std::string name;
+	double start_ms;
+	double end_ms; //negative : instant event.
+	int track;
+};
+
+struct trace_thread_buffer;
+
+std::atomic<bool> oden::trace_enabled(false);
+
+static std::mutex trace_mtx;
+static std::condition_variable trace_cv;
+static std::vector<std::vector<trace_event>> vtrace_chunks;
+static std::vector<trace_thread_buffer *> vtrace_threads;
+static std::thread trace_writer;
+static FILE *trace_fp = nullptr;
+static bool is_trace_stop = false;
+static double trace_origin_ms = 0.0;
+static std::atomic<int> trace_track_count(ODEN_TRACE_TRACK_GPU + 1);
+
+static void
+trace_submit(std::vector<trace_event> & vevents)
+{
+	if (vevents.empty())
+		return;
+	std::lock_guard<std::mutex> lock(trace_mtx);
+	vtrace_chunks.push_back(std::move(vevents));
+	vevents.clear();
+	trace_cv.notify_one();
+}
+
+//The lock is only contended while oden_trace_stop drains the buffer.
+struct trace_thread_buffer {
+	std::mutex mtx;
+	std::vector<trace_event> vevents;
+	int track = trace_track_count++;
+
+	trace_thread_buffer()
+	{
+		std::lock_guard<std::mutex> lock(trace_mtx);
+		vtrace_threads.push_back(this);
+	}
+
+	~trace_thread_buffer()
+	{
+		std::vector<trace_event> vrest;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			vrest.swap(vevents);
+		}
+		if (trace_is_enabled())
+			trace_submit(vrest);
+		std::lock_guard<std::mutex> lock(trace_mtx);
+		vtrace_threads.erase(std::remove(vtrace_threads.begin(), vtrace_threads.end(), this), vtrace_threads.end());
+	}
+};
+
+static void
+trace_push(trace_event && e)
+{
+	static thread_local trace_thread_buffer buffer;
+	std::vector<trace_event> vfull;
+	{
+		std::lock_guard<std::mutex> lock(buffer.mtx);
+		if (e.track < 0)
+			e.track = buffer.track;
+		buffer.vevents.push_back(std::move(e));
+		if (buffer.vevents.size() < TRACE_CHUNK_EVENTS)
+			return;
+		vfull.swap(buffer.vevents);
+	}
+	trace_submit(vfull);
+}
+
+static void
+trace_write_string(FILE *fp, const std::string & str)
+{
+	fputc('"', fp);
+	for (unsigned char c : str) {
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+static void
+trace_write_loop(void)
+{
+	std::set<int> tracks;
+	for (;;) {
+		std::vector<std::vector<trace_event>> vchunks;
+		{
+			std::unique_lock<std::mutex> lock(trace_mtx);
+			trace_cv.wait(lock, [] {
+				return is_trace_stop || !vtrace_chunks.empty();
+			});
+			vchunks.swap(vtrace_chunks);
+			if (vchunks.empty() && is_trace_stop)
+				break;
+		}
+
+		for (auto & vevents : vchunks) {
+			for (auto & e : vevents) {
+				if (tracks.insert(e.track).second) {
+					auto track_name = e.track == ODEN_TRACE_TRACK_GPU ?
+						std::string("gpu (start is approximate)") : "thread " + std::to_string(e.track);
+					fprintf(trace_fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", e.track);
+					trace_write_string(trace_fp, track_name);
+					fprintf(trace_fp, "}},\n");
+				}
+				fprintf(trace_fp, "{\"name\":");
+				trace_write_string(trace_fp, e.name);
+				fprintf(trace_fp, ",\"cat\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", e.category, e.track,
+					(e.start_ms - trace_origin_ms) * 1000.0);
+				if (e.end_ms < 0.0)
+					fprintf(trace_fp, ",\"ph\":\"i\",\"s\":\"t\"},\n");
+				else
+					fprintf(trace_fp, ",\"ph\":\"X\",\"dur\":%.3f},\n", (e.end_ms - e.start_ms) * 1000.0);
+			}
+		}
+	}
+}
+
+double
+oden::trace_get_time_ms(void)
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double, std::milli>(now).count();
+}
+
+void
+oden::trace_complete(const char *category, const std::string & name, double start_ms, double end_ms, int track)
+{
+	if (!trace_is_enabled())
+		return;
+	trace_push({category, name, start_ms, (std::max)(end_ms, start_ms), track});
+}
+
+void
+oden::trace_instant(const char *category, const std::string & name)
+{
+	if (!trace_is_enabled())
+		return;
+	trace_push({category, name, trace_get_time_ms(), -1.0, -1});
+}
+
+bool
+oden::oden_trace_start(const char *filename)
+{
+	if (trace_fp)
+		oden_trace_stop();
+	trace_fp = fopen(filename, "w");
+	if (trace_fp == nullptr) {
+		printf("ERR : %s:can't open %s\n", __func__, filename);
+		return false;
+	}
+	fprintf(trace_fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	trace_origin_ms = trace_get_time_ms();
+	{
+		//Drop chunks of a thread that raced with the last oden_trace_stop.
+		std::lock_guard<std::mutex> lock(trace_mtx);
+		vtrace_chunks.clear();
+		is_trace_stop = false;
+	}
+	trace_writer = std::thread(trace_write_loop);
+	trace_enabled = true;
+	return true;
+}
+
+void
+oden::oden_trace_stop(void)
+{
+	if (trace_fp == nullptr)
+		return;
+	trace_enabled = false;
+	{
+		std::lock_guard<std::mutex> lock(trace_mtx);
+		for (auto buffer : vtrace_threads) {
+			std::lock_guard<std::mutex> lock_buffer(buffer->mtx);
+			if (!buffer->vevents.empty())
+				vtrace_chunks.push_back(std::move(buffer->vevents));
+			buffer->vevents.clear();
+		}
+		is_trace_stop = true;
+	}
+	trace_cv.notify_one();
+	trace_writer.join();
+
+	//JSON does not allow a trailing comma, so close with an empty metadata event.
+	fprintf(trace_fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"oden\"}}\n]}\n");
+	fclose(trace_fp);
+	trace_fp = nullptr;
+}
+
+void
+oden::oden_trace_event(const char *category, const char *name, double start_ms, double end_ms)
+{
+	if (!trace_is_enabled())
+		return;
+	//The application category is not a literal. Keep a copy for the writer.
+	static std::mutex category_mtx;
+	static std::set<std::string> categories;
+	const char *cat = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(category_mtx);
+		cat = categories.insert(category).first->c_str();
+	}
+	trace_complete(cat, name, start_ms, end_ms);
+}
+
+double
+oden::oden_trace_get_time_ms(void)
+{
+	return trace_get_time_ms();
+}
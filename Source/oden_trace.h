@@ -0,0 +1,83 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#pragma once
+
+//Trace event recorder shared by the backends, see oden_trace_start in ODEN.h.
+//Events go to a buffer of the calling thread. Full buffers are handed to a
+//writer thread, so a hot thread only pays for a push_back while tracing and
+//for one relaxed load when not.
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+
+namespace oden
+{
+
+//Track of the gpu passes. Threads get tracks from 1.
+enum {
+	ODEN_TRACE_TRACK_GPU = 0,
+};
+
+extern std::atomic<bool> trace_enabled;
+
+inline bool
+trace_is_enabled(void)
+{
+	return trace_enabled.load(std::memory_order_relaxed);
+}
+
+//std::chrono::steady_clock in ms, the clock of the backends frame stats.
+double
+trace_get_time_ms(void);
+
+//category must be a string literal. track < 0 is the calling thread.
+void
+trace_complete(const char *category, const std::string & name, double start_ms, double end_ms, int track = -1);
+
+void
+trace_instant(const char *category, const std::string & name);
+
+//Span from construction to destruction on the calling thread.
+struct trace_scope {
+	const char *category = nullptr;
+	std::string name;
+	double start_ms = 0.0;
+
+	trace_scope(const char *category, const std::string & name)
+	{
+		if (!trace_is_enabled())
+			return;
+		this->category = category;
+		this->name = name;
+		start_ms = trace_get_time_ms();
+	}
+
+	~trace_scope()
+	{
+		if (category)
+			trace_complete(category, name, start_ms, trace_get_time_ms());
+	}
+};
+
+};
@@ -23,6 +23,9 @@
 
 #include "oden_util.h"
 
+#include <string.h>
+#include <math.h>
+
 namespace odenutil
 {
 
@@ -31,6 +34,7 @@ void SetBarrierToPresent(std::vector<cmd> & vcmd, std::string name)
 	cmd c = {};
 	c.type = CMD_SET_BARRIER;
 	c.name = name;
+	c.set_barrier = {};
 	c.set_barrier.to_present = true;
 	vcmd.push_back(c);
 }
@@ -40,6 +44,7 @@ void SetBarrierToRenderTarget(std::vector<cmd> & vcmd, std::string name)
 	cmd c = {};
 	c.type = CMD_SET_BARRIER;
 	c.name = name;
+	c.set_barrier = {};
 	c.set_barrier.to_rendertarget = true;
 	vcmd.push_back(c);
 }
@@ -49,6 +54,7 @@ void SetBarrierToDepthRenderTarget(std::vector<cmd> & vcmd, std::string name)
 	cmd c = {};
 	c.type = CMD_SET_BARRIER;
 	c.name = name;
+	c.set_barrier = {};
 	c.set_barrier.to_depthrendertarget = true;
 	vcmd.push_back(c);
 }
@@ -58,17 +64,19 @@ void SetBarrierToTexture(std::vector<cmd> & vcmd, std::string name)
 	cmd c = {};
 	c.type = CMD_SET_BARRIER;
 	c.name = name;
+	c.set_barrier = {};
 	c.set_barrier.to_texture = true;
 	vcmd.push_back(c);
 }
 
 void SetRenderTarget(std::vector<cmd> & vcmd, std::string name,
-	int w, int h, bool is_backbuffer)
+	int w, int h, bool is_backbuffer, int fmt)
 {
 	cmd c = {};
 	c.type = CMD_SET_RENDER_TARGET;
 	c.name = name;
-	c.set_render_target.fmt = 0;
+	c.set_render_target = {};
+	c.set_render_target.fmt = fmt;
 	c.set_render_target.rect.x = 0;
 	c.set_render_target.rect.y = 0;
 	c.set_render_target.rect.w = w;
@@ -77,15 +85,61 @@ void SetRenderTarget(std::vector<cmd> & vcmd, std::string name,
 	vcmd.push_back(c);
 }
 
+void SetRenderTarget(std::vector<cmd> & vcmd, std::string name,
+	int w, int h, const std::vector<int> & vfmt)
+{
+	SetRenderTarget(vcmd, name, w, h, false, vfmt.empty() ? FMT_DEFAULT : vfmt[0]);
+	auto & c = vcmd.back();
+	c.set_render_target.count = (int)vfmt.size();
+	for (size_t i = 1; i < vfmt.size() && i < RENDER_TARGET_MAX; i++)
+		c.set_render_target.fmts[i] = vfmt[i];
+}
+
+void SetDepthRenderTarget(std::vector<cmd> & vcmd, std::string name, int w, int h)
+{
+	SetRenderTarget(vcmd, name, w, h);
+	vcmd.back().set_render_target.is_depth_only = true;
+}
+
+void SetRenderTargetRect(std::vector<cmd> & vcmd, int x, int y, int w, int h)
+{
+	//A rect for another command would be dropped without a word, the pass then draws at full size.
+	if (vcmd.empty() || vcmd.back().type != CMD_SET_RENDER_TARGET) {
+		printf("ERR : %s : must follow SetRenderTarget / SetDepthRenderTarget, rect %d %d %d %d ignored\n", __func__, x, y, w, h);
+		return;
+	}
+	auto & c = vcmd.back();
+	oden_get_render_target_size(c, c.set_render_target.w, c.set_render_target.h);
+	c.set_render_target.rect.x = x;
+	c.set_render_target.rect.y = y;
+	c.set_render_target.rect.w = w;
+	c.set_render_target.rect.h = h;
+}
+
+int GetScaledSize(int size, float scale)
+{
+	return (std::min)((std::max)(int(float(size) * scale + 0.5f), 1), size);
+}
+
+void GetScaledUv(int w, int h, int rw, int rh, float uv[4])
+{
+	uv[0] = float(rw) / float(w);
+	uv[1] = float(rh) / float(h);
+	//the whole texture keeps the wrap of the samplers.
+	uv[2] = rw < w ? (float(rw) - 0.5f) / float(w) : 2.0f;
+	uv[3] = rh < h ? (float(rh) - 0.5f) / float(h) : 2.0f;
+}
+
 void
 SetTexture(
 	std::vector<cmd> & vcmd, std::string name,
-	int slot, int w, int h, void *data, size_t size, size_t stride_size)
+	int slot, int w, int h, void *data, size_t size, size_t stride_size, int fmt, int mips)
 {
 	cmd c = {};
 	c.type = CMD_SET_TEXTURE;
 	c.name = name;
-	c.set_texture.fmt = 0;
+	c.set_texture = {};
+	c.set_texture.fmt = fmt;
 	c.set_texture.slot = slot;
 	c.buf.resize(size);
 	memcpy(c.buf.data(), data, size);
@@ -94,6 +148,20 @@ SetTexture(
 	c.set_texture.rect.y = 0;
 	c.set_texture.rect.w = w;
 	c.set_texture.rect.h = h;
+	c.set_texture.miplevel = 0;
+	c.set_texture.mips = mips;
+	vcmd.push_back(c);
+}
+
+void
+SetTextureLevel(std::vector<cmd> & vcmd, std::string name, int slot, int miplevel)
+{
+	cmd c = {};
+	c.type = CMD_SET_TEXTURE;
+	c.name = name;
+	c.set_texture = {};
+	c.set_texture.slot = slot;
+	c.set_texture.miplevel = miplevel;
 	vcmd.push_back(c);
 }
 
@@ -106,6 +174,7 @@ SetTextureUav(
 	cmd c = {};
 	c.type = CMD_SET_TEXTURE_UAV;
 	c.name = name;
+	c.set_texture = {};
 	c.set_texture.fmt = 0;
 	c.set_texture.slot = slot;
 	c.buf.resize(size);
@@ -125,6 +194,7 @@ void SetVertex(std::vector<cmd> & vcmd, std::string name,
 	cmd c = {};
 	c.type = CMD_SET_VERTEX;
 	c.name = name;
+	c.set_vertex = {};
 	c.buf.resize(size);
 	memcpy(c.buf.data(), data, size);
 	c.set_vertex.stride_size = stride_size;
@@ -142,12 +212,72 @@ void SetIndex(std::vector<cmd> & vcmd, std::string name,
 	vcmd.push_back(c);
 }
 
+void SetBuffer(std::vector<cmd> & vcmd, std::string name,
+	int slot, size_t size, const void *data)
+{
+	cmd c = {};
+	c.type = CMD_SET_BUFFER;
+	c.name = name;
+	c.set_buffer = {};
+	c.set_buffer.slot = slot;
+	c.set_buffer.size = size;
+	if (data) {
+		c.buf.resize(size);
+		memcpy(c.buf.data(), data, size);
+	}
+	vcmd.push_back(c);
+}
+
+void SetBufferUav(std::vector<cmd> & vcmd, std::string name,
+	int slot, size_t size, const void *data)
+{
+	SetBuffer(vcmd, name, slot, size, data);
+	vcmd.back().type = CMD_SET_BUFFER_UAV;
+}
+
+void UpdateBuffer(std::vector<cmd> & vcmd, std::string name,
+	size_t offset, const void *data, size_t size)
+{
+	cmd c = {};
+	c.type = CMD_UPDATE_BUFFER;
+	c.name = name;
+	c.set_buffer = {};
+	c.set_buffer.offset = offset;
+	c.buf.resize(size);
+	memcpy(c.buf.data(), data, size);
+	vcmd.push_back(c);
+}
+
+void UpdateTexture(std::vector<cmd> & vcmd, std::string name,
+	int x, int y, int w, int h, const void *data, size_t size, size_t stride_size, int miplevel, bool is_copy)
+{
+	cmd c = {};
+	c.type = CMD_UPDATE_TEXTURE;
+	c.name = name;
+	c.set_texture = {};
+	if (is_copy) {
+		c.buf.resize(size);
+		memcpy(c.buf.data(), data, size);
+	} else {
+		c.ext_data = (const uint8_t *)data;
+		c.ext_size = size;
+	}
+	c.set_texture.stride_size = stride_size;
+	c.set_texture.rect.x = x;
+	c.set_texture.rect.y = y;
+	c.set_texture.rect.w = w;
+	c.set_texture.rect.h = h;
+	c.set_texture.miplevel = miplevel;
+	vcmd.push_back(c);
+}
+
 void SetConstant(std::vector<cmd> & vcmd, std::string name,
 	int slot, void *data, size_t size)
 {
 	cmd c = {};
 	c.type = CMD_SET_CONSTANT;
 	c.name = name;
+	c.set_constant = {};
 	c.set_constant.slot = slot;
 	c.buf.resize(size);
 	memcpy(c.buf.data(), data, size);
@@ -156,14 +286,16 @@ void SetConstant(std::vector<cmd> & vcmd, std::string name,
 
 void SetShader(
 	std::vector<cmd> & vcmd, std::string name,
-	bool is_update, bool is_cull, bool is_enable_depth)
+	bool is_update, bool is_cull, bool is_enable_depth, int depth_func)
 {
 	cmd c = {};
 	c.type = CMD_SET_SHADER;
 	c.name = name;
+	c.set_shader = {};
 	c.set_shader.is_update = is_update;
 	c.set_shader.is_cull = is_cull;
 	c.set_shader.is_enable_depth = is_enable_depth;
+	c.set_shader.depth_func = depth_func;
 	vcmd.push_back(c);
 }
 
@@ -173,6 +305,7 @@ void ClearRenderTarget(std::vector<cmd> & vcmd, std::string name,
 	cmd c = {};
 	c.type = CMD_CLEAR;
 	c.name = name;
+	c.clear = {};
 	for (int i = 0 ; i < 4; i++)
 		c.clear.color[i] = col[i];
 	vcmd.push_back(c);
@@ -184,6 +317,7 @@ void ClearDepthRenderTarget(std::vector<cmd> & vcmd, std::string name,
 	cmd c = {};
 	c.type = CMD_CLEAR_DEPTH;
 	c.name = name;
+	c.clear_depth = {};
 	c.clear_depth.value = value;
 	vcmd.push_back(c);
 }
@@ -194,33 +328,317 @@ void DrawIndex(std::vector<cmd> & vcmd, std::string name,
 	cmd c = {};
 	c.type = CMD_DRAW_INDEX;
 	c.name = name;
+	c.draw_index = {};
 	c.draw_index.start = start;
 	c.draw_index.count = count;
 	vcmd.push_back(c);
 }
 
+void DrawIndexIndirect(std::vector<cmd> & vcmd, std::string name,
+	size_t offset)
+{
+	cmd c = {};
+	c.type = CMD_DRAW_INDEX_INDIRECT;
+	c.name = name;
+	c.draw_index_indirect = {};
+	c.draw_index_indirect.offset = offset;
+	vcmd.push_back(c);
+}
+
 void Draw(std::vector<cmd> & vcmd, std::string name,
 	int vertex_count)
 {
 	cmd c = {};
 	c.type = CMD_DRAW;
 	c.name = name;
+	c.draw = {};
 	c.draw.vertex_count = vertex_count;
 	vcmd.push_back(c);
 }
 
+void DrawIndexInstanced(std::vector<cmd> & vcmd, std::string name,
+	int start, int count, int instance_count)
+{
+	cmd c = {};
+	c.type = CMD_DRAW_INDEX_INSTANCED;
+	c.name = name;
+	c.draw_instanced = {};
+	c.draw_instanced.start = start;
+	c.draw_instanced.count = count;
+	c.draw_instanced.instance_count = instance_count;
+	vcmd.push_back(c);
+}
+
+void DrawInstanced(std::vector<cmd> & vcmd, std::string name,
+	int vertex_count, int instance_count)
+{
+	cmd c = {};
+	c.type = CMD_DRAW_INSTANCED;
+	c.name = name;
+	c.draw_instanced = {};
+	c.draw_instanced.count = vertex_count;
+	c.draw_instanced.instance_count = instance_count;
+	vcmd.push_back(c);
+}
+
 void Dispatch(std::vector<cmd> & vcmd, std::string name,
 	int x, int y, int z)
 {
 	cmd c = {};
 	c.type = CMD_DISPATCH;
 	c.name = name;
+	c.dispatch = {};
 	c.dispatch.x = x;
 	c.dispatch.y = y;
 	c.dispatch.z = z;
 	vcmd.push_back(c);
 }
 
+void GenerateMips(std::vector<cmd> & vcmd, std::string name,
+	int miplevel)
+{
+	cmd c = {};
+	c.type = CMD_GENERATE_MIPS;
+	c.name = name;
+	c.generate_mips = {};
+	c.generate_mips.miplevel = miplevel;
+	vcmd.push_back(c);
+}
+
+void Release(std::vector<cmd> & vcmd, std::string name)
+{
+	cmd c = {};
+	c.type = CMD_RELEASE;
+	c.name = name;
+	vcmd.push_back(c);
+}
+
+//Dual filter bloom (shaders/bloom_down, bloom_up).
+//Each down pass halves the size, each up pass adds the blurred lower level to the down target of its size.
+//Returns the name of the result, sized like the first level. Targets and constants are named after prefix.
+std::string Bloom(std::vector<cmd> & vcmd, std::string src, std::string prefix,
+	int w, int h, const BloomParams & params, float *uv)
+{
+	struct vertex {
+		float pos[4];
+		float nor[3];
+		float uv[2];
+	};
+	static vertex vtx_rect[] = {
+		{{-1, 1, 0, 1}, {0,  1,  1}, { 0, 1}},
+		{{-1, -1, 0, 1}, {0,  1,  1}, { 0, 0}},
+		{{ 1, 1, 0, 1}, {0,  1,  1}, { 1, 1}},
+		{{ 1, -1, 0, 1}, {0,  1,  1}, { 1, 0}},
+	};
+	static uint32_t idx_rect[] = {
+		0, 1, 2,
+		2, 1, 3
+	};
+	static const struct {
+		int shift;
+		int levels;
+	} quality_info[BLOOM_QUALITY_MAX] = {
+		{2, 3},
+		{2, 5},
+		{1, 6},
+	};
+	int quality = params.quality;
+	if (quality < 0 || quality >= BLOOM_QUALITY_MAX)
+		quality = BLOOM_QUALITY_MEDIUM;
+	int shift = quality_info[quality].shift;
+	int levels = quality_info[quality].levels;
+	while (levels > 1 && ((w >> (shift + levels - 1)) < 2 || (h >> (shift + levels - 1)) < 2))
+		levels--;
+
+	//binfo of shaders/bloom_down, bloom_up.
+	struct binfo {
+		float texel[4]; //xy : texel size of tex0, z : threshold, w : scale
+		float uv0[4];   //xy : uv scale of the drawn rect of tex0, zw : max uv in it (GetScaledUv)
+		float uv1[4];   //the same of tex1
+	};
+
+	//Targets are made at their size for params.scale 1 and drawn in the top left of them.
+	auto draw = [&](std::string dst, int dw, int dh, std::string shader, std::string tex0, std::string tex1, binfo & info, std::string draw_name) {
+		SetRenderTarget(vcmd, dst, dw, dh, false, params.fmt);
+		SetRenderTargetRect(vcmd, 0, 0, GetScaledSize(dw, params.scale), GetScaledSize(dh, params.scale));
+		SetShader(vcmd, shader, params.is_update, false, false);
+		SetTexture(vcmd, tex0, 0);
+		if (!tex1.empty())
+			SetTexture(vcmd, tex1, 1);
+		SetVertex(vcmd, "bloom_vb", vtx_rect, sizeof(vtx_rect), sizeof(vertex));
+		SetIndex(vcmd, "bloom_ib", idx_rect, sizeof(idx_rect));
+		SetConstant(vcmd, dst + "_const", 0, &info, sizeof(info));
+		DrawIndex(vcmd, draw_name, 0, 6);
+	};
+	auto get_uv = [&](int tw, int th, float uv[4]) {
+		GetScaledUv(tw, th, GetScaledSize(tw, params.scale), GetScaledSize(th, params.scale), uv);
+	};
+
+	//The threshold is applied once, the intensity by the last pass. Every up pass adds one level, so it is divided by the count.
+	std::vector<std::string> vdown;
+	std::vector<int> vw, vh;
+	std::string tex = src;
+	int tw = w;
+	int th = h;
+	for (int i = 0; i < levels; i++) {
+		int dw = (std::max)(w >> (shift + i), 1);
+		int dh = (std::max)(h >> (shift + i), 1);
+		binfo info = {
+			{
+				1.0f / float(tw), 1.0f / float(th),
+				i == 0 ? params.threshold : 0.0f,
+				levels == 1 ? params.intensity : 1.0f,
+			},
+			{}, //get_uv
+			{}, //no tex1
+		};
+		get_uv(tw, th, info.uv0);
+		//named by the size, so the qualities share the targets of the same size.
+		vdown.push_back(prefix + "_down" + std::to_string(shift + i));
+		vw.push_back(dw);
+		vh.push_back(dh);
+		draw(vdown.back(), dw, dh, "./shaders/bloom_down", tex, "", info, "bloom_down" + std::to_string(i));
+		tex = vdown.back();
+		tw = dw;
+		th = dh;
+	}
+	for (int i = levels - 2; i >= 0; i--) {
+		auto dst = prefix + "_up" + std::to_string(shift + i);
+		binfo info = {
+			{
+				1.0f / float(tw), 1.0f / float(th),
+				0.0f,
+				i == 0 ? params.intensity / float(levels) : 1.0f,
+			},
+			{}, //get_uv
+			{}, //get_uv
+		};
+		get_uv(tw, th, info.uv0);
+		get_uv(vw[i], vh[i], info.uv1);
+		draw(dst, vw[i], vh[i], "./shaders/bloom_up", tex, vdown[i], info, "bloom_up" + std::to_string(i));
+		tex = dst;
+		tw = vw[i];
+		th = vh[i];
+	}
+	if (uv)
+		get_uv(tw, th, uv);
+	return tex;
+}
+
+//One hiz_copy dispatch writes level 0, then one hiz dispatch per level reduces it from the level above.
+//Not the single pass downsampler of GenerateMips (CMD_GENERATE_MIPS), which averages.
+//The depth is less is nearer, so the reduction keeps the max. A reversed depth would keep the min.
+void BuildHiZ(std::vector<cmd> & vcmd, std::string src, std::string dst, int w, int h)
+{
+	//The target of the caller, with its size and rect, is set again after the dispatches.
+	auto it = std::find_if(vcmd.rbegin(), vcmd.rend(), [](const cmd & c) {
+		return c.type == CMD_SET_RENDER_TARGET;
+	});
+	bool is_restore = it != vcmd.rend();
+	cmd restore = is_restore ? *it : cmd();
+
+	//made as a render target for the mips and the uav. It also unbinds the depth of src.
+	SetRenderTarget(vcmd, dst, w, h, false, FMT_R32_FLOAT);
+	SetShader(vcmd, "./shaders/hiz_copy", false);
+	SetTexture(vcmd, oden_get_depth_render_target_name(src), 0);
+	SetTextureUav(vcmd, dst, 1, 0, 0, 0);
+	Dispatch(vcmd, "hiz", (w + 7) / 8, (h + 7) / 8, 1);
+	int levels = oden_get_mipmap_max(w, h);
+	for (int i = 1; i < levels; i++) {
+		int lw = (std::max)(w >> i, 1);
+		int lh = (std::max)(h >> i, 1);
+		SetShader(vcmd, "./shaders/hiz", false);
+		SetTextureUav(vcmd, dst, 0, 0, 0, i - 1);
+		SetTextureUav(vcmd, dst, 1, 0, 0, i);
+		Dispatch(vcmd, "hiz", (lw + 7) / 8, (lh + 7) / 8, 1);
+	}
+	//dst is read next, unbind it.
+	if (is_restore)
+		vcmd.push_back(restore);
+	else
+		SetDepthRenderTarget(vcmd, src, w, h);
+}
+
+std::string CullInstances(std::vector<cmd> & vcmd, std::string bounds, int count, std::string hiz, int w, int h,
+	std::string prefix, const CullParams & params)
+{
+	//cullinfo of shaders/cull.
+	struct cullinfo {
+		float view[16];
+		float proj[16];
+		float hiz[4];       //w, h, levels of hiz, w 1 : occlusion test.
+		uint32_t count[4];  //x : instances
+	};
+	cullinfo info = {};
+	memcpy(info.view, params.view, sizeof(info.view));
+	memcpy(info.proj, params.proj, sizeof(info.proj));
+	info.hiz[0] = float(w);
+	info.hiz[1] = float(h);
+	info.hiz[2] = float(oden_get_mipmap_max(w, h));
+	info.hiz[3] = params.is_occlusion ? 1.0f : 0.0f;
+	info.count[0] = uint32_t(count);
+
+	//instance_count is counted up from 0 by the visible ones.
+	auto args = prefix + "_args";
+	auto visible = prefix + "_visible";
+	draw_index_indirect_args reset = {params.index_count, 0, params.start_index, 0, 0};
+	SetBuffer(vcmd, args, -1, sizeof(reset));
+	UpdateBuffer(vcmd, args, 0, &reset, sizeof(reset));
+	SetShader(vcmd, "./shaders/cull", false);
+	SetConstant(vcmd, prefix + "_cullinfo", 0, &info, sizeof(info));
+	SetBuffer(vcmd, bounds, 0);
+	if (params.is_occlusion)
+		SetTexture(vcmd, hiz, 1);
+	SetBufferUav(vcmd, args, 2);
+	SetBufferUav(vcmd, visible, 3, (std::max)(count, 1) * sizeof(uint32_t));
+	Dispatch(vcmd, "cull", (count + 63) / 64, 1, 1);
+	return args;
+}
+
+DynamicResolution::DynamicResolution(const DynamicResolutionParams & params)
+	: params(params), scale(params.max_scale), bloom_quality(params.bloom_quality)
+{
+}
+
+void DynamicResolution::Update(double gpu_ms)
+{
+	if (gpu_ms < 0.0)
+		return;
+	sum_ms += gpu_ms;
+	if (++count < (std::max)(params.frames, 1))
+		return;
+	double ms = sum_ms / count;
+	sum_ms = 0.0;
+	count = 0;
+
+	//Over : the scale first, the gpu time goes with the pixels (scale squared). Then the bloom.
+	//Under : back in the reverse order, a step at a time.
+	if (ms > params.target_ms) {
+		if (scale > params.min_scale) {
+			float to = scale * float(sqrt(params.target_ms / ms));
+			scale = (std::max)((std::min)(to, scale - 0.01f), params.min_scale);
+		} else if (bloom_quality > BLOOM_QUALITY_LOW) {
+			bloom_quality--;
+		}
+	} else if (ms < params.target_ms * params.headroom) {
+		if (bloom_quality < params.bloom_quality)
+			bloom_quality++;
+		else
+			scale = (std::min)(scale + params.step, params.max_scale);
+	}
+}
+
+double GetGpuFrameTime(const std::map<std::string, pass_stats> & mstats)
+{
+	double ms = 0.0;
+	for (auto & x : mstats) {
+		if (x.second.gpu_ms < 0.0)
+			return -1.0;
+		ms += x.second.gpu_ms;
+	}
+	return ms;
+}
+
 void DebugPrint(std::vector<cmd> & vcmd)
 {
 	printf("%s ================================\n", __func__);
@@ -235,10 +653,17 @@ void DebugPrint(std::vector<cmd> & vcmd)
 			printf("CMD_SET_BARRIER\n");
 			break;
 		case CMD_SET_RENDER_TARGET:
-			printf("CMD_SET_RENDER_TARGET\n");
+			if (c.set_render_target.is_depth_only) {
+				printf("CMD_SET_RENDER_TARGET depth only\n");
+				break;
+			}
+			printf("CMD_SET_RENDER_TARGET %s", oden_get_format_name(c.set_render_target.fmt));
+			for (int i = 1; i < oden_get_render_target_count(c); i++)
+				printf(" %s", oden_get_format_name(c.set_render_target.fmts[i]));
+			printf("\n");
 			break;
 		case CMD_SET_TEXTURE:
-			printf("CMD_SET_TEXTURE\n");
+			printf("CMD_SET_TEXTURE %s mips=%d\n", oden_get_format_name(c.set_texture.fmt), c.set_texture.mips);
 			break;
 		case CMD_SET_VERTEX:
 			printf("CMD_SET_VERTEX\n");
@@ -250,7 +675,7 @@ void DebugPrint(std::vector<cmd> & vcmd)
 			printf("CMD_SET_CONSTANT\n");
 			break;
 		case CMD_SET_SHADER:
-			printf("CMD_SET_SHADER\n");
+			printf("CMD_SET_SHADER%s\n", c.set_shader.depth_func == DEPTH_FUNC_EQUAL ? " depth equal" : "");
 			break;
 		case CMD_CLEAR:
 			printf("CMD_CLEAR\n");
@@ -264,6 +689,34 @@ void DebugPrint(std::vector<cmd> & vcmd)
 		case CMD_DRAW:
 			printf("CMD_DRAW\n");
 			break;
+		case CMD_DISPATCH:
+			printf("CMD_DISPATCH\n");
+			break;
+		case CMD_GENERATE_MIPS:
+			printf("CMD_GENERATE_MIPS\n");
+			break;
+		case CMD_RELEASE:
+			printf("CMD_RELEASE\n");
+			break;
+		case CMD_UPDATE_TEXTURE:
+			printf("CMD_UPDATE_TEXTURE %d,%d %dx%d miplevel=%d\n", c.set_texture.rect.x, c.set_texture.rect.y,
+				c.set_texture.rect.w, c.set_texture.rect.h, c.set_texture.miplevel);
+			break;
+		case CMD_SET_BUFFER:
+		case CMD_SET_BUFFER_UAV:
+			printf("%s slot=%d size=%zu\n", oden_get_cmd_name(type), c.set_buffer.slot, c.set_buffer.size);
+			break;
+		case CMD_UPDATE_BUFFER:
+			printf("CMD_UPDATE_BUFFER offset=%zu size=%zu\n", c.set_buffer.offset, c.buf.size());
+			break;
+		case CMD_DRAW_INDEX_INDIRECT:
+			printf("CMD_DRAW_INDEX_INDIRECT offset=%zu\n", c.draw_index_indirect.offset);
+			break;
+		case CMD_DRAW_INDEX_INSTANCED:
+		case CMD_DRAW_INSTANCED:
+			printf("%s start=%d count=%d instances=%d\n", oden_get_cmd_name(type),
+				c.draw_instanced.start, c.draw_instanced.count, c.draw_instanced.instance_count);
+			break;
 		default:
 			printf("CMD_UNKNOWN %d\n", type);
 			break;
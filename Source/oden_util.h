@@ -27,21 +27,132 @@
 namespace odenutil
 {
 using namespace oden;
+
+//Bloom quality : LOW / MEDIUM start the chain at 1/4 size with 3 / 5 levels, HIGH at 1/2 size with 6 levels.
+enum {
+	BLOOM_QUALITY_LOW,
+	BLOOM_QUALITY_MEDIUM,
+	BLOOM_QUALITY_HIGH,
+	BLOOM_QUALITY_MAX,
+};
+
+struct BloomParams {
+	int quality = BLOOM_QUALITY_MEDIUM;
+	float threshold = 1.0f; //brightness below it does not bloom, 0 blooms everything.
+	float intensity = 1.0f;
+	bool is_update = false;
+	int fmt = FMT_R11G11B10_FLOAT; //of the targets. The result has no alpha.
+	float scale = 1.0f; //dynamic resolution : src is drawn in the top left GetScaledSize of w x h, and so are the targets.
+};
+
+//Dynamic resolution governor. Update with the gpu time of each completed frame, then draw the frame
+//at GetScale of the target sizes (GetScaledSize, SetRenderTargetRect) and bloom at GetBloomQuality.
+struct DynamicResolutionParams {
+	double target_ms = 1000.0 / 60.0; //gpu time of a frame to hold.
+	double headroom = 0.85;           //scale up below target_ms * headroom.
+	float min_scale = 0.5f;
+	float max_scale = 1.0f;
+	float step = 0.05f;               //of a scale up. a scale down follows the time.
+	int frames = 8;                   //averaged per adjustment.
+	int bloom_quality = BLOOM_QUALITY_HIGH; //the best one, lowered once the scale is min_scale.
+};
+
+class DynamicResolution {
+public:
+	DynamicResolution(const DynamicResolutionParams & params = DynamicResolutionParams());
+	//Negative times (no timestamps) are ignored.
+	void Update(double gpu_ms);
+	float GetScale() const
+	{
+		return scale;
+	}
+	int GetBloomQuality() const
+	{
+		return bloom_quality;
+	}
+
+private:
+	DynamicResolutionParams params;
+	float scale;
+	int bloom_quality;
+	double sum_ms = 0.0;
+	int count = 0;
+};
+
+//Gpu time of a frame from oden_get_pass_stats, negative when the backend has no timestamps.
+double GetGpuFrameTime(const std::map<std::string, pass_stats> & mstats);
+
+//GPU culling of CullInstances. The camera is the one of the depth the Hi-Z is built from.
+struct CullParams {
+	float view[16];
+	float proj[16];
+	uint32_t index_count = 0; //of the mesh each instance draws.
+	uint32_t start_index = 0;
+	bool is_occlusion = true; //false : the frustum only, hiz is not read.
+};
+
+//uv : if not null, GetScaledUv of the result.
+std::string Bloom(std::vector<cmd> & vcmd, std::string src, std::string prefix, int w, int h, const BloomParams & params = BloomParams(),
+	float *uv = nullptr);
 void ClearDepthRenderTarget(std::vector<cmd> & vcmd, std::string name, float value);
+//Hi-Z pyramid of the depth of render target src into an FMT_R32_FLOAT target dst of w x h with the mip chain.
+//Each texel is the farthest depth below it (shaders/hiz_copy, hiz). The last render target set in vcmd is set again
+//after it, the depth of src of w x h when there is none.
+void BuildHiZ(std::vector<cmd> & vcmd, std::string src, std::string dst, int w, int h);
 void ClearRenderTarget(std::vector<cmd> & vcmd, std::string name, float col[4]);
+//One dispatch of shaders/cull : count bounding spheres of the buffer bounds (float4 : xyz center, w radius) against
+//the frustum and the BuildHiZ hiz of w x h. prefix + "_visible" gets the indices of the visible instances, read it at
+//SV_InstanceID. Returns prefix + "_args" for DrawIndexIndirect. prefix is per backbuffer, the constants are named after it.
+std::string CullInstances(std::vector<cmd> & vcmd, std::string bounds, int count, std::string hiz, int w, int h,
+	std::string prefix, const CullParams & params);
 void DebugPrint(std::vector<cmd> & vcmd);
 void Dispatch(std::vector<cmd> & vcmd, std::string name, int x, int y, int z);
 void Draw(std::vector<cmd> & vcmd, std::string name, int vertex_count);
 void DrawIndex(std::vector<cmd> & vcmd, std::string name, int start, int count);
+//instance_count instances in one draw. The shader reads their data from a SetBuffer at SV_InstanceID.
+void DrawIndexInstanced(std::vector<cmd> & vcmd, std::string name, int start, int count, int instance_count);
+void DrawInstanced(std::vector<cmd> & vcmd, std::string name, int vertex_count, int instance_count);
+//draw_index_indirect_args at offset of the buffer name, written by the gpu.
+void DrawIndexIndirect(std::vector<cmd> & vcmd, std::string name, size_t offset = 0);
+//Dynamic resolution : size of a size target drawn at scale, at least 1.
+int GetScaledSize(int size, float scale);
+//uv of the top left rw x rh of a w x h texture : xy scale, zw the largest uv half a texel inside it (bilinear stays in),
+//2 when rw / rh is the whole size. xy - zw is the smallest one, -1 for the whole size (wraps as before).
+void GetScaledUv(int w, int h, int rw, int rh, float uv[4]);
+//Encode RGBA8 pixels (R in the low byte) to FMT_BC1/BC4/BC5/BC7_UNORM block rows (oden_bc.cpp).
+//BC4 takes R, BC5 R and G, BC1 ignores alpha. stride is the bytes of a pixel row, block rows are vout.size() / ((h + 3) / 4).
+bool EncodeBC(int fmt, const uint32_t *rgba, int w, int h, size_t stride, std::vector<uint8_t> & vout);
+void GenerateMips(std::vector<cmd> & vcmd, std::string name, int miplevel = 0);
+//Destroy a texture of SetTexture once the frames using it are complete.
+void Release(std::vector<cmd> & vcmd, std::string name);
 void SetBarrierToPresent(std::vector<cmd> & vcmd, std::string name);
 void SetBarrierToRenderTarget(std::vector<cmd> & vcmd, std::string name);
 void SetBarrierToTexture(std::vector<cmd> & vcmd, std::string name);
+//Storage buffer of size bytes, data is the first of them (nullptr : zero) when it is created. slot -1 : not bound.
+void SetBuffer(std::vector<cmd> & vcmd, std::string name, int slot, size_t size = 0, const void *data = nullptr);
+void SetBufferUav(std::vector<cmd> & vcmd, std::string name, int slot, size_t size = 0, const void *data = nullptr);
 void SetConstant(std::vector<cmd> & vcmd, std::string name, int slot, void *data, size_t size);
 void SetIndex(std::vector<cmd> & vcmd, std::string name, void *data, size_t size);
-void SetRenderTarget(std::vector<cmd> & vcmd, std::string name, int w, int h, bool is_backbuffer = false);
-void SetShader(std::vector<cmd> & vcmd, std::string name, bool is_update, bool is_cull = false, bool is_enable_depth = false);
-void SetTexture(std::vector<cmd> & vcmd, std::string name, int slot, int w = 0, int h = 0, void *data = nullptr, size_t size = 0, size_t stride_size = 0);
+void SetRenderTarget(std::vector<cmd> & vcmd, std::string name, int w, int h, bool is_backbuffer = false, int fmt = FMT_DEFAULT);
+//Up to RENDER_TARGET_MAX color targets written by one pass. Target i is oden_get_color_render_target_name(name, i) of vfmt[i].
+void SetRenderTarget(std::vector<cmd> & vcmd, std::string name, int w, int h, const std::vector<int> & vfmt);
+//Depth only target for a depth prepass; the following SetRenderTarget(name) shares its depth.
+void SetDepthRenderTarget(std::vector<cmd> & vcmd, std::string name, int w, int h);
+//Dynamic resolution : the last SetRenderTarget keeps its size and draws into the rect of it.
+//Call it right after SetRenderTarget / SetDepthRenderTarget, otherwise it prints an error and does nothing.
+void SetRenderTargetRect(std::vector<cmd> & vcmd, int x, int y, int w, int h);
+void SetShader(std::vector<cmd> & vcmd, std::string name, bool is_update, bool is_cull = false, bool is_enable_depth = false,
+	int depth_func = DEPTH_FUNC_DEFAULT);
+//mips : levels in data, the smaller ones packed after level 0 (oden_get_texture_level_offset).
+void SetTexture(std::vector<cmd> & vcmd, std::string name, int slot, int w = 0, int h = 0, void *data = nullptr, size_t size = 0, size_t stride_size = 0, int fmt = FMT_DEFAULT, int mips = 1);
+//Bind a texture of SetTexture from level miplevel, the finer levels are not read (they may not be uploaded yet).
+void SetTextureLevel(std::vector<cmd> & vcmd, std::string name, int slot, int miplevel);
 void SetTextureUav(std::vector<cmd> & vcmd, std::string name, int slot, int w = 0, int h = 0, int miplevel = 0, void *data = nullptr, size_t size = 0, size_t stride_size = 0);
 void SetVertex(std::vector<cmd> & vcmd, std::string name, void *data, size_t size, size_t stride_size);
+//Write size bytes at offset of a buffer of SetBuffer, in the order of the commands.
+void UpdateBuffer(std::vector<cmd> & vcmd, std::string name, size_t offset, const void *data, size_t size);
+//Write a rect of a level of a texture of SetTexture, rows stride_size apart (0 : packed).
+//is_copy false : data is not copied and must stay valid until the frame is presented.
+void UpdateTexture(std::vector<cmd> & vcmd, std::string name, int x, int y, int w, int h, const void *data, size_t size, size_t stride_size = 0, int miplevel = 0, bool is_copy = true);
 
 };
@@ -22,7 +22,7 @@
  */
 
 #include <stdio.h>
-#include <windows.h>
+#include <stdlib.h>
 #include <map>
 #include <vector>
 #include <string>
@@ -30,6 +30,7 @@
 #include <algorithm>
 
 #include "oden_util.h"
+#include "oden_platform.h"
 
 #include "MatrixStack.h"
 #include "Win.h"
@@ -81,20 +82,6 @@ struct vertex_format {
 	vector2 uv;
 };
 
-void
-GenerateMipmap(std::vector<oden::cmd> & vcmd, std::string name, int w, int h)
-{
-	using namespace odenutil;
-	//Generate Mipmap
-	SetShader(vcmd, "./shaders/genmipmap", false, false, false);
-	int miplevel = oden_get_mipmap_max(w, h);
-	for (int i = 1; i < miplevel; i++) {
-		SetTextureUav(vcmd, name, 0, 0, 0, i - 1, nullptr, 0);
-		SetTextureUav(vcmd, name, 1, 0, 0, i - 0, nullptr, 0);
-		Dispatch(vcmd, "mip" + name, (w >> i), (h >> i), 1);
-	}
-}
-
 int main()
 {
 	using namespace oden;
@@ -102,8 +89,6 @@ int main()
 	enum {
 		Width = 1280,
 		Height = 720,
-		BloomWidth = Width >> 2,
-		BloomHeight = Height >> 2,
 
 		BufferMax = 2,
 		ShaderSlotMax = 8,
@@ -164,6 +149,9 @@ int main()
 			vtex.push_back((x ^ y) * 1110);
 		}
 	}
+	//BC1 : 1/8 of the RGBA8 bytes to record, upload and sample.
+	static std::vector<uint8_t> vtex_bc;
+	EncodeBC(FMT_BC1_UNORM, vtex.data(), TextureWidth, TextureHeight, TextureWidth * sizeof(uint32_t), vtex_bc);
 
 	struct constdata {
 		vector4 time;
@@ -172,20 +160,46 @@ int main()
 		matrix4x4 proj;
 		matrix4x4 view;
 	};
-	struct bloominfo {
-		vector4 direction;
-	};
 	constdata cdata {};
 	constdata cdata2 {};
-	bloominfo binfoX {};
-	bloominfo binfoY {};
+	BloomParams bparams;
+	bparams.threshold = 0.5f;
+
+	//Dynamic resolution : the offscreen and bloom passes are drawn at a scale held to the gpu time.
+	//Off by default, the output stays the same on every machine. ODEN_TARGET_MS=<ms> turns it on at that gpu time of a frame
+	//and F4 at the default one.
+	DynamicResolutionParams drparams;
+	auto target_ms_str = getenv("ODEN_TARGET_MS");
+	if (target_ms_str && atof(target_ms_str) > 0.0)
+		drparams.target_ms = atof(target_ms_str);
+	bool is_dynamic_resolution = target_ms_str && atof(target_ms_str) > 0.0;
+	DynamicResolution dynamic_resolution(drparams);
+	struct presentinfo {
+		float uv0[4];
+		float uv1[4];
+	};
 
 	MatrixStack stack;
 	std::vector<cmd> vcmd;
 
 	auto tex_name = "testtex";
 	uint64_t frame = 0;
+	std::vector<frame_stats> vstats;
+	std::map<std::string, pass_stats> mpass_stats;
+	std::map<std::string, memory_stats> mmemory_stats;
+
+	//Headless : ODEN_READBACK=<file.ppm> dumps the last presented frame.
+	auto readback_name = getenv("ODEN_READBACK");
+	std::vector<uint32_t> vreadback;
+	uint32_t readback_w = 0;
+	uint32_t readback_h = 0;
+
+	//ODEN_TRACE=<file.json> records a trace for Perfetto / chrome://tracing.
+	auto trace_name = getenv("ODEN_TRACE");
+	if (trace_name)
+		oden_trace_start(trace_name);
 	while (Update()) {
+		auto record_start = oden_trace_get_time_ms();
 		auto buffer_index = frame % BufferMax;
 		auto index_name = std::to_string(buffer_index);
 		auto backbuffer_name = oden_get_backbuffer_name(buffer_index);
@@ -193,9 +207,6 @@ int main()
 		auto offscreen_depth_name = oden_get_depth_render_target_name(offscreen_name);
 		auto constant_name = "constcommon" + index_name;
 		auto constmip_name = "constmip" + index_name;
-		auto constbloom_name = "constbloom" + index_name;
-		auto bloomscreen_name = "bloomtexture" + index_name;
-		auto bloomscreen_nameX = bloomscreen_name + index_name + "_X";
 
 		bool is_update = false;
 
@@ -203,6 +214,28 @@ int main()
 			is_update = true;
 		}
 
+		//F1-F3 : frames in flight.
+		for (uint32_t i = 0; i < 3; i++)
+			if (GetAsyncKeyState(VK_F1 + i) & 0x0001)
+				oden_set_frames_in_flight(i + 1);
+
+		//F6-F8 : bloom quality, when the governor is off.
+		for (int i = 0; i < BLOOM_QUALITY_MAX; i++)
+			if (GetAsyncKeyState(VK_F6 + i) & 0x0001)
+				bparams.quality = i;
+
+		//F4 : dynamic resolution on / off.
+		if (GetAsyncKeyState(VK_F4) & 0x0001)
+			is_dynamic_resolution = !is_dynamic_resolution;
+		if (is_dynamic_resolution) {
+			bparams.scale = dynamic_resolution.GetScale();
+			bparams.quality = dynamic_resolution.GetBloomQuality();
+		} else {
+			bparams.scale = 1.0f;
+		}
+		int scaled_w = GetScaledSize(Width, bparams.scale);
+		int scaled_h = GetScaledSize(Height, bparams.scale);
+
 		cdata.time.data[0] = float (frame) / 1000.0f;
 		cdata.time.data[1] = 0.0;
 		cdata.time.data[2] = 1.0;
@@ -236,6 +269,7 @@ int main()
 			{1, 1, 1, 1},
 		};
 		SetRenderTarget(vcmd, offscreen_name, Width, Height);
+		SetRenderTargetRect(vcmd, 0, 0, scaled_w, scaled_h);
 		SetShader(vcmd, "./shaders/clear", is_update, false, false);
 		ClearRenderTarget(vcmd, offscreen_name, clear_color);
 		ClearDepthRenderTarget(vcmd, offscreen_name, 1.0f);
@@ -244,61 +278,49 @@ int main()
 		SetIndex(vcmd, "clear_ib", idx_rect, sizeof(idx_rect));
 		DrawIndex(vcmd, "clear_draw", 0, _countof(idx_rect));
 
-		//Draw Cube to offscreenbuffer.
+		//Depth prepass : depth of the cubes only, then each visible pixel is shaded once with depth equal.
+		SetDepthRenderTarget(vcmd, offscreen_name, Width, Height);
+		SetRenderTargetRect(vcmd, 0, 0, scaled_w, scaled_h);
 		ClearDepthRenderTarget(vcmd, offscreen_name, 1.0f);
 		SetShader(vcmd, "./shaders/model", is_update, false, true);
 		cdata.misc.data[0] = 0.0;
 		SetConstant(vcmd, constant_name, 0, &cdata, sizeof(cdata));
-		SetTexture(vcmd, tex_name, 0, TextureWidth, TextureHeight, vtex.data(), vtex.size() * sizeof(uint32_t), 256 * sizeof(uint32_t));
 		SetVertex(vcmd, "cube_vb", vtx_cube, sizeof(vtx_cube), sizeof(vertex_format));
 		SetIndex(vcmd, "cube_ib", idx_cube, sizeof(idx_cube));
 		DrawIndex(vcmd, "cube_draw", 0, _countof(idx_cube));
+		cdata.misc.data[0] = 1.0;
+		SetConstant(vcmd, constant_name + "head", 0, &cdata, sizeof(cdata));
+		DrawIndex(vcmd, "cube_draw", 0, _countof(idx_cube));
 
-		SetShader(vcmd, "./shaders/model", is_update, false, true);
+		//Draw Cube to offscreenbuffer.
+		SetRenderTarget(vcmd, offscreen_name, Width, Height);
+		SetRenderTargetRect(vcmd, 0, 0, scaled_w, scaled_h);
+		SetShader(vcmd, "./shaders/model", is_update, false, true, DEPTH_FUNC_EQUAL);
+		cdata.misc.data[0] = 0.0;
+		SetConstant(vcmd, constant_name, 0, &cdata, sizeof(cdata));
+		SetTexture(vcmd, tex_name, 0, TextureWidth, TextureHeight, vtex_bc.data(), vtex_bc.size(), vtex_bc.size() / ((TextureHeight + 3) / 4), FMT_BC1_UNORM);
+		SetVertex(vcmd, "cube_vb", vtx_cube, sizeof(vtx_cube), sizeof(vertex_format));
+		SetIndex(vcmd, "cube_ib", idx_cube, sizeof(idx_cube));
+		DrawIndex(vcmd, "cube_draw", 0, _countof(idx_cube));
+
+		SetShader(vcmd, "./shaders/model", is_update, false, true, DEPTH_FUNC_EQUAL);
 		cdata.misc.data[0] = 1.0;
 		SetConstant(vcmd, constant_name + "head", 0, &cdata, sizeof(cdata));
 		SetTexture(vcmd, tex_name, 0);
 		DrawIndex(vcmd, "cube_draw", 0, _countof(idx_cube));
 
-		GenerateMipmap(vcmd, offscreen_name, Width, Height);
+		//Bloom
+		bparams.is_update = is_update;
+		presentinfo pinfo;
+		auto bloomscreen_name = Bloom(vcmd, offscreen_name, "bloom" + index_name, Width, Height, bparams, pinfo.uv1);
+		GetScaledUv(Width, Height, scaled_w, scaled_h, pinfo.uv0);
 
-		//Create Bloom X
-		SetRenderTarget(vcmd, bloomscreen_nameX, BloomWidth, BloomHeight);
-		SetShader(vcmd, "./shaders/bloom", is_update, false, false);
-		ClearRenderTarget(vcmd, bloomscreen_nameX, clear_color);
-		ClearDepthRenderTarget(vcmd, bloomscreen_nameX, 1.0f);
-		SetTexture(vcmd, offscreen_name, 0);
-		SetVertex(vcmd, "present_vb", vtx_rect, sizeof(vtx_rect), sizeof(vertex_format));
-		SetIndex(vcmd, "present_ib", idx_rect, sizeof(idx_rect));
-		binfoX.direction.x = BloomWidth;
-		binfoX.direction.y = BloomHeight;
-		binfoX.direction.z = 1.0;
-		binfoX.direction.w = 0.0;
-		SetConstant(vcmd, constbloom_name + "X", 0, &binfoX, sizeof(binfoX));
-		DrawIndex(vcmd, "bloomX", 0, _countof(idx_rect));
-		GenerateMipmap(vcmd, bloomscreen_nameX, BloomWidth, BloomHeight);
-
-		//Create Bloom Y
-		SetRenderTarget(vcmd, bloomscreen_name, BloomWidth, BloomHeight);
-		SetShader(vcmd, "./shaders/bloom", is_update, false, false);
-		ClearRenderTarget(vcmd, bloomscreen_name, clear_color);
-		ClearDepthRenderTarget(vcmd, bloomscreen_name, 1.0f);
-		SetTexture(vcmd, bloomscreen_nameX, 0);
-		SetVertex(vcmd, "present_vb", vtx_rect, sizeof(vtx_rect), sizeof(vertex_format));
-		SetIndex(vcmd, "present_ib", idx_rect, sizeof(idx_rect));
-		binfoY.direction.x = BloomWidth;
-		binfoY.direction.y = BloomHeight;
-		binfoY.direction.z = 0.0;
-		binfoY.direction.w = 1.0;
-		SetConstant(vcmd, constbloom_name + "Y", 0, &binfoY, sizeof(binfoY));
-		DrawIndex(vcmd, "bloomY", 0, _countof(idx_rect));
-		GenerateMipmap(vcmd, bloomscreen_name, BloomWidth, BloomHeight);
-
-		//Draw offscreen buffer to present buffer.
+		//Draw offscreen buffer to present buffer, upscaled from the drawn rect.
 		SetRenderTarget(vcmd, backbuffer_name, Width, Height, true);
 		SetShader(vcmd, "./shaders/present", is_update, false, false);
 		ClearRenderTarget(vcmd, backbuffer_name, clear_color_present[frame & 1]);
 		ClearDepthRenderTarget(vcmd, backbuffer_name, 1.0f);
+		SetConstant(vcmd, "presentinfo" + index_name, 0, &pinfo, sizeof(pinfo));
 		SetTexture(vcmd, offscreen_name, 0);
 		SetTexture(vcmd, bloomscreen_name, 1);
 		SetVertex(vcmd, "present_vb", vtx_rect, sizeof(vtx_rect), sizeof(vertex_format));
@@ -315,14 +337,70 @@ int main()
 
 		//Present CMD to ODEN.
 		SetBarrierToPresent(vcmd, backbuffer_name);
+		oden_trace_event("record", "frame", record_start, oden_trace_get_time_ms());
 		oden_present_graphics(app_name, vcmd, hwnd, Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
 
 		vcmd.clear();
 		frame++;
+
+		if (readback_name)
+			oden_get_backbuffer_readback(vreadback, readback_w, readback_h);
+
+		if (oden_get_pass_stats(mpass_stats))
+			dynamic_resolution.Update(GetGpuFrameTime(mpass_stats));
+
+		oden_get_frame_stats(vstats);
+		if (vstats.size() >= 256) {
+			double wait_ms = 0.0;
+			double latency_ms = 0.0;
+			for (auto & x : vstats) {
+				wait_ms += x.cpu_wait_ms;
+				latency_ms += x.latency_ms;
+			}
+			printf("frames in flight=%u, cpu wait=%.3fms, latency=%.3fms\n",
+				vstats.back().frames_in_flight, wait_ms / vstats.size(), latency_ms / vstats.size());
+			vstats.clear();
+
+			//Where the frame goes, per draw / dispatch name.
+			for (auto & x : mpass_stats)
+				printf("  %-24s count=%4u, cpu=%.3fms, gpu=%.3fms\n",
+					x.first.c_str(), x.second.count, x.second.cpu_ms, x.second.gpu_ms);
+			if (is_dynamic_resolution)
+				printf("  dynamic resolution scale=%.2f (%dx%d), bloom quality=%d\n",
+					bparams.scale, scaled_w, scaled_h, bparams.quality);
+
+			uint64_t memory_total = 0;
+			uint64_t memory_high_water = 0;
+			oden_get_memory_stats(mmemory_stats, memory_high_water);
+			for (auto & x : mmemory_stats)
+				memory_total += x.second.bytes;
+			printf("memory=%.2fMB, high water=%.2fMB, resources=%zu\n",
+				memory_total / 1048576.0, memory_high_water / 1048576.0, mmemory_stats.size());
+		}
 	}
 
+	//ODEN_MEMORY_CSV=<file.csv> dumps the resources alive at the end.
+	auto memory_csv_name = getenv("ODEN_MEMORY_CSV");
+	if (memory_csv_name)
+		oden_write_memory_stats_csv(memory_csv_name);
+
 	//Terminate Oden.
 	oden_present_graphics(app_name, vcmd, nullptr, Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
+	if (trace_name)
+		oden_trace_stop();
+
+	if (readback_name && oden_get_backbuffer_readback(vreadback, readback_w, readback_h)) {
+		FILE *fp = fopen(readback_name, "wb");
+		if (fp) {
+			fprintf(fp, "P6\n%u %u\n255\n", readback_w, readback_h);
+			for (auto & x : vreadback) {
+				uint8_t rgb[3] = {uint8_t(x >> 16), uint8_t(x >> 8), uint8_t(x)};
+				fwrite(rgb, 1, sizeof(rgb), fp);
+			}
+			fclose(fp);
+			printf("readback : %s %ux%u\n", readback_name, readback_w, readback_h);
+		}
+	}
 	return 0;
 }
 
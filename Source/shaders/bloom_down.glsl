@@ -23,10 +23,12 @@
 
 #version 450 core
 
-
+//Bloom downsample (dual filter). odenutil::Bloom draws one pass per level.
 layout(binding=0) uniform sampler2D tex0;
 layout(binding=1) uniform buf {
-	vec4 direction;
+	vec4 texel; //xy : texel size of tex0, z : threshold, w : scale
+	vec4 uv0;   //xy : uv scale of the drawn rect of tex0, zw : max uv in it, xy - zw the min (dynamic resolution)
+	vec4 uv1;   //of tex1, bloom_up only
 } ubuf;
 
 #ifdef _VS_
@@ -56,39 +58,28 @@ layout(location=2) in vec2 v_uv;
 
 layout(location=0) out vec4 out_color;
 
-//https://github.com/Jam3/glsl-fast-gaussian-blur/
-vec4 blur13(vec2 uv, vec2 resolution, vec2 direction, float miplevel)
+//bilinear tap of tex0 inside its drawn rect.
+vec4 tap0(vec2 uv)
 {
-	vec4 color = vec4(0.0);
-	vec2 off1 = 1.411764705882353 * direction;
-	vec2 off2 = 3.2941176470588234 * direction;
-	vec2 off3 = 5.176470588235294 * direction;
-	color += texture(tex0, uv, miplevel) * 0.1964825501511404;
-	color += texture(tex0, uv + (off1 / resolution), miplevel) * 0.2969069646728344;
-	color += texture(tex0, uv - (off1 / resolution), miplevel) * 0.2969069646728344;
-	color += texture(tex0, uv + (off2 / resolution), miplevel) * 0.09447039785044732;
-	color += texture(tex0, uv - (off2 / resolution), miplevel) * 0.09447039785044732;
-	color += texture(tex0, uv + (off3 / resolution), miplevel) * 0.010381362401148057;
-	color += texture(tex0, uv - (off3 / resolution), miplevel) * 0.010381362401148057;
-	color.a = 1.0;
-	return color;
+	return textureLod(tex0, clamp(uv, ubuf.uv0.xy - ubuf.uv0.zw, ubuf.uv0.zw), 0.0);
 }
 
-
+//5 bilinear taps : the center and the 4 diagonal texel corners.
 void main() {
-	vec2 uv = v_uv;
-	vec2 dir = ubuf.direction.zw;
-	vec2 rtsize = ubuf.direction.xy;
-	vec4 col = vec4(0, 0, 0, 0);
+	vec2 uv = v_uv * ubuf.uv0.xy;
+	vec2 o = ubuf.texel.xy;
+	vec4 col = tap0(uv) * 4.0;
+	col += tap0(uv + vec2(-o.x, -o.y));
+	col += tap0(uv + vec2( o.x, -o.y));
+	col += tap0(uv + vec2(-o.x,  o.y));
+	col += tap0(uv + vec2( o.x,  o.y));
+	col *= (1.0 / 8.0);
 
-	const int MAX_LEVEL = 10;
-	const float INV_MAX_LEVEL = (1.0 / float(MAX_LEVEL));
-	for (int i = MAX_LEVEL ; i >= 0; i--)
-	{
-		float level  = float(i);
-		col += blur13(uv, rtsize, dir, level);
-		col *= 0.5;
-	}
+	//Soft threshold by the brightest channel. 0 keeps the color.
+	float br = max(col.r, max(col.g, col.b));
+	col.rgb *= max(br - ubuf.texel.z, 0.0) / max(br, 0.0001);
+	col.rgb *= ubuf.texel.w;
+	col.a = 1.0;
 	out_color = col;
 }
 #endif //_PS_
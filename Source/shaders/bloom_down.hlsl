@@ -21,13 +21,16 @@
  *
  */
 
+//Bloom downsample (dual filter). odenutil::Bloom draws one pass per level.
 Texture2D<float4> tex0 : register(t0);
 SamplerState PointSampler : register(s0);
 SamplerState LinearSampler : register(s1);
 
 cbuffer binfo : register(b0)
 {
-	float4 direction;
+	float4 texel; //xy : texel size of tex0, z : threshold, w : scale
+	float4 uv0;   //xy : uv scale of the drawn rect of tex0, zw : max uv in it, xy - zw the min (dynamic resolution)
+	float4 uv1;   //of tex1, bloom_up only
 };
 
 struct PSInput {
@@ -46,38 +49,27 @@ PSInput VSMain(
 	return result;
 }
 
-//https://github.com/Jam3/glsl-fast-gaussian-blur/
-float4 blur13(Texture2D<float4> image, float2 uv, float2 resolution, float2 direction, float miplevel)
+//bilinear tap of tex0 inside its drawn rect.
+float4 tap0(float2 uv)
 {
-	float4 color = 0;
-	float2 off1 = 1.411764705882353 * direction;
-	float2 off2 = 3.2941176470588234 * direction;
-	float2 off3 = 5.176470588235294 * direction;
-	color += tex0.SampleLevel(LinearSampler, uv, miplevel) * 0.1964825501511404;
-	color += tex0.SampleLevel(LinearSampler, uv + (off1 / resolution), miplevel) * 0.2969069646728344;
-	color += tex0.SampleLevel(LinearSampler, uv - (off1 / resolution), miplevel) * 0.2969069646728344;
-	color += tex0.SampleLevel(LinearSampler, uv + (off2 / resolution), miplevel) * 0.09447039785044732;
-	color += tex0.SampleLevel(LinearSampler, uv - (off2 / resolution), miplevel) * 0.09447039785044732;
-	color += tex0.SampleLevel(LinearSampler, uv + (off3 / resolution), miplevel) * 0.010381362401148057;
-	color += tex0.SampleLevel(LinearSampler, uv - (off3 / resolution), miplevel) * 0.010381362401148057;
-	color.a = 1.0;
-	return color;
+	return tex0.SampleLevel(LinearSampler, clamp(uv, uv0.xy - uv0.zw, uv0.zw), 0.0);
 }
 
+//5 bilinear taps : the center and the 4 diagonal texel corners.
 float4 PSMain(PSInput input) : SV_TARGET {
-	float2 uv = input.uv;
-	float2 dir = direction.zw;
-	float2 rtsize = direction.xy;
-	float4 col = float4(0, 0, 0, 0);
-
-	const int MAX_LEVEL = 10;
-	const float INV_MAX_LEVEL = (1.0 / float(MAX_LEVEL));
-	for (int i = MAX_LEVEL ; i >= 0; i--)
-	{
-		float level  = float(i);
-		col += blur13(tex0, uv, rtsize, dir, level);
-		col *= 0.5;
-	}
+	float2 uv = input.uv * uv0.xy;
+	float2 o = texel.xy;
+	float4 col = tap0(uv) * 4.0;
+	col += tap0(uv + float2(-o.x, -o.y));
+	col += tap0(uv + float2( o.x, -o.y));
+	col += tap0(uv + float2(-o.x,  o.y));
+	col += tap0(uv + float2( o.x,  o.y));
+	col *= (1.0 / 8.0);
 
+	//Soft threshold by the brightest channel. 0 keeps the color.
+	float br = max(col.r, max(col.g, col.b));
+	col.rgb *= max(br - texel.z, 0.0) / max(br, 0.0001);
+	col.rgb *= texel.w;
+	col.a = 1.0;
 	return col;
 }
@@ -0,0 +1,88 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#version 450 core
+
+//Bloom upsample (dual filter). Adds the blurred lower level to the downsampled one of this size.
+layout(binding=0) uniform sampler2D tex0;
+layout(binding=3) uniform sampler2D tex1;
+layout(binding=1) uniform buf {
+	vec4 texel; //xy : texel size of tex0, z : threshold, w : scale
+	vec4 uv0;   //xy : uv scale of the drawn rect of tex0, zw : max uv in it, xy - zw the min (dynamic resolution)
+	vec4 uv1;   //the same of tex1
+} ubuf;
+
+#ifdef _VS_
+layout(location=0) in vec4 position;
+layout(location=1) in vec3 normal;
+layout(location=2) in vec2 uv;
+
+layout(location=0) out vec4 v_pos;
+layout(location=1) out vec3 v_nor;
+layout(location=2) out vec2 v_uv;
+
+void main()
+{
+	v_pos = position;
+	v_nor = vec3(0, 0, 1);
+	v_uv = uv;
+	gl_Position = v_pos;
+}
+#endif //_VS_
+
+
+#ifdef _PS_
+
+layout(location=0) in vec4 v_pos;
+layout(location=1) in vec3 v_nor;
+layout(location=2) in vec2 v_uv;
+
+layout(location=0) out vec4 out_color;
+
+//bilinear tap of tex0 inside its drawn rect.
+vec4 tap0(vec2 uv)
+{
+	return textureLod(tex0, clamp(uv, ubuf.uv0.xy - ubuf.uv0.zw, ubuf.uv0.zw), 0.0);
+}
+
+//8 bilinear taps : 4 at one texel on the axes, 4 at half a texel on the diagonals weighted twice.
+void main() {
+	vec2 uv = v_uv * ubuf.uv0.xy;
+	vec2 o = ubuf.texel.xy;
+	vec2 h = o * 0.5;
+	vec4 col = vec4(0.0);
+	col += tap0(uv + vec2(-o.x, 0.0));
+	col += tap0(uv + vec2( o.x, 0.0));
+	col += tap0(uv + vec2(0.0, -o.y));
+	col += tap0(uv + vec2(0.0,  o.y));
+	col += tap0(uv + vec2(-h.x, -h.y)) * 2.0;
+	col += tap0(uv + vec2( h.x, -h.y)) * 2.0;
+	col += tap0(uv + vec2(-h.x,  h.y)) * 2.0;
+	col += tap0(uv + vec2( h.x,  h.y)) * 2.0;
+	col *= (1.0 / 12.0);
+	col += textureLod(tex1, v_uv * ubuf.uv1.xy, 0.0);
+	col.rgb *= ubuf.texel.w;
+	col.a = 1.0;
+	out_color = col;
+}
+#endif //_PS_
@@ -0,0 +1,78 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Bloom upsample (dual filter). Adds the blurred lower level to the downsampled one of this size.
+Texture2D<float4> tex0 : register(t0);
+Texture2D<float4> tex1 : register(t1);
+SamplerState PointSampler : register(s0);
+SamplerState LinearSampler : register(s1);
+
+cbuffer binfo : register(b0)
+{
+	float4 texel; //xy : texel size of tex0, z : threshold, w : scale
+	float4 uv0;   //xy : uv scale of the drawn rect of tex0, zw : max uv in it, xy - zw the min (dynamic resolution)
+	float4 uv1;   //the same of tex1
+};
+
+struct PSInput {
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD0;
+};
+
+PSInput VSMain(
+	float4 position : POSITION,
+	float3 normal : NORMAL,
+	float2 uv : TEXCOORD)
+{
+	PSInput result = (PSInput)0;
+	result.position = position;
+	result.uv = uv;
+	return result;
+}
+
+//bilinear tap of tex0 inside its drawn rect.
+float4 tap0(float2 uv)
+{
+	return tex0.SampleLevel(LinearSampler, clamp(uv, uv0.xy - uv0.zw, uv0.zw), 0.0);
+}
+
+//8 bilinear taps : 4 at one texel on the axes, 4 at half a texel on the diagonals weighted twice.
+float4 PSMain(PSInput input) : SV_TARGET {
+	float2 uv = input.uv * uv0.xy;
+	float2 o = texel.xy;
+	float2 h = o * 0.5;
+	float4 col = 0;
+	col += tap0(uv + float2(-o.x, 0.0));
+	col += tap0(uv + float2( o.x, 0.0));
+	col += tap0(uv + float2(0.0, -o.y));
+	col += tap0(uv + float2(0.0,  o.y));
+	col += tap0(uv + float2(-h.x, -h.y)) * 2.0;
+	col += tap0(uv + float2( h.x, -h.y)) * 2.0;
+	col += tap0(uv + float2(-h.x,  h.y)) * 2.0;
+	col += tap0(uv + float2( h.x,  h.y)) * 2.0;
+	col *= (1.0 / 12.0);
+	col += tex1.SampleLevel(LinearSampler, input.uv * uv1.xy, 0.0);
+	col.rgb *= texel.w;
+	col.a = 1.0;
+	return col;
+}
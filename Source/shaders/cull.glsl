@@ -0,0 +1,108 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#version 450
+
+//GPU culling (CullInstances). An instance per thread against the frustum, then against the Hi-Z (BuildHiZ).
+//Visible ones add to the instance count of the DrawIndexIndirect arguments and append their index.
+//Buffers are at oden_get_buffer_binding : slot 0 SRV 64, slot 2 UAV 69, slot 3 UAV 71.
+layout(binding = 1) uniform cullinfo {
+	mat4 view;
+	mat4 proj;
+	vec4 hiz;    //w, h, levels, w 1 : occlusion test.
+	uvec4 count; //x : instances
+} info;
+layout(binding = 3) uniform sampler2D hiz;
+layout(std430, binding = 64) readonly buffer bounds_buf {
+	vec4 bounds[]; //xyz center, w radius.
+};
+layout(std430, binding = 69) buffer args_buf {
+	uint args[]; //draw_index_indirect_args
+};
+layout(std430, binding = 71) buffer visible_buf {
+	uint visible[];
+};
+
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= info.count.x)
+		return;
+	vec4 sphere = bounds[index];
+
+	//corners of the box around the sphere. Culled when all are out of one plane.
+	uint outside[6] = uint[6](0, 0, 0, 0, 0, 0);
+	bool is_behind = false;
+	vec2 ndc_min = vec2(1.0);
+	vec2 ndc_max = vec2(-1.0);
+	float z_min = 1.0;
+	for (uint i = 0; i < 8; i++) {
+		vec3 corner = sphere.xyz + vec3(
+			(i & 1) != 0 ? sphere.w : -sphere.w,
+			(i & 2) != 0 ? sphere.w : -sphere.w,
+			(i & 4) != 0 ? sphere.w : -sphere.w);
+		vec4 p = info.proj * info.view * vec4(corner, 1.0);
+		outside[0] += p.x < -p.w ? 1 : 0;
+		outside[1] += p.x > p.w ? 1 : 0;
+		outside[2] += p.y < -p.w ? 1 : 0;
+		outside[3] += p.y > p.w ? 1 : 0;
+		outside[4] += p.z < 0.0 ? 1 : 0;
+		outside[5] += p.z > p.w ? 1 : 0;
+		if (p.w <= 0.0) {
+			is_behind = true;
+			continue;
+		}
+		ndc_min = min(ndc_min, p.xy / p.w);
+		ndc_max = max(ndc_max, p.xy / p.w);
+		z_min = min(z_min, p.z / p.w);
+	}
+	for (uint k = 0; k < 6; k++)
+		if (outside[k] == 8)
+			return;
+
+	//the level where the rect is 2x2 texels at most. Occluded if it is behind the farthest depth of them.
+	//Vulkan rows go down with y.
+	if (!is_behind && info.hiz.w > 0.5) {
+		ivec2 size = ivec2(info.hiz.xy);
+		//the view of a render target can have fewer levels than the texture.
+		int levels = min(int(info.hiz.z), textureQueryLevels(hiz));
+		ivec2 t0 = clamp(ivec2(floor((ndc_min * 0.5 + 0.5) * info.hiz.xy)), ivec2(0), size - 1);
+		ivec2 t1 = clamp(ivec2(floor((ndc_max * 0.5 + 0.5) * info.hiz.xy)), ivec2(0), size - 1);
+		int level = 0;
+		while (any(greaterThan((t1 >> level) - (t0 >> level), ivec2(1))))
+			level++;
+		if (level < levels) {
+			ivec2 last = max(size >> level, ivec2(1)) - 1;
+			float d = texelFetch(hiz, min(t0 >> level, last), level).x;
+			d = max(d, texelFetch(hiz, min(ivec2(t1.x, t0.y) >> level, last), level).x);
+			d = max(d, texelFetch(hiz, min(ivec2(t0.x, t1.y) >> level, last), level).x);
+			d = max(d, texelFetch(hiz, min(t1 >> level, last), level).x);
+			if (z_min > d)
+				return;
+		}
+	}
+
+	uint slot = atomicAdd(args[1], 1);
+	visible[slot] = index;
+}
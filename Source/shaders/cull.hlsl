@@ -0,0 +1,104 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//GPU culling (CullInstances). An instance per thread against the frustum, then against the Hi-Z (BuildHiZ).
+//Visible ones add to the instance count of the DrawIndexIndirect arguments and append their index.
+ByteAddressBuffer bounds : register(t0);     //float4 : xyz center, w radius.
+Texture2D<float> hiz : register(t1);
+RWByteAddressBuffer args : register(u2);     //draw_index_indirect_args
+RWByteAddressBuffer visible : register(u3);  //uint per visible instance.
+
+cbuffer cullinfo : register(b0)
+{
+	float4x4 view;
+	float4x4 proj;
+	float4 hizinfo; //w, h, levels, w 1 : occlusion test.
+	uint4 count;    //x : instances
+};
+
+[numthreads(64, 1, 1)]
+void CSMain(uint3 dispatchThreadId : SV_DispatchThreadID)
+{
+	uint index = dispatchThreadId.x;
+	if (index >= count.x)
+		return;
+	float4 sphere = asfloat(bounds.Load4(index * 16));
+
+	//corners of the box around the sphere. Culled when all are out of one plane.
+	uint outside[6] = {0, 0, 0, 0, 0, 0};
+	bool is_behind = false;
+	float2 ndc_min = float2(1, 1);
+	float2 ndc_max = float2(-1, -1);
+	float z_min = 1;
+	for (uint i = 0; i < 8; i++) {
+		float3 corner = sphere.xyz + float3(
+			(i & 1) ? sphere.w : -sphere.w,
+			(i & 2) ? sphere.w : -sphere.w,
+			(i & 4) ? sphere.w : -sphere.w);
+		float4 p = mul(float4(corner, 1), transpose(view));
+		p = mul(p, transpose(proj));
+		outside[0] += p.x < -p.w ? 1 : 0;
+		outside[1] += p.x > p.w ? 1 : 0;
+		outside[2] += p.y < -p.w ? 1 : 0;
+		outside[3] += p.y > p.w ? 1 : 0;
+		outside[4] += p.z < 0 ? 1 : 0;
+		outside[5] += p.z > p.w ? 1 : 0;
+		if (p.w <= 0) {
+			is_behind = true;
+			continue;
+		}
+		ndc_min = min(ndc_min, p.xy / p.w);
+		ndc_max = max(ndc_max, p.xy / p.w);
+		z_min = min(z_min, p.z / p.w);
+	}
+	for (uint k = 0; k < 6; k++)
+		if (outside[k] == 8)
+			return;
+
+	//the level where the rect is 2x2 texels at most. Occluded if it is behind the farthest depth of them.
+	if (!is_behind && hizinfo.w > 0.5) {
+		int2 size = int2(hizinfo.xy);
+		//the view of a render target can have fewer levels than the texture.
+		uint hw, hh, hlevels;
+		hiz.GetDimensions(0, hw, hh, hlevels);
+		int levels = min(int(hizinfo.z), int(hlevels));
+		int2 t0 = clamp(int2(floor(float2(ndc_min.x * 0.5 + 0.5, 0.5 - ndc_max.y * 0.5) * hizinfo.xy)), 0, size - 1);
+		int2 t1 = clamp(int2(floor(float2(ndc_max.x * 0.5 + 0.5, 0.5 - ndc_min.y * 0.5) * hizinfo.xy)), 0, size - 1);
+		int level = 0;
+		while (any((t1 >> level) - (t0 >> level) > 1))
+			level++;
+		if (level < levels) {
+			int2 last = max(size >> level, 1) - 1;
+			float d = hiz.Load(int3(min(t0 >> level, last), level));
+			d = max(d, hiz.Load(int3(min(int2(t1.x, t0.y) >> level, last), level)));
+			d = max(d, hiz.Load(int3(min(int2(t0.x, t1.y) >> level, last), level)));
+			d = max(d, hiz.Load(int3(min(t1 >> level, last), level)));
+			if (z_min > d)
+				return;
+		}
+	}
+
+	uint slot;
+	args.InterlockedAdd(4, 1, slot);
+	visible.Store(slot * 4, index);
+}
@@ -0,0 +1,61 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+#version 450 core
+
+//Directional light of the G-buffer of gbuffer.glsl. tex0 albedo, tex1 normal, tex2 depth.
+layout(binding=0) uniform sampler2D tex0;
+layout(binding=3) uniform sampler2D tex1;
+layout(binding=6) uniform sampler2D tex2;
+
+#ifdef _VS_
+layout(location=0) in vec4 position;
+layout(location=1) in vec3 normal;
+layout(location=2) in vec2 uv;
+layout(location=0) out vec2 v_uv;
+
+void main()
+{
+	v_uv = uv;
+	gl_Position = position;
+}
+#endif //_VS_
+
+#ifdef _PS_
+layout(location=0) in vec2 v_uv;
+layout(location=0) out vec4 out_color;
+
+void main()
+{
+	vec4 albedo = textureLod(tex0, v_uv, 0.0);
+	vec4 normal = textureLod(tex1, v_uv, 0.0);
+	float depth = textureLod(tex2, v_uv, 0.0).x;
+	if (normal.w == 0.0) {
+		out_color = albedo;
+		return;
+	}
+	vec3 n = normalize(normal.xyz * 2.0 - 1.0);
+	vec3 l = normalize(vec3(0.5, 1.0, 0.3));
+	vec3 col = albedo.xyz * (0.3 + 0.7 * max(dot(n, l), 0.0));
+	out_color = vec4(mix(col, vec3(0.0, 0.2, 0.3), pow(depth, 64.0)), 1.0);
+}
+#endif //_PS_
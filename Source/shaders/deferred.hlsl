@@ -0,0 +1,57 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Directional light of the G-buffer of gbuffer.hlsl. tex0 albedo, tex1 normal, tex2 depth.
+Texture2D<float4> tex0 : register(t0);
+Texture2D<float4> tex1 : register(t1);
+Texture2D<float4> tex2 : register(t2);
+SamplerState PointSampler   : register(s0);
+SamplerState LinearSampler  : register(s1);
+
+struct PSInput {
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD0;
+};
+
+PSInput VSMain(
+	float4 position : POSITION,
+	float3 normal : NORMAL,
+	float2 uv : TEXCOORD)
+{
+	PSInput result = (PSInput)0;
+	result.position = position;
+	result.uv = uv;
+	return result;
+}
+
+float4 PSMain(PSInput input) : SV_TARGET {
+	float4 albedo = tex0.SampleLevel(PointSampler, input.uv, 0.0);
+	float4 normal = tex1.SampleLevel(PointSampler, input.uv, 0.0);
+	float depth = tex2.SampleLevel(PointSampler, input.uv, 0.0).x;
+	if (normal.w == 0.0)
+		return albedo;
+	float3 n = normalize(normal.xyz * 2.0 - 1.0);
+	float3 l = normalize(float3(0.5, 1.0, 0.3));
+	float3 col = albedo.xyz * (0.3 + 0.7 * max(dot(n, l), 0.0));
+	return float4(lerp(col, float3(0.0, 0.2, 0.3), pow(depth, 64.0)), 1.0);
+}
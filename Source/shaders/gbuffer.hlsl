@@ -0,0 +1,73 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//model.hlsl into a G-buffer of three targets in one pass.
+Texture2D<float4> tex0 : register(t0);
+SamplerState PointSampler   : register(s0);
+SamplerState LinearSampler  : register(s1);
+
+cbuffer constdata : register(b0)
+{
+	float4 time;
+	float4 misc;
+	float4x4 world;
+	float4x4 proj;
+	float4x4 view;
+};
+
+struct PSInput {
+	float4 position : SV_POSITION;
+	float3 normal : NORMAL0;
+	float2 uv : TEXCOORD0;
+	float4 pos : TEXCOORD1;
+};
+
+struct PSOutput {
+	float4 albedo : SV_TARGET0;
+	float4 normal : SV_TARGET1;
+	float4 depth : SV_TARGET2;
+};
+
+PSInput VSMain(
+	float4 position : POSITION,
+	float3 normal : NORMAL,
+	float2 uv : TEXCOORD)
+{
+	PSInput result = (PSInput)0;
+	result.position = float4(position.xyz, 1.0);
+	result.normal = mul(float4(normal, 0.0), transpose(world)).xyz;
+	result.uv = uv;
+	result.position = mul(result.position, transpose(world));
+	result.position = mul(result.position, transpose(view ));
+	result.position = mul(result.position, transpose(proj ));
+	result.pos = result.position;
+	return result;
+}
+
+PSOutput PSMain(PSInput input) {
+	PSOutput output;
+	output.albedo = tex0.SampleLevel(LinearSampler, input.uv, 0) + float4(0.1, 0.2, 0.3, 1.0);
+	output.normal = float4(normalize(input.normal) * 0.5 + 0.5, 1.0);
+	output.depth = float4(input.pos.z / input.pos.w, 0.0, 0.0, 0.0);
+	return output;
+}
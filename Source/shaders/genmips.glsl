@@ -0,0 +1,134 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#version 450
+
+//Single pass downsampler of CMD_GENERATE_MIPS.
+//A 256 thread group box filters a 64x64 tile of mip 0 down to mip 6 through shared memory.
+//The last group to finish (counter) builds the levels after mip 6.
+#define GENMIPS_MAX 16
+
+layout(push_constant) uniform genmips_info {
+	uint mips;   //levels of the texture, including mip 0.
+	uint groups; //work groups of the dispatch.
+} info;
+
+layout(binding = 0, rgba16f) coherent uniform image2D mip[GENMIPS_MAX];
+layout(binding = 1) coherent buffer genmips_counter {
+	uint counter;
+};
+
+shared vec4 lds[32][32];
+shared bool is_last;
+
+vec4 reduce(vec4 a, vec4 b, vec4 c, vec4 d)
+{
+	return (a + b + c + d) * 0.25;
+}
+
+//Out of bounds image access is undefined without robustness, so clamp loads and skip stores.
+ivec2 mip_size(uint level)
+{
+	return max(imageSize(mip[0]) >> int(level), ivec2(1));
+}
+
+vec4 load(uint level, ivec2 p)
+{
+	return imageLoad(mip[level], min(p, mip_size(level) - 1));
+}
+
+void store(uint level, ivec2 p, vec4 c)
+{
+	if (all(lessThan(p, mip_size(level))))
+		imageStore(mip[level], p, c);
+}
+
+vec4 reduce_image(uint level, ivec2 src)
+{
+	return reduce(
+			load(level, src + ivec2(0, 0)), load(level, src + ivec2(1, 0)),
+			load(level, src + ivec2(0, 1)), load(level, src + ivec2(1, 1)));
+}
+
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+void main()
+{
+	ivec2 t = ivec2(gl_LocalInvocationID.xy);
+	ivec2 group = ivec2(gl_WorkGroupID.xy);
+
+	//mip 1 : 2x2 texels per invocation, 32x32 per group.
+	for (int j = 0; j < 4; j++) {
+		ivec2 l = t * 2 + ivec2(j & 1, j >> 1);
+		ivec2 dst = group * 32 + l;
+		vec4 c = reduce_image(0, dst * 2);
+		if (info.mips > 1)
+			store(1, dst, c);
+		lds[l.y][l.x] = c;
+	}
+	memoryBarrierShared();
+	barrier();
+
+	//mip 2 - 6 : the tile halves every level.
+	for (uint level = 2; level <= 6; level++) {
+		int size = 64 >> level;
+		vec4 c = vec4(0);
+		bool is_active = t.x < size && t.y < size;
+		if (is_active) {
+			ivec2 src = t * 2;
+			c = reduce(
+					lds[src.y + 0][src.x + 0], lds[src.y + 0][src.x + 1],
+					lds[src.y + 1][src.x + 0], lds[src.y + 1][src.x + 1]);
+			if (level < info.mips)
+				store(level, group * size + t, c);
+		}
+		barrier();
+		if (is_active)
+			lds[t.y][t.x] = c;
+		memoryBarrierShared();
+		barrier();
+	}
+	if (info.mips <= 7)
+		return;
+
+	//Publish mip 6 before counting this group.
+	memoryBarrierImage();
+	barrier();
+	if (gl_LocalInvocationIndex == 0)
+		is_last = atomicAdd(counter, 1) == info.groups - 1;
+	memoryBarrierShared();
+	barrier();
+	if (!is_last)
+		return;
+	if (gl_LocalInvocationIndex == 0)
+		counter = 0;
+
+	for (uint level = 7; level < info.mips; level++) {
+		ivec2 size = mip_size(level);
+		for (int i = int(gl_LocalInvocationIndex); i < size.x * size.y; i += 256) {
+			ivec2 dst = ivec2(i % size.x, i / size.x);
+			store(level, dst, reduce_image(level - 1, dst * 2));
+		}
+		memoryBarrierImage();
+		barrier();
+	}
+}
@@ -0,0 +1,123 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Single pass downsampler of CMD_GENERATE_MIPS.
+//A 256 thread group box filters a 64x64 tile of mip 0 down to mip 6 through groupshared memory.
+//The last group to finish (counter) builds the levels after mip 6.
+#define GENMIPS_MAX 16
+
+cbuffer genmips_info : register(b0)
+{
+	uint mips;   //levels of the texture, including mip 0.
+	uint groups; //thread groups of the dispatch.
+};
+
+globallycoherent RWTexture2D<float4> mip[GENMIPS_MAX] : register(u0);
+globallycoherent RWStructuredBuffer<uint> counter : register(u0, space1);
+
+groupshared float4 lds[32][32];
+groupshared uint is_last;
+
+float4
+reduce(float4 a, float4 b, float4 c, float4 d)
+{
+	return (a + b + c + d) * 0.25;
+}
+
+[numthreads(16, 16, 1)]
+void CSMain(
+	uint3 groupId : SV_GroupID,
+	uint3 groupThreadId : SV_GroupThreadID,
+	uint groupIndex : SV_GroupIndex)
+{
+	uint2 t = groupThreadId.xy;
+
+	//mip 1 : 2x2 texels per thread, 32x32 per group.
+	[unroll]
+	for (uint j = 0; j < 4; j++) {
+		uint2 l = t * 2 + uint2(j & 1, j >> 1);
+		uint2 dst = groupId.xy * 32 + l;
+		uint2 src = dst * 2;
+		float4 c = reduce(
+				mip[0][src + uint2(0, 0)], mip[0][src + uint2(1, 0)],
+				mip[0][src + uint2(0, 1)], mip[0][src + uint2(1, 1)]);
+		if (mips > 1)
+			mip[1][dst] = c;
+		lds[l.y][l.x] = c;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	//mip 2 - 6 : the tile halves every level.
+	[unroll]
+	for (uint level = 2; level <= 6; level++) {
+		uint size = 64 >> level;
+		float4 c = 0;
+		bool is_active = t.x < size && t.y < size;
+		if (is_active) {
+			uint2 src = t * 2;
+			c = reduce(
+					lds[src.y + 0][src.x + 0], lds[src.y + 0][src.x + 1],
+					lds[src.y + 1][src.x + 0], lds[src.y + 1][src.x + 1]);
+			if (level < mips)
+				mip[level][groupId.xy * size + t] = c;
+		}
+		GroupMemoryBarrierWithGroupSync();
+		if (is_active)
+			lds[t.y][t.x] = c;
+		GroupMemoryBarrierWithGroupSync();
+	}
+	if (mips <= 7)
+		return;
+
+	//Publish mip 6 before counting this group.
+	DeviceMemoryBarrierWithGroupSync();
+	if (groupIndex == 0) {
+		uint prev = 0;
+		InterlockedAdd(counter[0], 1, prev);
+		is_last = prev == groups - 1;
+	}
+	GroupMemoryBarrierWithGroupSync();
+	if (!is_last)
+		return;
+	if (groupIndex == 0)
+		counter[0] = 0;
+
+	uint width;
+	uint height;
+	mip[0].GetDimensions(width, height);
+	[unroll]
+	for (uint level = 7; level < GENMIPS_MAX; level++) {
+		if (level < mips) {
+			uint w = max(width >> level, 1);
+			uint h = max(height >> level, 1);
+			for (uint i = groupIndex; i < w * h; i += 256) {
+				uint2 dst = uint2(i % w, i / w);
+				uint2 src = dst * 2;
+				mip[level][dst] = reduce(
+						mip[level - 1][src + uint2(0, 0)], mip[level - 1][src + uint2(1, 0)],
+						mip[level - 1][src + uint2(0, 1)], mip[level - 1][src + uint2(1, 1)]);
+			}
+		}
+		DeviceMemoryBarrierWithGroupSync();
+	}
+}
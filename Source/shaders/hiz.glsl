@@ -0,0 +1,48 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#version 450
+
+//A level of the Hi-Z from the one above, as genmipmap. The farthest depth of the texels below,
+//with the last row / column of an odd size.
+layout(binding = 2, r32f) uniform image2D tex0;
+layout(binding = 5, r32f) uniform image2D tex1;
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+void main()
+{
+	ivec2 src_size = imageSize(tex0);
+	ivec2 dst_size = imageSize(tex1);
+	ivec2 loc_dst = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(loc_dst, dst_size)))
+		return;
+	ivec2 last = loc_dst * 2 + ivec2(
+		(loc_dst.x == dst_size.x - 1 && (src_size.x & 1) != 0) ? 2 : 1,
+		(loc_dst.y == dst_size.y - 1 && (src_size.y & 1) != 0) ? 2 : 1);
+	last = min(last, src_size - 1);
+	float d = 0.0;
+	for (int y = loc_dst.y * 2; y <= last.y; y++)
+		for (int x = loc_dst.x * 2; x <= last.x; x++)
+			d = max(d, imageLoad(tex0, ivec2(x, y)).x);
+	imageStore(tex1, loc_dst, vec4(d));
+}
@@ -0,0 +1,47 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//A level of the Hi-Z from the one above, as genmipmap. The farthest depth of the texels below,
+//with the last row / column of an odd size.
+RWTexture2D<float> tex0 : register(u0);
+RWTexture2D<float> tex1 : register(u1);
+
+[numthreads(8, 8, 1)]
+void CSMain(uint3 dispatchThreadId : SV_DispatchThreadID)
+{
+	uint sw, sh, dw, dh;
+	tex0.GetDimensions(sw, sh);
+	tex1.GetDimensions(dw, dh);
+	uint2 idx = dispatchThreadId.xy;
+	if (idx.x >= dw || idx.y >= dh)
+		return;
+	uint2 last = idx * 2 + uint2(
+		(idx.x == dw - 1 && (sw & 1)) ? 2 : 1,
+		(idx.y == dh - 1 && (sh & 1)) ? 2 : 1);
+	last = min(last, uint2(sw - 1, sh - 1));
+	float d = 0;
+	for (uint y = idx.y * 2; y <= last.y; y++)
+		for (uint x = idx.x * 2; x <= last.x; x++)
+			d = max(d, tex0[uint2(x, y)]);
+	tex1[idx] = d;
+}
@@ -0,0 +1,69 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//shaders/model drawn per instance. The instance is visible[SV_InstanceID] when misc.y is set (CullInstances).
+Texture2D<float4> tex0 : register(t0);
+ByteAddressBuffer visible : register(t1);
+ByteAddressBuffer instances : register(t2); //float4 : xyz center, w scale.
+SamplerState PointSampler   : register(s0);
+SamplerState LinearSampler  : register(s1);
+
+cbuffer constdata : register(b0)
+{
+	float4 time;
+	float4 misc;
+	float4x4 world;
+	float4x4 proj;
+	float4x4 view;
+};
+
+struct PSInput {
+	float4 position : SV_POSITION;
+	float3 normal : NORMAL0;
+	float2 uv : TEXCOORD0;
+};
+
+PSInput VSMain(
+	float4 position : POSITION,
+	float3 normal : NORMAL,
+	float2 uv : TEXCOORD,
+	uint instance : SV_InstanceID)
+{
+	PSInput result = (PSInput)0;
+	uint index = misc.y > 0.5 ? visible.Load(instance * 4) : instance;
+	float4 inst = asfloat(instances.Load4(index * 16));
+	result.position = float4(position.xyz * inst.w + inst.xyz, 1.0);
+	result.normal = normal;
+	result.uv = uv;
+	result.position = mul(result.position, transpose(world));
+	result.position = mul(result.position, transpose(view ));
+	result.position = mul(result.position, transpose(proj ));
+	return result;
+}
+
+float4 PSMain(PSInput input) : SV_TARGET {
+	float4 col = tex0.SampleLevel(LinearSampler, input.uv, 0) +
+	float4(0.1, 0.2, 0.3, 1.0);
+	col.w = input.position.z / input.position.w;
+	return col;
+}
@@ -39,6 +39,7 @@ layout(location=2) in vec2 uv;
 layout(location=0) out vec4 v_pos;
 layout(location=1) out vec3 v_nor;
 layout(location=2) out vec2 v_uv;
+invariant gl_Position; //the same depth in the prepass and the depth equal pass.
 
 void main()
 {
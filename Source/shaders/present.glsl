@@ -24,12 +24,10 @@
 
 layout(binding=0) uniform sampler2D tex0;
 layout(binding=3) uniform sampler2D tex1;
+//Dynamic resolution upscale : uv scale of the drawn rect of tex0 / tex1 (xy) and the max uv in it (zw), xy - zw is the min.
 layout(binding=1) uniform buf {
-	vec4 time;
-	vec4 misc;
-	mat4 world;
-	mat4 proj;
-	mat4 view;
+	vec4 uv0;
+	vec4 uv1;
 } ubuf;
 
 #ifdef _VS_
@@ -57,11 +55,11 @@ layout(location=0) out vec4 out_color;
 
 void main()
 {
-	vec2 uv = v_uv;
-	vec4 col = texture(tex0, uv, 0.0);
-	vec4 blurcol = texture(tex1, uv, 0.0);
-	col.x = texture(tex0, uv + vec2(0.001, 0.001), 0).x;
-	col.z = texture(tex0, uv - vec2(0.001, 0.001), 0).z;
+	vec2 uv = v_uv * ubuf.uv0.xy;
+	vec4 col = texture(tex0, clamp(uv, ubuf.uv0.xy - ubuf.uv0.zw, ubuf.uv0.zw), 0.0);
+	vec4 blurcol = texture(tex1, clamp(v_uv * ubuf.uv1.xy, ubuf.uv1.xy - ubuf.uv1.zw, ubuf.uv1.zw), 0.0);
+	col.x = texture(tex0, clamp(uv + vec2(0.001, 0.001), ubuf.uv0.xy - ubuf.uv0.zw, ubuf.uv0.zw), 0).x;
+	col.z = texture(tex0, clamp(uv - vec2(0.001, 0.001), ubuf.uv0.xy - ubuf.uv0.zw, ubuf.uv0.zw), 0).z;
 	out_color = col + blurcol;
 }
 #endif //_PS_
@@ -26,12 +26,11 @@ Texture2D<float4> tex1 : register(t1);
 SamplerState PointSampler   : register(s0);
 SamplerState LinearSampler  : register(s1);
 
-cbuffer constdata : register(b0)
+//Dynamic resolution upscale : uv scale of the drawn rect of tex0 / tex1 (xy) and the max uv in it (zw), xy - zw is the min.
+cbuffer presentinfo : register(b0)
 {
-	float4 time;
-	float4 misc;
-	float4x4 proj;
-	float4x4 view;
+	float4 uv0;
+	float4 uv1;
 };
 
 struct PSInput {
@@ -51,10 +50,10 @@ PSInput VSMain(
 }
 
 float4 PSMain(PSInput input) : SV_TARGET {
-	float2 uv = input.uv;
-	float4 col = tex0.SampleLevel(LinearSampler, uv, 0.0);
-	float4 blurcol = tex1.SampleLevel(LinearSampler, uv, 0.0);
-	col.x = tex0.SampleLevel(LinearSampler, uv + float2(0.001, 0.001), 0).x;
-	col.z = tex0.SampleLevel(LinearSampler, uv - float2(0.001, 0.001), 0).z;
+	float2 uv = input.uv * uv0.xy;
+	float4 col = tex0.SampleLevel(LinearSampler, clamp(uv, uv0.xy - uv0.zw, uv0.zw), 0.0);
+	float4 blurcol = tex1.SampleLevel(LinearSampler, clamp(input.uv * uv1.xy, uv1.xy - uv1.zw, uv1.zw), 0.0);
+	col.x = tex0.SampleLevel(LinearSampler, clamp(uv + float2(0.001, 0.001), uv0.xy - uv0.zw, uv0.zw), 0).x;
+	col.z = tex0.SampleLevel(LinearSampler, clamp(uv - float2(0.001, 0.001), uv0.xy - uv0.zw, uv0.zw), 0).z;
 	return col + blurcol;
 }
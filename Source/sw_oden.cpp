@@ -0,0 +1,2551 @@
+/*
+ *
+ * Copyright (c) 2020 gyabo <gyaboyan@gmail.com>
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+//Software backend. Executes the ODEN command set into memory images.
+//Shaders are C++ functions registered by SetShader name, draws are
+//binned into screen tiles and rasterized by a thread pool, 4 pixels per step.
+
+#include "ODEN.h"
+#include "oden_platform.h"
+#include "oden_spirv.h"
+#include "oden_trace.h"
+#include "oden_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ODEN_SW_SSE2
+#endif
+
+#ifdef _WIN32
+#pragma comment(lib, "gdi32.lib")
+#pragma comment(lib, "user32.lib")
+#endif //_WIN32
+
+#define LOG_INFO(...) ODEN_LOG_INFO(__VA_ARGS__)
+#define LOG_ERR(...) ODEN_LOG_ERR(__VA_ARGS__)
+
+using namespace oden;
+
+enum {
+	SW_SLOT_MAX = 16,
+	SW_VARYING_MAX = 12,
+	SW_TILE_SIZE = 64,
+};
+
+//Written by oden_set_frames_in_flight on the app thread.
+static std::atomic<uint32_t> frames_in_flight_request {0};
+static std::mutex frame_stats_mtx;
+static std::vector<frame_stats> vframe_stats;
+static std::vector<cmd_stats> vcmd_stats(CMD_MAX);
+static std::map<std::string, pass_stats> mpass_stats;
+static bool is_pass_stats_updated = false;
+static std::map<std::string, memory_stats> mmemory_stats;
+static uint64_t memory_total = 0;
+static uint64_t memory_high_water = 0;
+
+//Commands up to a draw / dispatch, see oden_get_pass_stats.
+struct pass_segment {
+	std::string name;
+	double cpu_ms;
+	double gpu_ms;
+};
+
+static std::mutex readback_mtx;
+static bool is_readback_requested = false;
+static std::vector<uint32_t> vreadback;
+static uint32_t readback_width = 0;
+static uint32_t readback_height = 0;
+
+static double
+get_time_ms()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double, std::milli>(now).count();
+}
+
+static void
+push_frame_stats(frame_stats stats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (vframe_stats.size() >= 4096)
+		vframe_stats.erase(vframe_stats.begin(), vframe_stats.begin() + 2048);
+	vframe_stats.push_back(stats);
+}
+
+void
+oden::oden_set_frames_in_flight(uint32_t num)
+{
+	frames_in_flight_request = num;
+}
+
+void
+oden::oden_get_frame_stats(std::vector<frame_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats.insert(vstats.end(), vframe_stats.begin(), vframe_stats.end());
+	vframe_stats.clear();
+}
+
+void
+oden::oden_get_cmd_stats(std::vector<cmd_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats = vcmd_stats;
+	for (auto & x : vcmd_stats)
+		x = {};
+}
+
+static bool
+is_pass_end(int type)
+{
+	return type == CMD_DRAW_INDEX || type == CMD_DRAW || type == CMD_DISPATCH || type == CMD_GENERATE_MIPS ||
+		type == CMD_DRAW_INDEX_INDIRECT || type == CMD_DRAW_INDEX_INSTANCED || type == CMD_DRAW_INSTANCED;
+}
+
+//The gpu trace track lays the passes back to back from the submit.
+static void
+push_pass_stats(uint64_t frame, const std::vector<pass_segment> & vsegments, double submit_ms)
+{
+	auto gpu_start = submit_ms;
+	for (auto & x : vsegments) {
+		if (x.gpu_ms < 0.0)
+			continue;
+		trace_complete("gpu", x.name, gpu_start, gpu_start + x.gpu_ms, ODEN_TRACE_TRACK_GPU);
+		gpu_start += x.gpu_ms;
+	}
+
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mpass_stats.clear();
+	for (auto & x : vsegments) {
+		auto & stats = mpass_stats[x.name];
+		stats.frame = frame;
+		stats.count++;
+		stats.cpu_ms += x.cpu_ms;
+		stats.gpu_ms = x.gpu_ms < 0.0 ? -1.0 : stats.gpu_ms + x.gpu_ms;
+	}
+	is_pass_stats_updated = true;
+}
+
+bool
+oden::oden_get_pass_stats(std::map<std::string, pass_stats> & mstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (!is_pass_stats_updated)
+		return false;
+	mstats = mpass_stats;
+	is_pass_stats_updated = false;
+	return true;
+}
+
+//Replaces the previous entry of the name.
+static void
+account_memory(const std::string & name, int category, const char *heap, uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto & stats = mmemory_stats[name];
+	memory_total = memory_total - stats.bytes + bytes;
+	stats = {category, heap, bytes};
+	memory_high_water = (std::max)(memory_high_water, memory_total);
+}
+
+static void
+release_memory(const std::string & name)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto it = mmemory_stats.find(name);
+	if (it == mmemory_stats.end())
+		return;
+	memory_total -= it->second.bytes;
+	mmemory_stats.erase(it);
+}
+
+static void
+release_memory_all(void)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mmemory_stats.clear();
+	memory_total = 0;
+}
+
+void
+oden::oden_get_memory_stats(std::map<std::string, memory_stats> & mstats, uint64_t & high_water)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mstats = mmemory_stats;
+	high_water = memory_high_water;
+}
+
+bool
+oden::oden_get_backbuffer_readback(std::vector<uint32_t> & vdata, uint32_t & w, uint32_t & h)
+{
+	std::lock_guard<std::mutex> lock(readback_mtx);
+	is_readback_requested = true;
+	if (vreadback.empty())
+		return false;
+	vdata = vreadback;
+	w = readback_width;
+	h = readback_height;
+	return true;
+}
+
+//4 wide float. SSE2 if available.
+struct vf4 {
+#ifdef ODEN_SW_SSE2
+	__m128 v;
+
+	vf4() {}
+	vf4(__m128 a) : v(a) {}
+	static vf4 set1(float a)
+	{
+		return _mm_set1_ps(a);
+	}
+	static vf4 set(float a, float b, float c, float d)
+	{
+		return _mm_setr_ps(a, b, c, d);
+	}
+	static vf4 load(const float *p)
+	{
+		return _mm_loadu_ps(p);
+	}
+	void store(float *p) const
+	{
+		_mm_storeu_ps(p, v);
+	}
+	friend vf4 operator+(vf4 a, vf4 b)
+	{
+		return _mm_add_ps(a.v, b.v);
+	}
+	friend vf4 operator-(vf4 a, vf4 b)
+	{
+		return _mm_sub_ps(a.v, b.v);
+	}
+	friend vf4 operator*(vf4 a, vf4 b)
+	{
+		return _mm_mul_ps(a.v, b.v);
+	}
+	friend vf4 operator&(vf4 a, vf4 b)
+	{
+		return _mm_and_ps(a.v, b.v);
+	}
+	friend vf4 cmpge(vf4 a, vf4 b)
+	{
+		return _mm_cmpge_ps(a.v, b.v);
+	}
+	friend vf4 cmple(vf4 a, vf4 b)
+	{
+		return _mm_cmple_ps(a.v, b.v);
+	}
+	friend vf4 cmplt(vf4 a, vf4 b)
+	{
+		return _mm_cmplt_ps(a.v, b.v);
+	}
+	friend int movemask(vf4 a)
+	{
+		return _mm_movemask_ps(a.v);
+	}
+#else
+	float v[4];
+
+	static vf4 set1(float a)
+	{
+		return set(a, a, a, a);
+	}
+	static vf4 set(float a, float b, float c, float d)
+	{
+		vf4 r;
+		r.v[0] = a;
+		r.v[1] = b;
+		r.v[2] = c;
+		r.v[3] = d;
+		return r;
+	}
+	static vf4 load(const float *p)
+	{
+		return set(p[0], p[1], p[2], p[3]);
+	}
+	void store(float *p) const
+	{
+		for (int i = 0; i < 4; i++)
+			p[i] = v[i];
+	}
+	template<typename F>
+	static vf4 apply(vf4 a, vf4 b, F f)
+	{
+		vf4 r;
+		for (int i = 0; i < 4; i++)
+			r.v[i] = f(a.v[i], b.v[i]);
+		return r;
+	}
+	static float mask(bool b)
+	{
+		uint32_t m = b ? 0xFFFFFFFF : 0;
+		float f;
+		memcpy(&f, &m, sizeof(f));
+		return f;
+	}
+	friend vf4 operator+(vf4 a, vf4 b)
+	{
+		return apply(a, b, [](float x, float y) { return x + y; });
+	}
+	friend vf4 operator-(vf4 a, vf4 b)
+	{
+		return apply(a, b, [](float x, float y) { return x - y; });
+	}
+	friend vf4 operator*(vf4 a, vf4 b)
+	{
+		return apply(a, b, [](float x, float y) { return x * y; });
+	}
+	friend vf4 operator&(vf4 a, vf4 b)
+	{
+		return apply(a, b, [](float x, float y) {
+			uint32_t ix, iy;
+			memcpy(&ix, &x, 4);
+			memcpy(&iy, &y, 4);
+			ix &= iy;
+			memcpy(&x, &ix, 4);
+			return x;
+		});
+	}
+	friend vf4 cmpge(vf4 a, vf4 b)
+	{
+		return apply(a, b, [](float x, float y) { return mask(x >= y); });
+	}
+	friend vf4 cmple(vf4 a, vf4 b)
+	{
+		return apply(a, b, [](float x, float y) { return mask(x <= y); });
+	}
+	friend vf4 cmplt(vf4 a, vf4 b)
+	{
+		return apply(a, b, [](float x, float y) { return mask(x < y); });
+	}
+	friend int movemask(vf4 a)
+	{
+		int ret = 0;
+		for (int i = 0; i < 4; i++) {
+			uint32_t m;
+			memcpy(&m, &a.v[i], 4);
+			ret |= (m >> 31) << i;
+		}
+		return ret;
+	}
+#endif //ODEN_SW_SSE2
+};
+
+//Images are float texels. color = 4 channels, depth = 1 channel.
+//Texture formats are decoded to float at upload. Render targets keep float texels,
+//the channels and precision of their format are applied when a pixel is written.
+static float
+half_to_float(uint16_t h)
+{
+	uint32_t sign = uint32_t(h & 0x8000) << 16;
+	uint32_t e = (h >> 10) & 31;
+	uint32_t m = h & 0x3ff;
+	float ret;
+	if (e == 0) {
+		ret = float(m) * (1.0f / 16777216.0f);
+		return sign ? -ret : ret;
+	}
+	uint32_t bits = sign | (e == 31 ? 0x7f800000 | (m << 13) : ((e + 112) << 23) | (m << 13));
+	memcpy(&ret, &bits, sizeof(ret));
+	return ret;
+}
+
+//Unsigned float with mbits mantissa (R11G11B10) : 5 bit exponent, no sign.
+static float
+ufloat_to_float(uint32_t v, int mbits)
+{
+	uint32_t e = v >> mbits;
+	uint32_t m = v & ((1 << mbits) - 1);
+	if (e == 0)
+		return float(m) / float(1 << mbits) * (1.0f / 16384.0f);
+	uint32_t bits = e == 31 ? 0x7f800000 | (m << (23 - mbits)) : ((e + 112) << 23) | (m << (23 - mbits));
+	float ret;
+	memcpy(&ret, &bits, sizeof(ret));
+	return ret;
+}
+
+//Round to a float with 5 bit exponent and mbits mantissa.
+static float
+quantize_float(float v, int mbits, bool is_signed)
+{
+	float a = fabsf(v);
+	if (!(a > 0.0f) || (!is_signed && v < 0.0f))
+		return 0.0f;
+	float maxval = float(2 - 1.0 / (1 << mbits)) * 32768.0f;
+	if (a >= maxval)
+		return v < 0.0f ? -maxval : maxval;
+	if (a < 1.0f / 16384.0f) {
+		float step = 1.0f / 16384.0f / float(1 << mbits);
+		a = floorf(a / step + 0.5f) * step;
+	} else {
+		uint32_t bits;
+		memcpy(&bits, &a, sizeof(bits));
+		bits = (bits + (1 << (22 - mbits))) & ~((1u << (23 - mbits)) - 1);
+		memcpy(&a, &bits, sizeof(a));
+	}
+	return v < 0.0f ? -a : a;
+}
+
+static float
+quantize_unorm(float v, float scale)
+{
+	return floorf((std::min)((std::max)(v, 0.0f), 1.0f) * scale + 0.5f) / scale;
+}
+
+static void
+store_texel(int fmt, float *dst, const float *src)
+{
+	switch (fmt) {
+	case FMT_R8G8B8A8_UNORM:
+		for (int i = 0; i < 4; i++)
+			dst[i] = quantize_unorm(src[i], 255.0f);
+		break;
+	case FMT_R11G11B10_FLOAT:
+		dst[0] = quantize_float(src[0], 6, false);
+		dst[1] = quantize_float(src[1], 6, false);
+		dst[2] = quantize_float(src[2], 5, false);
+		dst[3] = 1.0f;
+		break;
+	case FMT_R16G16_FLOAT:
+		dst[0] = quantize_float(src[0], 10, true);
+		dst[1] = quantize_float(src[1], 10, true);
+		dst[2] = 0.0f;
+		dst[3] = 1.0f;
+		break;
+	case FMT_R8_UNORM:
+		dst[0] = quantize_unorm(src[0], 255.0f);
+		dst[1] = 0.0f;
+		dst[2] = 0.0f;
+		dst[3] = 1.0f;
+		break;
+	case FMT_R32_FLOAT:
+		dst[0] = src[0];
+		dst[1] = 0.0f;
+		dst[2] = 0.0f;
+		dst[3] = 1.0f;
+		break;
+	default:
+		//R16G16B16A16_FLOAT is kept at float precision.
+		memcpy(dst, src, sizeof(float) * 4);
+		break;
+	}
+}
+
+//16 pixels of a block as RGBA8 (R in the low byte).
+static void
+decode_bc1(const uint8_t *src, uint32_t *out)
+{
+	uint16_t c[2];
+	uint32_t indices;
+	memcpy(c, src, 4);
+	memcpy(&indices, src + 4, 4);
+	uint32_t rgb[2][3];
+	for (int n = 0; n < 2; n++) {
+		uint32_t r = (c[n] >> 11) & 31, g = (c[n] >> 5) & 63, b = c[n] & 31;
+		rgb[n][0] = (r << 3) | (r >> 2);
+		rgb[n][1] = (g << 2) | (g >> 4);
+		rgb[n][2] = (b << 3) | (b >> 2);
+	}
+	uint32_t pal[4];
+	for (int n = 0; n < 4; n++) {
+		uint32_t col[3];
+		for (int i = 0; i < 3; i++) {
+			if (n < 2)
+				col[i] = rgb[n][i];
+			else if (c[0] > c[1])
+				col[i] = n == 2 ? (2 * rgb[0][i] + rgb[1][i]) / 3 : (rgb[0][i] + 2 * rgb[1][i]) / 3;
+			else
+				col[i] = n == 2 ? (rgb[0][i] + rgb[1][i]) / 2 : 0;
+		}
+		uint32_t a = (n == 3 && c[0] <= c[1]) ? 0 : 255;
+		pal[n] = col[0] | (col[1] << 8) | (col[2] << 16) | (a << 24);
+	}
+	for (int i = 0; i < 16; i++)
+		out[i] = pal[(indices >> (i * 2)) & 3];
+}
+
+//Writes byte ch of every pixel.
+static void
+decode_bc4(const uint8_t *src, uint32_t *out, int ch)
+{
+	uint32_t r0 = src[0], r1 = src[1];
+	uint32_t pal[8] = {r0, r1};
+	for (int n = 2; n < 8; n++) {
+		if (r0 > r1)
+			pal[n] = ((8 - n) * r0 + (n - 1) * r1) / 7;
+		else
+			pal[n] = n < 6 ? ((6 - n) * r0 + (n - 1) * r1) / 5 : n == 6 ? 0 : 255;
+	}
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= uint64_t(src[2 + i]) << (i * 8);
+	for (int i = 0; i < 16; i++) {
+		out[i] &= ~(0xffu << (ch * 8));
+		out[i] |= pal[(indices >> (i * 3)) & 7] << (ch * 8);
+	}
+}
+
+//BC7 partitions. 2 subsets : bit i is the subset of pixel i.
+static const uint16_t bc7_partition2[64] = {
+	0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+	0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+	0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+	0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+	0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+	0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+	0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+	0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+//3 subsets. 2 bits a pixel, pixel 0 in the low bits.
+static const uint32_t bc7_partition3[64] = {
+	0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050,
+	0x5555a0a0, 0x5a5a5050, 0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090,
+	0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250, 0xa5945040, 0x0a425054,
+	0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+	0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414,
+	0x50a4a450, 0x6a5a0200, 0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424,
+	0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50, 0x500aa550, 0xaaaa4444,
+	0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+	0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580,
+	0xaa141414, 0x96960000, 0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000,
+	0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+};
+
+//Pixel of the second (and third) subset whose index drops the msb.
+static const uint8_t bc7_anchor2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+	15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+	6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+};
+
+static const uint8_t bc7_anchor3_1[64] = {
+	3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+	3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+	8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+	3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3,
+};
+
+static const uint8_t bc7_anchor3_2[64] = {
+	15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+	15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+	15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+	15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8,
+};
+
+static void
+decode_bc7(const uint8_t *src, uint32_t *out)
+{
+	static const struct {
+		int ns, pb, rb, isb, cb, ab, epb, spb, ib, ib2;
+	} modes[8] = {
+		{3, 4, 0, 0, 4, 0, 1, 0, 3, 0},
+		{2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+		{3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+		{2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+		{1, 0, 2, 1, 5, 6, 0, 0, 2, 3},
+		{1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+		{1, 0, 0, 0, 7, 7, 1, 0, 4, 0},
+		{2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+	};
+	static const uint32_t weights2[4] = {0, 21, 43, 64};
+	static const uint32_t weights3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+	static const uint32_t weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+	int pos = 0;
+	auto read = [&](int n) {
+		uint32_t ret = 0;
+		for (int i = 0; i < n; i++, pos++)
+			ret |= uint32_t((src[pos >> 3] >> (pos & 7)) & 1) << i;
+		return ret;
+	};
+
+	int mode = 0;
+	while (mode < 8 && read(1) == 0)
+		mode++;
+	if (mode == 8) {
+		//reserved mode decodes to transparent black.
+		memset(out, 0, sizeof(uint32_t) * 16);
+		return;
+	}
+	auto & m = modes[mode];
+	uint32_t partition = read(m.pb);
+	uint32_t rotation = read(m.rb);
+	uint32_t isb = read(m.isb);
+
+	uint32_t ep[6][4];
+	for (int c = 0; c < 3; c++)
+		for (int n = 0; n < m.ns * 2; n++)
+			ep[n][c] = read(m.cb);
+	for (int n = 0; n < m.ns * 2; n++)
+		ep[n][3] = m.ab ? read(m.ab) : 255;
+	uint32_t pbits[6] = {};
+	for (int n = 0; n < m.ns * 2 && m.epb; n++)
+		pbits[n] = read(1);
+	for (int n = 0; n < m.ns && m.spb; n++)
+		pbits[n * 2] = pbits[n * 2 + 1] = read(1);
+
+	//expand to 8 bits, the p-bit is the lsb below the color bits.
+	bool is_pbit = m.epb || m.spb;
+	for (int n = 0; n < m.ns * 2; n++) {
+		for (int c = 0; c < 4; c++) {
+			int bits = c < 3 ? m.cb : m.ab;
+			if (bits == 0)
+				continue;
+			uint32_t v = ep[n][c];
+			if (is_pbit) {
+				v = (v << 1) | pbits[n];
+				bits++;
+			}
+			v <<= 8 - bits;
+			ep[n][c] = v | (v >> bits);
+		}
+	}
+
+	int subset[16];
+	int anchor[3] = {0, 0, 0};
+	for (int i = 0; i < 16; i++) {
+		if (m.ns == 2)
+			subset[i] = (bc7_partition2[partition] >> i) & 1;
+		else if (m.ns == 3)
+			subset[i] = (bc7_partition3[partition] >> (i * 2)) & 3;
+		else
+			subset[i] = 0;
+	}
+	if (m.ns == 2)
+		anchor[1] = bc7_anchor2[partition];
+	if (m.ns == 3) {
+		anchor[1] = bc7_anchor3_1[partition];
+		anchor[2] = bc7_anchor3_2[partition];
+	}
+
+	uint32_t idx[16], idx2[16] = {};
+	for (int i = 0; i < 16; i++) {
+		bool is_anchor = i == 0 || (m.ns > 1 && i == anchor[1]) || (m.ns > 2 && i == anchor[2]);
+		idx[i] = read(is_anchor ? m.ib - 1 : m.ib);
+	}
+	for (int i = 0; i < 16 && m.ib2; i++)
+		idx2[i] = read(i == 0 ? m.ib2 - 1 : m.ib2);
+
+	auto weight = [](int bits, uint32_t index) {
+		return bits == 2 ? weights2[index] : bits == 3 ? weights3[index] : weights4[index];
+	};
+	for (int i = 0; i < 16; i++) {
+		auto & e0 = ep[subset[i] * 2];
+		auto & e1 = ep[subset[i] * 2 + 1];
+		uint32_t wc = weight(m.ib, idx[i]);
+		uint32_t wa = wc;
+		if (m.ib2) {
+			wc = isb ? weight(m.ib2, idx2[i]) : weight(m.ib, idx[i]);
+			wa = isb ? weight(m.ib, idx[i]) : weight(m.ib2, idx2[i]);
+		}
+		uint32_t col[4];
+		for (int c = 0; c < 4; c++) {
+			uint32_t w = c < 3 ? wc : wa;
+			col[c] = ((64 - w) * e0[c] + w * e1[c] + 32) >> 6;
+		}
+		if (rotation)
+			std::swap(col[3], col[rotation - 1]);
+		out[i] = col[0] | (col[1] << 8) | (col[2] << 16) | (col[3] << 24);
+	}
+}
+
+struct sw_image {
+	int w = 0;
+	int h = 0;
+	int channels = 4;
+	int fmt = FMT_R16G16B16A16_FLOAT; //of the texel writes.
+	int maxmips = 1;
+	bool is_texture = false; //created by CMD_SET_TEXTURE, CMD_RELEASE can destroy it.
+	std::vector<std::vector<float>> vmips;
+
+	void create(int width, int height, int ch, int mips)
+	{
+		w = width;
+		h = height;
+		channels = ch;
+		maxmips = (std::max)(mips, 1);
+		vmips.resize(maxmips);
+		for (int i = 0; i < maxmips; i++)
+			vmips[i].assign((size_t)mip_w(i) * mip_h(i) * channels, 0.0f);
+	}
+
+	int mip_w(int level) const
+	{
+		return (std::max)(w >> level, 1);
+	}
+
+	int mip_h(int level) const
+	{
+		return (std::max)(h >> level, 1);
+	}
+
+	float *texel(int level, int x, int y)
+	{
+		return &vmips[level][((size_t)y * mip_w(level) + x) * channels];
+	}
+
+	const float *texel(int level, int x, int y) const
+	{
+		return &vmips[level][((size_t)y * mip_w(level) + x) * channels];
+	}
+
+	uint64_t bytes() const
+	{
+		uint64_t ret = 0;
+		for (auto & x : vmips)
+			ret += x.size() * sizeof(float);
+		return ret;
+	}
+};
+
+//Decode rows of fmt (block rows of BC formats) into the rw x rh rect at rx, ry of a level. rw 0 : the level.
+static void
+decode_texture(sw_image & image, int level, int fmt, const uint8_t *data, size_t stride, int rx = 0, int ry = 0, int rw = 0, int rh = 0)
+{
+	int w = rw ? rw : image.mip_w(level);
+	int h = rw ? rh : image.mip_h(level);
+	if (oden_is_block_format(fmt)) {
+		int bytes = oden_get_format_bytes(fmt);
+		for (int by = 0; by < (h + 3) / 4; by++) {
+			for (int bx = 0; bx < (w + 3) / 4; bx++) {
+				auto src = data + stride * by + bytes * bx;
+				uint32_t px[16] = {};
+				if (fmt == FMT_BC1_UNORM)
+					decode_bc1(src, px);
+				if (fmt == FMT_BC4_UNORM || fmt == FMT_BC5_UNORM) {
+					decode_bc4(src, px, 0);
+					if (fmt == FMT_BC5_UNORM)
+						decode_bc4(src + 8, px, 1);
+					for (auto & x : px)
+						x |= 0xff000000;
+				}
+				if (fmt == FMT_BC7_UNORM)
+					decode_bc7(src, px);
+				for (int i = 0; i < 16; i++) {
+					int x = bx * 4 + (i & 3);
+					int y = by * 4 + (i >> 2);
+					if (x >= w || y >= h)
+						continue;
+					for (int c = 0; c < 4; c++)
+						image.texel(level, rx + x, ry + y)[c] = ((px[i] >> (c * 8)) & 0xff) / 255.0f;
+				}
+			}
+		}
+		return;
+	}
+	for (int y = 0; y < h; y++) {
+		auto src = data + stride * y;
+		for (int x = 0; x < w; x++) {
+			float *dst = image.texel(level, rx + x, ry + y);
+			float col[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+			if (fmt == FMT_R8G8B8A8_UNORM)
+				for (int i = 0; i < 4; i++)
+					col[i] = src[x * 4 + i] / 255.0f;
+			if (fmt == FMT_R16G16B16A16_FLOAT || fmt == FMT_R16G16_FLOAT) {
+				int n = fmt == FMT_R16G16_FLOAT ? 2 : 4;
+				uint16_t h[4];
+				memcpy(h, src + x * n * 2, n * 2);
+				for (int i = 0; i < n; i++)
+					col[i] = half_to_float(h[i]);
+			}
+			if (fmt == FMT_R11G11B10_FLOAT) {
+				uint32_t v;
+				memcpy(&v, src + x * 4, 4);
+				col[0] = ufloat_to_float(v & 0x7ff, 6);
+				col[1] = ufloat_to_float((v >> 11) & 0x7ff, 6);
+				col[2] = ufloat_to_float(v >> 22, 5);
+			}
+			if (fmt == FMT_R8_UNORM)
+				col[0] = src[x] / 255.0f;
+			if (fmt == FMT_R32_FLOAT)
+				memcpy(col, src + x * 4, 4);
+			memcpy(dst, col, sizeof(col));
+		}
+	}
+}
+
+struct sw_texture_view {
+	sw_image *image = nullptr;
+	int base_level = 0;
+};
+
+//CMD_SET_BUFFER / SET_BUFFER_UAV. The t and u registers of a slot are one binding here, as the textures.
+struct sw_buffer_view {
+	uint8_t *data = nullptr;
+	size_t size = 0;
+};
+
+struct sw_vs_ctx {
+	const uint8_t *vcb[SW_SLOT_MAX];
+	sw_buffer_view vbuf[SW_SLOT_MAX];
+	uint32_t instance; //SV_InstanceID
+};
+
+struct sw_ps_ctx {
+	sw_texture_view vtex[SW_SLOT_MAX];
+	const uint8_t *vcb[SW_SLOT_MAX];
+};
+
+struct sw_cs_ctx {
+	sw_texture_view vuav[SW_SLOT_MAX];
+	const uint8_t *vcb[SW_SLOT_MAX];
+	sw_buffer_view vbuf[SW_SLOT_MAX];
+};
+
+//pos : clip space position. var : SW_VARYING_MAX varyings.
+typedef void (*sw_vs_fn)(const sw_vs_ctx & ctx, const uint8_t *vtx, float *pos, float *var);
+//color : 4 floats per color target of the pass (RENDER_TARGET_MAX). return false to discard.
+typedef bool (*sw_ps_fn)(const sw_ps_ctx & ctx, const float *var, float *color);
+typedef void (*sw_cs_fn)(const sw_cs_ctx & ctx, int x, int y, int z);
+
+struct sw_shader {
+	sw_vs_fn vs = nullptr;
+	sw_ps_fn ps = nullptr;
+	sw_ps_fn ps_depth = nullptr; //optional alpha test on depth only targets. nullptr runs no pixel shader.
+	sw_cs_fn cs = nullptr;
+	int local_size[3] = {1, 1, 1};
+	std::shared_ptr<spirv_program> program; //compute shader run by the SPIR-V interpreter.
+};
+
+static std::map<std::string, sw_shader> &
+get_shader_registry()
+{
+	static std::map<std::string, sw_shader> mshaders;
+	return mshaders;
+}
+
+static void
+register_shader(std::string name, sw_shader shader)
+{
+	get_shader_registry()[name] = shader;
+}
+
+//"./shaders/model" is found as "./shaders/model" or "model".
+static const sw_shader *
+find_shader(std::string name)
+{
+	auto & mshaders = get_shader_registry();
+	auto it = mshaders.find(name);
+	if (it == mshaders.end()) {
+		auto pos = name.find_last_of("/\\");
+		if (pos != std::string::npos)
+			it = mshaders.find(name.substr(pos + 1));
+	}
+	if (it == mshaders.end())
+		return nullptr;
+	return &it->second;
+}
+
+//Compute shaders without a registered kernel run from SPIR-V.
+//glslangValidator compiles <name>.glsl the same way as the Vulkan backend.
+static bool
+load_spirv_compute(std::string name, sw_shader & shader)
+{
+	trace_scope trace("shader", name);
+	auto shaderfile = name + ".glsl";
+	std::vector<uint8_t> vsource;
+	std::vector<uint8_t> vdata;
+	auto read_file = [](std::string filename, std::vector<uint8_t> & vbuf) {
+		FILE *fp = fopen(filename.c_str(), "rb");
+		if (fp == nullptr)
+			return false;
+		uint8_t buf[4096];
+		size_t len = 0;
+		while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+			vbuf.insert(vbuf.end(), buf, buf + len);
+		fclose(fp);
+		return true;
+	};
+	if (!read_file(shaderfile, vsource))
+		return false;
+	if (std::string(vsource.begin(), vsource.end()).find("local_size_x") == std::string::npos)
+		return false;
+
+	//Several devices may compile the same shader at once, as compile_glsl2spirv.
+	auto tempfilename = oden_platform_get_temp_filename("_CS_sw.spv");
+	auto basecmd = "glslangValidator -V -S comp --D _CS_ " + shaderfile + " -o \"" + tempfilename + "\"";
+	LOG_INFO("basecmd : %s\n", basecmd.c_str());
+	oden_platform_exec_wait(basecmd.c_str());
+	read_file(tempfilename, vdata);
+	oden_platform_delete_file(tempfilename.c_str());
+
+	std::string error;
+	shader.program = spirv_load(vdata.data(), vdata.size(), error);
+	if (shader.program == nullptr) {
+		LOG_ERR("spirv_load failed name=%s : %s\n", name.c_str(), error.c_str());
+		return false;
+	}
+	spirv_get_local_size(*shader.program, shader.local_size);
+	return true;
+}
+
+//Shader helpers
+static inline void
+mul_row(const float *v, const float *m, float *out)
+{
+	//row vector * row major matrix, as XMMATRIX and the shaders' mul(v, transpose(m)).
+	float r[4];
+	for (int j = 0; j < 4; j++)
+		r[j] = v[0] * m[j] + v[1] * m[4 + j] + v[2] * m[8 + j] + v[3] * m[12 + j];
+	memcpy(out, r, sizeof(r));
+}
+
+static inline int
+wrap_coord(int i, int size)
+{
+	i %= size;
+	return i < 0 ? i + size : i;
+}
+
+static void
+fetch_texel(const sw_image *image, int level, int x, int y, float *out)
+{
+	const float *p = image->texel(level, wrap_coord(x, image->mip_w(level)), wrap_coord(y, image->mip_h(level)));
+	if (image->channels == 4) {
+		memcpy(out, p, sizeof(float) * 4);
+	} else {
+		out[0] = p[0];
+		out[1] = 0.0f;
+		out[2] = 0.0f;
+		out[3] = 1.0f;
+	}
+}
+
+static void
+sample_level_bilinear(const sw_image *image, int level, float u, float v, float *out)
+{
+	float fx = u * image->mip_w(level) - 0.5f;
+	float fy = v * image->mip_h(level) - 0.5f;
+	float x0f = floorf(fx);
+	float y0f = floorf(fy);
+	float tx = fx - x0f;
+	float ty = fy - y0f;
+	int x0 = (int)x0f;
+	int y0 = (int)y0f;
+	float c00[4], c10[4], c01[4], c11[4];
+	fetch_texel(image, level, x0, y0, c00);
+	fetch_texel(image, level, x0 + 1, y0, c10);
+	fetch_texel(image, level, x0, y0 + 1, c01);
+	fetch_texel(image, level, x0 + 1, y0 + 1, c11);
+	for (int i = 0; i < 4; i++) {
+		float a = c00[i] + (c10[i] - c00[i]) * tx;
+		float b = c01[i] + (c11[i] - c01[i]) * tx;
+		out[i] = a + (b - a) * ty;
+	}
+}
+
+//SampleLevel with wrap addressing. linear filters within and between mips.
+static void
+sample_level(const sw_texture_view & view, float u, float v, float level, bool is_linear, float *out)
+{
+	const sw_image *image = view.image;
+	if (image == nullptr) {
+		out[0] = out[1] = out[2] = out[3] = 0.0f;
+		return;
+	}
+	float maxlevel = float(image->maxmips - 1);
+	level = (std::min)((std::max)(level + view.base_level, 0.0f), maxlevel);
+	if (!is_linear) {
+		int l = (int)(level + 0.5f);
+		int x = (int)floorf(u * image->mip_w(l));
+		int y = (int)floorf(v * image->mip_h(l));
+		fetch_texel(image, l, x, y, out);
+		return;
+	}
+	int l0 = (int)level;
+	float t = level - l0;
+	sample_level_bilinear(image, l0, u, v, out);
+	if (t > 0.0f && l0 + 1 <= maxlevel) {
+		float c1[4];
+		sample_level_bilinear(image, l0 + 1, u, v, c1);
+		for (int i = 0; i < 4; i++)
+			out[i] += (c1[i] - out[i]) * t;
+	}
+}
+
+static void
+image_load(const sw_texture_view & view, int x, int y, float *out)
+{
+	auto image = view.image;
+	int l = view.base_level;
+	if (image == nullptr || x < 0 || y < 0 || x >= image->mip_w(l) || y >= image->mip_h(l)) {
+		out[0] = out[1] = out[2] = out[3] = 0.0f;
+		return;
+	}
+	fetch_texel(image, l, x, y, out);
+}
+
+//Word of a buffer, 0 out of it.
+static uint32_t
+buffer_load(const sw_buffer_view & view, size_t index)
+{
+	uint32_t v = 0;
+	if (view.data && (index + 1) * sizeof(uint32_t) <= view.size)
+		memcpy(&v, view.data + index * sizeof(uint32_t), sizeof(v));
+	return v;
+}
+
+static void
+buffer_store(const sw_buffer_view & view, size_t index, uint32_t v)
+{
+	if (view.data && (index + 1) * sizeof(uint32_t) <= view.size)
+		memcpy(view.data + index * sizeof(uint32_t), &v, sizeof(v));
+}
+
+static void
+image_store(const sw_texture_view & view, int x, int y, const float *in)
+{
+	auto image = view.image;
+	int l = view.base_level;
+	if (image == nullptr || x < 0 || y < 0 || x >= image->mip_w(l) || y >= image->mip_h(l))
+		return;
+	memcpy(image->texel(l, x, y), in, sizeof(float) * image->channels);
+}
+
+//Built-in ports of shaders/*.glsl.
+//varyings : [0-3] v_pos, [4-6] v_nor, [7-8] v_uv
+struct sw_vertex_format {
+	float pos[4];
+	float nor[3];
+	float uv[2];
+};
+
+struct sw_constdata {
+	float time[4];
+	float misc[4];
+	float world[16];
+	float proj[16];
+	float view[16];
+};
+
+static void
+vs_fullscreen(const sw_vs_ctx & /*ctx*/, const uint8_t *vtx, float *pos, float *var)
+{
+	auto v = (const sw_vertex_format *)vtx;
+	memcpy(pos, v->pos, sizeof(float) * 4);
+	memcpy(var, pos, sizeof(float) * 4);
+	var[4] = 0.0f;
+	var[5] = 0.0f;
+	var[6] = 1.0f;
+	var[7] = v->uv[0];
+	var[8] = v->uv[1];
+}
+
+static void
+vs_clear(const sw_vs_ctx & ctx, const uint8_t *vtx, float *pos, float *var)
+{
+	vs_fullscreen(ctx, vtx, pos, var);
+	pos[3] = var[3] = 1.0f;
+}
+
+static bool
+ps_clear(const sw_ps_ctx & /*ctx*/, const float *var, float *color)
+{
+	float k = (std::max)(0.2f, 1.0f - (var[8] * 0.5f + 0.5f));
+	color[0] = 0.2f * k;
+	color[1] = 0.3f * k;
+	color[2] = 0.5f * k;
+	color[3] = 1.0f;
+	return true;
+}
+
+static void
+vs_model(const sw_vs_ctx & ctx, const uint8_t *vtx, float *pos, float *var)
+{
+	auto v = (const sw_vertex_format *)vtx;
+	auto cb = (const sw_constdata *)ctx.vcb[0];
+	float p[4] = {v->pos[0], v->pos[1], v->pos[2], 1.0f};
+	if (cb && cb->misc[0] > 0.5f) {
+		if (p[1] > 0.0f)
+			p[0] *= 0.0f;
+		p[1] += 2.1f;
+	}
+	if (cb) {
+		mul_row(p, cb->world, p);
+		mul_row(p, cb->view, p);
+		mul_row(p, cb->proj, p);
+	}
+	memcpy(pos, p, sizeof(p));
+	memcpy(var, p, sizeof(p));
+	memcpy(var + 4, v->nor, sizeof(float) * 3);
+	var[7] = v->uv[0];
+	var[8] = v->uv[1];
+}
+
+static bool
+ps_model(const sw_ps_ctx & ctx, const float *var, float *color)
+{
+	sample_level(ctx.vtex[0], var[7], var[8], 0.0f, true, color);
+	color[0] += 0.1f;
+	color[1] += 0.2f;
+	color[2] += 0.3f;
+	color[3] = var[2] / var[3];
+	return true;
+}
+
+//shaders/gbuffer : albedo, normal and depth targets.
+static void
+vs_gbuffer(const sw_vs_ctx & ctx, const uint8_t *vtx, float *pos, float *var)
+{
+	auto v = (const sw_vertex_format *)vtx;
+	auto cb = (const sw_constdata *)ctx.vcb[0];
+	float p[4] = {v->pos[0], v->pos[1], v->pos[2], 1.0f};
+	float n[4] = {v->nor[0], v->nor[1], v->nor[2], 0.0f};
+	if (cb) {
+		mul_row(p, cb->world, p);
+		mul_row(p, cb->view, p);
+		mul_row(p, cb->proj, p);
+		mul_row(n, cb->world, n);
+	}
+	memcpy(pos, p, sizeof(p));
+	memcpy(var, p, sizeof(p));
+	memcpy(var + 4, n, sizeof(float) * 3);
+	var[7] = v->uv[0];
+	var[8] = v->uv[1];
+}
+
+static bool
+ps_gbuffer(const sw_ps_ctx & ctx, const float *var, float *color)
+{
+	sample_level(ctx.vtex[0], var[7], var[8], 0.0f, true, color);
+	color[0] += 0.1f;
+	color[1] += 0.2f;
+	color[2] += 0.3f;
+	color[3] += 1.0f;
+	float len = sqrtf(var[4] * var[4] + var[5] * var[5] + var[6] * var[6]);
+	float scale = len > 0.0f ? 0.5f / len : 0.0f;
+	for (int i = 0; i < 3; i++)
+		color[4 + i] = var[4 + i] * scale + 0.5f;
+	color[7] = 1.0f;
+	color[8] = var[2] / var[3];
+	color[9] = color[10] = color[11] = 0.0f;
+	return true;
+}
+
+//shaders/deferred : directional light of the gbuffer targets.
+static bool
+ps_deferred(const sw_ps_ctx & ctx, const float *var, float *color)
+{
+	static const float fog[3] = {0.0f, 0.2f, 0.3f};
+	float normal[4], depth[4];
+	sample_level(ctx.vtex[0], var[7], var[8], 0.0f, false, color);
+	sample_level(ctx.vtex[1], var[7], var[8], 0.0f, false, normal);
+	sample_level(ctx.vtex[2], var[7], var[8], 0.0f, false, depth);
+	if (normal[3] == 0.0f)
+		return true;
+	float n[3], l[3] = {0.5f, 1.0f, 0.3f};
+	float nlen = 0.0f, llen = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		n[i] = normal[i] * 2.0f - 1.0f;
+		nlen += n[i] * n[i];
+		llen += l[i] * l[i];
+	}
+	float ndotl = (n[0] * l[0] + n[1] * l[1] + n[2] * l[2]) / (std::max)(sqrtf(nlen * llen), 0.0001f);
+	float k = 0.3f + 0.7f * (std::max)(ndotl, 0.0f);
+	float t = powf(depth[0], 64.0f);
+	for (int i = 0; i < 3; i++)
+		color[i] = color[i] * k + (fog[i] - color[i] * k) * t;
+	color[3] = 1.0f;
+	return true;
+}
+
+//uv in the drawn rect of GetScaledUv : [scale - max, max], half a texel inside.
+static inline float
+clamp_uv(float u, float scale, float max)
+{
+	return (std::min)((std::max)(u, scale - max), max);
+}
+
+//binfo of the bloom shaders : texel, then uv0 / uv1 of the drawn rects (dynamic resolution).
+static const float *
+get_bloom_info(const sw_ps_ctx & ctx)
+{
+	static const float none[12] = {0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2};
+	auto info = (const float *)ctx.vcb[0];
+	return info ? info : none;
+}
+
+//shaders/bloom_down : 5 bilinear taps, then the soft threshold and scale.
+static bool
+ps_bloom_down(const sw_ps_ctx & ctx, const float *var, float *color)
+{
+	static const float taps[5][3] = {
+		{0, 0, 4}, {-1, -1, 1}, {1, -1, 1}, {-1, 1, 1}, {1, 1, 1},
+	};
+	auto texel = get_bloom_info(ctx);
+	auto uv0 = texel + 4;
+	float u = var[7] * uv0[0];
+	float v = var[8] * uv0[1];
+	float col[4] = {};
+	for (auto & t : taps) {
+		float c[4];
+		sample_level(ctx.vtex[0], clamp_uv(u + t[0] * texel[0], uv0[0], uv0[2]), clamp_uv(v + t[1] * texel[1], uv0[1], uv0[3]), 0.0f, true, c);
+		for (int k = 0; k < 4; k++)
+			col[k] += c[k] * t[2];
+	}
+	float br = (std::max)(col[0], (std::max)(col[1], col[2])) * (1.0f / 8.0f);
+	float k = (std::max)(br - texel[2], 0.0f) / (std::max)(br, 0.0001f) * texel[3];
+	for (int i = 0; i < 3; i++)
+		color[i] = col[i] * (1.0f / 8.0f) * k;
+	color[3] = 1.0f;
+	return true;
+}
+
+//shaders/bloom_up : 8 bilinear taps of the lower level plus this size.
+static bool
+ps_bloom_up(const sw_ps_ctx & ctx, const float *var, float *color)
+{
+	static const float taps[8][3] = {
+		{-1, 0, 1}, {1, 0, 1}, {0, -1, 1}, {0, 1, 1},
+		{-0.5f, -0.5f, 2}, {0.5f, -0.5f, 2}, {-0.5f, 0.5f, 2}, {0.5f, 0.5f, 2},
+	};
+	auto texel = get_bloom_info(ctx);
+	auto uv0 = texel + 4;
+	auto uv1 = texel + 8;
+	float u = var[7] * uv0[0];
+	float v = var[8] * uv0[1];
+	float col[4] = {};
+	float c[4];
+	for (auto & t : taps) {
+		sample_level(ctx.vtex[0], clamp_uv(u + t[0] * texel[0], uv0[0], uv0[2]), clamp_uv(v + t[1] * texel[1], uv0[1], uv0[3]), 0.0f, true, c);
+		for (int k = 0; k < 4; k++)
+			col[k] += c[k] * t[2];
+	}
+	sample_level(ctx.vtex[1], var[7] * uv1[0], var[8] * uv1[1], 0.0f, true, c);
+	for (int i = 0; i < 3; i++)
+		color[i] = (col[i] * (1.0f / 12.0f) + c[i]) * texel[3];
+	color[3] = 1.0f;
+	return true;
+}
+
+//shaders/present : tex0 plus the bloom tex1, upscaled from their drawn rects (presentinfo uv0 / uv1).
+static bool
+ps_present(const sw_ps_ctx & ctx, const float *var, float *color)
+{
+	static const float none[8] = {1, 1, 2, 2, 1, 1, 2, 2};
+	auto uv0 = ctx.vcb[0] ? (const float *)ctx.vcb[0] : none;
+	auto uv1 = uv0 + 4;
+	float u = var[7] * uv0[0];
+	float v = var[8] * uv0[1];
+	float blur[4], c[4];
+	sample_level(ctx.vtex[0], clamp_uv(u, uv0[0], uv0[2]), clamp_uv(v, uv0[1], uv0[3]), 0.0f, true, color);
+	sample_level(ctx.vtex[1], clamp_uv(var[7] * uv1[0], uv1[0], uv1[2]), clamp_uv(var[8] * uv1[1], uv1[1], uv1[3]), 0.0f, true, blur);
+	sample_level(ctx.vtex[0], clamp_uv(u + 0.001f, uv0[0], uv0[2]), clamp_uv(v + 0.001f, uv0[1], uv0[3]), 0.0f, true, c);
+	color[0] = c[0];
+	sample_level(ctx.vtex[0], clamp_uv(u - 0.001f, uv0[0], uv0[2]), clamp_uv(v - 0.001f, uv0[1], uv0[3]), 0.0f, true, c);
+	color[2] = c[2];
+	for (int k = 0; k < 4; k++)
+		color[k] += blur[k];
+	return true;
+}
+
+static void
+vs_showdepth(const sw_vs_ctx & ctx, const uint8_t *vtx, float *pos, float *var)
+{
+	vs_fullscreen(ctx, vtx, pos, var);
+	var[7] *= 4.0f;
+	var[8] *= 4.0f;
+}
+
+static bool
+ps_showdepth(const sw_ps_ctx & ctx, const float *var, float *color)
+{
+	if (var[7] > 1.0f || var[8] > 1.0f)
+		return false;
+	float c[4];
+	sample_level(ctx.vtex[0], var[7], var[8], 0.0f, true, c);
+	float d = powf(c[0], 64.0f);
+	color[0] = color[1] = color[2] = color[3] = d;
+	return true;
+}
+
+static void
+cs_genmipmap(const sw_cs_ctx & ctx, int x, int y, int /*z*/)
+{
+	float c[4];
+	image_load(ctx.vuav[0], x * 2, y * 2, c);
+	image_store(ctx.vuav[1], x, y, c);
+}
+
+//shaders/instanced : model of instance (visible[SV_InstanceID] when misc.y is set).
+//t1 : visible instance indices, t2 : float4 center xyz and scale w of each instance.
+static void
+vs_instanced(const sw_vs_ctx & ctx, const uint8_t *vtx, float *pos, float *var)
+{
+	auto v = (const sw_vertex_format *)vtx;
+	auto cb = (const sw_constdata *)ctx.vcb[0];
+	uint32_t index = ctx.instance;
+	if (cb && cb->misc[1] > 0.5f)
+		index = buffer_load(ctx.vbuf[1], index);
+	float inst[4];
+	for (int i = 0; i < 4; i++) {
+		uint32_t word = buffer_load(ctx.vbuf[2], size_t(index) * 4 + i);
+		memcpy(&inst[i], &word, sizeof(float));
+	}
+	float p[4] = {v->pos[0] * inst[3] + inst[0], v->pos[1] * inst[3] + inst[1], v->pos[2] * inst[3] + inst[2], 1.0f};
+	if (cb) {
+		mul_row(p, cb->world, p);
+		mul_row(p, cb->view, p);
+		mul_row(p, cb->proj, p);
+	}
+	memcpy(pos, p, sizeof(p));
+	memcpy(var, p, sizeof(p));
+	memcpy(var + 4, v->nor, sizeof(float) * 3);
+	var[7] = v->uv[0];
+	var[8] = v->uv[1];
+}
+
+//shaders/hiz_copy : depth of t0 to level 0 of the Hi-Z u1.
+static void
+cs_hiz_copy(const sw_cs_ctx & ctx, int x, int y, int /*z*/)
+{
+	float c[4];
+	image_load(ctx.vuav[0], x, y, c);
+	c[1] = c[2] = 0.0f;
+	c[3] = 1.0f;
+	image_store(ctx.vuav[1], x, y, c);
+}
+
+//shaders/hiz : u1 = the farthest depth of the 2x2 of u0 below, with the last row / column of an odd size.
+static void
+cs_hiz(const sw_cs_ctx & ctx, int x, int y, int /*z*/)
+{
+	auto & src = ctx.vuav[0];
+	auto & dst = ctx.vuav[1];
+	if (src.image == nullptr || dst.image == nullptr)
+		return;
+	int sw = src.image->mip_w(src.base_level);
+	int sh = src.image->mip_h(src.base_level);
+	int dw = dst.image->mip_w(dst.base_level);
+	int dh = dst.image->mip_h(dst.base_level);
+	if (x >= dw || y >= dh)
+		return;
+	int x1 = (std::min)(x * 2 + ((x == dw - 1 && (sw & 1)) ? 2 : 1), sw - 1);
+	int y1 = (std::min)(y * 2 + ((y == dh - 1 && (sh & 1)) ? 2 : 1), sh - 1);
+	float c[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	for (int sy = y * 2; sy <= y1; sy++) {
+		for (int sx = x * 2; sx <= x1; sx++) {
+			float t[4];
+			image_load(src, sx, sy, t);
+			c[0] = (std::max)(c[0], t[0]);
+		}
+	}
+	image_store(dst, x, y, c);
+}
+
+//cullinfo of shaders/cull.
+struct sw_cullinfo {
+	float view[16];
+	float proj[16];
+	float hiz[4];    //w, h, levels of the Hi-Z, w 1 : occlusion test.
+	uint32_t count[4];
+};
+
+//shaders/cull : instance x against the frustum and the Hi-Z t1. t0 : float4 bounding spheres,
+//u2 : draw_index_indirect_args, instance_count is added to. u3 : visible instance indices.
+static void
+cs_cull(const sw_cs_ctx & ctx, int x, int /*y*/, int /*z*/)
+{
+	auto info = (const sw_cullinfo *)ctx.vcb[0];
+	if (info == nullptr || uint32_t(x) >= info->count[0])
+		return;
+	float sphere[4];
+	for (int i = 0; i < 4; i++) {
+		uint32_t word = buffer_load(ctx.vbuf[0], size_t(x) * 4 + i);
+		memcpy(&sphere[i], &word, sizeof(float));
+	}
+
+	//corners of the box around the sphere. Culled when all are out of one plane.
+	int outside[6] = {};
+	bool is_behind = false;
+	float minx = 1.0f, miny = 1.0f, maxx = -1.0f, maxy = -1.0f, minz = 1.0f;
+	for (int i = 0; i < 8; i++) {
+		float p[4] = {
+			sphere[0] + ((i & 1) ? sphere[3] : -sphere[3]),
+			sphere[1] + ((i & 2) ? sphere[3] : -sphere[3]),
+			sphere[2] + ((i & 4) ? sphere[3] : -sphere[3]),
+			1.0f,
+		};
+		mul_row(p, info->view, p);
+		mul_row(p, info->proj, p);
+		outside[0] += p[0] < -p[3];
+		outside[1] += p[0] > p[3];
+		outside[2] += p[1] < -p[3];
+		outside[3] += p[1] > p[3];
+		outside[4] += p[2] < 0.0f;
+		outside[5] += p[2] > p[3];
+		if (p[3] <= 0.0f) {
+			is_behind = true;
+			continue;
+		}
+		minx = (std::min)(minx, p[0] / p[3]);
+		maxx = (std::max)(maxx, p[0] / p[3]);
+		miny = (std::min)(miny, p[1] / p[3]);
+		maxy = (std::max)(maxy, p[1] / p[3]);
+		minz = (std::min)(minz, p[2] / p[3]);
+	}
+	for (auto n : outside)
+		if (n == 8)
+			return;
+
+	//the level where the rect is 2x2 texels at most. Occluded if it is behind the farthest depth of them.
+	if (!is_behind && info->hiz[3] > 0.5f) {
+		int w = int(info->hiz[0]);
+		int h = int(info->hiz[1]);
+		int levels = int(info->hiz[2]);
+		auto to_texel = [](float v, int size) {
+			return (std::min)((std::max)(int(floorf(v * float(size))), 0), size - 1);
+		};
+		int x0 = to_texel(minx * 0.5f + 0.5f, w);
+		int x1 = to_texel(maxx * 0.5f + 0.5f, w);
+		int y0 = to_texel(0.5f - maxy * 0.5f, h);
+		int y1 = to_texel(0.5f - miny * 0.5f, h);
+		int level = 0;
+		while ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)
+			level++;
+		if (level < levels) {
+			sw_texture_view view = ctx.vuav[1];
+			view.base_level += level;
+			int lw = (std::max)(w >> level, 1);
+			int lh = (std::max)(h >> level, 1);
+			float depth = 0.0f;
+			for (int i = 0; i < 4; i++) {
+				float c[4];
+				int tx = (std::min)(((i & 1) ? x1 : x0) >> level, lw - 1);
+				int ty = (std::min)(((i & 2) ? y1 : y0) >> level, lh - 1);
+				image_load(view, tx, ty, c);
+				depth = (std::max)(depth, c[0]);
+			}
+			if (minz > depth)
+				return;
+		}
+	}
+
+	//the pool runs the rows of a dispatch in parallel.
+	static std::mutex mtx;
+	std::lock_guard<std::mutex> lock(mtx);
+	uint32_t index = buffer_load(ctx.vbuf[2], 1);
+	buffer_store(ctx.vbuf[2], 1, index + 1);
+	buffer_store(ctx.vbuf[3], index, uint32_t(x));
+}
+
+static void
+register_builtin_shaders()
+{
+	sw_shader shader;
+
+	shader = {};
+	shader.vs = vs_clear;
+	shader.ps = ps_clear;
+	register_shader("clear", shader);
+
+	shader = {};
+	shader.vs = vs_model;
+	shader.ps = ps_model;
+	register_shader("model", shader);
+
+	shader = {};
+	shader.vs = vs_gbuffer;
+	shader.ps = ps_gbuffer;
+	register_shader("gbuffer", shader);
+
+	shader = {};
+	shader.vs = vs_fullscreen;
+	shader.ps = ps_deferred;
+	register_shader("deferred", shader);
+
+	shader = {};
+	shader.vs = vs_fullscreen;
+	shader.ps = ps_bloom_down;
+	register_shader("bloom_down", shader);
+
+	shader = {};
+	shader.vs = vs_fullscreen;
+	shader.ps = ps_bloom_up;
+	register_shader("bloom_up", shader);
+
+	shader = {};
+	shader.vs = vs_fullscreen;
+	shader.ps = ps_present;
+	register_shader("present", shader);
+
+	shader = {};
+	shader.vs = vs_showdepth;
+	shader.ps = ps_showdepth;
+	register_shader("showdepth", shader);
+
+	shader = {};
+	shader.cs = cs_genmipmap;
+	register_shader("genmipmap", shader);
+
+	shader = {};
+	shader.vs = vs_instanced;
+	shader.ps = ps_model;
+	register_shader("instanced", shader);
+
+	shader = {};
+	shader.cs = cs_hiz_copy;
+	shader.local_size[0] = 8;
+	shader.local_size[1] = 8;
+	register_shader("hiz_copy", shader);
+
+	shader = {};
+	shader.cs = cs_hiz;
+	shader.local_size[0] = 8;
+	shader.local_size[1] = 8;
+	register_shader("hiz", shader);
+
+	shader = {};
+	shader.cs = cs_cull;
+	shader.local_size[0] = 64;
+	register_shader("cull", shader);
+}
+
+//Workers pull job indices from an atomic counter. The caller thread works too.
+struct sw_thread_pool {
+	std::vector<std::thread> vthreads;
+	std::mutex mtx;
+	std::condition_variable cv_job;
+	std::condition_variable cv_done;
+	std::function<void(int)> job;
+	std::atomic<int> next {0};
+	int count = 0;
+	int active = 0;
+	uint64_t generation = 0;
+	bool is_exit = false;
+
+	void start(int num)
+	{
+		is_exit = false;
+		for (int i = 0; i < num; i++)
+			vthreads.push_back(std::thread([this]() {
+			worker();
+		}));
+	}
+
+	void work()
+	{
+		for (;;) {
+			int i = next++;
+			if (i >= count)
+				break;
+			job(i);
+		}
+	}
+
+	void worker()
+	{
+		uint64_t seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv_job.wait(lock, [&]() {
+					return is_exit || generation != seen;
+				});
+				if (is_exit)
+					return;
+				seen = generation;
+			}
+			work();
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				if (--active == 0)
+					cv_done.notify_one();
+			}
+		}
+	}
+
+	void run(int num, std::function<void(int)> fn)
+	{
+		if (vthreads.empty() || num <= 1) {
+			for (int i = 0; i < num; i++)
+				fn(i);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			job = fn;
+			count = num;
+			next = 0;
+			active = (int)vthreads.size();
+			generation++;
+		}
+		cv_job.notify_all();
+		work();
+		std::unique_lock<std::mutex> lock(mtx);
+		cv_done.wait(lock, [&]() {
+			return active == 0;
+		});
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			is_exit = true;
+		}
+		cv_job.notify_all();
+		for (auto & x : vthreads)
+			x.join();
+		vthreads.clear();
+	}
+};
+
+struct sw_vertex {
+	float pos[4];
+	float var[SW_VARYING_MAX];
+};
+
+struct sw_draw_state {
+	const sw_shader *shader = nullptr;
+	bool is_cull = false;
+	bool is_enable_depth = false;
+	int depth_func = DEPTH_FUNC_DEFAULT;
+	sw_ps_ctx ps_ctx = {};
+};
+
+//Setup result. edge functions are scaled by 1/area, so they are barycentrics.
+struct sw_triangle {
+	float ea[3];
+	float eb[3];
+	float ec[3];
+	float z[3];
+	float invw[3];
+	float var[3][SW_VARYING_MAX]; //var / w
+	int x0, y0, x1, y1;
+	uint32_t draw;
+};
+
+//Draws to one set of render targets, rasterized together when the targets change.
+struct sw_pass {
+	sw_image *color = nullptr; //nullptr on a depth only pass.
+	sw_image *vcolor[RENDER_TARGET_MAX] = {}; //vcolor[0] is color.
+	int color_count = 0;
+	sw_image *depth = nullptr;
+	int w = 0;
+	int h = 0;
+	cmd::rect_t viewport = {}; //set_render_target.rect, inside w x h.
+	std::vector<sw_draw_state> vdraws;
+	std::vector<sw_triangle> vtris;
+	std::deque<std::vector<uint8_t>> vconstants;
+	std::vector<std::vector<uint32_t>> vbins;
+};
+
+//Clip against near plane z >= 0 (D3D/Vulkan clip space).
+static int
+clip_near(const sw_vertex *in, sw_vertex *out)
+{
+	int num = 0;
+	for (int i = 0; i < 3; i++) {
+		auto & a = in[i];
+		auto & b = in[(i + 1) % 3];
+		bool ina = a.pos[2] >= 0.0f;
+		bool inb = b.pos[2] >= 0.0f;
+		if (ina)
+			out[num++] = a;
+		if (ina != inb) {
+			float t = a.pos[2] / (a.pos[2] - b.pos[2]);
+			auto & o = out[num++];
+			for (int k = 0; k < 4; k++)
+				o.pos[k] = a.pos[k] + (b.pos[k] - a.pos[k]) * t;
+			for (int k = 0; k < SW_VARYING_MAX; k++)
+				o.var[k] = a.var[k] + (b.var[k] - a.var[k]) * t;
+		}
+	}
+	return num;
+}
+
+static void
+setup_triangle(sw_pass & pass, const sw_vertex & v0, const sw_vertex & v1, const sw_vertex & v2, uint32_t draw)
+{
+	const sw_vertex *vtx[3] = {&v0, &v1, &v2};
+	auto & state = pass.vdraws[draw];
+	auto & vp = pass.viewport;
+	float sx[4], sy[4];
+	sw_triangle tri;
+
+	for (int i = 0; i < 3; i++) {
+		auto & v = *vtx[i];
+		if (v.pos[3] <= 0.0f)
+			return;
+		float invw = 1.0f / v.pos[3];
+		sx[i] = (v.pos[0] * invw * 0.5f + 0.5f) * vp.w + vp.x;
+		sy[i] = (0.5f - v.pos[1] * invw * 0.5f) * vp.h + vp.y;
+		tri.z[i] = v.pos[2] * invw;
+		tri.invw[i] = invw;
+		for (int k = 0; k < SW_VARYING_MAX; k++)
+			tri.var[i][k] = v.var[k] * invw;
+	}
+	sx[3] = sy[3] = 0.0f;
+
+	//Edge i is opposite to vertex i. all three edges at once.
+	vf4 xa = vf4::set(sx[1], sx[2], sx[0], 0.0f);
+	vf4 ya = vf4::set(sy[1], sy[2], sy[0], 0.0f);
+	vf4 xb = vf4::set(sx[2], sx[0], sx[1], 0.0f);
+	vf4 yb = vf4::set(sy[2], sy[0], sy[1], 0.0f);
+	vf4 a = ya - yb;
+	vf4 b = xb - xa;
+	vf4 c = vf4::set1(0.0f) - (a * xa + b * ya);
+
+	//visually clockwise in y-down screen space is positive.
+	float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+	if (area == 0.0f)
+		return;
+	if (state.is_cull && area > 0.0f)
+		return;
+	vf4 scale = vf4::set1(1.0f / area);
+	float ea[4], eb[4], ec[4];
+	(a * scale).store(ea);
+	(b * scale).store(eb);
+	(c * scale).store(ec);
+	for (int i = 0; i < 3; i++) {
+		tri.ea[i] = ea[i];
+		tri.eb[i] = eb[i];
+		tri.ec[i] = ec[i];
+	}
+
+	float minx = (std::min)({sx[0], sx[1], sx[2]});
+	float maxx = (std::max)({sx[0], sx[1], sx[2]});
+	float miny = (std::min)({sy[0], sy[1], sy[2]});
+	float maxy = (std::max)({sy[0], sy[1], sy[2]});
+	tri.x0 = (std::max)((int)floorf(minx), vp.x);
+	tri.y0 = (std::max)((int)floorf(miny), vp.y);
+	tri.x1 = (std::min)((int)ceilf(maxx), vp.x + vp.w - 1);
+	tri.y1 = (std::min)((int)ceilf(maxy), vp.y + vp.h - 1);
+	if (tri.x0 > tri.x1 || tri.y0 > tri.y1)
+		return;
+	tri.draw = draw;
+	pass.vtris.push_back(tri);
+}
+
+static void
+raster_tile(sw_pass & pass, int tile)
+{
+	int tiles_x = (pass.w + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+	int tx0 = (tile % tiles_x) * SW_TILE_SIZE;
+	int ty0 = (tile / tiles_x) * SW_TILE_SIZE;
+	int tx1 = (std::min)(tx0 + SW_TILE_SIZE, pass.w) - 1;
+	int ty1 = (std::min)(ty0 + SW_TILE_SIZE, pass.h) - 1;
+	auto color = pass.color;
+	auto depth = pass.depth;
+	const vf4 zero = vf4::set1(0.0f);
+
+	for (auto index : pass.vbins[tile]) {
+		auto & tri = pass.vtris[index];
+		auto & state = pass.vdraws[tri.draw];
+		auto ps = color ? state.shader->ps : state.shader->ps_depth;
+		bool is_depth = state.is_enable_depth && depth;
+		bool is_depth_equal = is_depth && state.depth_func == DEPTH_FUNC_EQUAL;
+		int x0 = (std::max)(tri.x0, tx0);
+		int x1 = (std::min)(tri.x1, tx1);
+		int y0 = (std::max)(tri.y0, ty0);
+		int y1 = (std::min)(tri.y1, ty1);
+
+		vf4 ea0 = vf4::set1(tri.ea[0]), ea1 = vf4::set1(tri.ea[1]), ea2 = vf4::set1(tri.ea[2]);
+		vf4 z0 = vf4::set1(tri.z[0]), z1 = vf4::set1(tri.z[1]), z2 = vf4::set1(tri.z[2]);
+		vf4 w0 = vf4::set1(tri.invw[0]), w1 = vf4::set1(tri.invw[1]), w2 = vf4::set1(tri.invw[2]);
+		vf4 lane = vf4::set(0.5f, 1.5f, 2.5f, 3.5f);
+
+		for (int y = y0; y <= y1; y++) {
+			float py = y + 0.5f;
+			vf4 row0 = vf4::set1(tri.eb[0] * py + tri.ec[0]);
+			vf4 row1 = vf4::set1(tri.eb[1] * py + tri.ec[1]);
+			vf4 row2 = vf4::set1(tri.eb[2] * py + tri.ec[2]);
+			float *depth_row = is_depth ? depth->texel(0, 0, y) : nullptr;
+
+			for (int x = x0; x <= x1; x += 4) {
+				vf4 px = vf4::set1(float(x)) + lane;
+				vf4 b0 = ea0 * px + row0;
+				vf4 b1 = ea1 * px + row1;
+				vf4 b2 = ea2 * px + row2;
+				vf4 inside = cmpge(b0, zero) & cmpge(b1, zero) & cmpge(b2, zero);
+				inside = inside & cmplt(px, vf4::set1(float(x1 + 1)));
+				int mask = movemask(inside);
+				if (mask == 0)
+					continue;
+
+				vf4 z = b0 * z0 + b1 * z1 + b2 * z2;
+				if (is_depth) {
+					float d[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+					//stay inside the tile. the neighbour belongs to another thread.
+					if (x + 4 <= x1 + 1)
+						memcpy(d, depth_row + x, sizeof(d));
+					else
+						for (int i = 0; x + i <= x1; i++)
+							d[i] = depth_row[x + i];
+					auto dv = vf4::load(d);
+					mask &= movemask(is_depth_equal ? cmple(z, dv) & cmpge(z, dv) : cmple(z, dv));
+					if (mask == 0)
+						continue;
+				}
+
+				//depth only without alpha test : no varyings, no pixel shader.
+				if (!ps) {
+					float fz[4];
+					z.store(fz);
+					for (int i = 0; i < 4 && is_depth; i++)
+						if (mask & (1 << i))
+							depth_row[x + i] = fz[i];
+					continue;
+				}
+
+				float fb[3][4], fz[4], fw[4];
+				b0.store(fb[0]);
+				b1.store(fb[1]);
+				b2.store(fb[2]);
+				z.store(fz);
+				(b0 * w0 + b1 * w1 + b2 * w2).store(fw);
+
+				for (int i = 0; i < 4; i++) {
+					if ((mask & (1 << i)) == 0)
+						continue;
+
+					//perspective correct varyings. 3 x 4 wide.
+					float var[SW_VARYING_MAX];
+					vf4 wb0 = vf4::set1(fb[0][i] / fw[i]);
+					vf4 wb1 = vf4::set1(fb[1][i] / fw[i]);
+					vf4 wb2 = vf4::set1(fb[2][i] / fw[i]);
+					for (int k = 0; k < SW_VARYING_MAX; k += 4) {
+						auto v = wb0 * vf4::load(&tri.var[0][k]) +
+							wb1 * vf4::load(&tri.var[1][k]) +
+							wb2 * vf4::load(&tri.var[2][k]);
+						v.store(&var[k]);
+					}
+
+					float out[4 * RENDER_TARGET_MAX];
+					if (!ps(state.ps_ctx, var, out))
+						continue;
+					for (int t = 0; t < pass.color_count; t++)
+						store_texel(pass.vcolor[t]->fmt, pass.vcolor[t]->texel(0, x + i, y), out + t * 4);
+					if (is_depth && !is_depth_equal)
+						depth_row[x + i] = fz[i];
+				}
+			}
+		}
+	}
+}
+
+static void
+flush_pass(sw_pass & pass, sw_thread_pool & pool)
+{
+	if (pass.vtris.size() && (pass.color || pass.depth)) {
+		int tiles_x = (pass.w + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+		int tiles_y = (pass.h + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+		pass.vbins.resize(tiles_x * tiles_y);
+		for (auto & x : pass.vbins)
+			x.clear();
+		for (uint32_t i = 0; i < pass.vtris.size(); i++) {
+			auto & tri = pass.vtris[i];
+			for (int ty = tri.y0 / SW_TILE_SIZE; ty <= tri.y1 / SW_TILE_SIZE; ty++)
+				for (int tx = tri.x0 / SW_TILE_SIZE; tx <= tri.x1 / SW_TILE_SIZE; tx++)
+					pass.vbins[ty * tiles_x + tx].push_back(i);
+		}
+		pool.run(tiles_x * tiles_y, [&](int tile) {
+			raster_tile(pass, tile);
+		});
+	}
+	pass.vtris.clear();
+	pass.vdraws.clear();
+	pass.vconstants.clear();
+}
+
+//Same split as the gpu single pass downsampler : a job per 64x64 tile of level 0 writes
+//levels 1-6 of the tile while it is in cache, the caller does the rest from level 6.
+enum {
+	SW_MIPS_TILE_LEVELS = 6,
+};
+
+static void
+downsample_level(sw_image & image, int level, int x0, int y0, int x1, int y1)
+{
+	int ch = image.channels;
+	for (int y = y0; y < y1; y++) {
+		for (int x = x0; x < x1; x++) {
+			auto a = image.texel(level - 1, x * 2, y * 2);
+			auto b = image.texel(level - 1, x * 2 + 1, y * 2);
+			auto c = image.texel(level - 1, x * 2, y * 2 + 1);
+			auto d = image.texel(level - 1, x * 2 + 1, y * 2 + 1);
+			auto dst = image.texel(level, x, y);
+			for (int i = 0; i < ch; i++)
+				dst[i] = (a[i] + b[i] + c[i] + d[i]) * 0.25f;
+		}
+	}
+}
+
+static void
+generate_mips(sw_image & image, int levels, sw_thread_pool & pool)
+{
+	levels = (std::min)(levels, image.maxmips);
+	//Both sizes of the source are >= 2 for every level generated.
+	levels = (std::min)(levels, oden_get_mipmap_max(image.w, image.h));
+	if (levels <= 1)
+		return;
+	int tile = 1 << SW_MIPS_TILE_LEVELS;
+	int tiles_x = (image.w + tile - 1) / tile;
+	int tiles_y = (image.h + tile - 1) / tile;
+	int tile_levels = (std::min)(levels - 1, (int)SW_MIPS_TILE_LEVELS);
+	pool.run(tiles_x * tiles_y, [&](int index) {
+		int tx = index % tiles_x;
+		int ty = index / tiles_x;
+		for (int l = 1; l <= tile_levels; l++) {
+			int size = tile >> l;
+			downsample_level(image, l, tx * size, ty * size,
+				(std::min)((tx + 1) * size, image.mip_w(l)),
+				(std::min)((ty + 1) * size, image.mip_h(l)));
+		}
+	});
+	for (int l = tile_levels + 1; l < levels; l++)
+		downsample_level(image, l, 0, 0, image.mip_w(l), image.mip_h(l));
+}
+
+void
+oden::oden_present_graphics(
+	const char * appname, std::vector<cmd> & vcmd,
+	void *handle, uint32_t w, uint32_t h,
+	uint32_t count, uint32_t heapcount, uint32_t slotmax)
+{
+	static std::map<std::string, sw_image> mimages;
+	static std::map<std::string, std::pair<std::string, int>> mmipviews;
+	static std::map<std::string, std::vector<uint8_t>> mbuffers;
+	static std::map<std::string, std::vector<uint8_t>> mstorage_buffers;
+	static std::map<std::string, size_t> mvertex_strides;
+	static std::map<std::string, sw_shader> mspirv_shaders;
+	static sw_thread_pool pool;
+	static sw_pass pass;
+	static bool is_prefer_spirv = false;
+	static bool is_initialized = false;
+	static uint64_t frame_count = 0;
+
+	struct selected_handle {
+		std::string rendertarget;
+		const sw_shader *shader;
+		bool is_cull;
+		bool is_enable_depth;
+		int depth_func;
+		std::string vertex;
+		std::string index;
+		sw_texture_view vtex[SW_SLOT_MAX];
+		std::string vconstants[SW_SLOT_MAX];
+		std::string vbuffers[SW_SLOT_MAX];
+	};
+	selected_handle rec = {};
+	sw_image *present_image = nullptr;
+	if (slotmax > SW_SLOT_MAX)
+		slotmax = SW_SLOT_MAX;
+
+	auto find_buffer = [&](const std::string & name) {
+		sw_buffer_view view;
+		auto it = mstorage_buffers.find(name);
+		if (it != mstorage_buffers.end()) {
+			view.data = it->second.data();
+			view.size = it->second.size();
+		}
+		return view;
+	};
+
+	auto find_view = [&](std::string name) {
+		sw_texture_view view;
+		auto it = mimages.find(name);
+		if (it != mimages.end()) {
+			view.image = &it->second;
+			return view;
+		}
+		auto mip = mmipviews.find(name);
+		if (mip != mmipviews.end()) {
+			view.image = &mimages[mip->second.first];
+			view.base_level = mip->second.second;
+		}
+		return view;
+	};
+
+	if (!is_initialized && handle) {
+		LOG_INFO("appname=%s, w=%u, h=%u, count=%u, heapcount=%u, slotmax=%u\n",
+			appname, w, h, count, heapcount, slotmax);
+		register_builtin_shaders();
+		//ODEN_SW_THREADS : total threads including the caller.
+		int threads = (int)std::thread::hardware_concurrency();
+		if (getenv("ODEN_SW_THREADS"))
+			threads = atoi(getenv("ODEN_SW_THREADS"));
+		pool.start((std::max)(threads - 1, 0));
+		LOG_INFO("worker threads=%zu\n", pool.vthreads.size());
+		//ODEN_SW_SPIRV : run compute shaders by the SPIR-V interpreter even if a kernel is registered.
+		is_prefer_spirv = getenv("ODEN_SW_SPIRV") != nullptr;
+		is_initialized = true;
+	}
+
+	if (handle == nullptr) {
+		LOG_INFO("handle == nullptr. Start terminate...\n");
+		pass = sw_pass();
+		pool.stop();
+		mimages.clear();
+		mmipviews.clear();
+		mbuffers.clear();
+		mstorage_buffers.clear();
+		mvertex_strides.clear();
+		mspirv_shaders.clear();
+		release_memory_all();
+		is_initialized = false;
+		LOG_INFO("handle == nullptr. End terminate...\n");
+		log_flush();
+		return;
+	}
+
+	trace_scope trace_frame("frame", "frame " + std::to_string(frame_count));
+	auto frame_start = get_time_ms();
+	std::vector<cmd_stats> vstats(CMD_MAX);
+
+	//Draws are rasterized when their pass is flushed, so the flush is the "gpu" time
+	//of the last draw of the pass. Dispatches run in place.
+	std::vector<pass_segment> vsegments;
+	double segment_cpu_ms = 0.0;
+	double segment_start = frame_start;
+	double flush_ms = 0.0;
+	size_t pass_segment_index = SIZE_MAX;
+	auto flush = [&]() {
+		auto start = get_time_ms();
+		flush_pass(pass, pool);
+		auto ms = get_time_ms() - start;
+		flush_ms += ms;
+		if (pass_segment_index < vsegments.size())
+			vsegments[pass_segment_index].gpu_ms += ms;
+		pass_segment_index = SIZE_MAX;
+	};
+	for (auto & c : vcmd) {
+		auto type = c.type;
+		auto & name = c.name;
+		auto cmd_start = get_time_ms();
+
+		//CMD_SET_BARRIER
+		if (type == CMD_SET_BARRIER) {
+			flush();
+			if (c.set_barrier.to_present)
+				present_image = find_view(name).image;
+		}
+
+		//CMD_SET_RENDER_TARGET
+		if (type == CMD_SET_RENDER_TARGET) {
+			auto & rect = c.set_render_target.rect;
+			int rw = 0;
+			int rh = 0;
+			oden_get_render_target_size(c, rw, rh);
+			bool is_backbuffer = c.set_render_target.is_backbuffer;
+			int maxmips = oden_get_mipmap_max(rw, rh);
+			if (maxmips == 0 || rect.w <= 0 || rect.h <= 0) {
+				LOG_ERR("Invalid RT size w=%d, h=%d name=%s\n", rw, rh, name.c_str());
+				exit(1);
+			}
+
+			bool is_depth_only = c.set_render_target.is_depth_only;
+			int rt_count = is_depth_only ? 0 : oden_get_render_target_count(c);
+			if ((is_backbuffer && rt_count > 1) || (is_backbuffer && is_depth_only)) {
+				LOG_ERR("Backbuffer with multiple or depth only render targets name=%s\n", name.c_str());
+				exit(1);
+			}
+
+			auto name_depth = oden_get_depth_render_target_name(name);
+			if (mimages.count(name_depth) == 0) {
+				mimages[name_depth].create(rw, rh, 1, 1);
+				account_memory(name_depth, MEMORY_RT_DEPTH, "system", mimages[name_depth].bytes());
+			}
+			if (rec.rendertarget != name || pass.color_count != rt_count)
+				flush();
+			for (int t = 0; t < rt_count; t++) {
+				auto name_color = oden_get_color_render_target_name(name, t);
+				auto fmt = is_backbuffer ? FMT_R8G8B8A8_UNORM : oden_get_render_target_format(c, t);
+				if (fmt < 0 || fmt >= FMT_MAX || oden_is_block_format(fmt)) {
+					LOG_ERR("Invalid RT format fmt=%s name=%s\n", oden_get_format_name(fmt), name_color.c_str());
+					exit(1);
+				}
+				if (mimages.count(name_color) == 0) {
+					trace_scope trace("resource", name_color);
+					mimages[name_color].create(rw, rh, 4, is_backbuffer ? 1 : maxmips);
+					mimages[name_color].fmt = fmt;
+					for (int i = 0; i < maxmips && !is_backbuffer; i++)
+						mmipviews[oden_get_mipmap_name(name_color, i)] = {name_color, i};
+					account_memory(name_color, MEMORY_RT_COLOR, "system", mimages[name_color].bytes());
+				}
+				pass.vcolor[t] = &mimages[name_color];
+			}
+			pass.color = rt_count ? pass.vcolor[0] : nullptr;
+			pass.color_count = rt_count;
+			pass.depth = &mimages[name_depth];
+			pass.w = pass.depth->w;
+			pass.h = pass.depth->h;
+			//targets keep their size, the rect draws into a part of them.
+			pass.viewport.x = (std::min)((std::max)(rect.x, 0), pass.w - 1);
+			pass.viewport.y = (std::min)((std::max)(rect.y, 0), pass.h - 1);
+			pass.viewport.w = (std::min)(rect.w, pass.w - pass.viewport.x);
+			pass.viewport.h = (std::min)(rect.h, pass.h - pass.viewport.y);
+			rec.rendertarget = name;
+		}
+
+		//CMD_SET_TEXTURE
+		if (type == CMD_SET_TEXTURE || type == CMD_SET_TEXTURE_UAV) {
+			auto slot = c.set_texture.slot;
+			if (mimages.count(name) == 0 && mmipviews.count(name) == 0) {
+				auto tw = c.set_texture.rect.w;
+				auto th = c.set_texture.rect.h;
+				auto fmt = oden_get_texture_format(c.set_texture.fmt);
+				auto mips = (std::max)(c.set_texture.mips, 1);
+				bool is_block = oden_is_block_format(fmt);
+				size_t stride = c.set_texture.stride_size;
+				if (stride == 0)
+					stride = is_block ? size_t((tw + 3) / 4) * oden_get_format_bytes(fmt) : size_t(tw) * oden_get_format_bytes(fmt);
+				if (tw <= 0 || th <= 0 || fmt < 0 || fmt >= FMT_MAX || mips > oden_get_mipmap_max(tw, th) ||
+					oden_get_cmd_size(c) < oden_get_texture_level_offset(fmt, tw, th, mips, stride)) {
+					LOG_ERR("Invalid texture name=%s fmt=%s mips=%d\n", name.c_str(), oden_get_format_name(fmt), mips);
+					exit(1);
+				}
+				trace_scope trace("upload", name);
+				auto & image = mimages[name];
+				image.create(tw, th, 4, mips);
+				image.fmt = fmt;
+				image.is_texture = true;
+				for (int i = 0; i < mips; i++) {
+					auto offset = oden_get_texture_level_offset(fmt, tw, th, i, stride);
+					int lw = image.mip_w(i);
+					size_t lstride = i == 0 ? stride : is_block ? size_t((lw + 3) / 4) * oden_get_format_bytes(fmt) : size_t(lw) * oden_get_format_bytes(fmt);
+					decode_texture(image, i, fmt, oden_get_cmd_data(c) + offset, lstride);
+				}
+				account_memory(name, MEMORY_TEXTURE, "system", image.bytes());
+			}
+			if (slot >= 0 && slot < (int)slotmax) {
+				auto & view = rec.vtex[slot];
+				view = find_view(name);
+				if (view.image)
+					view.base_level = (std::min)(view.base_level + (std::max)(c.set_texture.miplevel, 0), view.image->maxmips - 1);
+			}
+		}
+
+		//CMD_SET_CONSTANT
+		if (type == CMD_SET_CONSTANT) {
+			auto slot = c.set_constant.slot;
+			mbuffers[name] = c.buf;
+			account_memory(name, MEMORY_CONSTANT, "system", c.buf.size());
+			if (slot >= 0 && slot < (int)slotmax)
+				rec.vconstants[slot] = name;
+		}
+
+		//CMD_SET_VERTEX
+		if (type == CMD_SET_VERTEX) {
+			if (mbuffers.count(name) == 0) {
+				mbuffers[name].assign(oden_get_cmd_data(c), oden_get_cmd_data(c) + oden_get_cmd_size(c));
+				mvertex_strides[name] = c.set_vertex.stride_size;
+				account_memory(name, MEMORY_VERTEX, "system", oden_get_cmd_size(c));
+			}
+			rec.vertex = name;
+		}
+
+		//CMD_SET_INDEX
+		if (type == CMD_SET_INDEX) {
+			if (mbuffers.count(name) == 0) {
+				mbuffers[name].assign(oden_get_cmd_data(c), oden_get_cmd_data(c) + oden_get_cmd_size(c));
+				account_memory(name, MEMORY_INDEX, "system", oden_get_cmd_size(c));
+			}
+			rec.index = name;
+		}
+
+		//CMD_SET_SHADER
+		if (type == CMD_SET_SHADER) {
+			rec.shader = find_shader(name);
+			if (rec.shader == nullptr || (rec.shader->cs && is_prefer_spirv)) {
+				if (mspirv_shaders.count(name) == 0)
+					load_spirv_compute(name, mspirv_shaders[name]);
+				if (mspirv_shaders[name].program)
+					rec.shader = &mspirv_shaders[name];
+			}
+			rec.is_cull = c.set_shader.is_cull;
+			rec.is_enable_depth = c.set_shader.is_enable_depth;
+			rec.depth_func = c.set_shader.depth_func;
+			if (rec.shader == nullptr)
+				LOG_ERR("shader is not registered name=%s\n", name.c_str());
+		}
+
+		//CMD_CLEAR
+		if (type == CMD_CLEAR) {
+			flush();
+			auto view = find_view(name);
+			if (view.image) {
+				auto & data = view.image->vmips[view.base_level];
+				float col[4];
+				store_texel(view.image->fmt, col, c.clear.color);
+				for (size_t i = 0; i < data.size(); i += 4)
+					memcpy(&data[i], col, sizeof(float) * 4);
+			}
+		}
+
+		//CMD_CLEAR_DEPTH
+		if (type == CMD_CLEAR_DEPTH) {
+			flush();
+			auto view = find_view(oden_get_depth_render_target_name(name));
+			if (view.image)
+				std::fill(view.image->vmips[0].begin(), view.image->vmips[0].end(), c.clear_depth.value);
+		}
+
+		//CMD_SET_BUFFER, CMD_SET_BUFFER_UAV
+		if (type == CMD_SET_BUFFER || type == CMD_SET_BUFFER_UAV) {
+			auto slot = c.set_buffer.slot;
+			if (mstorage_buffers.count(name) == 0) {
+				auto size = c.set_buffer.size;
+				if (size == 0 || (size % sizeof(uint32_t)) || c.buf.size() > size) {
+					LOG_ERR("Invalid buffer name=%s size=%zu\n", name.c_str(), size);
+					exit(1);
+				}
+				auto & buffer = mstorage_buffers[name];
+				buffer.assign(size, 0);
+				memcpy(buffer.data(), c.buf.data(), c.buf.size());
+				account_memory(name, MEMORY_BUFFER, "system", size);
+			}
+			if (slot >= 0 && slot < (int)slotmax)
+				rec.vbuffers[slot] = name;
+		}
+
+		//CMD_UPDATE_BUFFER
+		if (type == CMD_UPDATE_BUFFER) {
+			auto it = mstorage_buffers.find(name);
+			if (it == mstorage_buffers.end() || c.set_buffer.offset + c.buf.size() > it->second.size()) {
+				LOG_ERR("Invalid update name=%s\n", name.c_str());
+			} else {
+				//queued draws do not read buffers, the vertex shaders have run.
+				trace_scope trace("upload", name);
+				memcpy(it->second.data() + c.set_buffer.offset, c.buf.data(), c.buf.size());
+			}
+		}
+
+		//CMD_DRAW_INDEX, CMD_DRAW, CMD_DRAW_INDEX_INDIRECT, CMD_DRAW_INDEX_INSTANCED, CMD_DRAW_INSTANCED
+		if (type == CMD_DRAW_INDEX || type == CMD_DRAW || type == CMD_DRAW_INDEX_INDIRECT ||
+			type == CMD_DRAW_INDEX_INSTANCED || type == CMD_DRAW_INSTANCED) {
+			bool is_indexed = type != CMD_DRAW && type != CMD_DRAW_INSTANCED;
+			auto & vb = mbuffers[rec.vertex];
+			auto stride = mvertex_strides[rec.vertex];
+			draw_index_indirect_args args = {};
+			bool is_args_valid = true;
+			if (type == CMD_DRAW_INDEX_INDIRECT) {
+				auto it = mstorage_buffers.find(name);
+				auto offset = c.draw_index_indirect.offset;
+				if (it == mstorage_buffers.end() || offset + sizeof(args) > it->second.size())
+					is_args_valid = false;
+				else
+					memcpy(&args, it->second.data() + offset, sizeof(args));
+			} else if (type == CMD_DRAW_INDEX_INSTANCED || type == CMD_DRAW_INSTANCED) {
+				args.index_count = (std::max)(c.draw_instanced.count, 0);
+				args.instance_count = (std::max)(c.draw_instanced.instance_count, 0);
+				args.start_index = type == CMD_DRAW_INDEX_INSTANCED ? (std::max)(c.draw_instanced.start, 0) : 0;
+			} else {
+				args.index_count = (std::max)(type == CMD_DRAW_INDEX ? c.draw_index.count : c.draw.vertex_count, 0);
+				args.instance_count = 1;
+				args.start_index = type == CMD_DRAW_INDEX ? c.draw_index.start : 0;
+			}
+			if (rec.shader == nullptr || rec.shader->vs == nullptr || (rec.shader->ps == nullptr && pass.color) || pass.depth == nullptr || stride == 0 ||
+				!is_args_valid) {
+				LOG_ERR("Invalid draw state name=%s\n", name.c_str());
+			} else {
+				//snapshot constants. the same name may be updated by the next draw.
+				sw_draw_state state;
+				state.shader = rec.shader;
+				state.is_cull = rec.is_cull;
+				state.is_enable_depth = rec.is_enable_depth;
+				state.depth_func = rec.depth_func;
+				sw_vs_ctx vs_ctx = {};
+				for (uint32_t i = 0; i < slotmax; i++) {
+					state.ps_ctx.vtex[i] = rec.vtex[i];
+					vs_ctx.vbuf[i] = find_buffer(rec.vbuffers[i]);
+					if (rec.vconstants[i].empty())
+						continue;
+					pass.vconstants.push_back(mbuffers[rec.vconstants[i]]);
+					state.ps_ctx.vcb[i] = pass.vconstants.back().data();
+					vs_ctx.vcb[i] = state.ps_ctx.vcb[i];
+				}
+				uint32_t draw = (uint32_t)pass.vdraws.size();
+				pass.vdraws.push_back(state);
+
+				std::vector<uint32_t> vindices;
+				if (is_indexed) {
+					auto & ib = mbuffers[rec.index];
+					auto indices = (const uint32_t *)ib.data();
+					size_t index_count = ib.size() / sizeof(uint32_t);
+					for (uint32_t i = 0; i < args.index_count; i++) {
+						size_t at = (size_t)args.start_index + i;
+						vindices.push_back(at < index_count ? indices[at] + args.base_vertex : 0);
+					}
+				} else {
+					for (uint32_t i = 0; i < args.index_count; i++)
+						vindices.push_back(i);
+				}
+
+				//vertex shader over the whole buffer for each instance, then assemble.
+				size_t vertex_count = vb.size() / stride;
+				std::vector<sw_vertex> vvertices(vertex_count);
+				for (uint32_t n = 0; n < args.instance_count; n++) {
+					vs_ctx.instance = args.start_instance + n;
+					for (size_t i = 0; i < vertex_count; i++)
+						rec.shader->vs(vs_ctx, vb.data() + i * stride, vvertices[i].pos, vvertices[i].var);
+					for (size_t i = 0; i + 2 < vindices.size(); i += 3) {
+						sw_vertex tri[3];
+						bool is_valid = true;
+						for (int k = 0; k < 3; k++) {
+							if (vindices[i + k] >= vertex_count)
+								is_valid = false;
+							else
+								tri[k] = vvertices[vindices[i + k]];
+						}
+						if (!is_valid)
+							continue;
+						sw_vertex clipped[4];
+						int num = clip_near(tri, clipped);
+						for (int k = 1; k + 1 < num; k++)
+							setup_triangle(pass, clipped[0], clipped[k], clipped[k + 1], draw);
+					}
+				}
+			}
+		}
+
+		//CMD_DISPATCH
+		if (type == CMD_DISPATCH) {
+			flush();
+			if (rec.shader == nullptr || (rec.shader->cs == nullptr && rec.shader->program == nullptr)) {
+				LOG_ERR("Invalid dispatch state name=%s\n", name.c_str());
+			} else if (rec.shader->program) {
+				//glsl binding = slot * 3 + {0 : SRV, 1 : CBV, 2 : UAV}
+				sw_texture_view vviews[SW_SLOT_MAX];
+				std::vector<uint8_t> *vcbs[SW_SLOT_MAX] = {};
+				for (uint32_t i = 0; i < slotmax; i++) {
+					vviews[i] = rec.vtex[i];
+					if (rec.vconstants[i].size())
+						vcbs[i] = &mbuffers[rec.vconstants[i]];
+				}
+				auto view = [&](uint32_t binding) {
+					return binding / 3 < SW_SLOT_MAX ? vviews[binding / 3] : sw_texture_view();
+				};
+				spirv_bindings bindings;
+				bindings.image_read = [&](uint32_t binding, int x, int y, float *color) {
+					image_load(view(binding), x, y, color);
+				};
+				bindings.image_write = [&](uint32_t binding, int x, int y, const float *color) {
+					image_store(view(binding), x, y, color);
+				};
+				bindings.image_size = [&](uint32_t binding, int lod, int *size) {
+					auto v = view(binding);
+					if (v.image) {
+						size[0] = v.image->mip_w(v.base_level + lod);
+						size[1] = v.image->mip_h(v.base_level + lod);
+					}
+				};
+				bindings.image_sample = [&](uint32_t binding, float u, float v, float lod, float *color) {
+					sample_level(view(binding), u, v, lod, true, color);
+				};
+				bindings.uniform = [&](uint32_t binding, size_t & size) -> const uint8_t * {
+					auto cb = binding / 3 < SW_SLOT_MAX ? vcbs[binding / 3] : nullptr;
+					size = cb ? cb->size() : 0;
+					return cb ? cb->data() : nullptr;
+				};
+				auto & program = *rec.shader->program;
+				auto dx = c.dispatch.x;
+				auto dy = c.dispatch.y;
+				auto dz = c.dispatch.z;
+				uint64_t total = spirv_get_invocation_count(program, dx, dy, dz);
+				uint64_t chunk = ODEN_SPIRV_LANES * 32;
+				pool.run(int((total + chunk - 1) / chunk), [&](int job) {
+					spirv_run(program, bindings, dx, dy, dz, job * chunk, chunk);
+				});
+			} else {
+				sw_cs_ctx ctx = {};
+				for (uint32_t i = 0; i < slotmax; i++) {
+					ctx.vuav[i] = rec.vtex[i];
+					ctx.vbuf[i] = find_buffer(rec.vbuffers[i]);
+					if (rec.vconstants[i].size())
+						ctx.vcb[i] = mbuffers[rec.vconstants[i]].data();
+				}
+				auto cs = rec.shader->cs;
+				int gx = c.dispatch.x * rec.shader->local_size[0];
+				int gy = c.dispatch.y * rec.shader->local_size[1];
+				int gz = c.dispatch.z * rec.shader->local_size[2];
+				pool.run(gy * gz, [&](int row) {
+					for (int x = 0; x < gx; x++)
+						cs(ctx, x, row % gy, row / gy);
+				});
+			}
+		}
+
+		//CMD_GENERATE_MIPS
+		if (type == CMD_GENERATE_MIPS) {
+			flush();
+			auto view = find_view(name);
+			if (view.image == nullptr || view.base_level != 0) {
+				LOG_ERR("Invalid generate mips name=%s\n", name.c_str());
+			} else {
+				auto levels = c.generate_mips.miplevel;
+				generate_mips(*view.image, levels > 0 ? levels : view.image->maxmips, pool);
+			}
+		}
+
+		//CMD_RELEASE
+		if (type == CMD_RELEASE) {
+			auto it = mimages.find(name);
+			if (it == mimages.end() || !it->second.is_texture) {
+				LOG_ERR("Invalid release name=%s\n", name.c_str());
+			} else {
+				//queued draws may sample it.
+				flush();
+				for (auto & x : rec.vtex)
+					if (x.image == &it->second)
+						x = sw_texture_view();
+				mimages.erase(it);
+				release_memory(name);
+			}
+		}
+
+		//CMD_UPDATE_TEXTURE
+		if (type == CMD_UPDATE_TEXTURE) {
+			auto it = mimages.find(name);
+			auto & r = c.set_texture.rect;
+			auto level = c.set_texture.miplevel;
+			if (it == mimages.end() || !it->second.is_texture || level < 0 || level >= it->second.maxmips ||
+				!oden_is_texture_rect_valid(it->second.fmt, it->second.w, it->second.h, level, r.x, r.y, r.w, r.h)) {
+				LOG_ERR("Invalid update name=%s\n", name.c_str());
+			} else {
+				auto & image = it->second;
+				size_t stride = c.set_texture.stride_size ? c.set_texture.stride_size : size_t(oden_get_texture_row_bytes(image.fmt, r.w));
+				if (oden_get_cmd_size(c) < oden_get_texture_rect_size(image.fmt, r.w, r.h, stride)) {
+					LOG_ERR("Update data is smaller than the rect name=%s\n", name.c_str());
+				} else {
+					//queued draws may sample it.
+					flush();
+					trace_scope trace("upload", name);
+					decode_texture(image, level, image.fmt, oden_get_cmd_data(c), stride, r.x, r.y, r.w, r.h);
+				}
+			}
+		}
+
+		auto cmd_ms = get_time_ms() - cmd_start;
+		if (type >= 0 && type < CMD_MAX) {
+			vstats[type].count++;
+			vstats[type].cpu_ms += cmd_ms;
+		}
+
+		auto own_ms = cmd_ms - flush_ms;
+		flush_ms = 0.0;
+		if (type == CMD_DISPATCH || type == CMD_GENERATE_MIPS) {
+			vsegments.push_back({name, segment_cpu_ms, own_ms});
+			segment_cpu_ms = 0.0;
+		} else if (is_pass_end(type)) {
+			vsegments.push_back({name, segment_cpu_ms + own_ms, 0.0});
+			pass_segment_index = vsegments.size() - 1;
+			segment_cpu_ms = 0.0;
+		} else {
+			segment_cpu_ms += own_ms;
+		}
+		//The trace span includes flushes of the previous pass, they show on the gpu track too.
+		if (is_pass_end(type)) {
+			trace_complete("translate", name, segment_start, cmd_start + cmd_ms);
+			segment_start = cmd_start + cmd_ms;
+		}
+	}
+	flush();
+	if (!vcmd.empty() && !is_pass_end(vcmd.back().type)) {
+		vsegments.push_back({vcmd.back().name, segment_cpu_ms, 0.0});
+		trace_complete("translate", vcmd.back().name, segment_start, get_time_ms());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(frame_stats_mtx);
+		for (int i = 0 ; i < CMD_MAX; i++) {
+			vcmd_stats[i].count += vstats[i].count;
+			vcmd_stats[i].cpu_ms += vstats[i].cpu_ms;
+		}
+	}
+
+	//Present : BGRA8 for readback and the window.
+	bool is_readback = false;
+	{
+		std::lock_guard<std::mutex> lock(readback_mtx);
+		is_readback = is_readback_requested;
+	}
+#ifdef _WIN32
+	bool is_window = handle != oden_get_headless_handle();
+#else
+	bool is_window = false;
+#endif //_WIN32
+	if (present_image && (is_readback || is_window)) {
+		std::vector<uint32_t> vpixels((size_t)present_image->w * present_image->h);
+		auto & src = present_image->vmips[0];
+		auto to_u8 = [](float a) {
+			return (uint32_t)((std::min)((std::max)(a, 0.0f), 1.0f) * 255.0f + 0.5f);
+		};
+		for (size_t i = 0; i < vpixels.size(); i++) {
+			auto p = &src[i * 4];
+			vpixels[i] = (to_u8(p[3]) << 24) | (to_u8(p[0]) << 16) | (to_u8(p[1]) << 8) | to_u8(p[2]);
+		}
+#ifdef _WIN32
+		if (is_window) {
+			BITMAPINFO bmi = {};
+			bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+			bmi.bmiHeader.biWidth = present_image->w;
+			bmi.bmiHeader.biHeight = -present_image->h;
+			bmi.bmiHeader.biPlanes = 1;
+			bmi.bmiHeader.biBitCount = 32;
+			bmi.bmiHeader.biCompression = BI_RGB;
+			HDC hdc = GetDC((HWND)handle);
+			StretchDIBits(hdc, 0, 0, w, h, 0, 0, present_image->w, present_image->h,
+				vpixels.data(), &bmi, DIB_RGB_COLORS, SRCCOPY);
+			ReleaseDC((HWND)handle, hdc);
+		}
+#endif //_WIN32
+		if (is_readback) {
+			std::lock_guard<std::mutex> lock(readback_mtx);
+			vreadback.swap(vpixels);
+			readback_width = present_image->w;
+			readback_height = present_image->h;
+		}
+	}
+
+	//Work is done synchronously. latency is the frame time.
+	frame_stats stats = {};
+	stats.frame = frame_count;
+	stats.frames_in_flight = 1;
+	stats.cpu_wait_ms = 0.0;
+	stats.latency_ms = get_time_ms() - frame_start;
+	push_frame_stats(stats);
+	push_pass_stats(frame_count, vsegments, frame_start);
+
+	frame_count++;
+}
@@ -21,54 +21,223 @@
  *
  */
 #include "ODEN.h"
+#include "oden_platform.h"
+#include "oden_trace.h"
+#include "oden_log.h"
 
 #include <stdio.h>
-#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif //_WIN32
 #include <vulkan/vulkan.h>
-#include <vulkan/vk_sdk_platform.h>
 
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 #include <vector>
 #include <algorithm>
-
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif //__linux__
+
+#ifdef _MSC_VER
 #pragma comment(lib, "gdi32.lib")
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "winmm.lib")
 #pragma comment(lib, "advapi32.lib")
 
 #pragma comment(lib, "vulkan-1.lib")
+#endif //_MSC_VER
+
+//LOG_MAIN is compiled in with ODEN_LOG_LEVEL=0 and recorded after oden_log_set_level(0).
+#define LOG_MAIN(...) ODEN_LOG_MAIN(__VA_ARGS__)
+#define LOG_INFO(...) ODEN_LOG_INFO(__VA_ARGS__)
+#define LOG_ERR(...) ODEN_LOG_ERR(__VA_ARGS__)
+
+using namespace oden;
 
-//#define ODEN_VK_DEBUG_MODE
+//Written by oden_set_frames_in_flight on the app thread, read by the render thread.
+static std::atomic<uint32_t> frames_in_flight_request {0};
 
-#ifdef ODEN_VK_DEBUG_MODE
-#define LOG_MAIN(...) printf("MAIN : " __VA_ARGS__)
+static uint32_t
+get_frames_in_flight(uint32_t num)
+{
+	uint32_t request = frames_in_flight_request.load();
+	return request ? request : num;
+}
+
+//Host clock of oden_platform_get_host_ticks.
+#ifdef _WIN32
+static const VkTimeDomainEXT host_time_domain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
 #else
-#define LOG_MAIN(...) {}
-#endif //ODEN_VK_DEBUG_MODE
+static const VkTimeDomainEXT host_time_domain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif //_WIN32
+
+static std::mutex frame_stats_mtx;
+static std::vector<frame_stats> vframe_stats;
+static std::vector<cmd_stats> vcmd_stats(CMD_MAX);
+static std::map<std::string, pass_stats> mpass_stats;
+static bool is_pass_stats_updated = false;
+static std::map<std::string, memory_stats> mmemory_stats;
+static uint64_t memory_total = 0;
+static uint64_t memory_high_water = 0;
+
+//Commands up to a draw / dispatch, see oden_get_pass_stats.
+struct pass_segment {
+	std::string name;
+	double cpu_ms;
+	double gpu_ms;
+};
+
+static std::mutex readback_mtx;
+static bool is_readback_requested = false;
+static std::vector<uint32_t> vreadback;
+static uint32_t readback_width = 0;
+static uint32_t readback_height = 0;
+
+static double
+get_time_ms()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double, std::milli>(now).count();
+}
 
-#define LOG_INFO(...) printf("INFO : " __FUNCTION__ ":" __VA_ARGS__)
-#define LOG_ERR(...) printf("ERR : " __FUNCTION__ ":" __VA_ARGS__)
+static void
+push_frame_stats(frame_stats stats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (vframe_stats.size() >= 4096)
+		vframe_stats.erase(vframe_stats.begin(), vframe_stats.begin() + 2048);
+	vframe_stats.push_back(stats);
+}
 
-using namespace oden;
+void
+oden::oden_set_frames_in_flight(uint32_t num)
+{
+	frames_in_flight_request = num;
+}
+
+void
+oden::oden_get_frame_stats(std::vector<frame_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats.insert(vstats.end(), vframe_stats.begin(), vframe_stats.end());
+	vframe_stats.clear();
+}
 
+void
+oden::oden_get_cmd_stats(std::vector<cmd_stats> & vstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	vstats = vcmd_stats;
+	for (auto & x : vcmd_stats)
+		x = {};
+}
+
+static bool
+is_pass_end(int type)
+{
+	return type == CMD_DRAW_INDEX || type == CMD_DRAW || type == CMD_DISPATCH || type == CMD_GENERATE_MIPS ||
+		type == CMD_DRAW_INDEX_INDIRECT || type == CMD_DRAW_INDEX_INSTANCED || type == CMD_DRAW_INSTANCED;
+}
+
+//The gpu trace track lays the passes back to back from the submit.
 static void
-fork_process_wait(const char *command)
+push_pass_stats(uint64_t frame, const std::vector<pass_segment> & vsegments, double submit_ms)
 {
-	PROCESS_INFORMATION pi;
+	auto gpu_start = submit_ms;
+	for (auto & x : vsegments) {
+		if (x.gpu_ms < 0.0)
+			continue;
+		trace_complete("gpu", x.name, gpu_start, gpu_start + x.gpu_ms, ODEN_TRACE_TRACK_GPU);
+		gpu_start += x.gpu_ms;
+	}
 
-	STARTUPINFO si = {};
-	si.cb = sizeof(si);
-	if (CreateProcess(NULL, (LPTSTR)command, NULL, NULL, FALSE, NORMAL_PRIORITY_CLASS, NULL, NULL, &si, &pi)) {
-		while (WaitForSingleObject(pi.hProcess, 0) != WAIT_OBJECT_0) {
-			Sleep(0);
-		}
-		CloseHandle(pi.hProcess);
-		CloseHandle(pi.hThread);
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mpass_stats.clear();
+	for (auto & x : vsegments) {
+		auto & stats = mpass_stats[x.name];
+		stats.frame = frame;
+		stats.count++;
+		stats.cpu_ms += x.cpu_ms;
+		stats.gpu_ms = x.gpu_ms < 0.0 ? -1.0 : stats.gpu_ms + x.gpu_ms;
 	}
+	is_pass_stats_updated = true;
+}
+
+bool
+oden::oden_get_pass_stats(std::map<std::string, pass_stats> & mstats)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	if (!is_pass_stats_updated)
+		return false;
+	mstats = mpass_stats;
+	is_pass_stats_updated = false;
+	return true;
+}
+
+//Replaces the previous entry of the name.
+static void
+account_memory(const std::string & name, int category, const char *heap, uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto & stats = mmemory_stats[name];
+	memory_total = memory_total - stats.bytes + bytes;
+	stats = {category, heap, bytes};
+	memory_high_water = (std::max)(memory_high_water, memory_total);
+}
+
+static void
+release_memory(const std::string & name)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	auto it = mmemory_stats.find(name);
+	if (it == mmemory_stats.end())
+		return;
+	memory_total -= it->second.bytes;
+	mmemory_stats.erase(it);
+}
+
+static void
+release_memory_all(void)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mmemory_stats.clear();
+	memory_total = 0;
+}
+
+void
+oden::oden_get_memory_stats(std::map<std::string, memory_stats> & mstats, uint64_t & high_water)
+{
+	std::lock_guard<std::mutex> lock(frame_stats_mtx);
+	mstats = mmemory_stats;
+	high_water = memory_high_water;
+}
+
+bool
+oden::oden_get_backbuffer_readback(std::vector<uint32_t> & vdata, uint32_t & w, uint32_t & h)
+{
+	std::lock_guard<std::mutex> lock(readback_mtx);
+	is_readback_requested = true;
+	if (vreadback.empty())
+		return false;
+	vdata = vreadback;
+	w = readback_width;
+	h = readback_height;
+	return true;
 }
 
 static void
@@ -79,7 +248,10 @@ compile_glsl2spirv(
 {
 	//glslangValidator bloom.glsl -o a.spv -S frag -V --D _PS_
 	//glslangValidator bloom.glsl -o a.spv -S vert -V --D _VS_
-	auto tempfilename = shaderfile + type + std::string("temp.spv");
+	trace_scope trace("shader", shaderfile + ":" + type);
+	//The pipeline reloader compiles while the render thread does, and other processes may share the shaders.
+	//Out of the shader directory, the watcher would see the writes.
+	auto tempfilename = oden_platform_get_temp_filename(type + "temp.spv");
 	auto basecmd = std::string("glslangValidator -V -S ");
 	auto soption = std::string("null");
 	/*
@@ -103,16 +275,16 @@ compile_glsl2spirv(
 		soption = "vert";
 	if (type == "_GS_")
 		soption = "geom";
-	if (type == "_PS_")
+	if (type == "_PS_" || type == "_PS_DEPTH_")
 		soption = "frag";
 	if (type == "_CS_")
 		soption = "comp";
 
 	basecmd += soption;
-	basecmd += " --D " + type + " " + shaderfile + std::string(" -o ") + tempfilename;
+	basecmd += " --D " + type + " " + shaderfile + std::string(" -o \"") + tempfilename + "\"";
 	LOG_MAIN("basecmd : %s\n", basecmd.c_str());
 
-	fork_process_wait((char *)basecmd.c_str());
+	oden_platform_exec_wait(basecmd.c_str());
 	{
 		FILE *fp = fopen(tempfilename.c_str(), "rb");
 		if (fp) {
@@ -124,9 +296,188 @@ compile_glsl2spirv(
 			fclose(fp);
 		}
 	}
-	DeleteFile(tempfilename.c_str());
+	oden_platform_delete_file(tempfilename.c_str());
+}
+
+static std::string
+get_dirname(std::string filename)
+{
+	auto pos = filename.find_last_of("/\\");
+	if (pos == std::string::npos)
+		return std::string(".");
+	return filename.substr(0, pos);
+}
+
+static void
+collect_shader_dependencies(
+	std::string filename,
+	std::vector<std::string> &vdeps)
+{
+	//#include "xxx.glsl" (GL_GOOGLE_include_directive), resolved from the including file.
+	if (std::find(vdeps.begin(), vdeps.end(), filename) != vdeps.end())
+		return;
+	vdeps.push_back(filename);
+
+	FILE *fp = fopen(filename.c_str(), "rb");
+	if (fp == nullptr)
+		return;
+	char line[1024];
+	std::vector<std::string> vincludes;
+	while (fgets(line, sizeof(line), fp)) {
+		auto str = std::string(line);
+		auto pos = str.find("#include");
+		if (pos == std::string::npos)
+			continue;
+		auto first = str.find('"', pos);
+		auto last = str.find('"', first + 1);
+		if (first == std::string::npos || last == std::string::npos)
+			continue;
+		vincludes.push_back(get_dirname(filename) + "/" + str.substr(first + 1, last - first - 1));
+	}
+	fclose(fp);
+
+	for (auto & x : vincludes)
+		collect_shader_dependencies(x, vdeps);
+}
+
+//Last write in ns and the size. st_mtime has one second, a save in the same second as the last one differs in these.
+struct file_stamp {
+	uint64_t mtime_ns = 0;
+	uint64_t size = 0;
+
+	bool operator!=(const file_stamp & a) const
+	{
+		return mtime_ns != a.mtime_ns || size != a.size;
+	}
+};
+
+static file_stamp
+get_file_stamp(std::string filename)
+{
+	file_stamp ret;
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data = {};
+	if (GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &data)) {
+		ret.mtime_ns = ((uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime) * 100;
+		ret.size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+	}
+#else
+	struct stat st = {};
+	if (stat(filename.c_str(), &st) == 0) {
+		ret.mtime_ns = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + uint64_t(st.st_mtim.tv_nsec);
+		ret.size = uint64_t(st.st_size);
+	}
+#endif //_WIN32
+	return ret;
+}
+
+static std::string
+get_basename(std::string filename)
+{
+	auto pos = filename.find_last_of("/\\");
+	return pos == std::string::npos ? filename : filename.substr(pos + 1);
 }
 
+//Watch shader directories and report modified files.
+//inotify on linux, only the files named by the events are checked. change notification on win32, every file is.
+struct shader_watcher {
+	std::map<std::string, file_stamp> mfiles;
+#ifdef __linux__
+	int fd = -1;
+	std::map<int, std::string> mdirs;
+#else
+	std::map<std::string, HANDLE> mdirs;
+#endif //__linux__
+
+	void add(std::string filename)
+	{
+		if (mfiles.count(filename))
+			return;
+		mfiles[filename] = get_file_stamp(filename);
+		auto dirname = get_dirname(filename);
+#ifdef __linux__
+		if (fd < 0)
+			fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0)
+			return;
+		for (auto & x : mdirs)
+			if (x.second == dirname)
+				return;
+		auto wd = inotify_add_watch(fd, dirname.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (wd >= 0)
+			mdirs[wd] = dirname;
+#else
+		if (mdirs.count(dirname))
+			return;
+		auto h = FindFirstChangeNotification(dirname.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+		if (h != INVALID_HANDLE_VALUE)
+			mdirs[dirname] = h;
+#endif //__linux__
+	}
+
+	void poll(std::vector<std::string> &vchanged)
+	{
+		bool is_notified = false;
+		bool is_all = true;
+		std::set<std::pair<std::string, std::string>> snames; //directory, file name of the events.
+#ifdef __linux__
+		if (fd < 0)
+			return;
+		is_all = false;
+		alignas(struct inotify_event) char buf[4096];
+		for (;;) {
+			auto len = read(fd, buf, sizeof(buf));
+			if (len <= 0)
+				break;
+			is_notified = true;
+			for (ssize_t i = 0; i + (ssize_t)sizeof(struct inotify_event) <= len;) {
+				auto ev = (const struct inotify_event *)(buf + i);
+				auto it = mdirs.find(ev->wd);
+				if (ev->mask & IN_Q_OVERFLOW)
+					is_all = true;
+				else if (ev->len && it != mdirs.end())
+					snames.insert({it->second, std::string(ev->name)});
+				i += sizeof(struct inotify_event) + ev->len;
+			}
+		}
+#else
+		for (auto & x : mdirs) {
+			if (WaitForSingleObject(x.second, 0) == WAIT_OBJECT_0) {
+				is_notified = true;
+				FindNextChangeNotification(x.second);
+			}
+		}
+#endif //__linux__
+		if (!is_notified)
+			return;
+
+		//editors tend to rewrite a file several times. compare the stamp to dedup.
+		for (auto & x : mfiles) {
+			if (!is_all && snames.count({get_dirname(x.first), get_basename(x.first)}) == 0)
+				continue;
+			auto stamp = get_file_stamp(x.first);
+			if (stamp != x.second) {
+				x.second = stamp;
+				vchanged.push_back(x.first);
+			}
+		}
+	}
+
+	void term()
+	{
+#ifdef __linux__
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+#else
+		for (auto & x : mdirs)
+			FindCloseChangeNotification(x.second);
+#endif //__linux__
+		mdirs.clear();
+		mfiles.clear();
+	}
+};
+
 static VKAPI_ATTR VkBool32
 VKAPI_CALL debug_callback(
 	VkDebugReportFlagsEXT flags,
@@ -172,12 +523,70 @@ bind_debug_fn(
 	return callback;
 }
 
+static VkFormat
+get_vk_format(int fmt)
+{
+	static const VkFormat tbl[FMT_MAX] = {
+		VK_FORMAT_UNDEFINED,
+		VK_FORMAT_R8G8B8A8_UNORM,
+		VK_FORMAT_R16G16B16A16_SFLOAT,
+		VK_FORMAT_B10G11R11_UFLOAT_PACK32,
+		VK_FORMAT_R16G16_SFLOAT,
+		VK_FORMAT_R8_UNORM,
+		VK_FORMAT_BC1_RGBA_UNORM_BLOCK,
+		VK_FORMAT_BC4_UNORM_BLOCK,
+		VK_FORMAT_BC5_UNORM_BLOCK,
+		VK_FORMAT_BC7_UNORM_BLOCK,
+		VK_FORMAT_R32_SFLOAT,
+	};
+	return (fmt >= 0 && fmt < FMT_MAX) ? tbl[fmt] : VK_FORMAT_UNDEFINED;
+}
+
+//Pipelines are made against a render pass, so they are keyed by the color formats too.
+//The shader file is the part before '|' or '#', then a '|' per color target, "#depth_only" for
+//depth only render passes and "#depth_equal" for DEPTH_FUNC_EQUAL.
+static std::string
+get_pipeline_key(const std::string & name, const VkFormat *fmts, uint32_t count,
+	bool is_depth_only = false, int depth_func = DEPTH_FUNC_DEFAULT)
+{
+	auto ret = name;
+	if (is_depth_only)
+		ret += "#depth_only";
+	else if (count > 1 || (count == 1 && fmts[0] != VK_FORMAT_R16G16B16A16_SFLOAT && fmts[0] != VK_FORMAT_UNDEFINED))
+		for (uint32_t i = 0; i < count; i++)
+			ret += "|" + std::to_string(fmts[i]);
+	if (depth_func == DEPTH_FUNC_EQUAL)
+		ret += "#depth_equal";
+	return ret;
+}
+
+static std::string
+get_pipeline_filename(const std::string & key)
+{
+	return key.substr(0, key.find_first_of("|#"));
+}
+
+static uint32_t
+get_pipeline_color_count(const std::string & key)
+{
+	if (key.find("#depth_only") != std::string::npos)
+		return 0;
+	return (std::max)((uint32_t)std::count(key.begin(), key.end(), '|'), 1u);
+}
+
+static int
+get_pipeline_depth_func(const std::string & key)
+{
+	return key.find("#depth_equal") != std::string::npos ? DEPTH_FUNC_EQUAL : DEPTH_FUNC_DEFAULT;
+}
+
 [[ nodiscard ]] static VkImage
 create_image(
 	VkDevice device,
 	uint32_t width, uint32_t height, VkFormat format,
 	VkImageUsageFlags usageFlags, int maxmips)
 {
+	trace_scope trace("resource", "image " + std::to_string(width) + "x" + std::to_string(height));
 	VkImage ret = VK_NULL_HANDLE;
 	VkImageCreateInfo info = {};
 
@@ -208,7 +617,7 @@ create_image_view(
 	VkDevice device,
 	VkImage image,
 	VkFormat format,
-	VkImageAspectFlags aspectMask, int miplevel = 0)
+	VkImageAspectFlags aspectMask, int miplevel = 0, int levels = 1)
 {
 	VkImageView ret = VK_NULL_HANDLE;
 	VkImageViewCreateInfo info = {};
@@ -225,7 +634,7 @@ create_image_view(
 	info.components.a = VK_COMPONENT_SWIZZLE_A;
 	info.subresourceRange.aspectMask = aspectMask;
 	info.subresourceRange.baseMipLevel = miplevel;
-	info.subresourceRange.levelCount = 1;
+	info.subresourceRange.levelCount = levels;
 	info.subresourceRange.baseArrayLayer = 0;
 	info.subresourceRange.layerCount = 1;
 	vkCreateImageView(device, &info, NULL, &ret);
@@ -236,6 +645,7 @@ create_image_view(
 [[ nodiscard ]] static VkBuffer
 create_buffer(VkDevice device, VkDeviceSize size)
 {
+	trace_scope trace("resource", "buffer " + std::to_string(size));
 	VkBuffer ret = VK_NULL_HANDLE;
 	VkBufferCreateInfo info = {};
 
@@ -244,6 +654,8 @@ create_buffer(VkDevice device, VkDeviceSize size)
 	info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
 		VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
 		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	vkCreateBuffer(device, &info, nullptr, &ret);
@@ -281,7 +693,7 @@ create_renderpass(
 	VkDevice device,
 	uint32_t color_num,
 	bool is_presentable,
-	VkFormat color_format = VK_FORMAT_B8G8R8A8_UNORM,
+	const VkFormat *color_formats,
 	VkFormat depth_format = VK_FORMAT_D32_SFLOAT)
 {
 	VkRenderPass ret = VK_NULL_HANDLE;
@@ -307,7 +719,6 @@ create_renderpass(
 	VkAttachmentDescription color_attachment = {};
 
 	color_attachment.flags = 0;
-	color_attachment.format = color_format;
 	color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
 
 	color_attachment.loadOp = loadOp;
@@ -340,6 +751,7 @@ create_renderpass(
 	for (uint32_t i = 0 ; i < color_num; i++) {
 		auto ref = color_reference;
 		ref.attachment = attachment_index;
+		color_attachment.format = color_formats[i];
 		vattachments.push_back(color_attachment);
 		vattachment_refs.push_back(ref);
 		attachment_index++;
@@ -431,6 +843,23 @@ create_fence(VkDevice device)
 	return (ret);
 }
 
+//Wait in 1 sec steps and report stalls instead of blocking with UINT64_MAX.
+[[ nodiscard ]] static VkResult
+wait_fence(VkDevice device, VkFence fence, double & wait_ms)
+{
+	trace_scope trace("wait", "fence");
+	auto start = get_time_ms();
+	auto ret = VK_TIMEOUT;
+	for (;;) {
+		ret = vkWaitForFences(device, 1, &fence, VK_TRUE, 1000ULL * 1000ULL * 1000ULL);
+		if (ret != VK_TIMEOUT)
+			break;
+		LOG_ERR("fence=%p stalled %.1f ms\n", fence, get_time_ms() - start);
+	}
+	wait_ms = get_time_ms() - start;
+	return ret;
+}
+
 [[ nodiscard ]] static VkSampler
 create_sampler(VkDevice device, bool isfilterd)
 {
@@ -481,14 +910,15 @@ create_command_pool(
 
 [[ nodiscard ]] static VkCommandBuffer
 create_command_buffer(
-	VkDevice device, VkCommandPool cmd_pool)
+	VkDevice device, VkCommandPool cmd_pool,
+	VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY)
 {
 	VkCommandBufferAllocateInfo cballoc_info = {};
 
 	cballoc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	cballoc_info.pNext = nullptr;
 	cballoc_info.commandPool = cmd_pool;
-	cballoc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cballoc_info.level = level;
 	cballoc_info.commandBufferCount = 1;
 	VkCommandBuffer ret = nullptr;
 	auto err = vkAllocateCommandBuffers(device, &cballoc_info, &ret);
@@ -513,7 +943,7 @@ create_descriptor_pool(
 	vpoolsizes.push_back({VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, heapcount});
 	vpoolsizes.push_back({VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, heapcount});
 	vpoolsizes.push_back({VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, heapcount});
-	vpoolsizes.push_back({VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, heapcount});
+	vpoolsizes.push_back({VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, heapcount * 4}); //CMD_SET_BUFFER has two per slot.
 	vpoolsizes.push_back({VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, heapcount});
 	vpoolsizes.push_back({VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, heapcount});
 	vpoolsizes.push_back({VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, heapcount});
@@ -548,15 +978,19 @@ create_descriptor_set_layout(
 [[ nodiscard ]] static VkPipelineLayout
 create_pipeline_layout(
 	VkDevice device,
-	VkDescriptorSetLayout descriptor_layout)
+	VkDescriptorSetLayout descriptor_layout,
+	uint32_t push_constant_size = 0)
 {
 	VkPipelineLayout ret = nullptr;
 	VkPipelineLayoutCreateInfo info = {};
+	VkPushConstantRange range = {VK_SHADER_STAGE_COMPUTE_BIT, 0, push_constant_size};
 
 	info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	info.pNext = NULL;
 	info.setLayoutCount = 1;
 	info.pSetLayouts = &descriptor_layout;
+	info.pushConstantRangeCount = push_constant_size ? 1 : 0;
+	info.pPushConstantRanges = &range;
 	auto err = vkCreatePipelineLayout(device, &info, NULL, &ret);
 	return (ret);
 }
@@ -584,6 +1018,7 @@ create_cpipeline_from_file(
 	VkPipelineLayout pipeline_layout)
 {
 	VkPipeline ret = nullptr;
+	trace_scope trace("shader", filename);
 	VkComputePipelineCreateInfo info = {};
 	std::vector<uint8_t> cs;
 	std::vector<VkShaderModule> vshadermodules;
@@ -621,8 +1056,11 @@ create_gpipeline_from_file(
 	VkDevice device,
 	const char *filename,
 	VkPipelineLayout pipeline_layout,
-	VkRenderPass renderpass)
+	VkRenderPass renderpass,
+	uint32_t color_num = 1,
+	int depth_func = DEPTH_FUNC_DEFAULT)
 {
+	trace_scope trace("shader", filename);
 	VkPipeline ret = nullptr;
 	VkPipelineCacheCreateInfo pipelineCache = {};
 	VkPipelineVertexInputStateCreateInfo vi = {};
@@ -658,12 +1096,14 @@ create_gpipeline_from_file(
 	rs.lineWidth = 1.0f;
 
 	//SETUP CBA todo
-	VkPipelineColorBlendAttachmentState att_state[1];
+	VkPipelineColorBlendAttachmentState att_state[RENDER_TARGET_MAX];
 	memset(att_state, 0, sizeof(att_state));
-	att_state[0].colorWriteMask = 0xf;
-	att_state[0].blendEnable = VK_FALSE;
+	for (auto & x : att_state) {
+		x.colorWriteMask = 0xf;
+		x.blendEnable = VK_FALSE;
+	}
 	cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	cb.attachmentCount = 1;
+	cb.attachmentCount = color_num;
 	cb.pAttachments = att_state;
 
 	//SETUP DS
@@ -671,6 +1111,11 @@ create_gpipeline_from_file(
 	ds.depthTestEnable = VK_TRUE;
 	ds.depthWriteEnable = VK_TRUE;
 	ds.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	if (depth_func == DEPTH_FUNC_EQUAL) {
+		//depth equal to the prepass. the depth is already there, so no write.
+		ds.depthWriteEnable = VK_FALSE;
+		ds.depthCompareOp = VK_COMPARE_OP_EQUAL;
+	}
 	ds.depthBoundsTestEnable = VK_FALSE;
 	ds.back.failOp = VK_STENCIL_OP_KEEP;
 	ds.back.passOp = VK_STENCIL_OP_KEEP;
@@ -694,7 +1139,8 @@ create_gpipeline_from_file(
 	auto fname = std::string(filename);
 	compile_glsl2spirv((fname + ".glsl").c_str(), "_VS_", vs);
 	compile_glsl2spirv((fname + ".glsl").c_str(), "_GS_", gs);
-	compile_glsl2spirv((fname + ".glsl").c_str(), "_PS_", ps);
+	//depth only render passes (color_num == 0) run no fragment shader unless it has an alpha test.
+	compile_glsl2spirv((fname + ".glsl").c_str(), color_num ? "_PS_" : "_PS_DEPTH_", ps);
 
 	VkPipelineShaderStageCreateInfo sstage = {};
 	sstage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -778,20 +1224,118 @@ create_gpipeline_from_file(
 	return (ret);
 }
 
+//Rebuild pipelines on a worker thread.
+//Finished pipelines are collected by the render thread at the frame boundary.
+struct pipeline_reloader {
+	struct job {
+		std::string name;
+		VkPipelineBindPoint bindpoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		VkRenderPass renderpass = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		std::vector<std::string> vdeps;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::vector<job> vpending;
+	std::vector<job> vdone;
+	std::set<std::string> sinflight;
+	bool is_running = false;
+
+	void start(VkDevice dev, VkPipelineLayout layout)
+	{
+		device = dev;
+		pipeline_layout = layout;
+		is_running = true;
+		worker = std::thread([this]() {
+			for (;;) {
+				job j;
+				{
+					std::unique_lock<std::mutex> lock(mtx);
+					cv.wait(lock, [this]() {
+						return !is_running || !vpending.empty();
+					});
+					if (!is_running)
+						return;
+					j = vpending.front();
+					vpending.erase(vpending.begin());
+				}
+				LOG_INFO("reload pipeline start name=%s\n", j.name.c_str());
+				auto filename = get_pipeline_filename(j.name);
+				collect_shader_dependencies(filename + ".glsl", j.vdeps);
+				if (j.bindpoint == VK_PIPELINE_BIND_POINT_COMPUTE)
+					j.pipeline = create_cpipeline_from_file(device, filename.c_str(), pipeline_layout);
+				else
+					j.pipeline = create_gpipeline_from_file(device, filename.c_str(), pipeline_layout, j.renderpass,
+							get_pipeline_color_count(j.name), get_pipeline_depth_func(j.name));
+				LOG_INFO("reload pipeline done name=%s, pipeline=%p\n", j.name.c_str(), j.pipeline);
+
+				std::lock_guard<std::mutex> lock(mtx);
+				vdone.push_back(j);
+			}
+		});
+	}
+
+	void request(std::string name, VkPipelineBindPoint bindpoint, VkRenderPass renderpass)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (sinflight.count(name))
+			return;
+		sinflight.insert(name);
+		job j;
+		j.name = name;
+		j.bindpoint = bindpoint;
+		j.renderpass = renderpass;
+		vpending.push_back(j);
+		cv.notify_one();
+	}
+
+	void collect(std::vector<job> &vjobs)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		for (auto & j : vdone) {
+			sinflight.erase(j.name);
+			vjobs.push_back(j);
+		}
+		vdone.clear();
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			is_running = false;
+			cv.notify_all();
+		}
+		if (worker.joinable())
+			worker.join();
+		for (auto & j : vdone)
+			if (j.pipeline)
+				vkDestroyPipeline(device, j.pipeline, nullptr);
+		vdone.clear();
+		vpending.clear();
+		sinflight.clear();
+	}
+};
+
 static void
 update_descriptor_sets(
 	VkDevice device,
 	VkDescriptorSet descriptor_sets,
 	const void *pinfo,
 	uint32_t binding,
-	VkDescriptorType type)
+	VkDescriptorType type,
+	uint32_t count = 1)
 {
 	VkWriteDescriptorSet wd_sets = {};
 
 	wd_sets.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	wd_sets.pNext = NULL;
 	wd_sets.descriptorType = type;
-	wd_sets.descriptorCount = 1;
+	wd_sets.descriptorCount = count;
 	wd_sets.dstSet = descriptor_sets;
 	wd_sets.dstBinding = binding;
 	wd_sets.dstArrayElement = 0;
@@ -801,16 +1345,253 @@ update_descriptor_sets(
 		wd_sets.pImageInfo = (const VkDescriptorImageInfo *)pinfo;
 	if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
 		wd_sets.pBufferInfo = (const VkDescriptorBufferInfo *)pinfo;
+	if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+		wd_sets.pBufferInfo = (const VkDescriptorBufferInfo *)pinfo;
 	vkUpdateDescriptorSets(device, 1, &wd_sets, 0, NULL);
 }
 
+//Render pass contents. The render thread resolves the commands into ops,
+//workers record them into secondary command buffers.
+struct render_op {
+	enum {
+		BIND_PIPELINE,
+		BIND_DESCRIPTOR_SETS,
+		BIND_VERTEX,
+		BIND_INDEX,
+		SET_VIEWPORT,
+		SET_SCISSOR,
+		DRAW_INDEX,
+		DRAW,
+		DRAW_INDEX_INDIRECT,
+		DRAW_INDEX_INSTANCED,
+		DRAW_INSTANCED,
+		TIMESTAMP,
+	};
+	int type;
+	uint32_t value; //index / vertex count, query index, offset of the indirect arguments.
+	union {
+		VkPipeline pipeline;
+		VkDescriptorSet descriptor_sets;
+		VkBuffer buffer;
+		VkViewport viewport;
+		VkRect2D scissor;
+		struct {
+			uint32_t first_index;
+			uint32_t instance_count;
+		} instances; //DRAW_INDEX_INSTANCED / DRAW_INSTANCED
+	};
+};
+
+//Ops of a render pass are split so a large pass spreads over the workers.
+enum {
+	RENDER_OPS_PER_SECONDARY = 1024,
+};
+
+//CMD_GENERATE_MIPS : shaders/genmips.glsl binds every level of a render target as mip[GENMIPS_MAX].
+enum {
+	GENMIPS_MAX = 16,
+	GENMIPS_TILE = 64,
+};
+
+struct genmips_target {
+	VkDescriptorSet descriptor_sets;
+	uint32_t w;
+	uint32_t h;
+	uint32_t mips;
+	bool is_blit; //not a rgba16f storage image, shaders/genmips.glsl can not bind it.
+};
+
+struct render_piece {
+	std::string name;
+	VkRenderPass renderpass;
+	VkFramebuffer framebuffer;
+	size_t op_begin;
+	size_t op_end;
+	VkCommandBuffer cmdbuf;
+};
+
+//Secondary command buffers of one thread for one frame. Reset as a whole when the frame is reused.
+struct secondary_pool {
+	VkCommandPool cmd_pool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> vcmdbufs;
+	size_t used = 0;
+};
+
+static VkCommandBuffer
+get_secondary_command_buffer(VkDevice device, secondary_pool & pool)
+{
+	if (pool.used == pool.vcmdbufs.size())
+		pool.vcmdbufs.push_back(create_command_buffer(device, pool.cmd_pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+	return pool.vcmdbufs[pool.used++];
+}
+
+//renderpass == VK_NULL_HANDLE begins one for outside of render passes.
+static void
+begin_secondary_command_buffer(VkCommandBuffer cmdbuf, VkRenderPass renderpass, VkFramebuffer framebuffer)
+{
+	VkCommandBufferInheritanceInfo inheritance = {};
+	inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance.renderPass = renderpass;
+	inheritance.subpass = 0;
+	inheritance.framebuffer = framebuffer;
+
+	VkCommandBufferBeginInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (renderpass)
+		info.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	info.pInheritanceInfo = &inheritance;
+	vkBeginCommandBuffer(cmdbuf, &info);
+}
+
+static void
+record_render_ops(
+	VkCommandBuffer cmdbuf, VkPipelineLayout pipeline_layout, VkQueryPool query_pool,
+	const render_op *ops, size_t count)
+{
+	VkDeviceSize offset = 0;
+	for (size_t i = 0; i < count; i++) {
+		auto & op = ops[i];
+		switch (op.type) {
+		case render_op::BIND_PIPELINE:
+			vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, op.pipeline);
+			break;
+		case render_op::BIND_DESCRIPTOR_SETS:
+			vkCmdBindDescriptorSets(
+				cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0,
+				1, &op.descriptor_sets, 0, NULL);
+			break;
+		case render_op::BIND_VERTEX:
+			vkCmdBindVertexBuffers(cmdbuf, 0, 1, &op.buffer, &offset);
+			break;
+		case render_op::BIND_INDEX:
+			vkCmdBindIndexBuffer(cmdbuf, op.buffer, 0, VK_INDEX_TYPE_UINT32);
+			break;
+		case render_op::SET_VIEWPORT:
+			vkCmdSetViewport(cmdbuf, 0, 1, &op.viewport);
+			break;
+		case render_op::SET_SCISSOR:
+			vkCmdSetScissor(cmdbuf, 0, 1, &op.scissor);
+			break;
+		case render_op::DRAW_INDEX:
+			vkCmdDrawIndexed(cmdbuf, op.value, 1, 0, 0, 0);
+			break;
+		case render_op::DRAW:
+			vkCmdDraw(cmdbuf, op.value, 1, 0, 0);
+			break;
+		case render_op::DRAW_INDEX_INSTANCED:
+			vkCmdDrawIndexed(cmdbuf, op.value, op.instances.instance_count, op.instances.first_index, 0, 0);
+			break;
+		case render_op::DRAW_INSTANCED:
+			vkCmdDraw(cmdbuf, op.value, op.instances.instance_count, 0, 0);
+			break;
+		case render_op::DRAW_INDEX_INDIRECT:
+			vkCmdDrawIndexedIndirect(cmdbuf, op.buffer, op.value, 1, sizeof(draw_index_indirect_args));
+			break;
+		case render_op::TIMESTAMP:
+			vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, op.value);
+			break;
+		}
+	}
+}
+
+//Workers pull job indices from an atomic counter. The caller thread works too as worker 0.
+struct record_thread_pool {
+	std::vector<std::thread> vthreads;
+	std::mutex mtx;
+	std::condition_variable cv_job;
+	std::condition_variable cv_done;
+	std::function<void(int, int)> job;
+	std::atomic<int> next {0};
+	int count = 0;
+	int active = 0;
+	uint64_t generation = 0;
+	bool is_exit = false;
+
+	void start(int num)
+	{
+		is_exit = false;
+		for (int i = 0; i < num; i++)
+			vthreads.push_back(std::thread([this, i]() {
+			worker(i + 1);
+		}));
+	}
+
+	void work(int worker_index)
+	{
+		for (;;) {
+			int i = next++;
+			if (i >= count)
+				break;
+			job(i, worker_index);
+		}
+	}
+
+	void worker(int worker_index)
+	{
+		uint64_t seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv_job.wait(lock, [&]() {
+					return is_exit || generation != seen;
+				});
+				if (is_exit)
+					return;
+				seen = generation;
+			}
+			work(worker_index);
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				if (--active == 0)
+					cv_done.notify_one();
+			}
+		}
+	}
+
+	void run(int num, std::function<void(int, int)> fn)
+	{
+		if (vthreads.empty() || num <= 1) {
+			for (int i = 0; i < num; i++)
+				fn(i, 0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			job = fn;
+			count = num;
+			next = 0;
+			active = (int)vthreads.size();
+			generation++;
+		}
+		cv_job.notify_all();
+		work(0);
+		std::unique_lock<std::mutex> lock(mtx);
+		cv_done.wait(lock, [&]() {
+			return active == 0;
+		});
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			is_exit = true;
+		}
+		cv_job.notify_all();
+		for (auto & x : vthreads)
+			x.join();
+		vthreads.clear();
+	}
+};
+
 void
 oden::oden_present_graphics(
 	const char * appname, std::vector<cmd> & vcmd,
 	void *handle, uint32_t w, uint32_t h,
 	uint32_t count, uint32_t heapcount, uint32_t slotmax)
 {
-	HWND hwnd = (HWND) handle;
+	void *hwnd = handle;
 
 	enum {
 		RDT_SLOT_SRV = 0,
@@ -826,8 +1607,41 @@ oden::oden_present_graphics(
 		VkFramebuffer framebuffer = VK_NULL_HANDLE;
 		VkSemaphore sem = VK_NULL_HANDLE;
 
+		//frame pacing
+		bool is_submitted = false;
+		uint64_t frame = 0;
+		double submit_ms = 0.0;
+		double cpu_wait_ms = 0.0;
+
 		std::vector<VkBuffer> vscratch_buffers;
 		std::vector<VkDeviceMemory> vscratch_devmems;
+		std::vector<std::string> vscratch_names;
+		//of CMD_RELEASE, destroyed before the scratch memory.
+		std::vector<VkImageView> vretired_imageviews;
+		std::vector<VkImage> vretired_images;
+
+		//staging of CMD_UPDATE_TEXTURE, mapped while it lives. A full one goes to the scratch and a larger one replaces it.
+		VkBuffer upload_buffer = VK_NULL_HANDLE;
+		VkDeviceMemory upload_devmem = VK_NULL_HANDLE;
+		uint8_t *upload_data = nullptr;
+		VkDeviceSize upload_size = 0;
+		VkDeviceSize upload_offset = 0;
+
+		//secondary command buffers per record thread. [0] is the render thread.
+		std::vector<secondary_pool> vsecondary_pools;
+
+		//headless readback
+		bool is_readback = false;
+		VkBuffer readback_buffer = VK_NULL_HANDLE;
+		VkDeviceMemory readback_devmem = VK_NULL_HANDLE;
+		VkDeviceSize readback_size = 0;
+		uint32_t readback_width = 0;
+		uint32_t readback_height = 0;
+
+		//pass timestamps. query 0 is the frame start, query n + 1 the end of vsegments[n].
+		VkQueryPool query_pool = VK_NULL_HANDLE;
+		uint32_t query_max = 0;
+		std::vector<pass_segment> vsegments;
 	};
 
 	static VkInstance inst = VK_NULL_HANDLE;
@@ -837,13 +1651,22 @@ oden::oden_present_graphics(
 	static VkQueue graphics_queue = VK_NULL_HANDLE;
 	static VkSurfaceKHR surface = VK_NULL_HANDLE;
 	static VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+	static bool is_headless = false;
 	static VkCommandPool cmd_pool = VK_NULL_HANDLE;
+	static uint32_t cmd_queue_family_index = 0;
 	static VkSampler sampler_nearest = VK_NULL_HANDLE;
 	static VkSampler sampler_linear = VK_NULL_HANDLE;
 	static VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
 	static VkDescriptorSetLayout descriptor_layout = VK_NULL_HANDLE;
 	static VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+	static VkDescriptorSetLayout genmips_layout = VK_NULL_HANDLE;
+	static VkPipelineLayout genmips_pipeline_layout = VK_NULL_HANDLE;
+	static VkPipeline genmips_pipeline = VK_NULL_HANDLE;
+	static std::map<std::string, genmips_target> mgenmips_targets;
 	static VkPhysicalDeviceMemoryProperties devicememoryprop = {};
+	static double timestamp_period = 0.0;
+	static uint64_t timestamp_mask = 0;
+	static PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps = nullptr; //VK_EXT_calibrated_timestamps
 
 	static std::map<std::string, VkRenderPass> mrenderpasses;
 	static std::map<std::string, VkFramebuffer> mframebuffers;
@@ -853,24 +1676,49 @@ oden::oden_present_graphics(
 	static std::map<std::string, VkBuffer> mbuffers;
 	static std::map<std::string, VkMemoryRequirements> mmemreqs;
 	static std::map<std::string, VkDeviceMemory> mdevmem;
+	struct texture_desc {
+		uint32_t w = 0;
+		uint32_t h = 0;
+		uint32_t levels = 1;
+		int fmt = FMT_DEFAULT;
+	};
+	static std::map<std::string, texture_desc> mtextures; //images of CMD_SET_TEXTURE, CMD_RELEASE / UPDATE_TEXTURE take only these.
 
 	static std::map<std::string, uint64_t> mdescriptor_set_offset;
 	static std::map<std::string, VkPipeline> mpipelines;
 	static std::map<std::string, VkPipelineBindPoint> mpipeline_bindpoints;
+	static std::map<std::string, VkRenderPass> mpipeline_renderpasses;
+	static std::map<std::string, std::vector<std::string>> mshader_deps;
+	static std::vector<std::pair<uint64_t, VkPipeline>> vretired_pipelines;
+	static shader_watcher watcher;
+	static pipeline_reloader reloader;
 
 	static uint32_t backbuffer_index = 0;
 	static uint64_t frame_count = 0;
 
 	static std::vector<DeviceBuffer> devicebuffer;
 	static std::vector<VkDescriptorSet> vdescriptor_sets;
+	static record_thread_pool record_pool;
+	static std::vector<render_op> vrender_ops;
+	static std::vector<render_piece> vrender_pieces;
 
 	struct selected_handle {
 		std::string renderpass_name;
 		VkRenderPassBeginInfo info;
 		VkRenderPass renderpass;
 		VkRenderPass renderpass_commited;
+		VkFormat color_formats[RENDER_TARGET_MAX];
+		uint32_t color_count;
+		bool is_depth_only;
 
 		VkDescriptorSet descriptor_sets;
+
+		//graphics state. secondaries inherit none, so every render pass piece binds it first.
+		VkPipeline pipeline;
+		VkBuffer vertex_buffer;
+		VkBuffer index_buffer;
+		VkViewport viewport;
+		VkRect2D scissor;
 	};
 	selected_handle rec = {};
 
@@ -881,9 +1729,127 @@ oden::oden_present_graphics(
 		return ret;
 	};
 
-	auto alloc_devmem = [&](auto name, VkDeviceSize size, VkMemoryPropertyFlags flags, bool is_entry = true) {
-		for (auto & x : mdevmem)
-			LOG_MAIN("DEBUG alloc_devmem : addr=%p, name=%s\n", x.second, x.first.c_str());
+	auto create_frame_resources = [&](uint32_t num) {
+		devicebuffer.resize(num);
+		for (uint32_t i = 0 ; i < num; i++) {
+			auto & ref = devicebuffer[i];
+			ref.cmdbuf = create_command_buffer(device, cmd_pool);
+			ref.fence = create_fence(device);
+			ref.vsecondary_pools.resize(record_pool.vthreads.size() + 1);
+			for (auto & x : ref.vsecondary_pools)
+				x.cmd_pool = create_command_pool(device, cmd_queue_family_index);
+			VkSemaphoreCreateInfo semaphoreInfo = {};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &ref.sem);
+
+			LOG_MAIN("backbuffer cmdbuf[%d] = %p\n", i, ref.cmdbuf);
+			LOG_MAIN("backbuffer fence[%d] = %p\n", i, ref.fence);
+		}
+	};
+
+	auto collect_frame_stats = [&](DeviceBuffer & ref) {
+		if (!ref.is_submitted)
+			return;
+		frame_stats stats = {};
+		stats.frame = ref.frame;
+		stats.frames_in_flight = (uint32_t)devicebuffer.size();
+		stats.cpu_wait_ms = ref.cpu_wait_ms;
+		//Without calibrated timestamps, to the fence seen signaled.
+		stats.latency_ms = get_time_ms() - ref.submit_ms;
+		ref.is_submitted = false;
+
+		if (ref.query_pool && !ref.vsegments.empty()) {
+			std::vector<uint64_t> vtimestamps(ref.vsegments.size() + 1);
+			auto ret = vkGetQueryPoolResults(device, ref.query_pool, 0, (uint32_t)vtimestamps.size(),
+					vtimestamps.size() * sizeof(uint64_t), vtimestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			for (size_t i = 0; ret == VK_SUCCESS && i < ref.vsegments.size(); i++) {
+				auto ticks = (vtimestamps[i + 1] - vtimestamps[i]) & timestamp_mask;
+				ref.vsegments[i].gpu_ms = double(ticks) * timestamp_period / 1000000.0;
+			}
+
+			//The end of frame timestamp on the host clock, then on get_time_ms.
+			VkCalibratedTimestampInfoEXT vinfo[2] = {};
+			vinfo[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+			vinfo[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+			vinfo[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+			vinfo[1].timeDomain = host_time_domain;
+			uint64_t vnow[2] = {};
+			uint64_t deviation = 0;
+			auto host_ms = oden_platform_get_host_ms(oden_platform_get_host_ticks());
+			auto now_ms = get_time_ms();
+			if (ret == VK_SUCCESS && get_calibrated_timestamps &&
+				get_calibrated_timestamps(device, 2, vinfo, vnow, &deviation) == VK_SUCCESS) {
+				auto ticks = (vnow[0] - vtimestamps.back()) & timestamp_mask;
+				auto end_ms = oden_platform_get_host_ms(vnow[1]) - double(ticks) * timestamp_period / 1000000.0;
+				stats.latency_ms = end_ms + (now_ms - host_ms) - ref.submit_ms;
+			}
+		}
+		push_frame_stats(stats);
+		push_pass_stats(ref.frame, ref.vsegments, ref.submit_ms);
+	};
+
+	auto collect_readback = [&](DeviceBuffer & ref) {
+		if (!ref.is_readback)
+			return;
+		void *src = nullptr;
+		vkMapMemory(device, ref.readback_devmem, 0, ref.readback_size, 0, &src);
+		if (src) {
+			std::lock_guard<std::mutex> lock(readback_mtx);
+			vreadback.resize(ref.readback_width * ref.readback_height);
+			memcpy(vreadback.data(), src, vreadback.size() * sizeof(uint32_t));
+			readback_width = ref.readback_width;
+			readback_height = ref.readback_height;
+			vkUnmapMemory(device, ref.readback_devmem);
+		}
+		ref.is_readback = false;
+	};
+
+	auto destroy_frame_resources = [&]() {
+		for (size_t i = 0; i < devicebuffer.size(); i++) {
+			auto & ref = devicebuffer[i];
+			double wait_ms = 0.0;
+			if (ref.is_submitted && wait_fence(device, ref.fence, wait_ms) == VK_SUCCESS) {
+				collect_readback(ref);
+				collect_frame_stats(ref);
+			}
+			if (ref.readback_buffer)
+				vkDestroyBuffer(device, ref.readback_buffer, NULL);
+			if (ref.readback_devmem)
+				vkFreeMemory(device, ref.readback_devmem, NULL);
+			release_memory("__readback__" + std::to_string(i));
+			if (ref.upload_buffer)
+				vkDestroyBuffer(device, ref.upload_buffer, NULL);
+			if (ref.upload_devmem) {
+				vkUnmapMemory(device, ref.upload_devmem);
+				vkFreeMemory(device, ref.upload_devmem, NULL);
+			}
+			release_memory("__upload__" + std::to_string(i));
+			if (ref.query_pool)
+				vkDestroyQueryPool(device, ref.query_pool, NULL);
+			for (auto & x : ref.vscratch_buffers)
+				vkDestroyBuffer(device, x, NULL);
+			for (auto & x : ref.vretired_imageviews)
+				vkDestroyImageView(device, x, NULL);
+			for (auto & x : ref.vretired_images)
+				vkDestroyImage(device, x, NULL);
+			for (auto & x : ref.vscratch_devmems)
+				vkFreeMemory(device, x, NULL);
+			for (auto & x : ref.vscratch_names)
+				release_memory(x);
+			vkFreeCommandBuffers(device, cmd_pool, 1, &ref.cmdbuf);
+			for (auto & x : ref.vsecondary_pools)
+				vkDestroyCommandPool(device, x.cmd_pool, NULL);
+			vkDestroyFence(device, ref.fence, NULL);
+			vkDestroySemaphore(device, ref.sem, nullptr);
+		}
+		devicebuffer.clear();
+	};
+
+	//Not entried memory is owned by the caller, which releases its memory stats too.
+	auto alloc_devmem = [&](auto name, VkDeviceSize size, VkMemoryPropertyFlags flags, int category, bool is_entry = true) {
+		if (log_is_enabled(ODEN_LOG_LEVEL_MAIN))
+			for (auto & x : mdevmem)
+				LOG_MAIN("DEBUG alloc_devmem : addr=%p, name=%s\n", x.second, x.first.c_str());
 
 		VkDeviceMemory devmem = mdevmem[name];
 		if (devmem != nullptr) {
@@ -904,6 +1870,10 @@ oden::oden_present_graphics(
 			}
 		}
 		vkAllocateMemory(device, &ma_info, nullptr, &devmem);
+		if (devmem) {
+			auto heap = (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? "device_local" : "host_visible";
+			account_memory(name, category, heap, size);
+		}
 		if (is_entry) {
 			LOG_MAIN("%s : allocated name=%s\n", __func__, name.c_str());
 			if (devmem)
@@ -929,16 +1899,27 @@ oden::oden_present_graphics(
 		VkPhysicalDeviceProperties gpu_props = {};
 		VkPhysicalDeviceFeatures physDevFeatures = {};
 
+		//Headless : no surface and swapchain. backbuffers are ordinary images.
+		is_headless = (hwnd == oden_get_headless_handle());
+		if (is_headless)
+			LOG_INFO("headless mode\n");
+
 		//Is supported vk?
+		bool is_debug_report = false;
+		bool is_calibrated_timestamps = false;
 		vkEnumerateInstanceExtensionProperties(NULL, &inst_ext_cnt, NULL);
 		std::vector<VkExtensionProperties> vinstance_ext(inst_ext_cnt);
 		vkEnumerateInstanceExtensionProperties(NULL, &inst_ext_cnt, vinstance_ext.data());
 		for (auto x : vinstance_ext) {
 			auto name = std::string(x.extensionName);
-			if (name == VK_KHR_SURFACE_EXTENSION_NAME)
+			if (name == VK_KHR_SURFACE_EXTENSION_NAME && !is_headless)
 				vinstance_ext_names.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
-			if (name == VK_KHR_WIN32_SURFACE_EXTENSION_NAME)
+#ifdef _WIN32
+			if (name == VK_KHR_WIN32_SURFACE_EXTENSION_NAME && !is_headless)
 				vinstance_ext_names.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+#endif //_WIN32
+			if (name == VK_EXT_DEBUG_REPORT_EXTENSION_NAME)
+				is_debug_report = true;
 			LOG_MAIN("vkEnumerateInstanceExtensionProperties : name=%s\n", name.c_str());
 		}
 
@@ -954,7 +1935,7 @@ oden::oden_present_graphics(
 		//Create vk instances
 		VkApplicationInfo vkapp = {};
 		vkapp.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-		vkapp.pNext = &drcc_info;
+		vkapp.pNext = is_debug_report ? &drcc_info : nullptr;
 		vkapp.pApplicationName = appname;
 		vkapp.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
 		vkapp.pEngineName = appname;
@@ -968,19 +1949,38 @@ oden::oden_present_graphics(
 			//Todo avoid validation.
 			"VK_LAYER_KHRONOS_validation",
 		};
-		vinstance_ext_names.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+		if (is_debug_report)
+			vinstance_ext_names.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+
+		//Validation layer is optional. lavapipe/SwiftShader hosts usually don't have it.
+		std::vector<const char *> vlayer_names;
+		{
+			uint32_t layer_count = 0;
+			vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+			std::vector<VkLayerProperties> vlayers(layer_count);
+			vkEnumerateInstanceLayerProperties(&layer_count, vlayers.data());
+			for (auto & x : vlayers)
+				for (auto & name : debuglayers)
+					if (std::string(x.layerName) == name)
+						vlayer_names.push_back(name);
+		}
 
 		//create instance
 		inst_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 		inst_info.pNext = NULL;
 		inst_info.pApplicationInfo = &vkapp;
-		inst_info.enabledLayerCount = _countof(debuglayers);
-		inst_info.ppEnabledLayerNames = debuglayers;
+		inst_info.enabledLayerCount = (uint32_t)vlayer_names.size();
+		inst_info.ppEnabledLayerNames = vlayer_names.data();
 		inst_info.enabledExtensionCount = (uint32_t)vinstance_ext_names.size();
 		inst_info.ppEnabledExtensionNames = (const char *const *)vinstance_ext_names.data();
 		auto err = vkCreateInstance(&inst_info, NULL, &inst);
+		if (err != VK_SUCCESS) {
+			LOG_ERR("vkCreateInstance failed err=%d\n", err);
+			exit(1);
+		}
 
-		debug_callback_inst = bind_debug_fn(inst, drcc_info);
+		if (is_debug_report)
+			debug_callback_inst = bind_debug_fn(inst, drcc_info);
 
 		//Enumaration GPU's
 		err = vkEnumeratePhysicalDevices(inst, &gpu_count, NULL);
@@ -999,8 +1999,12 @@ oden::oden_present_graphics(
 			vdevice_extensions.size(), VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 		for (auto x : vdevice_extensions) {
 			auto name = std::string(x.extensionName);
-			if (name == VK_KHR_SWAPCHAIN_EXTENSION_NAME)
+			if (name == VK_KHR_SWAPCHAIN_EXTENSION_NAME && !is_headless)
 				ext_names.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+			if (name == VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) {
+				ext_names.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+				is_calibrated_timestamps = true;
+			}
 			LOG_MAIN("vkEnumerateDeviceExtensionProperties : extensionName=%s\n", x.extensionName);
 		}
 
@@ -1035,6 +2039,15 @@ oden::oden_present_graphics(
 				LOG_MAIN("index=%d : VK_QUEUE_PROTECTED_BIT\n", i);
 		}
 
+		//Pass timestamps need timestampValidBits on the graphics queue.
+		if (graphics_queue_family_index != UINT32_MAX) {
+			auto bits = vqueue_props[graphics_queue_family_index].timestampValidBits;
+			if (bits) {
+				timestamp_period = gpu_props.limits.timestampPeriod;
+				timestamp_mask = bits >= 64 ? UINT64_MAX : (1ULL << bits) - 1;
+			}
+		}
+
 		//Create Device and Queue
 		float queue_priorities[1] = {0.0};
 		VkDeviceQueueCreateInfo queue_info = {};
@@ -1050,94 +2063,123 @@ oden::oden_present_graphics(
 		device_info.pNext = NULL;
 		device_info.queueCreateInfoCount = 1;
 		device_info.pQueueCreateInfos = &queue_info;
-		device_info.enabledLayerCount = 1;
-		device_info.ppEnabledLayerNames = debuglayers;
+		device_info.enabledLayerCount = (uint32_t)vlayer_names.size();
+		device_info.ppEnabledLayerNames = vlayer_names.data();
 		device_info.enabledExtensionCount = (uint32_t)ext_names.size();
 		device_info.ppEnabledExtensionNames = (const char *const *)ext_names.data();
-		device_info.pEnabledFeatures = NULL;
+		//shaders/genmips.glsl indexes its image array by the level.
+		VkPhysicalDeviceFeatures enabled_features = {};
+		enabled_features.shaderStorageImageArrayDynamicIndexing = physDevFeatures.shaderStorageImageArrayDynamicIndexing;
+		if (!enabled_features.shaderStorageImageArrayDynamicIndexing)
+			LOG_ERR("No shaderStorageImageArrayDynamicIndexing. CMD_GENERATE_MIPS is not supported.\n");
+		enabled_features.textureCompressionBC = physDevFeatures.textureCompressionBC;
+		if (!enabled_features.textureCompressionBC)
+			LOG_ERR("No textureCompressionBC. FMT_BC* textures are not supported.\n");
+		device_info.pEnabledFeatures = &enabled_features;
 		err = vkCreateDevice(gpudev, &device_info, NULL, &device);
 
+		//latency_ms needs the device and the host clock in one calibration.
+		auto get_time_domains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+			vkGetInstanceProcAddr(inst, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+		if (is_calibrated_timestamps && timestamp_period > 0.0 && get_time_domains) {
+			uint32_t domain_count = 0;
+			get_time_domains(gpudev, &domain_count, nullptr);
+			std::vector<VkTimeDomainEXT> vdomains(domain_count);
+			get_time_domains(gpudev, &domain_count, vdomains.data());
+			bool is_device = std::find(vdomains.begin(), vdomains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != vdomains.end();
+			bool is_host = std::find(vdomains.begin(), vdomains.end(), host_time_domain) != vdomains.end();
+			if (is_device && is_host)
+				get_calibrated_timestamps = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT");
+		}
+		if (get_calibrated_timestamps == nullptr)
+			LOG_INFO("No calibrated timestamps, latency_ms is to the fence seen signaled.\n");
+
 		//get queue
 		vkGetPhysicalDeviceMemoryProperties(gpudev, &devicememoryprop);
 		vkGetDeviceQueue(device, graphics_queue_family_index, 0, &graphics_queue);
 
 		//Create Swapchain's
-		VkWin32SurfaceCreateInfoKHR surfaceinfo = {};
-		surfaceinfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-		surfaceinfo.hinstance = GetModuleHandle(NULL);
-		surfaceinfo.hwnd = hwnd;
-		vkCreateWin32SurfaceKHR(inst, &surfaceinfo, NULL, &surface);
-
-		//todo determine supported format from swapchain devices.
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(gpudev, 0, surface, &presentSupport);
-		VkSurfaceCapabilitiesKHR capabilities = {};
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gpudev, surface, &capabilities);
-		LOG_MAIN("vkGetPhysicalDeviceSurfaceSupportKHR Done\n", __LINE__);
-
-		VkSwapchainCreateInfoKHR sc_info = {};
-		sc_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-		sc_info.surface = surface;
-		sc_info.minImageCount = count;
-		sc_info.imageFormat = VK_FORMAT_B8G8R8A8_UNORM; //todo
-		sc_info.imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
-		sc_info.imageExtent.width = w;
-		sc_info.imageExtent.height = h;
-		sc_info.imageArrayLayers = 1;
-		sc_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-		sc_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		sc_info.queueFamilyIndexCount = 0;
-		sc_info.pQueueFamilyIndices = nullptr;
-
-		//http://vulkan-spec-chunked.ahcox.com/ch29s05.html#VkSurfaceTransformFlagBitsKHR
-		sc_info.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-		sc_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-		sc_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-		//sc_info.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-		sc_info.clipped = VK_TRUE;
-		sc_info.oldSwapchain = VK_NULL_HANDLE;
-
-		err = vkCreateSwapchainKHR(device, &sc_info, nullptr, &swapchain);
-
-		//Get BackBuffer Images
-		{
-			uint32_t count = 0;
-			std::vector<VkImage> temp;
-
-			vkGetSwapchainImagesKHR(device, swapchain, &count, nullptr);
-			temp.resize(count);
-			vkGetSwapchainImagesKHR(device, swapchain, &count, temp.data());
-			for (auto & x : temp)
-				LOG_MAIN("vkGetSwapchainImagesKHR temp = %p\n", x);
-
-			for (int i = 0 ; i < temp.size(); i++) {
-				auto name_color = oden_get_backbuffer_name(i);
-				mimages[name_color] = temp[i];
-				VkMemoryRequirements dummy = {};
-				mmemreqs[name_color] = dummy;
-
-				//dummy
-				alloc_devmem(name_color, 256, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		//Headless backbuffers are created by CMD_SET_RENDER_TARGET like other targets.
+		if (!is_headless) {
+#ifdef _WIN32
+			VkWin32SurfaceCreateInfoKHR surfaceinfo = {};
+			surfaceinfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+			surfaceinfo.hinstance = GetModuleHandle(NULL);
+			surfaceinfo.hwnd = (HWND)hwnd;
+			vkCreateWin32SurfaceKHR(inst, &surfaceinfo, NULL, &surface);
+#else
+			LOG_ERR("No window surface on this platform. Use oden_get_headless_handle()\n");
+			exit(1);
+#endif //_WIN32
+
+			//todo determine supported format from swapchain devices.
+			VkBool32 presentSupport = false;
+			vkGetPhysicalDeviceSurfaceSupportKHR(gpudev, 0, surface, &presentSupport);
+			VkSurfaceCapabilitiesKHR capabilities = {};
+			vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gpudev, surface, &capabilities);
+			LOG_MAIN("vkGetPhysicalDeviceSurfaceSupportKHR Done\n", __LINE__);
+
+			VkSwapchainCreateInfoKHR sc_info = {};
+			sc_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+			sc_info.surface = surface;
+			sc_info.minImageCount = count;
+			sc_info.imageFormat = VK_FORMAT_B8G8R8A8_UNORM; //todo
+			sc_info.imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+			sc_info.imageExtent.width = w;
+			sc_info.imageExtent.height = h;
+			sc_info.imageArrayLayers = 1;
+			sc_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			sc_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			sc_info.queueFamilyIndexCount = 0;
+			sc_info.pQueueFamilyIndices = nullptr;
+
+			//http://vulkan-spec-chunked.ahcox.com/ch29s05.html#VkSurfaceTransformFlagBitsKHR
+			sc_info.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+			sc_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+			sc_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+			//sc_info.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+			sc_info.clipped = VK_TRUE;
+			sc_info.oldSwapchain = VK_NULL_HANDLE;
+
+			err = vkCreateSwapchainKHR(device, &sc_info, nullptr, &swapchain);
+
+			//Get BackBuffer Images
+			{
+				uint32_t count = 0;
+				std::vector<VkImage> temp;
+
+				vkGetSwapchainImagesKHR(device, swapchain, &count, nullptr);
+				temp.resize(count);
+				vkGetSwapchainImagesKHR(device, swapchain, &count, temp.data());
+				for (auto & x : temp)
+					LOG_MAIN("vkGetSwapchainImagesKHR temp = %p\n", x);
+
+				for (int i = 0 ; i < temp.size(); i++) {
+					auto name_color = oden_get_backbuffer_name(i);
+					mimages[name_color] = temp[i];
+					VkMemoryRequirements dummy = {};
+					mmemreqs[name_color] = dummy;
+
+					//dummy
+					alloc_devmem(name_color, 256, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_RT_COLOR);
+				}
 			}
 		}
 
 		//Create CommandBuffers
 		cmd_pool = create_command_pool(device, graphics_queue_family_index);
+		cmd_queue_family_index = graphics_queue_family_index;
 
-		//Create Frame Resources
-		devicebuffer.resize(count);
+		//ODEN_VK_THREADS : render pass record threads including the caller.
+		//1 (default) records everything inline into the primary command buffer.
+		int threads = 1;
+		if (getenv("ODEN_VK_THREADS"))
+			threads = atoi(getenv("ODEN_VK_THREADS"));
+		record_pool.start((std::max)(threads - 1, 0));
+		LOG_INFO("record threads=%zu\n", record_pool.vthreads.size() + 1);
 
-		for (uint32_t i = 0 ; i < count; i++) {
-			auto & ref = devicebuffer[i];
-			ref.cmdbuf = create_command_buffer(device, cmd_pool);
-			ref.fence = create_fence(device);
-			VkSemaphoreCreateInfo semaphoreInfo = {};
-			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &ref.sem);
-
-			LOG_MAIN("backbuffer cmdbuf[%d] = %p\n", i, ref.cmdbuf);
-			LOG_MAIN("backbuffer fence[%d] = %p\n", i, ref.fence);
-		}
+		//Create Frame Resources
+		create_frame_resources(get_frames_in_flight(count));
 		sampler_nearest = create_sampler(device, false);
 		sampler_linear = create_sampler(device, true);
 		descriptor_pool = create_descriptor_pool(device, heapcount);
@@ -1149,9 +2191,22 @@ oden::oden_present_graphics(
 				vdesc_setlayout_binding.push_back({(uint32_t)RDT_SLOT_CBV + i * RDT_SLOT_MAX, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT, nullptr});
 				vdesc_setlayout_binding.push_back({(uint32_t)RDT_SLOT_UAV + i * RDT_SLOT_MAX, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT, nullptr});
 			}
+			for (uint32_t i = 0 ; i < slotmax; i++) {
+				vdesc_setlayout_binding.push_back({(uint32_t)oden_get_buffer_binding(i, false), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT, nullptr});
+				vdesc_setlayout_binding.push_back({(uint32_t)oden_get_buffer_binding(i, true), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT, nullptr});
+			}
 			descriptor_layout = create_descriptor_set_layout(device, vdesc_setlayout_binding);
 			pipeline_layout = create_pipeline_layout(device, descriptor_layout);
 		}
+		{
+			//push constants : mips, groups.
+			std::vector<VkDescriptorSetLayoutBinding> vdesc_setlayout_binding;
+			vdesc_setlayout_binding.push_back({0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GENMIPS_MAX, VK_SHADER_STAGE_COMPUTE_BIT, nullptr});
+			vdesc_setlayout_binding.push_back({1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr});
+			genmips_layout = create_descriptor_set_layout(device, vdesc_setlayout_binding);
+			genmips_pipeline_layout = create_pipeline_layout(device, genmips_layout, sizeof(uint32_t) * 2);
+		}
+		reloader.start(device, pipeline_layout);
 
 		for (int i = 0; i < 4096; i++)
 			vdescriptor_sets.push_back(create_descriptor_set(device, descriptor_pool, descriptor_layout));
@@ -1170,39 +2225,89 @@ oden::oden_present_graphics(
 
 	LOG_MAIN("frame_count=%llu\n", frame_count);
 
+	//Frame pacing. frames in flight is independent of the swapchain image count.
+	for (auto & x : devicebuffer)
+		if (x.is_submitted && vkGetFenceStatus(device, x.fence) == VK_SUCCESS) {
+			collect_readback(x);
+			collect_frame_stats(x);
+		}
+
+	uint32_t frames_in_flight = get_frames_in_flight(count);
+	if (hwnd && devicebuffer.size() != frames_in_flight) {
+		LOG_INFO("frames in flight %zu -> %u\n", devicebuffer.size(), frames_in_flight);
+		destroy_frame_resources();
+		create_frame_resources(frames_in_flight);
+	}
+
+	trace_scope trace_frame("frame", "frame " + std::to_string(frame_count));
+
 	//Determine resource index.
+	backbuffer_index = frame_count % devicebuffer.size();
 	auto & ref = devicebuffer[backbuffer_index];
 	uint32_t present_index = 0;
-	vkWaitForFences(device, 1, &ref.fence, VK_TRUE, UINT64_MAX);
-	vkResetFences(device, 1, &ref.fence);
-	vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, ref.sem, VK_NULL_HANDLE, &present_index);
+	VkImage readback_image = VK_NULL_HANDLE;
+	{
+		double wait_ms = 0.0;
+		auto ret = wait_fence(device, ref.fence, wait_ms);
+		if (ret != VK_SUCCESS) {
+			LOG_ERR("!!!!!!Device Lost frame_count=%llu, result=%d\n", frame_count, ret);
+			exit(1);
+		}
+		collect_readback(ref);
+		collect_frame_stats(ref);
+		ref.cpu_wait_ms = wait_ms;
+	}
 
 	//Destroy scratch resources
 	for (auto & x : ref.vscratch_buffers)
 		vkDestroyBuffer(device, x, NULL);
 	ref.vscratch_buffers.clear();
 
+	for (auto & x : ref.vretired_imageviews)
+		vkDestroyImageView(device, x, NULL);
+	ref.vretired_imageviews.clear();
+
+	for (auto & x : ref.vretired_images)
+		vkDestroyImage(device, x, NULL);
+	ref.vretired_images.clear();
+
 	for (auto & x : ref.vscratch_devmems)
 		vkFreeMemory(device, x, NULL);
 	ref.vscratch_devmems.clear();
 
+	for (auto & x : ref.vscratch_names)
+		release_memory(x);
+	ref.vscratch_names.clear();
+	ref.upload_offset = 0;
+
 	//Destroy resources
 	if (hwnd == nullptr) {
 		LOG_INFO("hwnd == nullptr. Start terminate...\n");
 		LOG_INFO("vkDeviceWaitIdle....\n");
 		vkDeviceWaitIdle(device);
-		for (auto & ref : devicebuffer) {
-			vkDestroyFence(device, ref.fence, NULL);
-			vkDestroySemaphore(device, ref.sem, nullptr);
-		}
+		reloader.stop();
+		watcher.term();
+		for (auto & x : vretired_pipelines)
+			vkDestroyPipeline(device, x.second, NULL);
+		vretired_pipelines.clear();
+		destroy_frame_resources();
+		record_pool.stop();
 		vkDestroyCommandPool(device, cmd_pool, NULL);
-		for (int i = 0 ; i < devicebuffer.size(); i++) {
+
+		//swapchain images are owned by swapchain. headless ones are ours.
+		for (uint32_t i = 0 ; i < count && !is_headless; i++) {
 			auto name_color = oden_get_backbuffer_name(i);
 			mimages.erase(name_color);
 		}
 		
 		vkDestroyDescriptorSetLayout(device, descriptor_layout, NULL);
 		vkDestroyPipelineLayout(device, pipeline_layout, NULL);
+		vkDestroyDescriptorSetLayout(device, genmips_layout, NULL);
+		vkDestroyPipelineLayout(device, genmips_pipeline_layout, NULL);
+		if (genmips_pipeline)
+			vkDestroyPipeline(device, genmips_pipeline, NULL);
+		genmips_pipeline = VK_NULL_HANDLE;
+		mgenmips_targets.clear();
 		vkDestroySampler(device, sampler_linear, NULL);
 		vkDestroySampler(device, sampler_nearest, NULL);
 		vkDestroyDescriptorPool(device, descriptor_pool, NULL);
@@ -1220,8 +2325,10 @@ oden::oden_present_graphics(
 			vkDestroyImage(device, x.second, NULL);
 		for (auto & x : mdevmem)
 			vkFreeMemory(device, x.second, NULL);
-		vkDestroySwapchainKHR(device, swapchain, NULL);
-		vkDestroySurfaceKHR(inst, surface, NULL);
+		if (!is_headless) {
+			vkDestroySwapchainKHR(device, swapchain, NULL);
+			vkDestroySurfaceKHR(inst, surface, NULL);
+		}
 		vkDestroyDevice(device, NULL);
 		if (debug_callback_inst) {
 			auto fn = PFN_vkDestroyDebugReportCallbackEXT(
@@ -1236,22 +2343,92 @@ oden::oden_present_graphics(
 		mimageviews.clear();
 		mimages.clear();
 		mdevmem.clear();
+		mtextures.clear();
+		release_memory_all();
+		mpipelines.clear();
+		mpipeline_bindpoints.clear();
+		mpipeline_renderpasses.clear();
+		mshader_deps.clear();
 		LOG_INFO("hwnd == nullptr. End terminate...\n");
+		log_flush();
 		return;
 	}
 
-	//Begin
+	vkResetFences(device, 1, &ref.fence);
+	if (!is_headless)
+		vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, ref.sem, VK_NULL_HANDLE, &present_index);
+
+	//Begin. Commands outside of render passes go to cmdbuf, a secondary of the render thread.
+	//Render pass contents go to vrender_ops and are recorded by record_pool at the end.
+	//Without record threads cmdbuf is the primary and each render pass is recorded inline when it ends.
+	bool is_inline_record = record_pool.vthreads.empty();
+	struct frame_block {
+		VkCommandBuffer cmdbuf; //outside of render passes. VK_NULL_HANDLE for a render pass.
+		VkRenderPassBeginInfo info;
+		size_t piece_begin;
+		size_t piece_end;
+	};
+	std::vector<frame_block> vblocks;
+	VkCommandBuffer cmdbuf = VK_NULL_HANDLE;
+
+	for (auto & x : ref.vsecondary_pools) {
+		vkResetCommandPool(device, x.cmd_pool, 0);
+		x.used = 0;
+	}
+	vrender_ops.clear();
+	vrender_pieces.clear();
+
 	VkCommandBufferBeginInfo cmdbegininfo = {};
 	cmdbegininfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	cmdbegininfo.pNext = nullptr;
 	cmdbegininfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 	cmdbegininfo.pInheritanceInfo = nullptr;
-
 	vkResetCommandBuffer(ref.cmdbuf, 0);
-	vkBeginCommandBuffer(ref.cmdbuf, &cmdbegininfo);
+	if (is_inline_record)
+		vkBeginCommandBuffer(ref.cmdbuf, &cmdbegininfo);
+
+	auto begin_serial = [&]() {
+		if (is_inline_record) {
+			cmdbuf = ref.cmdbuf;
+			return;
+		}
+		cmdbuf = get_secondary_command_buffer(device, ref.vsecondary_pools[0]);
+		begin_secondary_command_buffer(cmdbuf, VK_NULL_HANDLE, VK_NULL_HANDLE);
+		vblocks.push_back({cmdbuf, {}, 0, 0});
+	};
+	begin_serial();
+
+	//One timestamp per draw / dispatch, and the frame start and end.
+	if (timestamp_period > 0.0) {
+		uint32_t query_count = 2;
+		for (auto & c : vcmd)
+			if (is_pass_end(c.type))
+				query_count++;
+		if (query_count > ref.query_max) {
+			if (ref.query_pool)
+				vkDestroyQueryPool(device, ref.query_pool, NULL);
+			ref.query_max = query_count * 2;
+			VkQueryPoolCreateInfo qp_info = {};
+			qp_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			qp_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			qp_info.queryCount = ref.query_max;
+			vkCreateQueryPool(device, &qp_info, NULL, &ref.query_pool);
+		}
+	}
+	ref.vsegments.clear();
+	if (ref.query_pool) {
+		vkCmdResetQueryPool(cmdbuf, ref.query_pool, 0, ref.query_max);
+		vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ref.query_pool, 0);
+	}
 
 	LOG_MAIN("vcmd.size=%lu\n", vcmd.size());
 
+	auto is_storage_format = [&](VkFormat fmt) {
+		VkFormatProperties props = {};
+		vkGetPhysicalDeviceFormatProperties(gpudev, fmt, &props);
+		return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+	};
+
 	auto scratch_descriptor_sets = [&]() {
 		rec.descriptor_sets = alloc_descriptor_sets();
 		return rec.descriptor_sets;
@@ -1264,41 +2441,175 @@ oden::oden_present_graphics(
 		rec.renderpass_name = name;
 	};
 
+	auto push_render_op = [&](int type, uint32_t value = 0) -> render_op & {
+		render_op op = {};
+		op.type = type;
+		op.value = value;
+		vrender_ops.push_back(op);
+		return vrender_ops.back();
+	};
+
+	auto begin_render_piece = [&]() {
+		render_piece piece = {};
+		piece.name = rec.renderpass_name;
+		piece.renderpass = rec.info.renderPass;
+		piece.framebuffer = rec.info.framebuffer;
+		piece.op_begin = vrender_ops.size();
+		vrender_pieces.push_back(piece);
+		push_render_op(render_op::SET_VIEWPORT).viewport = rec.viewport;
+		push_render_op(render_op::SET_SCISSOR).scissor = rec.scissor;
+		if (rec.pipeline)
+			push_render_op(render_op::BIND_PIPELINE).pipeline = rec.pipeline;
+		if (rec.vertex_buffer)
+			push_render_op(render_op::BIND_VERTEX).buffer = rec.vertex_buffer;
+		if (rec.index_buffer)
+			push_render_op(render_op::BIND_INDEX).buffer = rec.index_buffer;
+	};
+
 	auto begin_renderpass = [&]() {
 		if (rec.renderpass) {
 			LOG_MAIN("!!!!!!!!!!!!!!!!!!!! vkCmdBeginRenderPass name=%s\n", rec.renderpass_name.c_str());
-			vkCmdBeginRenderPass(ref.cmdbuf, &rec.info, VK_SUBPASS_CONTENTS_INLINE);
+			if (is_inline_record) {
+				vkCmdBeginRenderPass(ref.cmdbuf, &rec.info, VK_SUBPASS_CONTENTS_INLINE);
+			} else {
+				vkEndCommandBuffer(cmdbuf);
+				vblocks.push_back({VK_NULL_HANDLE, rec.info, vrender_pieces.size(), 0});
+			}
+			cmdbuf = VK_NULL_HANDLE;
+			begin_render_piece();
 			rec.renderpass_commited = rec.renderpass;
 		} else {
 			LOG_MAIN("Failed vkCmdBeginRenderPass.\n");
 		}
 	};
 
+	//Start another secondary before a draw once the current one is large enough.
+	auto split_renderpass = [&]() {
+		if (!rec.renderpass_commited || is_inline_record)
+			return;
+		auto & piece = vrender_pieces.back();
+		if (vrender_ops.size() - piece.op_begin < RENDER_OPS_PER_SECONDARY)
+			return;
+		piece.op_end = vrender_ops.size();
+		begin_render_piece();
+	};
+
 	auto end_renderpass = [&]() {
 		if (rec.renderpass_commited) {
 			LOG_MAIN("!!!!!!!!!!!!!!!!!!!! vkCmdEndRenderPass name=%s\n", rec.renderpass_name.c_str());
-			vkCmdEndRenderPass(ref.cmdbuf);
+			auto & piece = vrender_pieces.back();
+			piece.op_end = vrender_ops.size();
+			if (is_inline_record) {
+				auto start = get_time_ms();
+				record_render_ops(ref.cmdbuf, pipeline_layout, ref.query_pool,
+					vrender_ops.data() + piece.op_begin, piece.op_end - piece.op_begin);
+				vkCmdEndRenderPass(ref.cmdbuf);
+				trace_complete("record", piece.name, start, get_time_ms());
+			} else {
+				vblocks.back().piece_end = vrender_pieces.size();
+			}
+			begin_serial();
 			rec.renderpass_commited = nullptr;
 		}
 	};
 
 	//update shaders
-	static bool is_lazy_shader_update = false;
-	if (is_lazy_shader_update) {
-		//lazy
-		vkDeviceWaitIdle(device);
-		mpipeline_bindpoints.clear();
-		for (auto & x : mpipelines)
+	auto request_reload = [&](auto name) {
+		if (mpipelines.count(name) == 0)
+			return;
+		reloader.request(name, mpipeline_bindpoints[name], mpipeline_renderpasses[name]);
+	};
+
+	{
+		std::vector<std::string> vchanged;
+		watcher.poll(vchanged);
+		for (auto & file : vchanged) {
+			LOG_INFO("shader modified file=%s\n", file.c_str());
+			for (auto & x : mshader_deps)
+				if (std::find(x.second.begin(), x.second.end(), file) != x.second.end())
+					request_reload(x.first);
+		}
+
+		//swap at the frame boundary. old pipeline may still be referenced by in-flight frames.
+		std::vector<pipeline_reloader::job> vjobs;
+		reloader.collect(vjobs);
+		for (auto & j : vjobs) {
+			mshader_deps[j.name] = j.vdeps;
+			for (auto & file : j.vdeps)
+				watcher.add(file);
+			if (j.pipeline == VK_NULL_HANDLE) {
+				LOG_ERR("Failed reload pipeline name=%s. keep current.\n", j.name.c_str());
+				continue;
+			}
+			auto old_pipeline = mpipelines[j.name];
+			if (old_pipeline)
+				vretired_pipelines.push_back({frame_count, old_pipeline});
+			mpipelines[j.name] = j.pipeline;
+		}
+
+		auto it = std::remove_if(vretired_pipelines.begin(), vretired_pipelines.end(), [&](auto & x) {
+			if (x.first + devicebuffer.size() > frame_count)
+				return false;
 			vkDestroyPipeline(device, x.second, nullptr);
-		mpipelines.clear();
-		is_lazy_shader_update = false;
+			return true;
+		});
+		vretired_pipelines.erase(it, vretired_pipelines.end());
 	}
 
+	//The upload ring of the frame slot for CMD_UPDATE_TEXTURE / UPDATE_BUFFER. Returns the offset of bytes.
+	auto alloc_upload = [&](const std::string & name, VkDeviceSize bytes) {
+		auto offset = (ref.upload_offset + 15) & ~VkDeviceSize(15);
+		if (offset + bytes > ref.upload_size) {
+			//The copies recorded before read the full one until this frame completes.
+			if (ref.upload_buffer) {
+				vkUnmapMemory(device, ref.upload_devmem);
+				ref.vscratch_buffers.push_back(ref.upload_buffer);
+				ref.vscratch_devmems.push_back(ref.upload_devmem);
+			}
+			ref.upload_size = (std::max)(ref.upload_size * 2, (bytes + 0xFFFF) & ~VkDeviceSize(0xFFFF));
+			ref.upload_buffer = create_buffer(device, ref.upload_size);
+			VkMemoryRequirements memreqs = {};
+			vkGetBufferMemoryRequirements(device, ref.upload_buffer, &memreqs);
+			ref.upload_devmem = alloc_devmem("__upload__" + std::to_string(backbuffer_index), memreqs.size,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_STAGING, false);
+			vkBindBufferMemory(device, ref.upload_buffer, ref.upload_devmem, 0);
+			ref.upload_data = nullptr;
+			vkMapMemory(device, ref.upload_devmem, 0, memreqs.size, 0, (void **)&ref.upload_data);
+			if (ref.upload_data == nullptr) {
+				LOG_ERR("vkMapMemory upload name=%s size=%llu\n", name.c_str(), (unsigned long long)ref.upload_size);
+				exit(1);
+			}
+			offset = 0;
+		}
+		ref.upload_offset = offset + bytes;
+		return offset;
+	};
+
 	//Proc command.
 	int cmd_index = 0;
+	std::vector<cmd_stats> vstats(CMD_MAX);
+	double segment_cpu_ms = 0.0;
+	double segment_start = get_time_ms();
+	auto end_segment = [&](const std::string & name) {
+		ref.vsegments.push_back({name, segment_cpu_ms, ref.query_pool ? 0.0 : -1.0});
+		segment_cpu_ms = 0.0;
+		auto segment_end = get_time_ms();
+		trace_complete("translate", name, segment_start, segment_end);
+		segment_start = segment_end;
+		if (ref.query_pool) {
+			auto query = (uint32_t)ref.vsegments.size();
+			if (rec.renderpass_commited)
+				push_render_op(render_op::TIMESTAMP, query);
+			else
+				vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ref.query_pool, query);
+		}
+	};
+
 	for (auto & c : vcmd) {
 		auto type = c.type;
 		auto name = c.name;
+		auto cmd_start = get_time_ms();
 		LOG_MAIN("cmd_index = %04d name=%s: %s\n", cmd_index++, name.c_str(), oden_get_cmd_name(type));
 
 		//allocate descriptor_sets.
@@ -1319,20 +2630,27 @@ oden::oden_present_graphics(
 
 			VkImageMemoryBarrier barrier = {};
 			if (image_color) {
-				if (c.set_barrier.to_present) {
+				if (c.set_barrier.to_present && is_headless) {
+					//No presentation engine. stay GENERAL and make it visible to the readback copy.
+					barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+					barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+					barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+					vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+					readback_image = image_color;
+				} else if (c.set_barrier.to_present) {
 					barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-					vkCmdPipelineBarrier(ref.cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+					vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 				}
 				if (c.set_barrier.to_texture) {
 					if (name.find("depth") != std::string::npos)
 						barrier = get_barrier(image_color, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
 					else
 						barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
-					vkCmdPipelineBarrier(ref.cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+					vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 				}
 				if (c.set_barrier.to_rendertarget) {
 					barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-					vkCmdPipelineBarrier(ref.cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+					vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 				}
 				LOG_MAIN("DONE BARRIER name=%s\n", name.c_str());
 			}
@@ -1340,7 +2658,7 @@ oden::oden_present_graphics(
 			if (image_depth) {
 				if (c.set_barrier.to_depthrendertarget) {
 					barrier = get_barrier(image_depth, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-					vkCmdPipelineBarrier(ref.cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+					vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 				}
 				LOG_MAIN("DONE BARRIER name=%s\n", name.c_str());
 			}
@@ -1348,19 +2666,19 @@ oden::oden_present_graphics(
 
 		//CMD_SET_RENDER_TARGET
 		if (type == CMD_SET_RENDER_TARGET) {
-			auto x = c.set_render_target.rect.x;
-			auto y = c.set_render_target.rect.y;
-			auto w = c.set_render_target.rect.w;
-			auto h = c.set_render_target.rect.h;
+			auto & rect = c.set_render_target.rect;
+			int w = 0;
+			int h = 0;
+			oden_get_render_target_size(c, w, h);
 			bool is_backbuffer = c.set_render_target.is_backbuffer;
+			bool is_depth_only = c.set_render_target.is_depth_only;
 
-			//COLOR
-			auto name_color = name;
-			auto image_color = mimages[name_color];
-			auto fmt_color = VK_FORMAT_R16G16B16A16_SFLOAT;
-			if (is_backbuffer == true)
-				fmt_color = VK_FORMAT_B8G8R8A8_UNORM;
+			int rt_count = is_depth_only ? 0 : oden_get_render_target_count(c);
+			VkImageView vimageview_color[RENDER_TARGET_MAX] = {};
+			VkFormat vfmt_color[RENDER_TARGET_MAX] = {};
 			int maxmips = oden_get_mipmap_max(w, h);
+			if (is_backbuffer && (rt_count > 1 || is_depth_only))
+				LOG_ERR("Backbuffer with multiple or depth only render targets name=%s\n", name.c_str());
 
 			//prepare for context roll.
 			if (rec.renderpass_commited) {
@@ -1370,62 +2688,96 @@ oden::oden_present_graphics(
 
 			if (maxmips == 0)
 				LOG_ERR("Invalid RT size w=%d, h=%d name=%s\n", w, h, name.c_str());
-			if (image_color == nullptr) {
-				image_color = create_image(device, w, h, fmt_color,
+
+			//COLOR
+			for (int index = 0; index < rt_count; index++) {
+				auto name_color = oden_get_color_render_target_name(name, index);
+				auto image_color = mimages[name_color];
+				auto fmt = oden_get_render_target_format(c, index);
+				auto fmt_color = get_vk_format(fmt);
+				maxmips = oden_get_mipmap_max(w, h);
+				if (is_backbuffer == true)
+					fmt_color = VK_FORMAT_B8G8R8A8_UNORM;
+				else if (fmt_color == VK_FORMAT_UNDEFINED || oden_is_block_format(fmt))
+					LOG_ERR("Invalid RT format fmt=%s name=%s\n", oden_get_format_name(fmt), name_color.c_str());
+
+				if (image_color == nullptr) {
+					VkImageUsageFlags usage =
 						VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
 						VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
-						VK_IMAGE_USAGE_STORAGE_BIT |
-						VK_IMAGE_USAGE_SAMPLED_BIT, maxmips);
-				mimages[name_color] = image_color;
-				LOG_MAIN("create_image name_color=%s, image_color=0x%p\n", name_color.c_str(), image_color);
-			}
+						VK_IMAGE_USAGE_SAMPLED_BIT;
+					if (is_storage_format(fmt_color))
+						usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+					//Mips of the other formats are blitted.
+					if (fmt_color != VK_FORMAT_R16G16B16A16_SFLOAT)
+						usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+					//Headless backbuffer. BGRA8 storage images are optional, so no UAV and no mips.
+					if (is_backbuffer) {
+						usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+							VK_IMAGE_USAGE_SAMPLED_BIT |
+							VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+						maxmips = 1;
+					}
+					image_color = create_image(device, w, h, fmt_color, usage, maxmips);
+					mimages[name_color] = image_color;
+					LOG_MAIN("create_image name_color=%s, image_color=0x%p\n", name_color.c_str(), image_color);
+				}
 
-			//allocate color memreq and Bind
-			if (mmemreqs.count(name_color) == 0) {
-				VkMemoryRequirements memreqs = {};
+				//allocate color memreq and Bind
+				if (mmemreqs.count(name_color) == 0) {
+					VkMemoryRequirements memreqs = {};
 
-				vkGetImageMemoryRequirements(device, image_color, &memreqs);
-				memreqs.size = memreqs.size + (memreqs.alignment - 1);
-				memreqs.size &= ~(memreqs.alignment - 1);
-				mmemreqs[name_color] = memreqs;
+					vkGetImageMemoryRequirements(device, image_color, &memreqs);
+					memreqs.size = memreqs.size + (memreqs.alignment - 1);
+					memreqs.size &= ~(memreqs.alignment - 1);
+					mmemreqs[name_color] = memreqs;
 
-				VkDeviceMemory devmem = alloc_devmem(
-						name_color, memreqs.size, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-				vkBindImageMemory(device, image_color, devmem, 0);
+					VkDeviceMemory devmem = alloc_devmem(
+							name_color, memreqs.size, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_RT_COLOR);
+					vkBindImageMemory(device, image_color, devmem, 0);
 
-				auto barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, maxmips);
-				vkCmdPipelineBarrier(ref.cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
-			}
+					auto barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, maxmips);
+					vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+				}
 
-			//COLOR VIEW
-			auto imageview_color = mimageviews[name_color];
-			if (imageview_color == nullptr) {
-				LOG_MAIN("create_image_view name=%s\n", name_color.c_str());
-				imageview_color = create_image_view(device, image_color, fmt_color, VK_IMAGE_ASPECT_COLOR_BIT);
-				mimageviews[name_color] = imageview_color;
-				LOG_MAIN("create_image_view imageview_color=0x%p\n", imageview_color);
-				if (is_backbuffer == false) {
-					for (int i = 0 ; i < maxmips; i++) {
-						auto imageview_color_mip = create_image_view(device, image_color, fmt_color, VK_IMAGE_ASPECT_COLOR_BIT, i);
-						auto name_color_mip = oden_get_mipmap_name(name_color, i);
-						mimageviews[name_color_mip] = imageview_color_mip;
-						LOG_MAIN("create_image_view name=%s, imageview_color_mip=0x%p\n",
-							name_color_mip.c_str(), imageview_color_mip);
+				//COLOR VIEW
+				auto imageview_color = mimageviews[name_color];
+				if (imageview_color == nullptr) {
+					LOG_MAIN("create_image_view name=%s\n", name_color.c_str());
+					imageview_color = create_image_view(device, image_color, fmt_color, VK_IMAGE_ASPECT_COLOR_BIT);
+					mimageviews[name_color] = imageview_color;
+					LOG_MAIN("create_image_view imageview_color=0x%p\n", imageview_color);
+					if (is_backbuffer == false) {
+						for (int i = 0 ; i < maxmips; i++) {
+							auto imageview_color_mip = create_image_view(device, image_color, fmt_color, VK_IMAGE_ASPECT_COLOR_BIT, i);
+							auto name_color_mip = oden_get_mipmap_name(name_color, i);
+							mimageviews[name_color_mip] = imageview_color_mip;
+							LOG_MAIN("create_image_view name=%s, imageview_color_mip=0x%p\n",
+								name_color_mip.c_str(), imageview_color_mip);
+						}
+						mgenmips_targets[name_color] = {
+							VK_NULL_HANDLE, (uint32_t)w, (uint32_t)h, (uint32_t)maxmips,
+							fmt_color != VK_FORMAT_R16G16B16A16_SFLOAT
+						};
+						VkImageSubresourceRange image_range_color = {};
+						image_range_color.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+						image_range_color.baseMipLevel = 0;
+						image_range_color.levelCount = maxmips;
+						image_range_color.baseArrayLayer = 0;
+						image_range_color.layerCount = 1;
+
+						VkClearColorValue clearColor = {};
+						clearColor.float32[0] = c.clear.color[0];
+						clearColor.float32[1] = c.clear.color[1];
+						clearColor.float32[2] = c.clear.color[2];
+						clearColor.float32[3] = c.clear.color[3];
+						vkCmdClearColorImage(cmdbuf, image_color, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &image_range_color);
 					}
-					VkImageSubresourceRange image_range_color = {};
-					image_range_color.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-					image_range_color.baseMipLevel = 0;
-					image_range_color.levelCount = maxmips;
-					image_range_color.baseArrayLayer = 0;
-					image_range_color.layerCount = 1;
-
-					VkClearColorValue clearColor = {};
-					clearColor.float32[0] = c.clear.color[0];
-					clearColor.float32[1] = c.clear.color[1];
-					clearColor.float32[2] = c.clear.color[2];
-					clearColor.float32[3] = c.clear.color[3];
-					vkCmdClearColorImage(ref.cmdbuf, image_color, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &image_range_color);
 				}
+
+				vimageview_color[index] = imageview_color;
+				vfmt_color[index] = fmt_color;
 			}
 
 			//DEPTH
@@ -1449,11 +2801,11 @@ oden::oden_present_graphics(
 				memreqs.size &= ~(memreqs.alignment - 1);
 				mmemreqs[name_depth] = memreqs;
 				VkDeviceMemory devmem = alloc_devmem(
-						name_depth, memreqs.size, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+						name_depth, memreqs.size, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_RT_DEPTH);
 				vkBindImageMemory(device, image_depth, devmem, 0);
 
 				auto barrier = get_barrier(image_depth, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-				vkCmdPipelineBarrier(ref.cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+				vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 			}
 
 			//DEPTH VIEW
@@ -1466,42 +2818,45 @@ oden::oden_present_graphics(
 			}
 
 			//RENDER PASS
-			auto renderpass = mrenderpasses[name];
-			LOG_MAIN("query renderpass name=%s\n", name.c_str());
+			//a depth only pass has its own render pass and framebuffer on the same depth image.
+			auto name_pass = is_depth_only ? name + "#depth_only" : name;
+			auto renderpass = mrenderpasses[name_pass];
+			LOG_MAIN("query renderpass name=%s\n", name_pass.c_str());
 			if (renderpass == nullptr) {
-				renderpass = create_renderpass(device, 1, is_backbuffer, fmt_color, fmt_depth);
-				LOG_MAIN("create_renderpass name=%s, ptr=%p\n", name_color.c_str(), renderpass);
-				mrenderpasses[name] = renderpass;
+				renderpass = create_renderpass(device, rt_count, is_backbuffer && !is_headless, vfmt_color, fmt_depth);
+				LOG_MAIN("create_renderpass name=%s, count=%d, ptr=%p\n", name_pass.c_str(), rt_count, renderpass);
+				mrenderpasses[name_pass] = renderpass;
 			}
 
 			//FRAMEBUFFER
-			auto framebuffer = mframebuffers[name];
+			auto framebuffer = mframebuffers[name_pass];
 			if (framebuffer == nullptr && renderpass) {
-				std::vector<VkImageView> imageviews;
-				imageviews.push_back(imageview_color);
+				std::vector<VkImageView> imageviews(vimageview_color, vimageview_color + rt_count);
 				imageviews.push_back(imageview_depth);
 
 				framebuffer = create_framebuffer(device, renderpass, imageviews, w, h);
-				LOG_MAIN("create_framebuffer name=%s, ptr=%p\n", name_color.c_str(), framebuffer);
-				mframebuffers[name] = framebuffer;
+				LOG_MAIN("create_framebuffer name=%s, ptr=%p\n", name_pass.c_str(), framebuffer);
+				mframebuffers[name_pass] = framebuffer;
 			}
-			LOG_MAIN("found renderpass name=%s, ptr=%p\n", name_color.c_str(), renderpass);
-			LOG_MAIN("found framebuffer name=%s, ptr=%p\n", name_color.c_str(), framebuffer);
+			LOG_MAIN("found renderpass name=%s, ptr=%p\n", name.c_str(), renderpass);
+			LOG_MAIN("found framebuffer name=%s, ptr=%p\n", name.c_str(), framebuffer);
 
-			//setup viewport and scissor
+			//setup viewport and scissor. targets keep their size, the rect draws into a part of them.
 			VkViewport viewport = {};
-			viewport.width = (float)w;
-			viewport.height = (float)h;
+			viewport.x = (float)rect.x;
+			viewport.y = (float)rect.y;
+			viewport.width = (float)rect.w;
+			viewport.height = (float)rect.h;
 			viewport.minDepth = (float)0.0f;
 			viewport.maxDepth = (float)1.0f;
-			vkCmdSetViewport(ref.cmdbuf, 0, 1, &viewport);
+			rec.viewport = viewport;
 
 			VkRect2D scissor = {};
-			scissor.extent.width = w;
-			scissor.extent.height = h;
-			scissor.offset.x = 0;
-			scissor.offset.y = 0;
-			vkCmdSetScissor(ref.cmdbuf, 0, 1, &scissor);
+			scissor.extent.width = rect.w;
+			scissor.extent.height = rect.h;
+			scissor.offset.x = rect.x;
+			scissor.offset.y = rect.y;
+			rec.scissor = scissor;
 
 			VkRenderPassBeginInfo rp_begin = {};
 			rp_begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -1515,6 +2870,9 @@ oden::oden_present_graphics(
 			rp_begin.clearValueCount = 0;
 			rp_begin.pClearValues = nullptr;
 			setup_renderpass(name, rp_begin, renderpass);
+			memcpy(rec.color_formats, vfmt_color, sizeof(vfmt_color));
+			rec.color_count = rt_count;
+			rec.is_depth_only = is_depth_only;
 		}
 
 		//CMD_SET_TEXTURE
@@ -1524,31 +2882,34 @@ oden::oden_present_graphics(
 			auto slot = c.set_texture.slot;
 			LOG_MAIN("DEBUG : name=%s, c.set_texture.miplevel=%d\n", name.c_str(), c.set_texture.miplevel);
 
-			//prepare for context roll.
-			if (rec.renderpass_commited)
-				end_renderpass();
-
-			if (rec.descriptor_sets == nullptr)
+			if (rec.descriptor_sets == nullptr && slot >= 0)
 				descriptor_sets = scratch_descriptor_sets();
 
 			//COLOR
 			auto name_color = name;
-			auto fmt_color = VK_FORMAT_R8G8B8A8_UNORM;
+			auto fmt = oden_get_texture_format(c.set_texture.fmt);
+			auto fmt_color = get_vk_format(fmt);
 			auto image_color = mimages[name_color];
 			if (image_color == nullptr) {
-				image_color = create_image(device, w, h, fmt_color,
-						VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
-						VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
-						VK_IMAGE_USAGE_STORAGE_BIT |
-						VK_IMAGE_USAGE_SAMPLED_BIT, 1);
+				if (fmt_color == VK_FORMAT_UNDEFINED)
+					LOG_ERR("Invalid texture format fmt=%s name=%s\n", oden_get_format_name(fmt), name.c_str());
+				//Block compressed formats are sampled only.
+				VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+				if (!oden_is_block_format(fmt))
+					usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+				if (is_storage_format(fmt_color))
+					usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+				uint32_t levels = (std::max)(c.set_texture.mips, 1);
+				image_color = create_image(device, w, h, fmt_color, usage, levels);
 				mimages[name_color] = image_color;
+				mtextures[name_color] = {w, h, levels, fmt};
 				LOG_MAIN("create_image name_color=%s, image_color=0x%p\n", name_color.c_str(), image_color);
 			}
 
 			//allocate color memreq and Bind
 			if (mmemreqs.count(name_color) == 0) {
-				auto data = c.buf.data();
-				auto size = c.buf.size();
+				auto data = oden_get_cmd_data(c);
+				auto size = oden_get_cmd_size(c);
 				VkMemoryRequirements memreqs = {};
 
 				vkGetImageMemoryRequirements(device, image_color, &memreqs);
@@ -1557,12 +2918,28 @@ oden::oden_present_graphics(
 				mmemreqs[name_color] = memreqs;
 
 				VkDeviceMemory devmem = alloc_devmem(
-						name_color, memreqs.size, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+						name_color, memreqs.size, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_TEXTURE);
 				vkBindImageMemory(device, image_color, devmem, 0);
 
+				//prepare for context roll. the upload is recorded outside of render passes.
+				if (rec.renderpass_commited)
+					end_renderpass();
+
 				{
+					//Levels after 0 are packed in data. Their staging offsets are aligned for the copy.
+					uint32_t levels = mtextures[name_color].levels;
+					std::vector<VkDeviceSize> voffset(levels);
+					VkDeviceSize staging_size = 0;
+					for (uint32_t i = 0; i < levels; i++) {
+						voffset[i] = staging_size;
+						auto next = oden_get_texture_level_offset(fmt, w, h, i + 1, c.set_texture.stride_size);
+						auto level_size = next - oden_get_texture_level_offset(fmt, w, h, i, c.set_texture.stride_size);
+						staging_size = (staging_size + level_size + 15) & ~VkDeviceSize(15);
+					}
+					if (size < oden_get_texture_level_offset(fmt, w, h, levels, c.set_texture.stride_size))
+						LOG_ERR("texture data is smaller than the levels name=%s size=%zu levels=%u\n", name.c_str(), size, levels);
 					LOG_MAIN("create_buffer-staging name=%s\n", name.c_str());
-					auto scratch_buffer = create_buffer(device, size);
+					auto scratch_buffer = create_buffer(device, staging_size);
 					ref.vscratch_buffers.push_back(scratch_buffer);
 
 					LOG_MAIN("create_buffer-staging name=%s Done\n", name.c_str());
@@ -1570,35 +2947,51 @@ oden::oden_present_graphics(
 					vkGetBufferMemoryRequirements(device, scratch_buffer, &memreqs);
 					memreqs.size = memreqs.size + (memreqs.alignment - 1);
 					memreqs.size &= ~(memreqs.alignment - 1);
-					VkDeviceMemory devmem = alloc_devmem(std::string(name) + "_staging", memreqs.size,
+					auto scratch_name = std::string(name) + "_staging";
+					VkDeviceMemory devmem = alloc_devmem(scratch_name, memreqs.size,
 							VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-							VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, false);
+							VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_STAGING, false);
 					ref.vscratch_devmems.push_back(devmem);
+					ref.vscratch_names.push_back(scratch_name);
 					vkBindBufferMemory(device, scratch_buffer, devmem, 0);
 					LOG_MAIN("vkBindBufferMemory name=%s Done\n", name.c_str());
+					trace_scope trace("upload", name);
 					void *dest = nullptr;
 					vkMapMemory(device, devmem, 0, memreqs.size, 0, (void **)&dest);
 					if (dest) {
 						LOG_MAIN("vkMapMemory name=%s addr=0x%p\n", name.c_str(), dest);
-						memcpy(dest, data, size);
+						for (uint32_t i = 0; i < levels; i++) {
+							auto offset = oden_get_texture_level_offset(fmt, w, h, i, c.set_texture.stride_size);
+							auto next = oden_get_texture_level_offset(fmt, w, h, i + 1, c.set_texture.stride_size);
+							if (offset < size)
+								memcpy((uint8_t *)dest + voffset[i], data + offset, size_t((std::min)(uint64_t(size), next) - offset));
+						}
 						vkUnmapMemory(device, devmem);
 					} else {
 						LOG_ERR("vkMapMemory name=%s addr=0x%p\n", name.c_str(), dest);
-						Sleep(1000);
+						oden_platform_sleep(1000);
 					}
 
-					auto before_barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-					auto after_barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
-					vkCmdPipelineBarrier(ref.cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &before_barrier);
-					VkBufferImageCopy copy_region = {};
-					copy_region.bufferOffset = 0;
-					copy_region.bufferRowLength = w;
-					copy_region.bufferImageHeight = h;
-					copy_region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-					copy_region.imageOffset = {0, 0, 0};
-					copy_region.imageExtent = {w, h, 1};
-					vkCmdCopyBufferToImage(ref.cmdbuf, scratch_buffer, image_color, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
-					vkCmdPipelineBarrier(ref.cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &after_barrier);
+					auto before_barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, levels);
+					auto after_barrier = get_barrier(image_color, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, 0, levels);
+					vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &before_barrier);
+					std::vector<VkBufferImageCopy> vcopy_region(levels);
+					for (uint32_t i = 0; i < levels; i++) {
+						auto & copy_region = vcopy_region[i];
+						//bufferRowLength is in texels, of 4x4 blocks it is 4 per block.
+						size_t stride = i == 0 ? c.set_texture.stride_size : 0;
+						int bytes = oden_get_format_bytes(fmt);
+						copy_region.bufferOffset = voffset[i];
+						copy_region.bufferRowLength = 0;
+						if (stride && bytes)
+							copy_region.bufferRowLength = oden_is_block_format(fmt) ? uint32_t(stride / bytes * 4) : uint32_t(stride / bytes);
+						copy_region.bufferImageHeight = 0;
+						copy_region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+						copy_region.imageOffset = {0, 0, 0};
+						copy_region.imageExtent = {(std::max)(w >> i, 1u), (std::max)(h >> i, 1u), 1};
+					}
+					vkCmdCopyBufferToImage(cmdbuf, scratch_buffer, image_color, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levels, vcopy_region.data());
+					vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &after_barrier);
 				}
 			}
 
@@ -1606,12 +2999,25 @@ oden::oden_present_graphics(
 			auto imageview_color = mimageviews[name_color];
 			if (imageview_color == nullptr) {
 				LOG_MAIN("create_image_view name=%s\n", name_color.c_str());
-				imageview_color = create_image_view(device, image_color, fmt_color, VK_IMAGE_ASPECT_COLOR_BIT);
+				uint32_t levels = mtextures.count(name_color) ? mtextures[name_color].levels : 1;
+				imageview_color = create_image_view(device, image_color, fmt_color, VK_IMAGE_ASPECT_COLOR_BIT, 0, levels);
 				mimageviews[name_color] = imageview_color;
 				LOG_MAIN("create_image_view imageview_color=0x%p\n", imageview_color);
 			}
 
-			if (descriptor_sets) {
+			//A view from miplevel, the finer levels are not read.
+			if (type == CMD_SET_TEXTURE && c.set_texture.miplevel > 0 && mtextures.count(name_color)) {
+				uint32_t levels = mtextures[name_color].levels;
+				uint32_t miplevel = (std::min)(uint32_t(c.set_texture.miplevel), levels - 1);
+				auto name_level = oden_get_mipmap_name(name_color, int(miplevel)) + "_srv";
+				if (mimageviews[name_level] == nullptr)
+					mimageviews[name_level] = create_image_view(device, image_color, fmt_color, VK_IMAGE_ASPECT_COLOR_BIT, miplevel, levels - miplevel);
+				imageview_color = mimageviews[name_level];
+			}
+
+			if (slot < 0) {
+				//created only.
+			} else if (descriptor_sets) {
 				if (type == CMD_SET_TEXTURE) {
 					auto binding = (RDT_SLOT_MAX * slot) + RDT_SLOT_SRV;
 					VkDescriptorImageInfo image_info = {};
@@ -1640,6 +3046,80 @@ oden::oden_present_graphics(
 			}
 		}
 
+		//CMD_SET_BUFFER
+		if (type == CMD_SET_BUFFER || type == CMD_SET_BUFFER_UAV) {
+			auto slot = c.set_buffer.slot;
+			auto buffer = mbuffers[name];
+			if (buffer == nullptr) {
+				trace_scope trace("upload", name);
+				auto size = c.set_buffer.size;
+				buffer = create_buffer(device, size);
+				mbuffers[name] = buffer;
+				VkMemoryRequirements memreqs = {};
+				vkGetBufferMemoryRequirements(device, buffer, &memreqs);
+				mmemreqs[name] = memreqs;
+				VkDeviceMemory devmem = alloc_devmem(name, memreqs.size,
+						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_BUFFER);
+				vkBindBufferMemory(device, buffer, devmem, 0);
+
+				//written once here, CMD_UPDATE_BUFFER copies in the command buffer.
+				uint8_t *dest = nullptr;
+				vkMapMemory(device, devmem, 0, memreqs.size, 0, (void **)&dest);
+				if (dest) {
+					auto data_size = (std::min)(oden_get_cmd_size(c), size);
+					memset(dest, 0, size);
+					if (data_size)
+						memcpy(dest, oden_get_cmd_data(c), data_size);
+					vkUnmapMemory(device, devmem);
+				} else {
+					LOG_ERR("vkMapMemory name=%s addr=0x%p\n", name.c_str(), dest);
+				}
+				LOG_MAIN("create_buffer-storage name=%s size=%zu\n", name.c_str(), size);
+			}
+
+			if (rec.descriptor_sets == nullptr && slot >= 0)
+				descriptor_sets = scratch_descriptor_sets();
+			if (slot >= 0 && descriptor_sets) {
+				auto binding = oden_get_buffer_binding(slot, type == CMD_SET_BUFFER_UAV);
+				VkDescriptorBufferInfo buffer_info = {};
+				buffer_info.buffer = buffer;
+				buffer_info.offset = 0;
+				buffer_info.range = VK_WHOLE_SIZE;
+				update_descriptor_sets(device, descriptor_sets, &buffer_info, binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+			}
+		}
+
+		//CMD_UPDATE_BUFFER
+		if (type == CMD_UPDATE_BUFFER) {
+			auto buffer = mbuffers[name];
+			auto size = oden_get_cmd_size(c);
+			if (buffer == nullptr || size == 0) {
+				LOG_ERR("Invalid update buffer name=%s\n", name.c_str());
+			} else {
+				//the copy is recorded outside of render passes.
+				if (rec.renderpass_commited)
+					end_renderpass();
+				trace_scope trace("upload", name);
+				auto offset = alloc_upload(name, size);
+				memcpy(ref.upload_data + offset, oden_get_cmd_data(c), size);
+
+				//after the reads of the previous draws and dispatches, before the next ones.
+				auto shader_stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+					VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+				VkMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				vkCmdPipelineBarrier(cmdbuf, shader_stages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+				VkBufferCopy region = {offset, c.set_buffer.offset, size};
+				vkCmdCopyBuffer(cmdbuf, ref.upload_buffer, buffer, 1, &region);
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+				vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, shader_stages, 0, 1, &barrier, 0, NULL, 0, NULL);
+			}
+		}
+
 		//CMD_SET_CONSTANT
 		if (type == CMD_SET_CONSTANT) {
 			auto slot = c.set_constant.slot;
@@ -1665,21 +3145,24 @@ oden::oden_present_graphics(
 				mmemreqs[name] = memreqs;
 				devmem = alloc_devmem(name, memreqs.size,
 						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_CONSTANT);
 				vkBindBufferMemory(device, buffer, devmem, 0);
 				LOG_MAIN("vkBindBufferMemory name=%s Done\n", name.c_str());
 			}
 
 			//update
-			void *dest = nullptr;
-			vkMapMemory(device, devmem, 0, size, 0, (void **)&dest);
-			if (dest) {
-				LOG_MAIN("vkMapMemory name=%s addr=0x%p\n", name.c_str(), dest);
-				memcpy(dest, data, size);
-				vkUnmapMemory(device, devmem);
-			} else {
-				LOG_ERR("vkMapMemory name=%s addr=0x%p\n", name.c_str(), dest);
-				Sleep(1000);
+			{
+				trace_scope trace("upload", name);
+				void *dest = nullptr;
+				vkMapMemory(device, devmem, 0, size, 0, (void **)&dest);
+				if (dest) {
+					LOG_MAIN("vkMapMemory name=%s addr=0x%p\n", name.c_str(), dest);
+					memcpy(dest, data, size);
+					vkUnmapMemory(device, devmem);
+				} else {
+					LOG_ERR("vkMapMemory name=%s addr=0x%p\n", name.c_str(), dest);
+					oden_platform_sleep(1000);
+				}
 			}
 
 			if (descriptor_sets) {
@@ -1700,8 +3183,8 @@ oden::oden_present_graphics(
 		//CMD_SET_VERTEX
 		if (type == CMD_SET_VERTEX) {
 			auto buffer = mbuffers[name];
-			auto data = c.buf.data();
-			auto size = c.buf.size();
+			auto data = oden_get_cmd_data(c);
+			auto size = oden_get_cmd_size(c);
 			if (buffer == nullptr) {
 				LOG_MAIN("create_buffer-vertex name=%s\n", name.c_str());
 				buffer = create_buffer(device, size);
@@ -1719,10 +3202,11 @@ oden::oden_present_graphics(
 				mmemreqs[name] = memreqs;
 				VkDeviceMemory devmem = alloc_devmem(name, memreqs.size,
 						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_VERTEX);
 				vkBindBufferMemory(device, buffer, devmem, 0);
 				LOG_MAIN("vkBindBufferMemory name=%s Done\n", name.c_str());
 
+				trace_scope trace("upload", name);
 				void *dest = nullptr;
 				vkMapMemory(device, devmem, 0, memreqs.size, 0, (void **)&dest);
 				if (dest) {
@@ -1731,20 +3215,21 @@ oden::oden_present_graphics(
 					vkUnmapMemory(device, devmem);
 				} else {
 					LOG_ERR("vkMapMemory name=%s addr=0x%p\n", name.c_str(), dest);
-					Sleep(1000);
+					oden_platform_sleep(1000);
 				}
 			}
 
-			VkDeviceSize offsets[1] = {0};
-			vkCmdBindVertexBuffers(ref.cmdbuf, 0, 1, &buffer, offsets);
+			rec.vertex_buffer = buffer;
+			if (rec.renderpass_commited)
+				push_render_op(render_op::BIND_VERTEX).buffer = buffer;
 			LOG_MAIN("vkCmdBindVertexBuffers name=%s\n", name.c_str());
 		}
 
 		//CMD_SET_INDEX
 		if (type == CMD_SET_INDEX) {
 			auto buffer = mbuffers[name];
-			auto data = c.buf.data();
-			auto size = c.buf.size();
+			auto data = oden_get_cmd_data(c);
+			auto size = oden_get_cmd_size(c);
 			if (buffer == nullptr) {
 				LOG_MAIN("create_buffer-index name=%s\n", name.c_str());
 				buffer = create_buffer(device, size);
@@ -1762,10 +3247,11 @@ oden::oden_present_graphics(
 				mmemreqs[name] = memreqs;
 				VkDeviceMemory devmem = alloc_devmem(name, memreqs.size,
 						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_INDEX);
 				vkBindBufferMemory(device, buffer, devmem, 0);
 				LOG_MAIN("vkBindBufferMemory index name=%s Done\n", name.c_str());
 
+				trace_scope trace("upload", name);
 				void *dest = nullptr;
 				vkMapMemory(device, devmem, 0, memreqs.size, 0, (void **)&dest);
 				if (dest) {
@@ -1774,22 +3260,24 @@ oden::oden_present_graphics(
 					vkUnmapMemory(device, devmem);
 				} else {
 					LOG_ERR("vkMapMemory name=%s addr=0x%p\n", name.c_str(), dest);
-					Sleep(1000);
+					oden_platform_sleep(1000);
 				}
 			}
 
-			VkDeviceSize offset = {};
-			vkCmdBindIndexBuffer(ref.cmdbuf, buffer, offset, VK_INDEX_TYPE_UINT32);
+			rec.index_buffer = buffer;
+			if (rec.renderpass_commited)
+				push_render_op(render_op::BIND_INDEX).buffer = buffer;
 			LOG_MAIN("vkCmdBindIndexBuffers name=%s\n", name.c_str());
 		}
 
 		//CMD_SET_SHADER
 		if (type == CMD_SET_SHADER) {
+			auto key = get_pipeline_key(name, rec.color_formats, rec.color_count, rec.is_depth_only, c.set_shader.depth_func);
 			if (c.set_shader.is_update)
-				is_lazy_shader_update = true;
+				request_reload(key);
 
-			auto binding_point = mpipeline_bindpoints[name];
-			auto pipeline = mpipelines[name];
+			auto binding_point = mpipeline_bindpoints[key];
+			auto pipeline = mpipelines[key];
 
 			//prepare for context roll.
 			if (rec.renderpass_commited) {
@@ -1798,30 +3286,42 @@ oden::oden_present_graphics(
 			}
 
 			if (pipeline == nullptr) {
-				pipeline = create_gpipeline_from_file(device, name.c_str(), pipeline_layout, rec.renderpass);
+				pipeline = create_gpipeline_from_file(device, name.c_str(), pipeline_layout, rec.renderpass,
+						get_pipeline_color_count(key), c.set_shader.depth_func);
 				if (pipeline) {
-					mpipelines[name] = pipeline;
-					mpipeline_bindpoints[name] = VK_PIPELINE_BIND_POINT_GRAPHICS;
-					binding_point = mpipeline_bindpoints[name];
+					mpipelines[key] = pipeline;
+					mpipeline_bindpoints[key] = VK_PIPELINE_BIND_POINT_GRAPHICS;
+					binding_point = mpipeline_bindpoints[key];
 				}
 			}
 
 			if (pipeline == nullptr) {
 				pipeline = create_cpipeline_from_file(device, name.c_str(), pipeline_layout);
 				if (pipeline) {
-					mpipelines[name] = pipeline;
-					mpipeline_bindpoints[name] = VK_PIPELINE_BIND_POINT_COMPUTE;
-					binding_point = mpipeline_bindpoints[name];
+					mpipelines[key] = pipeline;
+					mpipeline_bindpoints[key] = VK_PIPELINE_BIND_POINT_COMPUTE;
+					binding_point = mpipeline_bindpoints[key];
 				}
 			}
 
-			if (pipeline) {
+			if (pipeline && mshader_deps.count(key) == 0) {
+				auto & vdeps = mshader_deps[key];
+				collect_shader_dependencies(name + ".glsl", vdeps);
+				for (auto & file : vdeps)
+					watcher.add(file);
+				mpipeline_renderpasses[key] = rec.renderpass;
+			}
+
+			if (pipeline && binding_point == VK_PIPELINE_BIND_POINT_GRAPHICS) {
+				//bound by the render pass pieces.
+				rec.pipeline = pipeline;
+			} else if (pipeline) {
 				LOG_MAIN("vkCmdBindPipeline\n");
-				vkCmdBindPipeline(ref.cmdbuf, binding_point, pipeline);
+				vkCmdBindPipeline(cmdbuf, binding_point, pipeline);
 
 				LOG_MAIN("vkCmdBindDescriptorSets descriptor_sets=%p\n", descriptor_sets);
 				vkCmdBindDescriptorSets(
-					ref.cmdbuf, binding_point, pipeline_layout, 0,
+					cmdbuf, binding_point, pipeline_layout, 0,
 					1, (const VkDescriptorSet *)&descriptor_sets, 0, NULL);
 			} else {
 				LOG_ERR("Failed make pipeline name=%s\n", name.c_str());
@@ -1852,7 +3352,7 @@ oden::oden_present_graphics(
 			clearColor.float32[1] = c.clear.color[1];
 			clearColor.float32[2] = c.clear.color[2];
 			clearColor.float32[3] = c.clear.color[3];
-			vkCmdClearColorImage(ref.cmdbuf, image_color, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &image_range_color);
+			vkCmdClearColorImage(cmdbuf, image_color, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &image_range_color);
 		}
 
 		//CMD_CLEAR_DEPTH
@@ -1875,48 +3375,358 @@ oden::oden_present_graphics(
 			image_range_depth.levelCount = 1;
 			image_range_depth.baseArrayLayer = 0;
 			image_range_depth.layerCount = 1;
-			vkCmdClearDepthStencilImage(ref.cmdbuf, image_depth, VK_IMAGE_LAYOUT_GENERAL, &cdsv, 1, &image_range_depth);
+			vkCmdClearDepthStencilImage(cmdbuf, image_depth, VK_IMAGE_LAYOUT_GENERAL, &cdsv, 1, &image_range_depth);
 		}
 
 		//CMD_DRAW_INDEX
 		if (type == CMD_DRAW_INDEX) {
 			if (!rec.renderpass_commited)
 				begin_renderpass();
-			vkCmdBindDescriptorSets(
-				ref.cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0,
-				1, (const VkDescriptorSet*)&rec.descriptor_sets, 0, NULL);
-			vkCmdDrawIndexed(ref.cmdbuf, c.draw_index.count, 1, 0, 0, 0);
+			split_renderpass();
+			push_render_op(render_op::BIND_DESCRIPTOR_SETS).descriptor_sets = rec.descriptor_sets;
+			push_render_op(render_op::DRAW_INDEX, c.draw_index.count);
 		}
 
 		//CMD_DRAW
 		if (type == CMD_DRAW) {
 			if (!rec.renderpass_commited)
 				begin_renderpass();
-			vkCmdBindDescriptorSets(
-				ref.cmdbuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0,
-				1, (const VkDescriptorSet *)&rec.descriptor_sets, 0, NULL);
-			vkCmdDraw(ref.cmdbuf, c.draw.vertex_count, 1, 0, 0);
+			split_renderpass();
+			push_render_op(render_op::BIND_DESCRIPTOR_SETS).descriptor_sets = rec.descriptor_sets;
+			push_render_op(render_op::DRAW, c.draw.vertex_count);
+		}
+
+		//CMD_DRAW_INDEX_INSTANCED, CMD_DRAW_INSTANCED
+		if (type == CMD_DRAW_INDEX_INSTANCED || type == CMD_DRAW_INSTANCED) {
+			if (!rec.renderpass_commited)
+				begin_renderpass();
+			split_renderpass();
+			push_render_op(render_op::BIND_DESCRIPTOR_SETS).descriptor_sets = rec.descriptor_sets;
+			auto op_type = type == CMD_DRAW_INDEX_INSTANCED ? render_op::DRAW_INDEX_INSTANCED : render_op::DRAW_INSTANCED;
+			auto & op = push_render_op(op_type, uint32_t(c.draw_instanced.count));
+			op.instances.first_index = type == CMD_DRAW_INDEX_INSTANCED ? uint32_t(c.draw_instanced.start) : 0;
+			op.instances.instance_count = uint32_t(c.draw_instanced.instance_count);
+		}
+
+		//CMD_DRAW_INDEX_INDIRECT
+		if (type == CMD_DRAW_INDEX_INDIRECT) {
+			auto buffer = mbuffers[name];
+			if (buffer) {
+				if (!rec.renderpass_commited)
+					begin_renderpass();
+				split_renderpass();
+				push_render_op(render_op::BIND_DESCRIPTOR_SETS).descriptor_sets = rec.descriptor_sets;
+				push_render_op(render_op::DRAW_INDEX_INDIRECT, uint32_t(c.draw_index_indirect.offset)).buffer = buffer;
+			} else {
+				LOG_ERR("Invalid draw indirect name=%s\n", name.c_str());
+			}
 		}
 
 		//CMD_DISPATCH
 		if (type == CMD_DISPATCH) {
+			//prepare for context roll.
+			if (rec.renderpass_commited)
+				end_renderpass();
+
 			vkCmdBindDescriptorSets(
-				ref.cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0,
+				cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0,
 				1, (const VkDescriptorSet *)&rec.descriptor_sets, 0, NULL);
-			vkCmdDispatch(ref.cmdbuf, c.dispatch.x, c.dispatch.y, c.dispatch.z);
+			vkCmdDispatch(cmdbuf, c.dispatch.x, c.dispatch.y, c.dispatch.z);
+
+			//the next dispatches, draws and indirect arguments read what this one wrote.
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+			vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+				VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				0, 1, &barrier, 0, NULL, 0, NULL);
 
 			//discard dispatch desc set and increase.
 			scratch_descriptor_sets();
 		}
+
+		//CMD_RELEASE
+		if (type == CMD_RELEASE) {
+			if (mtextures.count(name) == 0 || mimages[name] == nullptr) {
+				LOG_ERR("Invalid release name=%s\n", name.c_str());
+			} else {
+				//This frame slot destroys them when its fence has passed, after every frame using them.
+				for (auto it = mimageviews.begin(); it != mimageviews.end();) {
+					if (it->first == name || it->first.find(name + "_miplevel_") == 0) {
+						if (it->second)
+							ref.vretired_imageviews.push_back(it->second);
+						it = mimageviews.erase(it);
+					} else {
+						it++;
+					}
+				}
+				ref.vretired_images.push_back(mimages[name]);
+				if (mdevmem[name])
+					ref.vscratch_devmems.push_back(mdevmem[name]);
+				mimages.erase(name);
+				mdevmem.erase(name);
+				mmemreqs.erase(name);
+				mtextures.erase(name);
+				release_memory(name);
+			}
+		}
+
+		//CMD_UPDATE_TEXTURE
+		if (type == CMD_UPDATE_TEXTURE) {
+			auto it = mtextures.find(name);
+			auto image = mimages[name];
+			texture_desc desc;
+			if (it != mtextures.end())
+				desc = it->second;
+			auto & r = c.set_texture.rect;
+			auto level = c.set_texture.miplevel;
+			auto row_bytes = oden_get_texture_row_bytes(desc.fmt, r.w);
+			auto rows = oden_get_texture_rows(desc.fmt, r.h);
+			size_t stride = c.set_texture.stride_size ? c.set_texture.stride_size : size_t(row_bytes);
+			if (it == mtextures.end() || image == nullptr || level < 0 || level >= int(desc.levels) ||
+				!oden_is_texture_rect_valid(desc.fmt, int(desc.w), int(desc.h), level, r.x, r.y, r.w, r.h) ||
+				oden_get_cmd_size(c) < oden_get_texture_rect_size(desc.fmt, r.w, r.h, stride)) {
+				LOG_ERR("Invalid update name=%s\n", name.c_str());
+			} else {
+				//the copy is recorded outside of render passes.
+				if (rec.renderpass_commited)
+					end_renderpass();
+				trace_scope trace("upload", name);
+				auto bytes = VkDeviceSize(row_bytes) * rows;
+				auto offset = alloc_upload(name, bytes);
+				auto data = oden_get_cmd_data(c);
+				if (stride == row_bytes) {
+					memcpy(ref.upload_data + offset, data, size_t(bytes));
+				} else {
+					for (int i = 0; i < rows; i++)
+						memcpy(ref.upload_data + offset + row_bytes * i, data + stride * i, size_t(row_bytes));
+				}
+
+				auto shader_stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+				auto before_barrier = get_barrier(image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, level, 1);
+				before_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				before_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				auto after_barrier = get_barrier(image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, level, 1);
+				after_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				after_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(cmdbuf, shader_stages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &before_barrier);
+				VkBufferImageCopy copy_region = {};
+				copy_region.bufferOffset = offset;
+				copy_region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, uint32_t(level), 0, 1};
+				copy_region.imageOffset = {r.x, r.y, 0};
+				copy_region.imageExtent = {uint32_t(r.w), uint32_t(r.h), 1};
+				vkCmdCopyBufferToImage(cmdbuf, ref.upload_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+				vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, shader_stages, 0, 0, NULL, 0, NULL, 1, &after_barrier);
+			}
+		}
+
+		//CMD_GENERATE_MIPS
+		if (type == CMD_GENERATE_MIPS) {
+			//prepare for context roll.
+			if (rec.renderpass_commited)
+				end_renderpass();
+
+			//Last group counter of shaders/genmips.glsl. The shader resets it, so it is cleared once.
+			auto name_counter = std::string("__genmips_counter__");
+			auto counter = mbuffers[name_counter];
+			if (counter == nullptr) {
+				counter = create_buffer(device, sizeof(uint32_t));
+				VkMemoryRequirements memreqs = {};
+				vkGetBufferMemoryRequirements(device, counter, &memreqs);
+				mmemreqs[name_counter] = memreqs;
+				auto devmem = alloc_devmem(name_counter, memreqs.size, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_BUFFER);
+				vkBindBufferMemory(device, counter, devmem, 0);
+				mbuffers[name_counter] = counter;
+				vkCmdFillBuffer(cmdbuf, counter, 0, VK_WHOLE_SIZE, 0);
+				VkMemoryBarrier barrier = {
+					VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr,
+					VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+				};
+				vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+			}
+			if (genmips_pipeline == nullptr)
+				genmips_pipeline = create_cpipeline_from_file(device, "./shaders/genmips", genmips_pipeline_layout);
+
+			auto it = mgenmips_targets.find(name);
+			if (it == mgenmips_targets.end()) {
+				LOG_ERR("Invalid generate mips name=%s\n", name.c_str());
+			} else if (it->second.is_blit) {
+				//Linear blits, each level from the one above.
+				auto & target = it->second;
+				auto image = mimages[name];
+				uint32_t mips = target.mips;
+				if (c.generate_mips.miplevel > 0)
+					mips = (std::min)(mips, (uint32_t)c.generate_mips.miplevel);
+				VkMemoryBarrier barrier = {
+					VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr,
+					VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+				};
+				for (uint32_t i = 1; i < mips; i++) {
+					vkCmdPipelineBarrier(cmdbuf,
+						VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+						VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+					VkImageBlit blit = {};
+					blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1};
+					blit.srcOffsets[1] = {int32_t((std::max)(target.w >> (i - 1), 1u)), int32_t((std::max)(target.h >> (i - 1), 1u)), 1};
+					blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+					blit.dstOffsets[1] = {int32_t((std::max)(target.w >> i, 1u)), int32_t((std::max)(target.h >> i, 1u)), 1};
+					vkCmdBlitImage(cmdbuf, image, VK_IMAGE_LAYOUT_GENERAL, image, VK_IMAGE_LAYOUT_GENERAL, 1, &blit, VK_FILTER_LINEAR);
+				}
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0, 1, &barrier, 0, NULL, 0, NULL);
+			} else if (genmips_pipeline == nullptr) {
+				LOG_ERR("Failed make pipeline name=./shaders/genmips\n");
+			} else {
+				auto & target = it->second;
+				if (target.descriptor_sets == nullptr) {
+					//Levels past the last one repeat it, the shader never touches them.
+					VkDescriptorImageInfo vimage_info[GENMIPS_MAX] = {};
+					for (uint32_t i = 0; i < GENMIPS_MAX; i++) {
+						auto level = (std::min)(i, target.mips - 1);
+						vimage_info[i].imageView = mimageviews[oden_get_mipmap_name(name, (int)level)];
+						vimage_info[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+					}
+					VkDescriptorBufferInfo buffer_info = {counter, 0, VK_WHOLE_SIZE};
+					target.descriptor_sets = create_descriptor_set(device, descriptor_pool, genmips_layout);
+					update_descriptor_sets(device, target.descriptor_sets, vimage_info, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, GENMIPS_MAX);
+					update_descriptor_sets(device, target.descriptor_sets, &buffer_info, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+				}
+				uint32_t mips = (std::min)(target.mips, (uint32_t)GENMIPS_MAX);
+				if (c.generate_mips.miplevel > 0)
+					mips = (std::min)(mips, (uint32_t)c.generate_mips.miplevel);
+				uint32_t gx = (target.w + GENMIPS_TILE - 1) / GENMIPS_TILE;
+				uint32_t gy = (target.h + GENMIPS_TILE - 1) / GENMIPS_TILE;
+				uint32_t constants[2] = {mips, gx * gy};
+
+				//Level 0 is written by the pass before, the counter by the previous generation.
+				VkMemoryBarrier barrier = {
+					VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr,
+					VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+					VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+				};
+				vkCmdPipelineBarrier(cmdbuf,
+					VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+				vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, genmips_pipeline);
+				vkCmdBindDescriptorSets(
+					cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, genmips_pipeline_layout, 0,
+					1, &target.descriptor_sets, 0, NULL);
+				vkCmdPushConstants(cmdbuf, genmips_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), constants);
+				vkCmdDispatch(cmdbuf, gx, gy, 1);
+
+				//The levels are sampled by the following passes.
+				barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0, 1, &barrier, 0, NULL, 0, NULL);
+			}
+		}
+
+		auto cmd_ms = get_time_ms() - cmd_start;
+		if (type >= 0 && type < CMD_MAX) {
+			vstats[type].count++;
+			vstats[type].cpu_ms += cmd_ms;
+		}
+
+		segment_cpu_ms += cmd_ms;
+		if (is_pass_end(type))
+			end_segment(name);
+	}
+	end_renderpass();
+	if (!vcmd.empty() && !is_pass_end(vcmd.back().type))
+		end_segment(vcmd.back().name);
+
+	{
+		std::lock_guard<std::mutex> lock(frame_stats_mtx);
+		for (int i = 0 ; i < CMD_MAX; i++) {
+			vcmd_stats[i].count += vstats[i].count;
+			vcmd_stats[i].cpu_ms += vstats[i].cpu_ms;
+		}
+	}
+
+	//Headless readback of the presented backbuffer.
+	bool is_readback = false;
+	{
+		std::lock_guard<std::mutex> lock(readback_mtx);
+		is_readback = is_readback_requested;
+	}
+	if (is_readback && readback_image) {
+		VkDeviceSize size = (VkDeviceSize)w * h * sizeof(uint32_t);
+		if (ref.readback_size != size) {
+			if (ref.readback_buffer)
+				vkDestroyBuffer(device, ref.readback_buffer, NULL);
+			if (ref.readback_devmem)
+				vkFreeMemory(device, ref.readback_devmem, NULL);
+			ref.readback_buffer = create_buffer(device, size);
+			VkMemoryRequirements memreqs = {};
+			vkGetBufferMemoryRequirements(device, ref.readback_buffer, &memreqs);
+			ref.readback_devmem = alloc_devmem("__readback__" + std::to_string(backbuffer_index), memreqs.size,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_STAGING, false);
+			vkBindBufferMemory(device, ref.readback_buffer, ref.readback_devmem, 0);
+			ref.readback_size = size;
+		}
+
+		VkBufferImageCopy copy_region = {};
+		copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copy_region.imageSubresource.layerCount = 1;
+		copy_region.imageExtent.width = w;
+		copy_region.imageExtent.height = h;
+		copy_region.imageExtent.depth = 1;
+		vkCmdCopyImageToBuffer(cmdbuf, readback_image, VK_IMAGE_LAYOUT_GENERAL, ref.readback_buffer, 1, &copy_region);
+
+		VkMemoryBarrier host_barrier = {};
+		host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &host_barrier, 0, NULL, 0, NULL);
+		ref.is_readback = true;
+		ref.readback_width = w;
+		ref.readback_height = h;
+	}
+
+	//Record the render passes on the workers, then the primary executes everything in order.
+	if (!is_inline_record) {
+		vkEndCommandBuffer(cmdbuf);
+		record_pool.run((int)vrender_pieces.size(), [&](int index, int worker) {
+			auto & piece = vrender_pieces[index];
+			auto start = get_time_ms();
+			piece.cmdbuf = get_secondary_command_buffer(device, ref.vsecondary_pools[worker]);
+			begin_secondary_command_buffer(piece.cmdbuf, piece.renderpass, piece.framebuffer);
+			record_render_ops(piece.cmdbuf, pipeline_layout, ref.query_pool,
+				vrender_ops.data() + piece.op_begin, piece.op_end - piece.op_begin);
+			vkEndCommandBuffer(piece.cmdbuf);
+			trace_complete("record", piece.name, start, get_time_ms());
+		});
+
+		vkBeginCommandBuffer(ref.cmdbuf, &cmdbegininfo);
+		std::vector<VkCommandBuffer> vsecondaries;
+		for (auto & x : vblocks) {
+			if (x.cmdbuf) {
+				vkCmdExecuteCommands(ref.cmdbuf, 1, &x.cmdbuf);
+				continue;
+			}
+			vsecondaries.clear();
+			for (auto i = x.piece_begin; i < x.piece_end; i++)
+				vsecondaries.push_back(vrender_pieces[i].cmdbuf);
+			vkCmdBeginRenderPass(ref.cmdbuf, &x.info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			vkCmdExecuteCommands(ref.cmdbuf, (uint32_t)vsecondaries.size(), vsecondaries.data());
+			vkCmdEndRenderPass(ref.cmdbuf);
+		}
 	}
-	if (rec.renderpass_commited)
-		vkCmdEndRenderPass(ref.cmdbuf);
 
 	//End Command Buffer
 	vkEndCommandBuffer(ref.cmdbuf);
 
 	//for debug.
-	{
+	if (log_is_enabled(ODEN_LOG_LEVEL_MAIN)) {
 		for (auto & pair : mimages) {
 			LOG_MAIN("handle=0x%p : name=%s\n", pair.second, pair.first.c_str());
 		}
@@ -1928,7 +3738,7 @@ oden::oden_present_graphics(
 	VkSemaphore waitSemaphores[] = { ref.sem };
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submit_info.pNext = nullptr;
-	submit_info.waitSemaphoreCount = 1;
+	submit_info.waitSemaphoreCount = is_headless ? 0 : 1;
 	submit_info.pWaitSemaphores = waitSemaphores;
 	submit_info.pWaitDstStageMask = wait_mask;
 	submit_info.commandBufferCount = 1;
@@ -1937,8 +3747,10 @@ oden::oden_present_graphics(
 	submit_info.pSignalSemaphores = nullptr;
 
 	LOG_MAIN("vkQueueSubmit backbuffer_index=%d, fence=%p\n", backbuffer_index, ref.fence);
-	vkResetFences(device, 1, &ref.fence);
+	ref.submit_ms = get_time_ms();
 	auto submit_result = vkQueueSubmit(graphics_queue, 1, &submit_info, ref.fence);
+	ref.is_submitted = true;
+	ref.frame = frame_count;
 	LOG_MAIN("vkQueueSubmit Done backbuffer_index=%d, fence=%p, submit_result=%d\n", backbuffer_index, ref.fence, submit_result);
 
 	VkPresentInfoKHR present_info = {};
@@ -1951,9 +3763,9 @@ oden::oden_present_graphics(
 	present_info.pImageIndices = &present_index;
 	present_info.pResults = nullptr;
 
-	vkQueuePresentKHR(graphics_queue, &present_info);
+	if (!is_headless)
+		vkQueuePresentKHR(graphics_queue, &present_info);
 
-	backbuffer_index = frame_count % count;
 	LOG_MAIN("=======================================================================\n");
 	LOG_MAIN("FRAME Done frame_count=%d\n", frame_count);
 	LOG_MAIN("=======================================================================\n");